@@ -0,0 +1,333 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <complex.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "calc.h"
+#include "calc_cache.h"
+#include "calc_stats.h"
+#include "pool.h"
+#include "strbuf.h"
+
+/* ============================= */
+/* Partie Mode Batch             */
+/* Évalue une expression par ligne, lue sur l'entrée standard ou dans
+   des fichiers (projetés en mémoire), sans jamais initialiser ncurses.
+   Chaque ligne produit exactement une ligne de sortie : le résultat,
+   ou le message d'erreur si l'expression est invalide.
+
+   L'entrée est traitée par fenêtres de BATCH_WINDOW octets, découpées
+   en morceaux d'environ BATCH_CHUNK octets (sur des fins de ligne).
+   Les morceaux sont évalués en parallèle par le pool de threads, chacun
+   dans son propre tampon de sortie, puis écrits dans l'ordre d'entrée.
+   Sur un tube ou un terminal, la fenêtre n'est remplie que tant que
+   l'entrée continue d'arriver : dès qu'elle reste BATCH_IDLE_MS sans
+   données (saisie interactive, producteur plus lent que nous), les
+   lignes complètes reçues sont évaluées et leurs résultats envoyés sans
+   attendre. */
+/* ============================= */
+
+#define BATCH_IO_SIZE (1 << 20)
+#define BATCH_WINDOW (8 << 20)
+#define BATCH_CHUNK (64 << 10)
+#define BATCH_IDLE_MS 1 /* entrée sans données depuis ce délai : on évalue */
+
+/* Morceau de l'entrée évalué par une seule tâche */
+typedef struct {
+    const char *data;
+    size_t size;
+    StrBuf line;  /* ligne courante, recopiée pour être terminée par '\0' */
+    StrBuf out;   /* résultats du morceau */
+    CalcContext *ctx; /* contexte d'évaluation propre au morceau */
+} Chunk;
+
+typedef struct {
+    Chunk *chunks;
+    size_t nchunks, cap;
+    ThreadPool *pool;
+    CalcCache *cache;   /* cache des résultats (facultatif) */
+    int exact;          /* --exact : valeur exacte quand elle existe */
+    int dd;             /* --dd : calcul en double-double, sans cache */
+} Batch;
+
+static void batch_eval_line(Batch *batch, Chunk *chunk, const char *line, size_t len) {
+    if (len > 0 && line[len - 1] == '\r')
+        len--;
+    chunk->line.len = 0;
+    if (strbuf_reserve(&chunk->line, len + 1) < 0) {
+        strbuf_append(&chunk->out, "Erreur\n", 7);
+        return;
+    }
+    memcpy(chunk->line.data, line, len);
+    chunk->line.data[len] = '\0';
+
+    char result[256];
+    double complex res;
+    CalcDDComplex dres;
+    CalcErrorCode code = CALC_OK;
+    int n, dd = 0;
+    if (batch->dd) {
+        code = calc_eval_dd(chunk->ctx, chunk->line.data, &dres);
+        dd = code != CALC_ERR_PRECISION;
+    }
+    /* opérateurs à variable liée : calculés et affichés en double */
+    if (!dd)
+        code = calc_eval_cached(chunk->ctx, batch->cache, chunk->line.data, &res);
+    if (code != CALC_OK)
+        n = calc_format_error(calc_last_error(chunk->ctx), result, sizeof(result) - 1);
+    else if (!batch->exact ||
+             (n = calc_eval_exact(chunk->ctx, chunk->line.data, result, sizeof(result) - 1)) < 0)
+        n = dd ? calc_format_result_dd(&dres, result, sizeof(result) - 1)
+               : batch->dd ? calc_format_result_full(res, result, sizeof(result) - 1)
+                           : calc_format_result(res, result, sizeof(result) - 1);
+    if (n < 0)
+        n = 0;
+    if (n > (int)sizeof(result) - 2)
+        n = sizeof(result) - 2;
+    result[n++] = '\n';
+    strbuf_append(&chunk->out, result, n);
+}
+
+static void batch_eval_chunk(void *arg, size_t index) {
+    Batch *batch = arg;
+    Chunk *chunk = &batch->chunks[index];
+    if (!chunk->ctx)
+        chunk->ctx = calc_context_new();
+    if (!chunk->ctx) {
+        strbuf_append(&chunk->out, "Erreur : mémoire insuffisante\n", strlen("Erreur : mémoire insuffisante\n"));
+        return;
+    }
+    const char *data = chunk->data;
+    size_t size = chunk->size, start = 0;
+    while (start < size) {
+        const char *nl = memchr(data + start, '\n', size - start);
+        size_t end = nl ? (size_t)(nl - data) : size;
+        batch_eval_line(batch, chunk, data + start, end - start);
+        start = end + 1;
+    }
+}
+
+/* Évalue un bloc de lignes complètes (la dernière peut ne pas avoir
+   de '\n') en parallèle et écrit les résultats dans l'ordre. */
+static int batch_eval_block(Batch *batch, const char *data, size_t size) {
+    size_t pos = 0;
+    batch->nchunks = 0;
+    while (pos < size) {
+        size_t end = pos + BATCH_CHUNK;
+        if (end >= size) {
+            end = size;
+        } else {
+            const char *nl = memchr(data + end, '\n', size - end);
+            end = nl ? (size_t)(nl - data) + 1 : size;
+        }
+        if (batch->nchunks == batch->cap) {
+            size_t cap = batch->cap ? batch->cap * 2 : 64;
+            Chunk *chunks = realloc(batch->chunks, cap * sizeof(Chunk));
+            if (!chunks) {
+                perror("realloc");
+                return 1;
+            }
+            memset(chunks + batch->cap, 0, (cap - batch->cap) * sizeof(Chunk));
+            batch->chunks = chunks;
+            batch->cap = cap;
+        }
+        Chunk *chunk = &batch->chunks[batch->nchunks++];
+        chunk->data = data + pos;
+        chunk->size = end - pos;
+        chunk->out.len = 0;
+        pos = end;
+    }
+
+    pool_run(batch->pool, batch->nchunks, batch_eval_chunk, batch);
+
+    for (size_t k = 0; k < batch->nchunks; k++)
+        fwrite(batch->chunks[k].out.data, 1, batch->chunks[k].out.len, stdout);
+    return 0;
+}
+
+/* L'entrée a-t-elle des données (ou sa fin) lisibles dans les
+   BATCH_IDLE_MS qui viennent ? Le délai laisse au producteur, même sur
+   un seul cœur, le temps de remplir le tube. */
+static int input_ready(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    return poll(&pfd, 1, BATCH_IDLE_MS) > 0;
+}
+
+static int batch_eval_fd(Batch *batch, int fd) {
+    char *buf = malloc(BATCH_WINDOW);
+    size_t cap = BATCH_WINDOW, used = 0;
+    if (!buf) {
+        perror("malloc");
+        return 1;
+    }
+    for (;;) {
+        if (used == cap) { /* ligne plus longue que le tampon */
+            char *nbuf = realloc(buf, cap * 2);
+            if (!nbuf) {
+                perror("realloc");
+                free(buf);
+                return 1;
+            }
+            buf = nbuf;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + used, cap - used);
+        if (n < 0) {
+            perror("read");
+            free(buf);
+            return 1;
+        }
+        if (n == 0)
+            break;
+        used += n;
+        /* remplir la fenêtre avant de lancer les threads, tant que la
+           suite est déjà là */
+        int waiting = used < cap && !input_ready(fd);
+        if (used < cap && !waiting)
+            continue;
+        char *last = memrchr(buf, '\n', used);
+        if (!last)
+            continue;
+        size_t done = last - buf + 1;
+        if (batch_eval_block(batch, buf, done) != 0) {
+            free(buf);
+            return 1;
+        }
+        if (waiting)
+            fflush(stdout);
+        memmove(buf, buf + done, used - done);
+        used -= done;
+    }
+    int ret = used > 0 ? batch_eval_block(batch, buf, used) : 0;
+    free(buf);
+    return ret;
+}
+
+static int batch_eval_file(Batch *batch, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        /* Pas un fichier ordinaire (tube, ...) : lecture classique */
+        int ret = batch_eval_fd(batch, fd);
+        close(fd);
+        return ret;
+    }
+    size_t size = st.st_size;
+    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return 1;
+    }
+    posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+    int ret = 0;
+    size_t start = 0;
+    while (start < size && ret == 0) {
+        size_t end = start + BATCH_WINDOW;
+        if (end >= size) {
+            end = size;
+        } else {
+            const char *nl = memchr(data + end, '\n', size - end);
+            end = nl ? (size_t)(nl - data) + 1 : size;
+        }
+        ret = batch_eval_block(batch, data + start, end - start);
+        start = end;
+    }
+    munmap(data, size);
+    return ret;
+}
+
+static void print_cache_stats(CalcCache *cache) {
+    CalcCacheStats st;
+    calc_cache_stats(cache, &st);
+    fprintf(stderr, "Cache : %llu succès, %llu défauts, %llu ajouts, %llu évictions, %zu/%zu entrées\n",
+            st.hits, st.misses, st.inserts, st.evictions, st.entries, st.capacity);
+}
+
+static void print_stats(void) {
+    CalcStats st;
+    char buf[4096];
+    calc_stats_collect(&st);
+    calc_stats_format(&st, 20, buf, sizeof(buf));
+    fputs(buf, stderr);
+}
+
+/* cal_ncurses --batch [-j N] [--cache FICHIER] [--cache-size N] [--cache-stats]
+                       [--stats] [--exact] [--dd] [fichier...]
+   "-" ou aucun fichier = entrée standard ; N threads (défaut : un par cœur).
+   --cache-size seul active un cache en mémoire. --exact affiche la valeur
+   exacte des expressions entières et décimales (voir calc_eval_exact).
+   --dd calcule en double-double et affiche 30 chiffres (voir calc_eval_dd),
+   sauf les expressions à opérateur à variable liée, calculées en double et
+   affichées avec 17 chiffres au plus (calc_format_result_full) ;
+   le cache, qui ne garde que des double, ne sert alors qu'à celles-ci. */
+int run_batch(int argc, char **argv) {
+    int ret = 0, jobs = 0, k = 0, use_cache = 0, cache_stats = 0, stats = 0, exact = 0, dd = 0;
+    const char *cache_path = NULL;
+    size_t cache_size = 65536;
+    for (; k < argc; k++) {
+        if (strcmp(argv[k], "-j") == 0 && k + 1 < argc) {
+            jobs = atoi(argv[++k]);
+        } else if (strcmp(argv[k], "--cache") == 0 && k + 1 < argc) {
+            cache_path = argv[++k];
+            use_cache = 1;
+        } else if (strcmp(argv[k], "--cache-size") == 0 && k + 1 < argc) {
+            cache_size = strtoul(argv[++k], NULL, 10);
+            use_cache = 1;
+        } else if (strcmp(argv[k], "--cache-stats") == 0) {
+            cache_stats = 1;
+        } else if (strcmp(argv[k], "--stats") == 0) {
+            stats = 1;
+        } else if (strcmp(argv[k], "--exact") == 0) {
+            exact = 1;
+        } else if (strcmp(argv[k], "--dd") == 0) {
+            dd = 1;
+        } else {
+            break;
+        }
+    }
+
+    Batch batch = { NULL, 0, 0, pool_create(jobs), NULL, exact, dd };
+    if (use_cache) {
+        batch.cache = calc_cache_open(cache_path, cache_size);
+        if (!batch.cache)
+            perror(cache_path ? cache_path : "cache");
+    }
+    setvbuf(stdout, NULL, _IOFBF, BATCH_IO_SIZE);
+    if (k == argc) {
+        ret = batch_eval_fd(&batch, STDIN_FILENO);
+    } else {
+        for (; k < argc; k++) {
+            if (strcmp(argv[k], "-") == 0)
+                ret |= batch_eval_fd(&batch, STDIN_FILENO);
+            else
+                ret |= batch_eval_file(&batch, argv[k]);
+        }
+    }
+    fflush(stdout);
+    if (batch.cache && cache_stats)
+        print_cache_stats(batch.cache);
+
+    for (size_t c = 0; c < batch.cap; c++) {
+        free(batch.chunks[c].line.data);
+        free(batch.chunks[c].out.data);
+        calc_context_free(batch.chunks[c].ctx);
+    }
+    free(batch.chunks);
+    calc_cache_close(batch.cache);
+    pool_destroy(batch.pool);
+    if (stats)
+        print_stats();
+    return ret;
+}
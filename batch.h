@@ -0,0 +1,9 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/* Mode batch : cal_ncurses --batch [-j N] [--cache FICHIER] [--cache-size N]
+                                  [--cache-stats] [--stats] [fichier...]
+   argc/argv ne contiennent que les arguments qui suivent "--batch". */
+int run_batch(int argc, char **argv);
+
+#endif
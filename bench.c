@@ -0,0 +1,351 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <complex.h>
+#include "calc.h"
+#include "format.h"
+
+/* ============================= */
+/* Microbenchmarks (make bench)  */
+/* Chaque cas est répété jusqu'à durer au moins bench_seconds ; on
+   rapporte ns/op, le débit (opérations et octets d'entrée par seconde)
+   et le nombre d'allocations par opération. Les allocations sont
+   comptées en enveloppant malloc/calloc/realloc à l'édition de liens
+   (-Wl,--wrap=...). Les résultats sont écrits en JSON, une ligne par
+   cas, pour comparer deux versions. */
+/* ============================= */
+
+#ifndef CALC_VERSION
+#define CALC_VERSION "inconnue"
+#endif
+
+/* Compteur d'allocations (voir BENCH_LDFLAGS dans le Makefile) */
+static unsigned long alloc_count = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    alloc_count++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    alloc_count++;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    alloc_count++;
+    return __real_realloc(ptr, size);
+}
+
+typedef enum {
+    BENCH_COMPILE,  /* calc_compile + calc_program_free */
+    BENCH_RUN,      /* calc_run d'un programme déjà compilé */
+    BENCH_VARS,     /* calc_run_vars, x variant d'une exécution à l'autre */
+    BENCH_EVAL,     /* calc_eval (compilation + exécution) */
+    BENCH_FORMAT    /* format_expression */
+} BenchKind;
+
+typedef struct {
+    char name[64];
+    BenchKind kind;
+    char *src;
+} BenchCase;
+
+static double bench_seconds = 0.2;
+static CalcContext *ctx;
+static CalcContext *ref_ctx; /* sans code natif : résultats de l'interpréteur */
+static const char *const var_names[] = { "x" };
+static volatile double sink;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Exécute n fois le cas ; renvoie 0 si tout s'est bien passé */
+static int bench_iter(const BenchCase *bc, CalcProgram *prog, char *fmt, size_t fmt_size, long n) {
+    double complex res = 0;
+    for (long k = 0; k < n; k++) {
+        switch (bc->kind) {
+        case BENCH_COMPILE: {
+            CalcProgram *p = calc_compile(ctx, bc->src);
+            if (!p)
+                return -1;
+            calc_program_free(p);
+            break;
+        }
+        case BENCH_RUN:
+            if (calc_run(ctx, prog, &res) != CALC_OK)
+                return -1;
+            break;
+        case BENCH_VARS: {
+            double complex x = 0.5 + (k & 1023) * 1e-3;
+            if (calc_run_vars(ctx, prog, &x, &res) != CALC_OK)
+                return -1;
+            break;
+        }
+        case BENCH_EVAL:
+            if (calc_eval(ctx, bc->src, &res) != CALC_OK)
+                return -1;
+            break;
+        case BENCH_FORMAT:
+            format_expression(bc->src, fmt, fmt_size);
+            res = fmt[0];
+            break;
+        }
+    }
+    sink = creal(res);
+    return 0;
+}
+
+/* Compare les résultats du programme mesuré (passé en code natif après
+   les itérations) à ceux de l'interpréteur, au bit près ; 0 si égaux */
+static int check_interp(const BenchCase *bc, const CalcProgram *prog) {
+    CalcProgram *ref = calc_compile_vars(ref_ctx, bc->src, var_names, bc->kind == BENCH_VARS);
+    if (!ref)
+        return -1;
+    int ret = 0;
+    for (int k = 0; k < 2048 && ret == 0; k++) {
+        double complex x = 0.5 + k * 1e-3, a = 0, b = 0;
+        CalcErrorCode ca = calc_run_vars(ctx, prog, &x, &a);
+        CalcErrorCode cb = calc_run_vars(ref_ctx, ref, &x, &b);
+        if (ca != cb || memcmp(&a, &b, sizeof(a)) != 0) {
+            fprintf(stderr, "%s : x = %.17g, %.17g%+.17gi au lieu de %.17g%+.17gi\n",
+                    bc->name, creal(x), creal(a), cimag(a), creal(b), cimag(b));
+            ret = -1;
+        }
+    }
+    calc_program_free(ref);
+    return ret;
+}
+
+static int bench_case(const BenchCase *bc, FILE *json) {
+    CalcProgram *prog = NULL;
+    size_t src_len = strlen(bc->src);
+    size_t fmt_size = 4 * src_len + 16;
+    char *fmt = malloc(fmt_size);
+    if (!fmt)
+        return -1;
+    if (bc->kind == BENCH_RUN || bc->kind == BENCH_VARS) {
+        prog = calc_compile_vars(ctx, bc->src, var_names, bc->kind == BENCH_VARS);
+        if (!prog) {
+            char msg[256];
+            calc_format_error(calc_last_error(ctx), msg, sizeof(msg));
+            fprintf(stderr, "%s : %s\n", bc->name, msg);
+            free(fmt);
+            return -1;
+        }
+    }
+
+    /* Échauffement, puis calibrage du nombre d'itérations */
+    long n = 1;
+    double elapsed = 0;
+    unsigned long allocs = 0;
+    for (;;) {
+        if (bench_iter(bc, prog, fmt, fmt_size, 1) != 0) {
+            char msg[256];
+            calc_format_error(calc_last_error(ctx), msg, sizeof(msg));
+            fprintf(stderr, "%s : %s\n", bc->name, msg);
+            calc_program_free(prog);
+            free(fmt);
+            return -1;
+        }
+        unsigned long before = alloc_count;
+        double start = now();
+        bench_iter(bc, prog, fmt, fmt_size, n);
+        elapsed = now() - start;
+        allocs = alloc_count - before;
+        if (elapsed >= bench_seconds || n > (1L << 40))
+            break;
+        n = elapsed > 0 ? (long)(n * 1.2 * bench_seconds / elapsed) + 1 : n * 10;
+    }
+
+    double ns_op = elapsed * 1e9 / n;
+    double ops_s = n / elapsed;
+    double mb_s = src_len * ops_s / 1e6;
+    double allocs_op = (double)allocs / n;
+    printf("%-32s %12.1f ns/op %14.0f op/s %10.1f Mo/s %8.2f alloc/op\n",
+           bc->name, ns_op, ops_s, mb_s, allocs_op);
+    if (json)
+        fprintf(json, "{\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.3f, "
+                "\"ops_per_sec\": %.1f, \"input_bytes\": %zu, \"mb_per_sec\": %.3f, "
+                "\"allocs_per_op\": %.3f}\n",
+                bc->name, n, ns_op, ops_s, src_len, mb_s, allocs_op);
+    int ret = prog ? check_interp(bc, prog) : 0;
+    calc_program_free(prog);
+    free(fmt);
+    return ret;
+}
+
+/* Construit "head item sep item sep ... item tail" (count éléments) */
+static char *repeat(const char *head, const char *item, const char *sep, const char *tail, int count) {
+    size_t size = strlen(head) + count * (strlen(item) + strlen(sep)) + strlen(tail) + 1;
+    char *s = malloc(size);
+    if (!s)
+        return NULL;
+    strcpy(s, head);
+    for (int k = 0; k < count; k++) {
+        if (k > 0)
+            strcat(s, sep);
+        strcat(s, item);
+    }
+    strcat(s, tail);
+    return s;
+}
+
+static char *dup(const char *s) {
+    char *d = malloc(strlen(s) + 1);
+    if (d)
+        strcpy(d, s);
+    return d;
+}
+
+#define MAX_CASES 128
+
+static BenchCase cases[MAX_CASES];
+static int ncases = 0;
+
+static void add_case(const char *name, BenchKind kind, char *src) {
+    if (!src || ncases == MAX_CASES)
+        return;
+    snprintf(cases[ncases].name, sizeof(cases[ncases].name), "%s", name);
+    cases[ncases].kind = kind;
+    cases[ncases].src = src;
+    ncases++;
+}
+
+static void build_cases(void) {
+    /* Analyse lexicale : espaces, nombres (strtod), identifiants */
+    add_case("lex/whitespace", BENCH_COMPILE, repeat("", "   1   ", "+", "", 200));
+    add_case("lex/numbers", BENCH_COMPILE, repeat("", "3.14159265e-3", "+", "", 200));
+    add_case("lex/identifiers", BENCH_COMPILE, repeat("", "pi", "+", "", 200));
+    add_case("lex/functions", BENCH_COMPILE, repeat("", "arctan(1)", "+", "", 200));
+
+    /* Fonctions de base, argument réel puis complexe */
+    static const struct { const char *name, *real, *cplx; } builtins[] = {
+        { "log", "log(2.5)", "log(-2.5)" },
+        { "ln", "ln(2.5)", "ln(2.5+i)" },
+        { "cos", "cos(0.7)", "cos(0.7+i)" },
+        { "sin", "sin(0.7)", "sin(0.7+i)" },
+        { "tan", "tan(0.7)", "tan(0.7+i)" },
+        { "arccos", "arccos(0.3)", "arccos(2)" },
+        { "arcsin", "arcsin(0.3)", "arcsin(2)" },
+        { "arctan", "arctan(0.3)", "arctan(0.3+i)" },
+        { "sqrt", "sqrt(2)", "sqrt(-2)" },
+        { "root", "root(27,3)", "root(-8,3)" },
+        { "exp", "exp(1.5)", "exp(1.5+i)" },
+        { "abs", "abs(-1.5)", "abs(3+4xi)" },
+        { "sinh", "sinh(1.5)", "sinh(1.5+i)" },
+        { "cosh", "cosh(1.5)", "cosh(1.5+i)" },
+        { "tanh", "tanh(1.5)", "tanh(1.5+i)" },
+        { "atan2", "atan2(1,2)", "atan2(1+i,2)" },
+        { "min", "min(3,1,2)", "min(3,1+i,2)" },
+        { "max", "max(3,1,2)", "max(3,1+i,2)" },
+        { "pow", "2^10", "(-2)^0.5" },
+        { "factorial", "10!", "(10+0xi)!" },
+        { "idiv", "17//5", "(17+0xi)//5" },
+        { "percent", "50%", "(50+i)%" }
+    };
+    for (size_t k = 0; k < sizeof(builtins) / sizeof(builtins[0]); k++) {
+        char name[64];
+        snprintf(name, sizeof(name), "builtin/%s", builtins[k].name);
+        add_case(name, BENCH_RUN, dup(builtins[k].real));
+        snprintf(name, sizeof(name), "builtin/%s/complex", builtins[k].name);
+        add_case(name, BENCH_RUN, dup(builtins[k].cplx));
+    }
+
+    /* Imbrication profonde : récursion à droite de '^' et groupes */
+    static const int depths[] = { 10, 100, 1000 };
+    for (size_t k = 0; k < sizeof(depths) / sizeof(depths[0]); k++) {
+        char name[64];
+        snprintf(name, sizeof(name), "nest/power/%d", depths[k]);
+        add_case(name, BENCH_EVAL, repeat("", "1", "^", "", depths[k]));
+        char *open = repeat("", "(", "", "", depths[k]);
+        char *close = repeat("1", ")", "", "", depths[k]);
+        if (open && close) {
+            char *src = malloc(strlen(open) + strlen(close) + 1);
+            if (src) {
+                strcpy(src, open);
+                strcat(src, close);
+                snprintf(name, sizeof(name), "nest/group/%d", depths[k]);
+                add_case(name, BENCH_EVAL, src);
+            }
+        }
+        free(open);
+        free(close);
+    }
+
+    /* Longues chaînes de '+' et de 'x' */
+    add_case("chain/add/1000/eval", BENCH_EVAL, repeat("", "1.5", "+", "", 1000));
+    add_case("chain/add/1000/run", BENCH_RUN, repeat("", "1.5", "+", "", 1000));
+    add_case("chain/mul/1000/eval", BENCH_EVAL, repeat("", "1.001", "x", "", 1000));
+    add_case("chain/mul/1000/run", BENCH_RUN, repeat("", "1.001", "x", "", 1000));
+
+    /* Expression mixte, de bout en bout */
+    add_case("mixed/eval", BENCH_EVAL, dup("sqrt(2)+log(3) x (1+2)^2 - root(27,3)//2 + 5!%"));
+    add_case("mixed/run", BENCH_RUN, dup("sqrt(2)+log(3) x (1+2)^2 - root(27,3)//2 + 5!%"));
+
+    /* Programmes à variable, exécutés en code natif après quelques
+       milliers d'exécutions ; sqrt(x-1) repasse en complexe pour x < 1 */
+    add_case("jit/poly", BENCH_VARS, dup("x^3-2 x x^2+x-1"));
+    add_case("jit/trig", BENCH_VARS, dup("sin(x)^2+cos(x)^2"));
+    add_case("jit/mixed", BENCH_VARS, dup("sqrt(x^2+1)/(x+2)+log(x+1)-root(x+8,3)//2+x%"));
+    add_case("jit/call", BENCH_VARS, dup("exp(-x)+max(x,1,2)+atan2(x,2)"));
+    add_case("jit/promote", BENCH_VARS, dup("sqrt(x-1)+x!"));
+
+    /* Mise en forme des exposants */
+    add_case("format/superscript", BENCH_FORMAT, repeat("", "2^-10.5", "+", "", 200));
+    add_case("format/plain", BENCH_FORMAT, repeat("", "2x10.5", "+", "", 200));
+}
+
+int main(int argc, char **argv) {
+    const char *out_path = "bench_output.txt";
+    const char *filter = NULL;
+    for (int k = 1; k < argc; k++) {
+        if (strcmp(argv[k], "-o") == 0 && k + 1 < argc) {
+            out_path = argv[++k];
+        } else if (strcmp(argv[k], "-t") == 0 && k + 1 < argc) {
+            bench_seconds = atof(argv[++k]);
+        } else if (strcmp(argv[k], "-f") == 0 && k + 1 < argc) {
+            filter = argv[++k];
+        } else {
+            fprintf(stderr, "Usage : %s [-o fichier] [-t secondes] [-f filtre]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    ctx = calc_context_new();
+    ref_ctx = calc_context_new();
+    if (!ctx || !ref_ctx)
+        return 1;
+    calc_set_option(ref_ctx, CALC_OPTION_JIT, 0);
+    build_cases();
+    FILE *json = fopen(out_path, "w");
+    if (!json)
+        perror(out_path);
+    else
+        fprintf(json, "{\"version\": \"%s\", \"seconds_per_case\": %g}\n", CALC_VERSION, bench_seconds);
+
+    int ret = 0;
+    for (int k = 0; k < ncases; k++) {
+        if (filter && !strstr(cases[k].name, filter))
+            continue;
+        if (bench_case(&cases[k], json) != 0)
+            ret = 1;
+    }
+    if (json)
+        fclose(json);
+    for (int k = 0; k < ncases; k++)
+        free(cases[k].src);
+    calc_context_free(ctx);
+    calc_context_free(ref_ctx);
+    return ret;
+}
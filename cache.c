@@ -0,0 +1,381 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "calc.h"
+#include "calc_internal.h"
+#include "calc_cache.h"
+
+/* ============================= */
+/* Partie Normalisation          */
+/* ============================= */
+
+static int is_word(char c) {
+    return isalnum((unsigned char)c) || c == '.';
+}
+
+/* dest[0..len-1] finit par l'exposant d'un nombre écrit ("1e", "2.5E",
+   "0x1p") : un signe qui suit immédiatement en fait partie pour strtod() */
+static int number_exponent(const char *dest, size_t len) {
+    if (len == 0 || !strchr("eEpP", dest[len - 1]))
+        return 0;
+    while (len > 0 && is_word(dest[len - 1]))
+        len--;
+    return isdigit((unsigned char)dest[len]) || dest[len] == '.';
+}
+
+/* Un espace retiré entre dest[0..len-1] et c changerait-il la lecture ?
+   Oui entre deux mots ("pi x 2", "1 2"), entre deux '/' ("4 / / 2"
+   n'est pas "4 // 2"), et de part et d'autre du signe d'un exposant
+   ("1e +3" et "1e+ 3" ne sont pas "1e+3"). */
+static int space_matters(const char *dest, size_t len, char c) {
+    if (len == 0)
+        return 0;
+    char prev = dest[len - 1];
+    if ((is_word(prev) && is_word(c)) || (prev == '/' && c == '/'))
+        return 1;
+    if ((c == '+' || c == '-') && number_exponent(dest, len))
+        return 1;
+    return (prev == '+' || prev == '-') && is_word(c) && number_exponent(dest, len - 1);
+}
+
+/* Vérifie que les groupes sont bien imbriqués : seulement dans ce cas
+   "[1+2]" et "(1+2)" sont équivalents ("(1+2]" doit rester une erreur) */
+static int brackets_match(const char *src) {
+    char stack[256];
+    int depth = 0;
+    for (; *src && *src != '\n'; src++) {
+        char c = *src;
+        if (c == '(' || c == '[' || c == '{') {
+            if (depth == (int)sizeof(stack))
+                return 0;
+            stack[depth++] = c == '(' ? ')' : c == '[' ? ']' : '}';
+        } else if (c == ')' || c == ']' || c == '}') {
+            if (depth == 0 || stack[--depth] != c)
+                return 0;
+        }
+    }
+    return depth == 0;
+}
+
+size_t calc_normalize(const char *src, char *dest, size_t size) {
+    int map_brackets = brackets_match(src);
+    size_t len = 0;
+    int space = 0;
+    /* comme le parseur, on s'arrête à la fin de la ligne */
+    for (; *src && *src != '\n'; src++) {
+        char c = *src;
+        if (isspace((unsigned char)c)) {
+            space = 1;
+            continue;
+        }
+        if (map_brackets) {
+            if (c == '[' || c == '{')
+                c = '(';
+            else if (c == ']' || c == '}')
+                c = ')';
+        }
+        if (space && space_matters(dest, len, c)) {
+            if (len + 1 >= size)
+                return (size_t)-1;
+            dest[len++] = ' ';
+        }
+        space = 0;
+        if (len + 1 >= size)
+            return (size_t)-1;
+        dest[len++] = c;
+    }
+    dest[len] = '\0';
+    return len;
+}
+
+/* ============================= */
+/* Partie Table                  */
+/* Disposition en mémoire (identique dans le fichier) :
+   CacheHeader, puis nsets ensembles de CALC_CACHE_WAYS entrées. */
+/* ============================= */
+
+#define CACHE_MAGIC "CALCMEM1"
+/* Version des résultats rangés : à augmenter à chaque changement de la
+   valeur d'une expression (nouvelle sémantique, correction) ou du format,
+   pour qu'un fichier écrit par une version antérieure soit réinitialisé
+   au lieu de servir des résultats périmés */
+#define CACHE_VERSION 2
+#define LOCK_SPINS 1000000
+
+typedef struct {
+    uint64_t hash;          /* 0 = entrée libre */
+    uint64_t stamp;         /* date du dernier accès dans l'ensemble */
+    double re, im;
+    uint32_t key_len;
+    char key[CALC_CACHE_KEY_MAX];
+} CacheEntry;
+
+typedef struct {
+    _Atomic uint32_t lock;
+    uint32_t pad;
+    uint64_t clock;         /* horloge LRU de l'ensemble */
+    CacheEntry ways[CALC_CACHE_WAYS];
+} CacheSet;
+
+typedef struct {
+    char magic[8];
+    uint32_t nsets;
+    uint32_t ways;
+    uint32_t key_max;
+    uint32_t entry_size;
+    _Atomic uint64_t hits;
+    _Atomic uint64_t misses;
+    _Atomic uint64_t inserts;
+    _Atomic uint64_t evictions;
+    uint32_t version;       /* CACHE_VERSION (0 dans les anciens fichiers) */
+    uint32_t pad;
+    uint64_t reserved;
+} CacheHeader;
+
+struct CalcCache {
+    CacheHeader *hdr;
+    CacheSet *sets;
+    size_t map_size;
+};
+
+static uint64_t hash_key(const char *key, size_t len) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t k = 0; k < len; k++) {
+        h ^= (unsigned char)key[k];
+        h *= 1099511628211ull;
+    }
+    return h ? h : 1;
+}
+
+/* Verrou d'ensemble ; abandonne (défaut de cache) plutôt que d'attendre
+   indéfiniment un processus mort en tenant le verrou */
+static int set_lock(CacheSet *set) {
+    for (long k = 0; k < LOCK_SPINS; k++) {
+        uint32_t expected = 0;
+        if (atomic_compare_exchange_weak_explicit(&set->lock, &expected, 1,
+                                                  memory_order_acquire, memory_order_relaxed))
+            return 1;
+    }
+    return 0;
+}
+
+static void set_unlock(CacheSet *set) {
+    atomic_store_explicit(&set->lock, 0, memory_order_release);
+}
+
+static size_t map_size_for(uint32_t nsets) {
+    return sizeof(CacheHeader) + (size_t)nsets * sizeof(CacheSet);
+}
+
+static void init_header(CacheHeader *hdr, uint32_t nsets) {
+    memcpy(hdr->magic, CACHE_MAGIC, 8);
+    hdr->nsets = nsets;
+    hdr->ways = CALC_CACHE_WAYS;
+    hdr->key_max = CALC_CACHE_KEY_MAX;
+    hdr->entry_size = sizeof(CacheEntry);
+    hdr->version = CACHE_VERSION;
+}
+
+static int header_valid(const CacheHeader *hdr, size_t file_size) {
+    return memcmp(hdr->magic, CACHE_MAGIC, 8) == 0 && hdr->version == CACHE_VERSION &&
+           hdr->ways == CALC_CACHE_WAYS && hdr->key_max == CALC_CACHE_KEY_MAX &&
+           hdr->entry_size == sizeof(CacheEntry) &&
+           hdr->nsets > 0 && (hdr->nsets & (hdr->nsets - 1)) == 0 &&
+           map_size_for(hdr->nsets) == file_size;
+}
+
+CalcCache *calc_cache_open(const char *path, size_t capacity) {
+    uint32_t nsets = 1;
+    while ((size_t)nsets * CALC_CACHE_WAYS < capacity && nsets < (1u << 24))
+        nsets <<= 1;
+
+    CalcCache *cache = calloc(1, sizeof(CalcCache));
+    if (!cache)
+        return NULL;
+
+    if (!path) {
+        cache->map_size = map_size_for(nsets);
+        void *mem = mmap(NULL, cache->map_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            free(cache);
+            return NULL;
+        }
+        cache->hdr = mem;
+        init_header(cache->hdr, nsets);
+    } else {
+        int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            free(cache);
+            return NULL;
+        }
+        /* Création et vérification sous verrou exclusif : deux processus
+           qui démarrent ensemble ne doivent pas initialiser chacun le fichier */
+        flock(fd, LOCK_EX);
+        struct stat st;
+        int ok = fstat(fd, &st) == 0;
+        CacheHeader hdr;
+        if (ok && st.st_size >= (off_t)sizeof(hdr) &&
+            pread(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr) &&
+            header_valid(&hdr, st.st_size)) {
+            nsets = hdr.nsets; /* fichier existant : on garde sa taille */
+        } else if (ok) {
+            memset(&hdr, 0, sizeof(hdr));
+            init_header(&hdr, nsets);
+            ok = ftruncate(fd, 0) == 0 && ftruncate(fd, map_size_for(nsets)) == 0 &&
+                 pwrite(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr);
+        }
+        void *mem = MAP_FAILED;
+        if (ok) {
+            cache->map_size = map_size_for(nsets);
+            mem = mmap(NULL, cache->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        flock(fd, LOCK_UN);
+        close(fd);
+        if (mem == MAP_FAILED) {
+            free(cache);
+            return NULL;
+        }
+        cache->hdr = mem;
+    }
+    cache->sets = (CacheSet *)(cache->hdr + 1);
+    return cache;
+}
+
+void calc_cache_close(CalcCache *cache) {
+    if (!cache)
+        return;
+    munmap(cache->hdr, cache->map_size);
+    free(cache);
+}
+
+static int lookup_key(CalcCache *cache, const char *key, size_t len, double complex *result) {
+    uint64_t h = hash_key(key, len);
+    CacheSet *set = &cache->sets[h & (cache->hdr->nsets - 1)];
+    int found = 0;
+    if (set_lock(set)) {
+        for (int w = 0; w < CALC_CACHE_WAYS; w++) {
+            CacheEntry *e = &set->ways[w];
+            if (e->hash == h && e->key_len == len && memcmp(e->key, key, len) == 0) {
+                e->stamp = ++set->clock;
+                *result = CMPLX(e->re, e->im);
+                found = 1;
+                break;
+            }
+        }
+        set_unlock(set);
+    }
+    atomic_fetch_add_explicit(found ? &cache->hdr->hits : &cache->hdr->misses, 1,
+                              memory_order_relaxed);
+    return found;
+}
+
+static void store_key(CalcCache *cache, const char *key, size_t len, double complex result) {
+    uint64_t h = hash_key(key, len);
+    CacheSet *set = &cache->sets[h & (cache->hdr->nsets - 1)];
+    if (!set_lock(set))
+        return;
+    CacheEntry *victim = NULL;
+    int evict = 0;
+    for (int w = 0; w < CALC_CACHE_WAYS && !victim; w++) {
+        CacheEntry *e = &set->ways[w];
+        if (e->hash == h && e->key_len == len && memcmp(e->key, key, len) == 0)
+            victim = e; /* déjà présent (ajout concurrent) : mise à jour */
+    }
+    for (int w = 0; w < CALC_CACHE_WAYS && !victim; w++)
+        if (set->ways[w].hash == 0)
+            victim = &set->ways[w];
+    if (!victim) {
+        /* Ensemble plein : on remplace l'entrée la moins récemment utilisée */
+        victim = &set->ways[0];
+        for (int w = 1; w < CALC_CACHE_WAYS; w++)
+            if (set->ways[w].stamp < victim->stamp)
+                victim = &set->ways[w];
+        evict = 1;
+    }
+    victim->hash = h;
+    victim->stamp = ++set->clock;
+    victim->re = creal(result);
+    victim->im = cimag(result);
+    victim->key_len = len;
+    memcpy(victim->key, key, len);
+    set_unlock(set);
+    atomic_fetch_add_explicit(&cache->hdr->inserts, 1, memory_order_relaxed);
+    if (evict)
+        atomic_fetch_add_explicit(&cache->hdr->evictions, 1, memory_order_relaxed);
+}
+
+/* Clé d'une expression : les options de ctx qui changent le résultat
+   (options par défaut pour ctx NULL), puis la forme normalisée */
+static size_t make_key(const CalcContext *ctx, const char *src, char *key, size_t size) {
+    int optimize = ctx ? ctx->optimize : 1;
+    int precision = ctx ? ctx->precision : CALC_PRECISION_DOUBLE;
+    key[0] = (char)('a' + 2 * precision + optimize);
+    size_t len = calc_normalize(src, key + 1, size - 1);
+    return len == (size_t)-1 ? len : len + 1;
+}
+
+/* ============================= */
+/* Partie API                    */
+/* ============================= */
+
+int calc_cache_lookup(CalcCache *cache, const char *src, double complex *result) {
+    char key[CALC_CACHE_KEY_MAX];
+    size_t len = make_key(NULL, src, key, sizeof(key));
+    if (len == (size_t)-1) {
+        atomic_fetch_add_explicit(&cache->hdr->misses, 1, memory_order_relaxed);
+        return 0;
+    }
+    return lookup_key(cache, key, len, result);
+}
+
+void calc_cache_store(CalcCache *cache, const char *src, double complex result) {
+    char key[CALC_CACHE_KEY_MAX];
+    size_t len = make_key(NULL, src, key, sizeof(key));
+    if (len != (size_t)-1)
+        store_key(cache, key, len, result);
+}
+
+CalcErrorCode calc_eval_cached(CalcContext *ctx, CalcCache *cache, const char *src,
+                               double complex *result) {
+    if (!cache)
+        return calc_eval(ctx, src, result);
+    char key[CALC_CACHE_KEY_MAX];
+    size_t len = make_key(ctx, src, key, sizeof(key));
+    if (len == (size_t)-1) {
+        atomic_fetch_add_explicit(&cache->hdr->misses, 1, memory_order_relaxed);
+        return calc_eval(ctx, src, result);
+    }
+    if (lookup_key(cache, key, len, result))
+        return CALC_OK;
+    /* Une fonction ou une constante de l'application peut changer d'un
+       processus à l'autre : seuls les résultats des symboles intégrés
+       sont partagés */
+    CalcErrorCode code = calc_eval(ctx, src, result);
+    if (code == CALC_OK && !ctx->p.external)
+        store_key(cache, key, len, *result);
+    return code;
+}
+
+void calc_cache_stats(CalcCache *cache, CalcCacheStats *stats) {
+    CacheHeader *hdr = cache->hdr;
+    stats->hits = atomic_load_explicit(&hdr->hits, memory_order_relaxed);
+    stats->misses = atomic_load_explicit(&hdr->misses, memory_order_relaxed);
+    stats->inserts = atomic_load_explicit(&hdr->inserts, memory_order_relaxed);
+    stats->evictions = atomic_load_explicit(&hdr->evictions, memory_order_relaxed);
+    stats->capacity = (size_t)hdr->nsets * CALC_CACHE_WAYS;
+    stats->entries = 0;
+    for (uint32_t s = 0; s < hdr->nsets; s++)
+        for (int w = 0; w < CALC_CACHE_WAYS; w++)
+            if (cache->sets[s].ways[w].hash != 0)
+                stats->entries++;
+}
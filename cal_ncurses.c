@@ -1,253 +1,22 @@
+#define _GNU_SOURCE
+
 #include <ncurses.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
-#include <math.h>
 #include <complex.h>
-
-/* Définitions de constantes mathématiques */
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-#ifndef M_E
-#define M_E 2.71828182845904523536
-#endif
-
-/* ============================= */
-/* Partie Parsing                */
-/* Utilise la grammaire :
-     expression = term { ('+' | '-') term }
-     term       = power { ( 'x' | '/' | "//" ) power }
-     power      = factor [ '^' power ]          (droite associativité)
-     factor     = { '-' } primary { ('!' | '%') }
-     primary    = func_call | constant | number | group
-     func_call  = ident '(' arglist ')'
-     arglist    = expression [ ',' expression ]
-     constant   = "pi" | "e" | "i"
-     group      = '(' expression ')' | '[' expression ']' | '{' expression '}'
-*/
-/* ============================= */
-
-const char *expr;  /* pointeur global sur la chaîne à analyser */
-int error_flag = 0;
-
-void skip_whitespace(void) {
-    while (*expr && isspace(*expr))
-        expr++;
-}
-
-double complex parse_expression(void);
-double complex parse_term(void);
-double complex parse_power(void);
-double complex parse_factor(void);
-double complex parse_primary(void);
-
-double complex parse_expression(void) {
-    double complex val = parse_term();
-    skip_whitespace();
-    while (*expr == '+' || *expr == '-') {
-        char op = *expr;
-        expr++;
-        double complex val2 = parse_term();
-        if (error_flag) return 0;
-        if (op == '+')
-            val += val2;
-        else
-            val -= val2;
-        skip_whitespace();
-    }
-    return val;
-}
-
-double complex parse_term(void) {
-    double complex val = parse_power();
-    skip_whitespace();
-    while (1) {
-        if (*expr == 'x') {  /* multiplication */
-            expr++;
-            double complex val2 = parse_power();
-            val *= val2;
-        } else if (*expr == '/') {
-            expr++;
-            if (*expr == '/') { /* division entière : "//" */
-                expr++;
-                double complex val2 = parse_power();
-                if (cabs(val2) < 1e-12) {
-                    error_flag = 1;
-                    fprintf(stderr, "Erreur : division entière par 0\n");
-                    return 0;
-                }
-                val = trunc(creal(val) / creal(val2));
-            } else { /* division classique */
-                double complex val2 = parse_power();
-                if (cabs(val2) < 1e-12) {
-                    error_flag = 1;
-                    fprintf(stderr, "Erreur : division par 0\n");
-                    return 0;
-                }
-                val /= val2;
-            }
-        } else {
-            break;
-        }
-        skip_whitespace();
-    }
-    return val;
-}
-
-double complex parse_power(void) {
-    double complex base = parse_factor();
-    skip_whitespace();
-    if (*expr == '^') {
-        expr++; /* sauter '^' */
-        double complex exponent = parse_power();
-        return cpow(base, exponent);
-    }
-    return base;
-}
-
-double complex parse_factor(void) {
-    skip_whitespace();
-    int neg = 0;
-    while (*expr == '-') {
-        neg = !neg;
-        expr++;
-        skip_whitespace();
-    }
-    double complex val = parse_primary();
-    if (error_flag) return 0;
-    skip_whitespace();
-    while (*expr == '!' || *expr == '%') {
-        if (*expr == '!') {
-            expr++;
-            /* Factorielle définie uniquement pour les réels non négatifs */
-            if (cimag(val) != 0 || creal(val) < 0) {
-                error_flag = 1;
-                fprintf(stderr, "Erreur : factorielle d'un nombre négatif ou complexe non supportée\n");
-                return 0;
-            }
-            val = tgamma(creal(val) + 1);
-        } else if (*expr == '%') {
-            expr++;
-            val = val / 100.0;
-        }
-        skip_whitespace();
-    }
-    if (neg)
-        val = -val;
-    return val;
-}
-
-double complex parse_primary(void) {
-    skip_whitespace();
-    //double complex val = 0;
-    if (isalpha(*expr)) {
-        /* Lecture de l'identifiant */
-        char ident[32];
-        int pos = 0;
-        while (isalpha(*expr)) {
-            if (pos < 31)
-                ident[pos++] = *expr;
-            expr++;
-        }
-        ident[pos] = '\0';
-        skip_whitespace();
-        if (*expr == '(') {
-            /* Appel de fonction */
-            expr++; /* sauter '(' */
-            double complex arg1 = parse_expression();
-            double complex arg2 = 0;
-            skip_whitespace();
-            int num_args = 1;
-            if (*expr == ',') {
-                expr++; /* sauter ',' */
-                arg2 = parse_expression();
-                num_args = 2;
-                skip_whitespace();
-            }
-            if (*expr != ')') {
-                error_flag = 1;
-                fprintf(stderr, "Erreur : ')' attendue après fonction\n");
-                return 0;
-            }
-            expr++; /* sauter ')' */
-            if ((strcmp(ident, "log") == 0 || strcmp(ident, "ln") == 0) && num_args == 1) {
-                return clog(arg1);
-            } else if (strcmp(ident, "cos") == 0 && num_args == 1) {
-                return ccos(arg1);
-            } else if (strcmp(ident, "sin") == 0 && num_args == 1) {
-                return csin(arg1);
-            } else if (strcmp(ident, "tan") == 0 && num_args == 1) {
-                return ctan(arg1);
-            } else if (strcmp(ident, "arccos") == 0 && num_args == 1) {
-                return cacos(arg1);
-            } else if (strcmp(ident, "arcsin") == 0 && num_args == 1) {
-                return casin(arg1);
-            } else if (strcmp(ident, "arctan") == 0 && num_args == 1) {
-                return catan(arg1);
-            } else if (strcmp(ident, "sqrt") == 0 && num_args == 1) {
-                return csqrt(arg1);
-            } else if (strcmp(ident, "root") == 0 && num_args == 2) {
-                /* root(x,n) = x^(1/n) */
-                return cpow(arg1, 1.0/arg2);
-            } else {
-                error_flag = 1;
-                fprintf(stderr, "Erreur : fonction inconnue '%s' ou nombre d'arguments invalide\n", ident);
-                return 0;
-            }
-        } else {
-            /* Constante ou identifiant simple */
-            if (strcmp(ident, "pi") == 0) {
-                return M_PI;
-            } else if (strcmp(ident, "e") == 0) {
-                return M_E;
-            } else if (strcmp(ident, "i") == 0) {
-                return I;
-            } else {
-                error_flag = 1;
-                fprintf(stderr, "Erreur : identifiant inconnu '%s'\n", ident);
-                return 0;
-            }
-        }
-    } else if (isdigit(*expr) || *expr == '.') {
-        char *endptr;
-        double real_val = strtod(expr, &endptr);
-        expr = endptr;
-        return real_val;
-    } else if (*expr == '(' || *expr == '[' || *expr == '{') {
-        char open = *expr;
-        char close;
-        if (open == '(') close = ')';
-        else if (open == '[') close = ']';
-        else /* if (open == '{') */ close = '}';
-        expr++; /* sauter le caractère d'ouverture */
-        double complex inner = parse_expression();
-        skip_whitespace();
-        if (*expr != close) {
-            error_flag = 1;
-            fprintf(stderr, "Erreur : '%c' attendue\n", close);
-            return 0;
-        }
-        expr++; /* sauter le caractère de fermeture */
-        return inner;
-    } else {
-        error_flag = 1;
-        fprintf(stderr, "Erreur : caractère inattendu '%c'\n", *expr);
-        return 0;
-    }
-}
-
-/* Fonction d'évaluation : lance le parsing sur l'expression donnée */
-double complex evaluate_expression(const char *expression_str) {
-    expr = expression_str;
-    error_flag = 0;
-    double complex res = parse_expression();
-    skip_whitespace();
-    if (*expr != '\0' && *expr != '\n')
-        error_flag = 1;
-    return res;
-}
+#include <pthread.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "batch.h"
+#include "columns.h"
+#include "calc.h"
+#include "calc_cache.h"
+#include "calc_stats.h"
+#include "editbuf.h"
+#include "format.h"
 
 /* ============================= */
 /* Partie Interface Ncurses      */
@@ -269,74 +38,66 @@ typedef struct {
 Button buttons[NUM_BUTTONS];
 int selected_button = 0;  /* index du bouton sélectionné */
 
-/* Buffer d'expression éditable */
-char expression_buf[256] = "";
-int expr_cursor = 0;      /* position d'insertion dans le buffer */
+/* Expression éditable, de taille quelconque */
+EditBuf expression;
+size_t view_start = 0;    /* premier caractère visible de l'expression */
 
 /* Mode de focus : 0 = mode boutons, 1 = mode édition */
 int focus_mode = 0;
 
+/* Panneau de statistiques (F3) affiché à la place du clavier */
+int stats_panel = 0;
+
 /* Zone de message (résultat ou erreur) */
 char message[256] = "";
 
-/* Convertit une expression contenant '^' en affichant les exposants en superscript */
-void format_expression(const char *src, char *dest, size_t dest_size) {
-    size_t j = 0;
-    for (size_t i = 0; src[i] && j < dest_size - 1; i++) {
-        if (src[i] == '^') {
-            i++;
-            while (src[i] && (src[i] == '-' || isdigit(src[i]) || src[i]=='.')) {
-                const char *sup = NULL;
-                if (src[i] == '-') sup = "⁻";
-                else if (src[i] == '0') sup = "⁰";
-                else if (src[i] == '1') sup = "¹";
-                else if (src[i] == '2') sup = "²";
-                else if (src[i] == '3') sup = "³";
-                else if (src[i] == '4') sup = "⁴";
-                else if (src[i] == '5') sup = "⁵";
-                else if (src[i] == '6') sup = "⁶";
-                else if (src[i] == '7') sup = "⁷";
-                else if (src[i] == '8') sup = "⁸";
-                else if (src[i] == '9') sup = "⁹";
-                else if (src[i] == '.') { dest[j++] = src[i]; i++; continue; }
-                else { dest[j++] = src[i]; i++; continue; }
-                size_t len = strlen(sup);
-                if (j + len < dest_size) {
-                    strcpy(&dest[j], sup);
-                    j += len;
-                }
-                i++;
-            }
-            i--;
-        } else {
-            dest[j++] = src[i];
-        }
-    }
-    dest[j] = '\0';
-}
+/* Contexte d'évaluation de l'interface et cache des résultats */
+CalcContext *calc_ctx = NULL;
+CalcCache *calc_cache = NULL;
+
+/* --dd : la touche '=' calcule en double-double et affiche 30 chiffres */
+int dd_mode = 0;
+
+/* Fenêtres : zone d'affichage (lignes 0 à 4) et clavier en dessous */
+#define DISPLAY_ROWS 5
+#define DISPLAY_COLS 640
+WINDOW *display_win = NULL;
+WINDOW *keypad_win = NULL;
+
+/* Ce qui est actuellement à l'écran, pour ne redessiner que ce qui change */
+char shown_rows[DISPLAY_ROWS][DISPLAY_COLS];
+int shown_focus = -1;     /* mode pour lequel le clavier est dessiné (-1 : à refaire,
+                             SHOWN_PANEL : panneau de statistiques) */
+int shown_button = -1;    /* bouton affiché en surbrillance (-1 : aucun) */
+#define SHOWN_PANEL 2
+#define PANEL_SIZE 4096
+char shown_panel[PANEL_SIZE];
 
-/* Insertion de texte dans le buffer d'expression à la position du curseur */
+/* Mesures du rendu (--render-stats) */
+unsigned long long term_bytes = 0;   /* octets envoyés au terminal */
+int io_fd = -1;                      /* /proc/thread-self/io */
+unsigned long long key_count = 0;
+unsigned long long key_bytes = 0;    /* octets envoyés en réponse aux touches */
+double key_latency_sum = 0, key_latency_max = 0; /* touche -> écran, en µs */
+
+/* Insertion de texte dans l'expression à la position du curseur */
 void insert_text(const char *text) {
-    int len = strlen(expression_buf);
-    int text_len = strlen(text);
-    if (len + text_len >= (int)sizeof(expression_buf) - 1)
-        return;
-    memmove(expression_buf + expr_cursor + text_len,
-            expression_buf + expr_cursor,
-            len - expr_cursor + 1);
-    memcpy(expression_buf + expr_cursor, text, text_len);
-    expr_cursor += text_len;
+    if (editbuf_insert(&expression, text, strlen(text)) < 0)
+        snprintf(message, sizeof(message), "Erreur : mémoire insuffisante");
 }
 
 /* Suppression d'un caractère avant le curseur */
 void delete_char(void) {
-    int len = strlen(expression_buf);
-    if (expr_cursor > 0) {
-        memmove(expression_buf + expr_cursor - 1,
-                expression_buf + expr_cursor,
-                len - expr_cursor + 1);
-        expr_cursor--;
-    }
+    editbuf_delete(&expression);
+}
+
+/* Déplacement du curseur d'une position */
+void move_cursor(int delta) {
+    size_t cur = editbuf_cursor(&expression);
+    if (delta < 0 && cur > 0)
+        editbuf_move(&expression, cur - 1);
+    else if (delta > 0)
+        editbuf_move(&expression, cur + 1);
 }
 
 /* Initialisation des boutons dans une grille 7x6 */
@@ -369,59 +130,562 @@ void init_buttons(void) {
     }
 }
 
-/* Affiche les boutons sur l'écran */
-void draw_buttons(void) {
-    for (int i = 0; i < NUM_BUTTONS; i++) {
-        if (strlen(buttons[i].label) == 0)
+/* ============================= */
+/* Partie Aperçu                 */
+/* Le résultat est recalculé pendant la saisie par un thread dédié, avec
+   une CalcSession : seule la partie de l'expression qui suit la
+   modification est réanalysée et réévaluée. L'expression n'est recopiée
+   pour ce thread qu'après PREVIEW_DELAY_MS sans nouvelle modification :
+   une rafale de frappes ou un collage ne la recopie qu'une fois. Un calcul
+   en cours est interrompu dès que l'expression change : la saisie
+   n'attend jamais le calcul. Pendant une longue somme ou un long produit,
+   la ligne du résultat montre l'avancement, et F4 interrompt le calcul.
+   La touche '=' passe aussi par ce thread (preview_equals) : elle reprend
+   le résultat déjà calculé pour l'expression, ou l'attend sans bloquer
+   la saisie. */
+/* ============================= */
+
+#define PREVIEW_DELAY_MS 20
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;      /* nouvelle demande ou arrêt */
+    pthread_t thread;
+    CalcSession *session;
+    char *text;               /* dernière expression demandée */
+    size_t text_cap;
+    char *work;               /* expression en cours de calcul (thread d'aperçu) */
+    size_t work_cap;
+    unsigned long requested;  /* numéro de la dernière demande */
+    unsigned long done;       /* demande dont result est le résultat */
+    unsigned long shown;      /* demande dont le résultat est dans message */
+    char result[sizeof(message)];
+    CalcErrorCode code;       /* code et valeur de result */
+    double complex value;
+    unsigned long equals;     /* demande dont le résultat va à la touche '=' */
+    int stale;                /* expression modifiée, pas encore demandée */
+    int busy;                 /* calcul en cours */
+    int abort;                /* interruption demandée par F4 */
+    int shutdown;
+    /* Utilisés par le seul thread de l'interface */
+    unsigned long version;    /* version de l'expression vue en dernier */
+    double deadline;          /* fin de l'attente avant la demande, en µs */
+} Preview;
+
+Preview preview;
+int preview_running = 0;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Échange la demande et l'expression en cours de calcul : l'interface
+   peut écrire une nouvelle demande pendant le calcul */
+static void swap_text(void) {
+    char *text = preview.text;
+    size_t cap = preview.text_cap;
+    preview.text = preview.work;
+    preview.text_cap = preview.work_cap;
+    preview.work = text;
+    preview.work_cap = cap;
+}
+
+static void *preview_main(void *arg) {
+    (void)arg;
+    char result[sizeof(preview.result)];
+    pthread_mutex_lock(&preview.lock);
+    while (!preview.shutdown) {
+        if (preview.done == preview.requested || preview.stale) {
+            pthread_cond_wait(&preview.cond, &preview.lock);
+            continue;
+        }
+        unsigned long gen = preview.requested;
+        swap_text();
+        const char *text = preview.work;
+        preview.busy = 1;
+        pthread_mutex_unlock(&preview.lock);
+
+        CalcErrorCode code = CALC_OK;
+        double complex res = 0;
+        result[0] = '\0';
+        if (text[0] != '\0') {
+            code = calc_session_eval(preview.session, text, &res);
+            if (code == CALC_OK)
+                calc_format_result(res, result, sizeof(result));
+            else
+                calc_format_error(calc_session_error(preview.session), result, sizeof(result));
+        }
+
+        pthread_mutex_lock(&preview.lock);
+        preview.busy = 0;
+        /* Une interruption arrivée juste après la fin d'un calcul précédent
+           peut toucher celui-ci : la demande est alors simplement reprise.
+           Seule une interruption par F4 est affichée. */
+        int aborted = code == CALC_ERR_CANCELLED && preview.abort;
+        preview.abort = 0;
+        if ((code == CALC_ERR_CANCELLED && !aborted) || gen != preview.requested) {
+            if (gen == preview.requested)
+                swap_text();
             continue;
-        int x = buttons[i].x, y = buttons[i].y;
-        int w = buttons[i].width, h = buttons[i].height;
-        if (focus_mode == 0 && i == selected_button)
-            attron(A_REVERSE);
-        for (int j = 0; j < h; j++) {
-            for (int k = 0; k < w; k++) {
-                if (j == 0 || j == h - 1 || k == 0 || k == w - 1)
-                    mvprintw(y + j, x + k, " ");
-                else
-                    mvprintw(y + j, x + k, " ");
-            }
         }
-        int label_len = strlen(buttons[i].label);
-        int label_x = x + (w - label_len) / 2;
-        int label_y = y + h / 2;
-        mvprintw(label_y, label_x, "%s", buttons[i].label);
-        if (focus_mode == 0 && i == selected_button)
-            attroff(A_REVERSE);
+        strcpy(preview.result, result);
+        preview.code = code;
+        preview.value = res;
+        preview.done = gen;
     }
+    pthread_mutex_unlock(&preview.lock);
+    return NULL;
 }
 
-/* Affiche la zone d'expression et le message.
+static int preview_start(void) {
+    preview.session = calc_session_new();
+    preview.text = malloc(1);
+    preview.work = malloc(1);
+    if (!preview.session || !preview.text || !preview.work) {
+        calc_session_free(preview.session);
+        free(preview.text);
+        free(preview.work);
+        return -1;
+    }
+    preview.text[0] = preview.work[0] = '\0';
+    preview.text_cap = preview.work_cap = 1;
+    pthread_mutex_init(&preview.lock, NULL);
+    pthread_cond_init(&preview.cond, NULL);
+    if (pthread_create(&preview.thread, NULL, preview_main, NULL) != 0) {
+        calc_session_free(preview.session);
+        free(preview.text);
+        free(preview.work);
+        return -1;
+    }
+    preview_running = 1;
+    return 0;
+}
+
+static void preview_stop(void) {
+    if (!preview_running)
+        return;
+    pthread_mutex_lock(&preview.lock);
+    preview.shutdown = 1;
+    calc_session_cancel(preview.session);
+    pthread_cond_signal(&preview.cond);
+    pthread_mutex_unlock(&preview.lock);
+    pthread_join(preview.thread, NULL);
+    pthread_cond_destroy(&preview.cond);
+    pthread_mutex_destroy(&preview.lock);
+    calc_session_free(preview.session);
+    free(preview.text);
+    free(preview.work);
+    preview_running = 0;
+}
+
+/* Recopie l'expression pour le thread d'aperçu et la lui demande (verrou
+   tenu) ; renvoie -1 si la mémoire manque */
+static int send_request(void) {
+    size_t len = editbuf_length(&expression);
+    if (len + 1 > preview.text_cap) {
+        char *text = realloc(preview.text, len + 1);
+        if (!text)
+            return -1;
+        preview.text = text;
+        preview.text_cap = len + 1;
+    }
+    editbuf_copy(&expression, 0, len, preview.text);
+    preview.text[len] = '\0';
+    preview.stale = 0;
+    preview.requested++;
+    pthread_cond_signal(&preview.cond);
+    return 0;
+}
+
+/* Demande l'aperçu de l'expression si elle a changé depuis la dernière
+   demande et que PREVIEW_DELAY_MS se sont écoulées depuis ; renvoie 1
+   tant qu'un résultat est attendu */
+static int preview_request(void) {
+    if (!preview_running)
+        return 0;
+    pthread_mutex_lock(&preview.lock);
+    if (preview.version != expression.version) {
+        preview.version = expression.version;
+        preview.deadline = now_us() + PREVIEW_DELAY_MS * 1000.0;
+        preview.stale = 1;
+        /* Le calcul en cours ne sera pas affiché : on l'interrompt */
+        if (preview.busy)
+            calc_session_cancel(preview.session);
+    }
+    if (preview.stale && now_us() >= preview.deadline)
+        send_request();
+    int pending = preview.stale || preview.shown != preview.requested;
+    pthread_mutex_unlock(&preview.lock);
+    return pending;
+}
+
+static void equals_show(double complex res, const CalcDDComplex *dres);
+
+/* Recopie dans message le résultat de la dernière demande s'il est prêt,
+   sinon l'avancement du calcul en cours ; un résultat attendu par '='
+   remplace l'expression */
+static void preview_poll(void) {
+    if (!preview_running)
+        return;
+    int equals = 0;
+    double complex value = 0;
+    pthread_mutex_lock(&preview.lock);
+    if (!preview.stale && preview.done == preview.requested && preview.shown != preview.done) {
+        strcpy(message, preview.result);
+        preview.shown = preview.done;
+        if (preview.equals == preview.done) {
+            equals = preview.code == CALC_OK;
+            value = preview.value;
+            preview.equals = 0;
+        }
+    } else if (preview.busy) {
+        int progress = calc_session_progress(preview.session);
+        if (progress >= 0)
+            snprintf(message, sizeof(message), "calcul en cours : %d %% (F4 : interrompre)",
+                     progress / 10);
+    }
+    pthread_mutex_unlock(&preview.lock);
+    /* une erreur est déjà dans message ; l'interface n'enregistre ni
+       fonction ni constante : le résultat peut aller au cache */
+    if (equals) {
+        if (calc_cache)
+            calc_cache_store(calc_cache, editbuf_text(&expression), value);
+        equals_show(value, NULL);
+    }
+}
+
+/* Touche '=' : le résultat de l'expression actuelle, déjà calculé ou en
+   cours, ira à la touche ; le calcul est demandé tout de suite s'il ne
+   l'était pas. Renvoie -1 sans aperçu. */
+static int preview_equals(void) {
+    if (!preview_running)
+        return -1;
+    int ret = 0;
+    pthread_mutex_lock(&preview.lock);
+    if (preview.version != expression.version || preview.stale) {
+        preview.version = expression.version;
+        if (preview.busy)
+            calc_session_cancel(preview.session);
+        preview.stale = 1;
+        ret = send_request();
+    }
+    if (ret == 0) {
+        preview.equals = preview.requested;
+        /* résultat déjà affiché : il est repris une fois de plus */
+        if (preview.shown == preview.requested)
+            preview.shown--;
+    }
+    pthread_mutex_unlock(&preview.lock);
+    return ret;
+}
+
+/* Interrompt le calcul en cours (F4) ; son résultat sera l'erreur */
+static void preview_abort(void) {
+    if (!preview_running)
+        return;
+    pthread_mutex_lock(&preview.lock);
+    if (preview.busy) {
+        preview.abort = 1;
+        calc_session_cancel(preview.session);
+    }
+    pthread_mutex_unlock(&preview.lock);
+}
+
+/* ============================= */
+/* Partie Touche =               */
+/* Le résultat remplace l'expression. Seuls les calculs dont la durée ne
+   dépend que de la longueur de l'expression sont faits ici : le
+   double-double, qui n'admet pas d'opérateur à variable liée, et la
+   lecture du cache. Les autres passent par le thread d'aperçu. */
+/* ============================= */
+
+/* Résultat réussi (dres : double-double) : la valeur exacte si
+   l'expression le permet (25!, 2^100...), sinon le résultat formaté */
+static void equals_show(double complex res, const CalcDDComplex *dres) {
+    const char *text = editbuf_text(&expression);
+    if (calc_eval_exact(calc_ctx, text, message, sizeof(message)) < 0) {
+        if (dres)
+            calc_format_result_dd(dres, message, sizeof(message));
+        else if (dd_mode)
+            calc_format_result_full(res, message, sizeof(message));
+        else
+            calc_format_result(res, message, sizeof(message));
+    }
+    editbuf_set(&expression, message);
+}
+
+static void equals_key(void) {
+    const char *text = editbuf_text(&expression);
+    double complex res;
+    CalcDDComplex dres;
+    CalcErrorCode code;
+    message[0] = '\0';
+    if (dd_mode) {
+        code = calc_eval_dd(calc_ctx, text, &dres);
+        /* opérateurs à variable liée : calculés et affichés en double */
+        if (code != CALC_ERR_PRECISION) {
+            if (code != CALC_OK)
+                calc_format_error(calc_last_error(calc_ctx), message, sizeof(message));
+            else
+                equals_show(0, &dres);
+            return;
+        }
+    }
+    if (calc_cache && calc_cache_lookup(calc_cache, text, &res)) {
+        equals_show(res, NULL);
+        return;
+    }
+    if (text[0] != '\0' && preview_equals() == 0) {
+        snprintf(message, sizeof(message), "calcul en cours (F4 : interrompre)");
+        return;
+    }
+    /* sans aperçu, ou expression vide : calcul direct */
+    code = calc_eval_cached(calc_ctx, calc_cache, text, &res);
+    if (code != CALC_OK)
+        calc_format_error(calc_last_error(calc_ctx), message, sizeof(message));
+    else
+        equals_show(res, NULL);
+}
+
+/* ============================= */
+/* Partie Rendu                  */
+/* Chaque zone est comparée à ce qui est déjà affiché : seules les lignes
+   de la zone d'affichage dont le texte a changé, et les boutons dont la
+   surbrillance a changé, sont redessinés. Les deux fenêtres sont
+   recopiées avec wnoutrefresh() puis envoyées en une fois par doupdate(). */
+/* ============================= */
+
+/* Octets écrits jusqu'ici par le thread (champ wchar de
+   /proc/thread-self/io) : la différence autour de doupdate() est ce que
+   ncurses a envoyé au terminal */
+static unsigned long long written_bytes(void) {
+    char buf[512];
+    ssize_t n = pread(io_fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    const char *w = strstr(buf, "wchar:");
+    return w ? strtoull(w + 6, NULL, 10) : 0;
+}
+
+/* Dessine un bouton dans la fenêtre du clavier */
+static void draw_button(int i, int highlight) {
+    if (strlen(buttons[i].label) == 0)
+        return;
+    int x = buttons[i].x, y = buttons[i].y - getbegy(keypad_win);
+    int w = buttons[i].width, h = buttons[i].height;
+    if (highlight)
+        wattron(keypad_win, A_REVERSE);
+    for (int j = 0; j < h; j++)
+        mvwprintw(keypad_win, y + j, x, "%*s", w, "");
+    int label_len = strlen(buttons[i].label);
+    mvwprintw(keypad_win, y + h / 2, x + (w - label_len) / 2, "%s", buttons[i].label);
+    if (highlight)
+        wattroff(keypad_win, A_REVERSE);
+}
+
+/* Fait défiler la vue pour que le curseur soit visible dans width
+   colonnes, puis en recopie le texte dans dest ; seule la partie visible
+   de l'expression est lue */
+static void expression_view(char *dest, size_t width) {
+    size_t cursor = editbuf_cursor(&expression);
+    size_t len = editbuf_length(&expression);
+    if (cursor < view_start)
+        view_start = cursor;
+    else if (cursor >= view_start + width)
+        view_start = cursor - width + 1;
+    /* Pas de colonnes vides à droite tant que le début est caché */
+    if (view_start > 0 && len + 1 < view_start + width)
+        view_start = len + 1 > width ? len + 1 - width : 0;
+    dest[editbuf_copy(&expression, view_start, width, dest)] = '\0';
+}
+
+/* Texte des lignes de la zone d'affichage, pour width colonnes.
    En mode édition, le buffer brut est affiché avec un indicateur de curseur. */
-void draw_display(void) {
+static void compose_display(char rows[DISPLAY_ROWS][DISPLAY_COLS], int width) {
+    for (int r = 0; r < DISPLAY_ROWS; r++)
+        rows[r][0] = '\0';
+    if (focus_mode == 0)
+        snprintf(rows[0], DISPLAY_COLS, "Focus: Boutons (F2: éditer, F3: statistiques, q: quitter)");
+    else
+        snprintf(rows[0], DISPLAY_COLS, "Focus: Expression (F2: boutons, F3: statistiques, q: quitter)");
+    const char *label = focus_mode == 1 ? "Expression (edit): " : "Expression: ";
+    int base = strlen(label);
+    int view = width - base - 1;
+    if (view > DISPLAY_COLS / 4)
+        view = DISPLAY_COLS / 4; /* les exposants prennent jusqu'à 3 octets */
+    if (view < 1)
+        view = 1;
+    char text[DISPLAY_COLS / 4 + 1];
+    expression_view(text, view);
     if (focus_mode == 1) {
-        mvprintw(1, 2, "Expression (edit): %-50s", expression_buf);
-        int base = strlen("Expression (edit): ");
-        mvprintw(2, base + 2 + expr_cursor, "^");
+        snprintf(rows[1], DISPLAY_COLS, "%s%-50s", label, text);
+        snprintf(rows[2], DISPLAY_COLS, "%*s^", base + (int)(editbuf_cursor(&expression) - view_start), "");
     } else {
-        char formatted[512];
-        format_expression(expression_buf, formatted, sizeof(formatted));
-        mvprintw(1, 2, "Expression: %-50s", formatted);
+        char formatted[DISPLAY_COLS / 4 * 3 + 1];
+        format_expression(text, formatted, sizeof(formatted));
+        snprintf(rows[1], DISPLAY_COLS, "%s%-50s", label, formatted);
+    }
+    if (calc_cache) {
+        CalcCacheStats st;
+        calc_cache_stats(calc_cache, &st);
+        snprintf(rows[3], DISPLAY_COLS, "Cache: %llu succès, %llu défauts", st.hits, st.misses);
+    }
+    snprintf(rows[4], DISPLAY_COLS, "Result/Error: %-50s", message);
+}
+
+/* Texte du panneau de statistiques : compteurs de libcalc, puis mesures
+   du rendu ; autant de fonctions que la fenêtre peut en montrer */
+static void compose_panel(char *buf, size_t size, int rows) {
+    CalcStats st;
+    calc_stats_collect(&st);
+    int len = snprintf(buf, size, "Statistiques (F3 : fermer)\n");
+    len += calc_stats_format(&st, rows > 7 ? rows - 7 : 0, buf + len, size - len);
+    if (len < (int)size && key_count > 0)
+        snprintf(buf + len, size - len, "Rendu : %llu touches, %.1f µs en moyenne (max %.1f µs), "
+                 "%.1f octets par touche\n", key_count, key_latency_sum / key_count,
+                 key_latency_max, (double)key_bytes / key_count);
+}
+
+static void draw_panel(const char *text) {
+    int width = getmaxx(keypad_win), row = 0;
+    werase(keypad_win);
+    while (*text && row < getmaxy(keypad_win)) {
+        const char *nl = strchr(text, '\n');
+        int len = nl ? nl - text : (int)strlen(text);
+        if (width > 2)
+            mvwaddnstr(keypad_win, row, 2, text, len < width - 2 ? len : width - 2);
+        row++;
+        text += nl ? len + 1 : len;
+    }
+}
+
+/* (Re)crée les fenêtres à la taille du terminal ; le clavier est tronqué
+   s'il ne tient pas en hauteur */
+static int create_windows(void) {
+    if (display_win)
+        delwin(display_win);
+    if (keypad_win)
+        delwin(keypad_win);
+    int top = buttons[0].y;
+    int rows = GRID_ROWS * (buttons[0].height + 1);
+    if (rows > LINES - top)
+        rows = LINES - top;
+    display_win = newwin(DISPLAY_ROWS < LINES ? DISPLAY_ROWS : LINES, COLS, 0, 0);
+    keypad_win = rows > 0 ? newwin(rows, COLS, top, 0) : NULL;
+    if (!display_win)
+        return -1;
+    /* Les touches sont lues par la fenêtre d'affichage : stdscr n'est
+       jamais rafraîchi, il recouvrirait les deux fenêtres */
+    keypad(display_win, TRUE);
+    return 0;
+}
+
+/* Tout redessiner au prochain rendu (démarrage, redimensionnement) */
+static void invalidate_screen(void) {
+    for (int r = 0; r < DISPLAY_ROWS; r++)
+        strcpy(shown_rows[r], "\n"); /* jamais produit par compose_display */
+    shown_focus = -1;
+    shown_button = -1;
+}
+
+static void render(void) {
+    char rows[DISPLAY_ROWS][DISPLAY_COLS];
+    int width = getmaxx(display_win);
+    compose_display(rows, width - 2);
+    for (int r = 0; r < getmaxy(display_win); r++) {
+        if (strcmp(rows[r], shown_rows[r]) == 0)
+            continue;
+        wmove(display_win, r, 0);
+        wclrtoeol(display_win);
+        if (width > 2)
+            mvwaddnstr(display_win, r, 2, rows[r], width - 2);
+        strcpy(shown_rows[r], rows[r]);
+    }
+
+    /* Le clavier n'est affiché qu'en mode boutons, et sans le panneau */
+    int highlight = focus_mode == 0 && !stats_panel ? selected_button : -1;
+    if (!keypad_win) {
+        shown_focus = -1;
+    } else if (stats_panel) {
+        char panel[PANEL_SIZE];
+        compose_panel(panel, sizeof(panel), getmaxy(keypad_win));
+        if (shown_focus != SHOWN_PANEL || strcmp(panel, shown_panel) != 0) {
+            draw_panel(panel);
+            strcpy(shown_panel, panel);
+        }
+        shown_focus = SHOWN_PANEL;
+    } else if (focus_mode != shown_focus) {
+        werase(keypad_win);
+        if (focus_mode == 0)
+            for (int i = 0; i < NUM_BUTTONS; i++)
+                draw_button(i, i == highlight);
+        shown_focus = focus_mode;
+    } else if (highlight != shown_button) {
+        if (shown_button >= 0)
+            draw_button(shown_button, 0);
+        if (highlight >= 0)
+            draw_button(highlight, 1);
+    }
+    shown_button = highlight;
+
+    wnoutrefresh(display_win);
+    if (keypad_win)
+        wnoutrefresh(keypad_win);
+    if (io_fd >= 0) {
+        unsigned long long before = written_bytes();
+        doupdate();
+        term_bytes += written_bytes() - before;
+    } else {
+        doupdate();
     }
-    mvprintw(4, 2, "Result/Error: %-50s", message);
-    if (focus_mode == 0)
-        mvprintw(0, 2, "Focus: Boutons (F2: éditer, q: quitter)");
-    else
-        mvprintw(0, 2, "Focus: Expression (F2: boutons, q: quitter)");
 }
 
-int main(void) {
+int main(int argc, char **argv) {
     int ch;
     MEVENT event;
 
+    if (argc > 1 && strcmp(argv[1], "--batch") == 0)
+        return run_batch(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--columns") == 0)
+        return run_columns(argc - 2, argv + 2);
+    const char *cache_path = NULL;
+    int render_stats = 0;
+    for (int k = 1; k < argc; k++) {
+        if (strcmp(argv[k], "--cache") == 0 && k + 1 < argc) {
+            cache_path = argv[++k];
+        } else if (strcmp(argv[k], "--render-stats") == 0) {
+            render_stats = 1;
+        } else if (strcmp(argv[k], "--dd") == 0) {
+            dd_mode = 1;
+        } else {
+            fprintf(stderr, "Usage : %s [--cache FICHIER] [--render-stats] [--dd]\n"
+                            "        %s --batch [-j N] [--cache FICHIER] [--cache-size N] [--cache-stats] [--stats]\n"
+                            "                  [--exact] [--dd] [fichier...]\n"
+                            "        %s --columns EXPRESSION [-j N] [--vars a,b,...] [--binary]\n"
+                            "                  [fichier...]\n",
+                    argv[0], argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    if (render_stats && (io_fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC)) < 0)
+        perror("/proc/thread-self/io");
+    calc_ctx = calc_context_new();
+    if (!calc_ctx || editbuf_init(&expression) < 0) {
+        fprintf(stderr, "Erreur : mémoire insuffisante\n");
+        return 1;
+    }
+    /* Sans fichier, petit cache en mémoire pour la session */
+    calc_cache = calc_cache_open(cache_path, cache_path ? 65536 : 1024);
+    if (!calc_cache && cache_path)
+        perror(cache_path);
+
     initscr();
     noecho();
     cbreak();
-    keypad(stdscr, TRUE);
     mousemask(ALL_MOUSE_EVENTS | REPORT_MOUSE_POSITION, NULL);
     curs_set(0);
     if (has_colors()) {
@@ -430,22 +694,42 @@ int main(void) {
     }
 
     init_buttons();
+    if (create_windows() < 0) {
+        endwin();
+        fprintf(stderr, "Erreur : impossible de créer les fenêtres\n");
+        return 1;
+    }
+    invalidate_screen();
+    render();
+    preview_start(); /* sans aperçu, le résultat n'apparaît qu'avec '=' */
 
+    int preview_pending = 0;
     while (1) {
-        clear();
-        draw_display();
-        if (focus_mode == 0)
-            draw_buttons();
-        refresh();
-
-        ch = getch();
+        /* En attendant un aperçu, on vérifie régulièrement s'il est prêt */
+        wtimeout(display_win, preview_pending ? PREVIEW_DELAY_MS : -1);
+        ch = wgetch(display_win);
+        if (ch == ERR) {
+            preview_poll();
+            preview_pending = preview_request();
+            render();
+            continue;
+        }
+        double t0 = now_us();
+        unsigned long long bytes0 = term_bytes;
         if (ch == 'q' || ch == 'Q')
             break;
-        if (ch == KEY_F(2)) {
+        if (ch == KEY_RESIZE) {
+            if (create_windows() < 0)
+                break;
+            clearok(curscr, TRUE);
+            invalidate_screen();
+        } else if (ch == KEY_F(2)) {
             focus_mode = !focus_mode;
-            continue;
-        }
-        if (focus_mode == 0) {  /* Mode Boutons */
+        } else if (ch == KEY_F(3)) {
+            stats_panel = !stats_panel;
+        } else if (ch == KEY_F(4)) {
+            preview_abort();
+        } else if (focus_mode == 0) {  /* Mode Boutons */
             if (ch == KEY_MOUSE) {
                 if (getmouse(&event) == OK) {
                     if (event.bstate & BUTTON1_CLICKED) {
@@ -513,11 +797,9 @@ int main(void) {
             /* Support du clavier physique en mode Boutons :
                les touches '<' et '>' déplacent le curseur dans l'expression */
             else if (ch == '<') {
-                if (expr_cursor > 0)
-                    expr_cursor--;
+                move_cursor(-1);
             } else if (ch == '>') {
-                if (expr_cursor < (int)strlen(expression_buf))
-                    expr_cursor++;
+                move_cursor(1);
             }
             else if (ch == KEY_BACKSPACE || ch == 127) {
                 delete_char();
@@ -529,34 +811,25 @@ int main(void) {
                 if (strcmp(label, "Quit") == 0) {
                     break;
                 } else if (strcmp(label, "C") == 0) {
-                    expression_buf[0] = '\0';
-                    expr_cursor = 0;
+                    editbuf_clear(&expression);
                     message[0] = '\0';
                 } else if (strcmp(label, "<-") == 0) {
                     delete_char();
                 } else if (strcmp(label, "=") == 0) {
-                    message[0] = '\0';
-                    double complex res = evaluate_expression(expression_buf);
-                    if (!error_flag) {
-                        if (fabs(cimag(res)) < 1e-12)
-                            snprintf(message, sizeof(message), "%g", creal(res));
-                        else
-                            snprintf(message, sizeof(message), "%g+%gi", creal(res), cimag(res));
-                        /* Optionnel : mettre à jour l'expression avec le résultat */
-                        snprintf(expression_buf, sizeof(expression_buf), "%s", message);
-                        expr_cursor = strlen(expression_buf);
-                    }
+                    equals_key();
                 } else {
                     insert_text(label);
                 }
             }
         } else {  /* Mode Édition */
             if (ch == KEY_LEFT || ch == '<') {
-                if (expr_cursor > 0)
-                    expr_cursor--;
+                move_cursor(-1);
             } else if (ch == KEY_RIGHT || ch == '>') {
-                if (expr_cursor < (int)strlen(expression_buf))
-                    expr_cursor++;
+                move_cursor(1);
+            } else if (ch == KEY_HOME) {
+                editbuf_move(&expression, 0);
+            } else if (ch == KEY_END) {
+                editbuf_move(&expression, editbuf_length(&expression));
             } else if (ch == KEY_BACKSPACE || ch == 127) {
                 delete_char();
             } else if (isprint(ch)) {
@@ -564,7 +837,31 @@ int main(void) {
                 insert_text(s);
             }
         }
+        preview_pending = preview_request();
+        preview_poll();
+        render();
+        double latency = now_us() - t0;
+        key_count++;
+        key_bytes += term_bytes - bytes0;
+        key_latency_sum += latency;
+        if (latency > key_latency_max)
+            key_latency_max = latency;
     }
+    preview_stop();
+    if (display_win)
+        delwin(display_win);
+    if (keypad_win)
+        delwin(keypad_win);
     endwin();
+    if (render_stats && key_count > 0)
+        fprintf(stderr, "Rendu : %llu touches, latence moyenne %.1f µs (max %.1f µs), "
+                        "%llu octets écrits (%.1f par touche)\n",
+                key_count, key_latency_sum / key_count, key_latency_max,
+                term_bytes, (double)key_bytes / key_count);
+    if (io_fd >= 0)
+        close(io_fd);
+    calc_cache_close(calc_cache);
+    calc_context_free(calc_ctx);
+    editbuf_free(&expression);
     return 0;
 }
@@ -0,0 +1,1657 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <complex.h>
+#include "calc.h"
+#include "calc_internal.h"
+
+/* ============================= */
+/* Partie Compilation            */
+/* Le parseur ne calcule rien : il compile l'expression en un programme
+   postfixé (bytecode pour une machine à pile), exécuté ensuite par
+   calc_run(). */
+/* ============================= */
+
+void calc_set_error(CalcContext *ctx, CalcErrorCode code, size_t pos) {
+    if (ctx->err.code != CALC_OK)
+        return; /* on garde la première erreur */
+    ctx->err.code = code;
+    ctx->err.pos = pos;
+}
+
+static size_t parser_pos(const Parser *p) {
+    return p->cur - p->src;
+}
+
+static void skip_whitespace(Parser *p) {
+    while (*p->cur && isspace((unsigned char)*p->cur))
+        p->cur++;
+}
+
+/* Effet de chaque instruction sur la hauteur de pile */
+int calc_stack_effect(const Instr *ins) {
+    switch (ins->op) {
+    case OP_CONST: case OP_CCONST: case OP_LOAD: case OP_VAR:
+        return 1;
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+    case OP_IDIV: case OP_POW: case OP_ROOT: case OP_SCALE:
+        return -1;
+    case OP_CALL: case OP_INTEGRATE: case OP_SOLVE: case OP_DIFF:
+    case OP_SUM: case OP_PROD:
+        return 1 - ins->argc;
+    default:
+        return 0;
+    }
+}
+
+static void emit_argc(CalcContext *ctx, int op, int argc, int arg, size_t pos) {
+    CodeBuf *out = &ctx->p.out;
+    if (ctx->err.code != CALC_OK)
+        return;
+    if (out->len == out->cap) {
+        int cap = out->cap ? out->cap * 2 : 32;
+        Instr *code = realloc(out->code, cap * sizeof(Instr));
+        if (code)
+            out->code = code;
+        unsigned *positions = realloc(out->pos, cap * sizeof(unsigned));
+        if (positions)
+            out->pos = positions;
+        if (!code || !positions) {
+            calc_set_error(ctx, CALC_ERR_NOMEM, pos);
+            return;
+        }
+        out->cap = cap;
+    }
+    out->code[out->len].op = op;
+    out->code[out->len].argc = argc;
+    out->code[out->len].arg = arg;
+    out->pos[out->len] = pos;
+    out->depth += calc_stack_effect(&out->code[out->len]);
+    out->len++;
+    if (out->depth > out->max_depth)
+        out->max_depth = out->depth;
+}
+
+static void emit(CalcContext *ctx, int op, int arg, size_t pos) {
+    emit_argc(ctx, op, 0, arg, pos);
+}
+
+/* Les nombres gardent leur partie basse en CALC_PRECISION_DD, qui
+   n'admet pas de corps d'opérateur à variable liée (begin_body) */
+static int dd_code(const CalcContext *ctx) {
+    return ctx->precision == CALC_PRECISION_DD;
+}
+
+/* lo : partie basse de la valeur réelle, conservée en CALC_PRECISION_DD */
+static void emit_const(CalcContext *ctx, double complex val, double lo, size_t pos) {
+    CodeBuf *out = &ctx->p.out;
+    if (ctx->err.code != CALC_OK)
+        return;
+    if (out->nconsts == out->consts_cap) {
+        int cap = out->consts_cap ? out->consts_cap * 2 : 16;
+        double complex *consts = realloc(out->consts, cap * sizeof(double complex));
+        if (consts)
+            out->consts = consts;
+        double *rconsts = realloc(out->rconsts, cap * sizeof(double));
+        if (rconsts)
+            out->rconsts = rconsts;
+        if (!consts || !rconsts) {
+            calc_set_error(ctx, CALC_ERR_NOMEM, pos);
+            return;
+        }
+        out->consts_cap = cap;
+    }
+    if (dd_code(ctx)) {
+        if (out->nconsts == out->clo_cap) {
+            int cap = out->clo_cap ? out->clo_cap * 2 : 16;
+            double *clo = realloc(out->clo, cap * sizeof(double));
+            if (!clo) {
+                calc_set_error(ctx, CALC_ERR_NOMEM, pos);
+                return;
+            }
+            out->clo = clo;
+            out->clo_cap = cap;
+        }
+        out->clo[out->nconsts] = lo;
+    }
+    out->consts[out->nconsts] = val;
+    out->rconsts[out->nconsts] = creal(val);
+    emit(ctx, cimag(val) != 0 ? OP_CCONST : OP_CONST, out->nconsts++, pos);
+}
+
+static void emit_call(CalcContext *ctx, int index, int argc, size_t pos) {
+    emit_argc(ctx, OP_CALL, argc, index, pos);
+}
+
+/* Recopie le nom en cause dans l'erreur (tronqué si trop long) */
+static void copy_ident(CalcContext *ctx, const char *name, size_t len) {
+    if (len > sizeof(ctx->err.ident) - 1)
+        len = sizeof(ctx->err.ident) - 1;
+    memcpy(ctx->err.ident, name, len);
+    ctx->err.ident[len] = '\0';
+}
+
+/* Priorité des opérateurs binaires ; '^' est associatif à droite */
+static int precedence(int op) {
+    switch (op) {
+    case OP_POW:
+        return 3;
+    case OP_MUL: case OP_DIV: case OP_IDIV:
+        return 2;
+    default: /* OP_ADD, OP_SUB */
+        return 1;
+    }
+}
+
+/* Émet les opérateurs en attente (au-dessus de base) de priorité >= prec */
+static void reduce(CalcContext *ctx, int base, int prec) {
+    Parser *p = &ctx->p;
+    while (p->nops > base && precedence(p->ops[p->nops - 1].op) >= prec) {
+        p->nops--;
+        emit(ctx, p->ops[p->nops].op, 0, p->ops[p->nops].pos);
+    }
+}
+
+static void push_op(CalcContext *ctx, int op, size_t pos) {
+    Parser *p = &ctx->p;
+    if (p->nops == p->ops_cap) {
+        int cap = p->ops_cap ? p->ops_cap * 2 : 32;
+        PendingOp *ops = realloc(p->ops, cap * sizeof(*ops));
+        if (!ops) {
+            calc_set_error(ctx, CALC_ERR_NOMEM, pos);
+            return;
+        }
+        p->ops = ops;
+        p->ops_cap = cap;
+    }
+    p->ops[p->nops].op = op;
+    p->ops[p->nops].pos = pos;
+    p->nops++;
+}
+
+static OpenGroup *push_group(CalcContext *ctx, size_t pos) {
+    Parser *p = &ctx->p;
+    if (p->ngroups == p->groups_cap) {
+        int cap = p->groups_cap ? p->groups_cap * 2 : 16;
+        OpenGroup *groups = realloc(p->groups, cap * sizeof(*groups));
+        if (!groups) {
+            calc_set_error(ctx, CALC_ERR_NOMEM, pos);
+            return NULL;
+        }
+        p->groups = groups;
+        p->groups_cap = cap;
+    }
+    OpenGroup *g = &p->groups[p->ngroups++];
+    memset(g, 0, sizeof(*g));
+    g->base = p->nops;
+    return g;
+}
+
+/* Fin d'un appel de fonction : vérification du symbole et de l'arité.
+   sub : corps d'un opérateur à variable liée */
+static void emit_function(CalcContext *ctx, int index, size_t len, size_t start, int num_args,
+                          int sub) {
+    const char *name = ctx->p.src + start;
+    const CalcSymbol *sym = index >= 0 ? calc_symbol(index) : NULL;
+    if (!sym || sym->kind == SYM_CONST) {
+        calc_set_error(ctx, CALC_ERR_UNKNOWN_FUNC, start);
+        copy_ident(ctx, name, len);
+        return;
+    }
+    if (num_args < sym->min_args ||
+        (sym->max_args != CALC_VARIADIC && num_args > sym->max_args) ||
+        (sym->kind == SYM_BINDER && sub < 0)) {
+        calc_set_error(ctx, CALC_ERR_ARITY, start);
+        copy_ident(ctx, name, len);
+        return;
+    }
+    if (!sym->pure)
+        ctx->p.external = 1;
+    if (sym->kind == SYM_OPCODE)
+        emit(ctx, sym->op, 0, start);
+    else if (sym->kind == SYM_BINDER)
+        emit_argc(ctx, sym->op, num_args, sub, start);
+    else
+        emit_call(ctx, index, num_args, start);
+}
+
+/* Indice de la variable nommée name (len octets), ou -1 : d'abord les
+   variables liées des corps ouverts, du plus intérieur au plus extérieur,
+   puis celles de l'expression */
+static int find_var(const Parser *p, const char *name, size_t len) {
+    for (int k = p->nbodies - 1; k >= 0; k--)
+        if (p->bodies[k].var_len == len && memcmp(p->src + p->bodies[k].var, name, len) == 0)
+            return p->nbodies - 1 - k;
+    for (int k = 0; k < p->nvars; k++)
+        if (strncmp(p->vars[k], name, len) == 0 && p->vars[k][len] == '\0')
+            return p->nbodies + k;
+    return -1;
+}
+
+static void free_codebuf(CodeBuf *out) {
+    calc_drop_subs(out, 0);
+    free(out->subs);
+    free(out->code);
+    free(out->pos);
+    free(out->consts);
+    free(out->rconsts);
+    free(out->clo);
+}
+
+static void free_parser(Parser *p) {
+    free_codebuf(&p->out);
+    for (int k = 0; k < p->bodies_cap; k++)
+        free_codebuf(&p->bodies[k].spare);
+    free(p->bodies);
+    free(p->ops);
+    free(p->groups);
+    free(p->arg_end);
+    free(p->arg_stack);
+}
+
+void calc_drop_subs(CodeBuf *out, int keep) {
+    while (out->nsubs > keep)
+        calc_program_free(out->subs[--out->nsubs]);
+}
+
+/* Fin de ligne : l'analyse ne va pas au-delà */
+static int end_of_line(char c) {
+    return c == '\0' || c == '\n';
+}
+
+/* Remplit p.arg_end pour toute la ligne, en une passe : chaque ouvrante
+   y reçoit la position de la première virgule hors de tout groupe qui la
+   suit, ou celle de sa fermeture (ou de la fin de la ligne). Renvoie -1
+   en cas d'erreur. */
+static int scan_arguments(CalcContext *ctx) {
+    Parser *p = &ctx->p;
+    if (p->arg_scanned)
+        return 0;
+    size_t len = 0;
+    while (!end_of_line(p->src[len]))
+        len++;
+    if (len + 1 > p->arg_cap) {
+        unsigned *end = realloc(p->arg_end, (len + 1) * sizeof(unsigned));
+        if (end)
+            p->arg_end = end;
+        unsigned *stack = realloc(p->arg_stack, (len + 1) * sizeof(unsigned));
+        if (stack)
+            p->arg_stack = stack;
+        if (!end || !stack) {
+            calc_set_error(ctx, CALC_ERR_NOMEM, parser_pos(p));
+            return -1;
+        }
+        p->arg_cap = len + 1;
+    }
+    /* arg_stack : ouvrantes encore ouvertes ; UINT_MAX marque celles
+       dont la première virgule n'est pas encore vue */
+    size_t depth = 0;
+    for (size_t k = 0; k < len; k++) {
+        char c = p->src[k];
+        if (c == '(' || c == '[' || c == '{') {
+            p->arg_end[k] = UINT_MAX;
+            p->arg_stack[depth++] = (unsigned)k;
+        } else if ((c == ')' || c == ']' || c == '}' || c == ',') && depth > 0) {
+            unsigned *end = &p->arg_end[p->arg_stack[depth - 1]];
+            if (*end == UINT_MAX)
+                *end = (unsigned)k;
+            if (c != ',')
+                depth--;
+        }
+    }
+    while (depth > 0) {
+        unsigned *end = &p->arg_end[p->arg_stack[--depth]];
+        if (*end == UINT_MAX)
+            *end = (unsigned)len;
+    }
+    p->arg_scanned = 1;
+    return 0;
+}
+
+/* Erreur de syntaxe d'un opérateur à variable liée, au caractère courant */
+static void binder_syntax(CalcContext *ctx, size_t start, size_t len) {
+    Parser *p = &ctx->p;
+    if (*p->cur == ')') {
+        calc_set_error(ctx, CALC_ERR_ARITY, start);
+        copy_ident(ctx, p->src + start, len);
+    } else {
+        calc_set_error(ctx, CALC_ERR_EXPECTED, parser_pos(p));
+        ctx->err.expected = ',';
+    }
+}
+
+/* Variable liée, suivie d'une virgule ; renvoie -1 en cas d'erreur */
+static int bound_variable(CalcContext *ctx, size_t start, size_t len,
+                          const char **var, size_t *var_len) {
+    Parser *p = &ctx->p;
+    skip_whitespace(p);
+    *var = p->cur;
+    if (!isalpha((unsigned char)*p->cur)) {
+        if (*p->cur == ')' || *p->cur == ',')
+            binder_syntax(ctx, start, len);
+        else
+            calc_set_error(ctx, CALC_ERR_UNEXPECTED, parser_pos(p));
+        return -1;
+    }
+    while (isalnum((unsigned char)*p->cur))
+        p->cur++;
+    *var_len = p->cur - *var;
+    skip_whitespace(p);
+    if (*p->cur != ',') {
+        binder_syntax(ctx, start, len);
+        return -1;
+    }
+    p->cur++;
+    return 0;
+}
+
+/* Ouvre le corps de l'appel du haut de la pile des groupes, terminé par
+   le caractère close : le code émis va désormais dans le tampon du
+   corps, jusqu'à end_body(). Renvoie -1 en cas d'erreur. */
+static int begin_body(CalcContext *ctx, char close) {
+    Parser *p = &ctx->p;
+    const OpenGroup *call = &p->groups[p->ngroups - 1];
+    size_t start = call->start;
+    /* le corps serait calculé en double dans un résultat à 30 chiffres */
+    if (ctx->precision == CALC_PRECISION_DD) {
+        calc_set_error(ctx, CALC_ERR_PRECISION, start);
+        return -1;
+    }
+    if (p->nbodies == CALC_MAX_NESTING) {
+        calc_set_error(ctx, CALC_ERR_NESTING, start);
+        return -1;
+    }
+    if (p->nbodies == p->bodies_cap) {
+        int cap = p->bodies_cap ? p->bodies_cap * 2 : 4;
+        BodyFrame *bodies = realloc(p->bodies, cap * sizeof(*bodies));
+        if (!bodies) {
+            calc_set_error(ctx, CALC_ERR_NOMEM, start);
+            return -1;
+        }
+        memset(bodies + p->bodies_cap, 0, (cap - p->bodies_cap) * sizeof(*bodies));
+        p->bodies = bodies;
+        p->bodies_cap = cap;
+    }
+    BodyFrame *f = &p->bodies[p->nbodies];
+    f->outer = p->out;
+    p->out = f->spare;
+    p->out.len = p->out.nconsts = 0;
+    p->out.depth = p->out.max_depth = p->out.nregs = 0;
+    p->out.nsubs = 0;
+    f->var = call->var;
+    f->var_len = call->var_len;
+    p->nbodies++;
+
+    OpenGroup *g = push_group(ctx, start);
+    if (!g)
+        return -1;
+    g->body = 1;
+    g->close = close;
+    g->start = start;
+    return 0;
+}
+
+/* Referme le dernier corps ouvert sans garder son code */
+static void pop_body(Parser *p) {
+    BodyFrame *f = &p->bodies[--p->nbodies];
+    calc_drop_subs(&p->out, 0);
+    f->spare = p->out;
+    p->out = f->outer;
+}
+
+static CalcProgram *build_program(CalcContext *ctx, int nvars, int dd);
+
+/* Fin du corps ouvert par begin_body() : il devient un programme, rangé
+   dans les corps du code extérieur. Ses variables sont la variable liée
+   puis celles du code extérieur. Il est toujours compilé en double (voir
+   calc_exec_binder). Une session n'optimise pas le code de l'expression,
+   qui doit rester le reflet du texte, mais le corps est un programme à
+   part, exécuté en boucle : il est optimisé comme par calc_compile(). */
+static void end_body(CalcContext *ctx) {
+    Parser *p = &ctx->p;
+    size_t start = p->groups[p->ngroups - 1].start;
+    int nvars = p->nvars + p->nbodies;
+    if (ctx->optimize || p->session)
+        calc_optimize(ctx);
+    CalcProgram *prog = build_program(ctx, nvars, 0);
+    pop_body(p);
+    p->ngroups--;
+    if (!prog)
+        return;
+    CodeBuf *out = &p->out;
+    if (out->nsubs == out->subs_cap) {
+        int cap = out->subs_cap ? out->subs_cap * 2 : 4;
+        CalcProgram **subs = realloc(out->subs, cap * sizeof(*subs));
+        if (!subs) {
+            calc_program_free(prog);
+            calc_set_error(ctx, CALC_ERR_NOMEM, start);
+            return;
+        }
+        out->subs = subs;
+        out->subs_cap = cap;
+    }
+    p->groups[p->ngroups - 1].sub = out->nsubs;
+    out->subs[out->nsubs++] = prog;
+}
+
+/* Opérateur à variable liée, après "name(" (ouvrante à la position open).
+   Le corps est compilé en un programme à part, exécuté autant de fois que
+   nécessaire ; le groupe de l'appel recevra les arguments numériques.
+   - name(corps, variable, args) : le corps s'arrête à la première
+     virgule hors de tout groupe, connue par scan_arguments(). La variable
+     est lue d'abord, puis l'analyse revient au corps et reprend après la
+     variable une fois le corps fermé ;
+   - name(variable, args, corps) (à partir de OP_FIRST_RANGE) : le corps
+     est ouvert après le dernier argument numérique (voir
+     parse_expression) et va jusqu'à la fermeture de l'appel.
+   Renvoie -1 en cas d'erreur. */
+static int parse_binder(CalcContext *ctx, int index, size_t open, size_t start, size_t len,
+                        int neg, size_t neg_pos) {
+    Parser *p = &ctx->p;
+    const CalcSymbol *sym = calc_symbol(index);
+    const char *body = p->cur, *var;
+    size_t var_len, resume = 0;
+    if (sym->op < OP_FIRST_RANGE) {
+        if (scan_arguments(ctx) < 0)
+            return -1;
+        p->cur = p->src + p->arg_end[open];
+        if (*p->cur != ',') {
+            binder_syntax(ctx, start, len);
+            return -1;
+        }
+        p->cur++;
+    }
+    if (bound_variable(ctx, start, len, &var, &var_len) < 0)
+        return -1;
+    if (sym->op < OP_FIRST_RANGE) {
+        resume = parser_pos(p);
+        p->cur = body;
+    }
+    OpenGroup *g = push_group(ctx, start);
+    if (!g)
+        return -1;
+    g->call = 1;
+    g->close = ')';
+    g->neg = neg;
+    g->neg_pos = neg_pos;
+    g->index = index;
+    g->len = len;
+    g->start = start;
+    g->sub = -1;
+    g->var = var - p->src;
+    g->var_len = var_len;
+    g->resume = resume;
+    if (resume)
+        return begin_body(ctx, ',');
+    return 0;
+}
+
+/* Lit un opérateur binaire après un facteur ; -1 si l'expression s'arrête */
+static int binary_operator(Parser *p, size_t *pos) {
+    *pos = parser_pos(p);
+    switch (*p->cur) {
+    case '^':
+        p->cur++;
+        return OP_POW;
+    case 'x':  /* multiplication */
+        p->cur++;
+        return OP_MUL;
+    case '/':
+        p->cur++;
+        if (*p->cur == '/') { /* division entière : "//" */
+            p->cur++;
+            return OP_IDIV;
+        }
+        return OP_DIV;
+    case '+':
+        p->cur++;
+        return OP_ADD;
+    case '-':
+        p->cur++;
+        return OP_SUB;
+    default:
+        return -1;
+    }
+}
+
+/* Analyse par précédence d'opérateurs (shunting-yard), avec des piles
+   explicites : ni la profondeur des groupes ni la longueur d'une tour
+   "2^2^...^2" ne consomment de pile native, et chaque caractère n'est lu
+   qu'une fois. Le code émis est le même que celui de la grammaire : les
+   suffixes '!' et '%' puis la négation s'appliquent au facteur dès qu'il
+   est complet, avant tout opérateur binaire.
+   Entre deux facteurs, tout l'état de l'analyse tient dans p->cur, les
+   deux piles et p->out : c'est là qu'une session peut le sauvegarder. */
+static void parse_expression(CalcContext *ctx) {
+    Parser *p = &ctx->p;
+    for (;;) {
+        if (p->session) {
+            calc_session_checkpoint(ctx);
+            if (ctx->err.code != CALC_OK)
+                return;
+        }
+        /* Un facteur : { '-' } primary */
+        skip_whitespace(p);
+        int neg = 0;
+        size_t neg_pos = parser_pos(p);
+        while (*p->cur == '-') {
+            neg = !neg;
+            p->cur++;
+            skip_whitespace(p);
+        }
+        size_t start = parser_pos(p);
+        if (isalpha((unsigned char)*p->cur)) {
+            /* Lecture de l'identifiant, puis recherche dans le registre */
+            const char *name = p->cur;
+            while (isalnum((unsigned char)*p->cur))
+                p->cur++;
+            size_t len = p->cur - name;
+            int index;
+            skip_whitespace(p);
+            if (*p->cur == '(') {
+                /* Appel de fonction */
+                index = calc_lookup(name, len);
+                size_t open = parser_pos(p);
+                p->cur++; /* sauter '(' */
+                skip_whitespace(p);
+                if (*p->cur == ')') {
+                    p->cur++; /* aucun argument */
+                    emit_function(ctx, index, len, start, 0, -1);
+                } else if (index >= 0 && calc_symbol(index)->kind == SYM_BINDER) {
+                    if (parse_binder(ctx, index, open, start, len, neg, neg_pos) < 0)
+                        return;
+                    continue; /* corps ou premier argument numérique */
+                } else {
+                    OpenGroup *g = push_group(ctx, start);
+                    if (!g)
+                        return;
+                    g->call = 1;
+                    g->close = ')';
+                    g->neg = neg;
+                    g->neg_pos = neg_pos;
+                    g->index = index;
+                    g->len = len;
+                    g->start = start;
+                    continue; /* premier argument */
+                }
+            } else if ((index = find_var(p, name, len)) >= 0) {
+                emit(ctx, OP_VAR, index, start);
+            } else {
+                /* Constante */
+                index = calc_lookup(name, len);
+                const CalcSymbol *sym = index >= 0 ? calc_symbol(index) : NULL;
+                if (!sym || sym->kind != SYM_CONST) {
+                    calc_set_error(ctx, CALC_ERR_UNKNOWN_IDENT, start);
+                    copy_ident(ctx, name, len);
+                    return;
+                }
+                if (!sym->pure)
+                    p->external = 1;
+                emit_const(ctx, sym->value, sym->lo, start);
+            }
+        } else if (isdigit((unsigned char)*p->cur) || *p->cur == '.') {
+            char *endptr;
+            double real_val = strtod(p->cur, &endptr);
+            double lo = dd_code(ctx)
+                        ? calc_dd_literal_lo(p->cur, endptr, real_val) : 0;
+            p->cur = endptr;
+            emit_const(ctx, real_val, lo, start);
+        } else if (*p->cur == '(' || *p->cur == '[' || *p->cur == '{') {
+            char open = *p->cur;
+            OpenGroup *g = push_group(ctx, start);
+            if (!g)
+                return;
+            if (open == '(') g->close = ')';
+            else if (open == '[') g->close = ']';
+            else /* if (open == '{') */ g->close = '}';
+            g->neg = neg;
+            g->neg_pos = neg_pos;
+            p->cur++; /* sauter le caractère d'ouverture */
+            continue;
+        } else {
+            calc_set_error(ctx, CALC_ERR_UNEXPECTED, start);
+        }
+
+        /* Le facteur est complet : suffixes, négation, puis opérateur
+           binaire, ou fermeture d'autant de groupes que nécessaire */
+        for (;;) {
+            if (ctx->err.code != CALC_OK)
+                return;
+            skip_whitespace(p);
+            while (*p->cur == '!' || *p->cur == '%') {
+                emit(ctx, *p->cur == '!' ? OP_FACT : OP_PERCENT, 0, parser_pos(p));
+                p->cur++;
+                skip_whitespace(p);
+            }
+            if (neg)
+                emit(ctx, OP_NEG, 0, neg_pos);
+
+            int base = p->ngroups ? p->groups[p->ngroups - 1].base : 0;
+            size_t pos;
+            int op = binary_operator(p, &pos);
+            if (op >= 0) {
+                reduce(ctx, base, op == OP_POW ? 4 : precedence(op));
+                push_op(ctx, op, pos);
+                break;
+            }
+            reduce(ctx, base, 0);
+            if (p->ngroups == 0)
+                return;
+
+            OpenGroup *g = &p->groups[p->ngroups - 1];
+            skip_whitespace(p);
+            if (g->body) {
+                /* Fin du corps d'un opérateur à variable liée ; le
+                   caractère de fermeture revient à l'appel */
+                if (*p->cur == ',' && g->close != ',') {
+                    calc_set_error(ctx, CALC_ERR_UNEXPECTED, parser_pos(p));
+                    return;
+                } else if (*p->cur != g->close) {
+                    calc_set_error(ctx, CALC_ERR_EXPECTED, parser_pos(p));
+                    ctx->err.expected = g->close;
+                    return;
+                }
+                end_body(ctx);
+                if (ctx->err.code != CALC_OK)
+                    return;
+                g = &p->groups[p->ngroups - 1];
+                if (g->resume) {
+                    p->cur = p->src + g->resume; /* variable déjà lue */
+                    break;
+                }
+            } else if (g->call) {
+                g->nargs++;
+                if (*p->cur == ',' && g->var_len && !g->resume &&
+                    g->nargs == calc_symbol(g->index)->min_args) {
+                    p->cur++; /* corps de sum() ou prod() */
+                    if (begin_body(ctx, ')') < 0)
+                        return;
+                    break;
+                } else if (*p->cur == ',') {
+                    p->cur++; /* argument suivant */
+                    break;
+                }
+            }
+            if (*p->cur != g->close) {
+                calc_set_error(ctx, CALC_ERR_EXPECTED, parser_pos(p));
+                ctx->err.expected = g->close;
+                return;
+            }
+            p->cur++; /* sauter le caractère de fermeture */
+            if (g->call)
+                emit_function(ctx, g->index, g->len, g->start, g->nargs, g->sub);
+            neg = g->neg;
+            neg_pos = g->neg_pos;
+            p->ngroups--;
+        }
+    }
+}
+
+/* ============================= */
+/* Partie API                    */
+/* ============================= */
+
+CalcContext *calc_context_new(void) {
+    CalcContext *ctx = calloc(1, sizeof(CalcContext));
+    if (!ctx)
+        return NULL;
+    ctx->optimize = 1;
+    ctx->jit = 1;
+    calc_stats_attach(&ctx->stats);
+    return ctx;
+}
+
+void calc_set_option(CalcContext *ctx, CalcOption option, int value) {
+    switch (option) {
+    case CALC_OPTION_OPTIMIZE:
+        ctx->optimize = value != 0;
+        break;
+    case CALC_OPTION_JIT:
+        ctx->jit = value != 0;
+        break;
+    case CALC_OPTION_PRECISION:
+        ctx->precision = value == CALC_PRECISION_DD ? CALC_PRECISION_DD : CALC_PRECISION_DOUBLE;
+        break;
+    }
+}
+
+void calc_context_free(CalcContext *ctx) {
+    if (!ctx)
+        return;
+    calc_stats_detach(&ctx->stats);
+    free_parser(&ctx->p);
+    calc_context_free(ctx->child);
+    free(ctx->stack);
+    free(ctx->rstack);
+    free(ctx->ddstack);
+    free(ctx->block);
+    free(ctx->dual);
+    free(ctx);
+}
+
+const CalcError *calc_last_error(const CalcContext *ctx) {
+    return &ctx->err;
+}
+
+void calc_program_free(CalcProgram *prog) {
+    if (!prog)
+        return;
+    calc_jit_free(prog);
+    for (int k = 0; k < prog->nsubs; k++)
+        calc_program_free(prog->subs[k]);
+    free(prog);
+}
+
+static void reset_error(CalcContext *ctx) {
+    memset(&ctx->err, 0, sizeof(ctx->err));
+}
+
+void calc_parse_from(CalcContext *ctx) {
+    Parser *p = &ctx->p;
+    p->nbodies = 0;
+    p->arg_scanned = 0;
+    parse_expression(ctx);
+    /* Après une erreur, les corps encore ouverts sont abandonnés */
+    while (p->nbodies > 0)
+        pop_body(p);
+    if (ctx->err.code != CALC_OK)
+        return;
+    skip_whitespace(p);
+    if (*p->cur != '\0' && *p->cur != '\n')
+        calc_set_error(ctx, CALC_ERR_UNEXPECTED, parser_pos(p));
+}
+
+/* optimize : passe d'optimisation sur le code de l'expression ; les corps
+   des opérateurs à variable liée suivent l'option du contexte */
+static CalcProgram *compile(CalcContext *ctx, const char *src, const char *const *vars, int nvars,
+                            int optimize) {
+    Parser *p = &ctx->p;
+    CodeBuf *out = &p->out;
+    reset_error(ctx);
+    p->src = p->cur = src;
+    p->vars = vars;
+    p->nvars = nvars;
+    p->nops = p->ngroups = 0;
+    p->external = 0;
+    /* Les tampons de génération sont conservés d'une compilation à l'autre */
+    out->len = out->nconsts = 0;
+    out->depth = out->max_depth = out->nregs = 0;
+    calc_drop_subs(out, 0);
+
+    calc_parse_from(ctx);
+    p->vars = NULL;
+    p->nvars = 0;
+    if (ctx->err.code != CALC_OK)
+        return NULL;
+    /* En double-double, les constantes précalculées en double perdraient
+       leur partie basse : pas d'optimisation */
+    int dd = ctx->precision == CALC_PRECISION_DD;
+    if (optimize && !dd)
+        calc_optimize(ctx);
+    return build_program(ctx, nvars, dd);
+}
+
+/* Construit le programme à partir du code de p.out, qui lui cède ses
+   corps compilés */
+static CalcProgram *build_program(CalcContext *ctx, int nvars, int dd) {
+    CodeBuf *out = &ctx->p.out;
+    /* Appels de fonctions du programme, ajoutés aux statistiques à
+       chaque exécution */
+    unsigned calls[CALC_STATS_FUNCS] = { 0 };
+    int nfuncs = 0;
+    for (int k = 0; k < out->len; k++) {
+        int slot = calc_stats_slot(&out->code[k]);
+        if (slot >= 0 && calls[slot]++ == 0)
+            nfuncs++;
+    }
+
+    /* Constantes, code, positions et appels regroupés dans un bloc contigu */
+    size_t consts_off = sizeof(CalcProgram);
+    consts_off = (consts_off + _Alignof(double complex) - 1) & ~(_Alignof(double complex) - 1);
+    size_t rconsts_off = consts_off + out->nconsts * sizeof(double complex);
+    size_t clo_off = rconsts_off + out->nconsts * sizeof(double);
+    size_t code_off = clo_off + (dd ? out->nconsts * sizeof(double) : 0);
+    size_t pos_off = code_off + out->len * sizeof(Instr);
+    size_t funcs_off = pos_off + out->len * sizeof(unsigned);
+    size_t subs_off = funcs_off + nfuncs * sizeof(struct ProgramFunc);
+    subs_off = (subs_off + _Alignof(CalcProgram *) - 1) & ~(_Alignof(CalcProgram *) - 1);
+    CalcProgram *prog = malloc(subs_off + out->nsubs * sizeof(CalcProgram *));
+    if (!prog) {
+        calc_set_error(ctx, CALC_ERR_NOMEM, 0);
+        return NULL;
+    }
+    prog->len = out->len;
+    prog->nconsts = out->nconsts;
+    prog->max_depth = out->max_depth;
+    prog->nregs = out->nregs;
+    prog->nvars = nvars;
+    prog->dd = dd;
+    prog->consts = (double complex *)((char *)prog + consts_off);
+    prog->rconsts = (double *)((char *)prog + rconsts_off);
+    prog->clo = dd ? (double *)((char *)prog + clo_off) : NULL;
+    prog->code = (Instr *)((char *)prog + code_off);
+    prog->pos = (unsigned *)((char *)prog + pos_off);
+    if (out->nconsts)
+        memcpy(prog->consts, out->consts, out->nconsts * sizeof(double complex));
+    if (out->nconsts)
+        memcpy(prog->rconsts, out->rconsts, out->nconsts * sizeof(double));
+    if (dd && out->nconsts)
+        memcpy(prog->clo, out->clo, out->nconsts * sizeof(double));
+    memcpy(prog->code, out->code, out->len * sizeof(Instr));
+    memcpy(prog->pos, out->pos, out->len * sizeof(unsigned));
+    prog->nfuncs = nfuncs;
+    prog->funcs = (struct ProgramFunc *)((char *)prog + funcs_off);
+    nfuncs = 0;
+    for (int k = 0; k < CALC_STATS_FUNCS; k++) {
+        if (calls[k]) {
+            prog->funcs[nfuncs].slot = k;
+            prog->funcs[nfuncs++].count = calls[k];
+        }
+    }
+    /* Les corps appartiennent désormais au programme */
+    prog->nsubs = out->nsubs;
+    prog->subs = (CalcProgram **)((char *)prog + subs_off);
+    if (out->nsubs)
+        memcpy(prog->subs, out->subs, out->nsubs * sizeof(CalcProgram *));
+    out->nsubs = 0;
+    prog->real_only = 1;
+    prog->binders = 0;
+    prog->nvars_used = 0;
+    for (int k = 0; k < out->len; k++) {
+        const Instr *ins = &out->code[k];
+        int used = 0;
+        if (ins->op == OP_CCONST)
+            prog->real_only = 0;
+        else if (ins->op == OP_VAR)
+            used = ins->arg + 1;
+        else if (ins->op >= OP_FIRST_BINDER) {
+            prog->binders = 1;
+            used = prog->subs[ins->arg]->nvars_used - 1;
+        }
+        if (used > prog->nvars_used)
+            prog->nvars_used = used;
+    }
+    calc_jit_init(prog, ctx->jit && !dd && !prog->binders);
+    return prog;
+}
+
+/* Compilation comptée (et parfois chronométrée) dans les statistiques */
+static CalcProgram *compile_sampled(CalcContext *ctx, const char *src,
+                                    const char *const *names, int nvars, int optimize) {
+    if (!STATS_ON())
+        return compile(ctx, src, names, nvars, optimize);
+    StatsBlock *st = &ctx->stats;
+    CalcProgram *prog;
+    if (atomic_load_explicit(&st->compiles, memory_order_relaxed) % CALC_STATS_SAMPLE == 0) {
+        unsigned long long t0 = calc_stats_now_ns();
+        prog = compile(ctx, src, names, nvars, optimize);
+        STAT_ADD(st->compile_ns, calc_stats_now_ns() - t0);
+        STAT_ADD(st->sampled_compiles, 1);
+    } else {
+        prog = compile(ctx, src, names, nvars, optimize);
+    }
+    STAT_ADD(st->compiles, 1);
+    if (!prog)
+        STAT_ADD(st->errors[ctx->err.code], 1);
+    return prog;
+}
+
+CalcProgram *calc_compile_vars(CalcContext *ctx, const char *src,
+                               const char *const *names, int nvars) {
+    return compile_sampled(ctx, src, names, nvars, ctx->optimize);
+}
+
+CalcProgram *calc_compile(CalcContext *ctx, const char *src) {
+    return calc_compile_vars(ctx, src, NULL, 0);
+}
+
+/* ============================= */
+/* Partie Exécution              */
+/* ============================= */
+
+/* n! pour n = 0..170, arrondi au plus près (exact jusqu'à 22!) */
+static const double fact_table[171] = {
+    1.0, 1.0, 2.0, 6.0,
+    24.0, 120.0, 720.0, 5040.0,
+    40320.0, 362880.0, 3628800.0, 39916800.0,
+    479001600.0, 6227020800.0, 87178291200.0, 1307674368000.0,
+    20922789888000.0, 355687428096000.0, 6402373705728000.0, 1.21645100408832e+17,
+    2.43290200817664e+18, 5.109094217170944e+19, 1.1240007277776077e+21, 2.585201673888498e+22,
+    6.204484017332394e+23, 1.5511210043330986e+25, 4.0329146112660565e+26, 1.0888869450418352e+28,
+    3.0488834461171387e+29, 8.841761993739702e+30, 2.6525285981219107e+32, 8.222838654177922e+33,
+    2.631308369336935e+35, 8.683317618811886e+36, 2.9523279903960416e+38, 1.0333147966386145e+40,
+    3.7199332678990125e+41, 1.3763753091226346e+43, 5.230226174666011e+44, 2.0397882081197444e+46,
+    8.159152832478977e+47, 3.345252661316381e+49, 1.40500611775288e+51, 6.041526306337383e+52,
+    2.658271574788449e+54, 1.1962222086548019e+56, 5.502622159812089e+57, 2.5862324151116818e+59,
+    1.2413915592536073e+61, 6.082818640342675e+62, 3.0414093201713376e+64, 1.5511187532873822e+66,
+    8.065817517094388e+67, 4.2748832840600255e+69, 2.308436973392414e+71, 1.2696403353658276e+73,
+    7.109985878048635e+74, 4.0526919504877214e+76, 2.3505613312828785e+78, 1.3868311854568984e+80,
+    8.32098711274139e+81, 5.075802138772248e+83, 3.146997326038794e+85, 1.98260831540444e+87,
+    1.2688693218588417e+89, 8.247650592082472e+90, 5.443449390774431e+92, 3.647111091818868e+94,
+    2.4800355424368305e+96, 1.711224524281413e+98, 1.1978571669969892e+100, 8.504785885678623e+101,
+    6.1234458376886085e+103, 4.4701154615126844e+105, 3.307885441519386e+107, 2.48091408113954e+109,
+    1.8854947016660504e+111, 1.4518309202828587e+113, 1.1324281178206297e+115, 8.946182130782976e+116,
+    7.156945704626381e+118, 5.797126020747368e+120, 4.753643337012842e+122, 3.945523969720659e+124,
+    3.314240134565353e+126, 2.81710411438055e+128, 2.4227095383672734e+130, 2.107757298379528e+132,
+    1.8548264225739844e+134, 1.650795516090846e+136, 1.4857159644817615e+138, 1.352001527678403e+140,
+    1.2438414054641308e+142, 1.1567725070816416e+144, 1.087366156656743e+146, 1.032997848823906e+148,
+    9.916779348709496e+149, 9.619275968248212e+151, 9.426890448883248e+153, 9.332621544394415e+155,
+    9.332621544394415e+157, 9.42594775983836e+159, 9.614466715035127e+161, 9.90290071648618e+163,
+    1.0299016745145628e+166, 1.081396758240291e+168, 1.1462805637347084e+170, 1.226520203196138e+172,
+    1.324641819451829e+174, 1.4438595832024937e+176, 1.588245541522743e+178, 1.7629525510902446e+180,
+    1.974506857221074e+182, 2.2311927486598138e+184, 2.5435597334721877e+186, 2.925093693493016e+188,
+    3.393108684451898e+190, 3.969937160808721e+192, 4.684525849754291e+194, 5.574585761207606e+196,
+    6.689502913449127e+198, 8.094298525273444e+200, 9.875044200833601e+202, 1.214630436702533e+205,
+    1.506141741511141e+207, 1.882677176888926e+209, 2.372173242880047e+211, 3.0126600184576594e+213,
+    3.856204823625804e+215, 4.974504222477287e+217, 6.466855489220474e+219, 8.47158069087882e+221,
+    1.1182486511960043e+224, 1.4872707060906857e+226, 1.9929427461615188e+228, 2.6904727073180504e+230,
+    3.659042881952549e+232, 5.012888748274992e+234, 6.917786472619489e+236, 9.615723196941089e+238,
+    1.3462012475717526e+241, 1.898143759076171e+243, 2.695364137888163e+245, 3.854370717180073e+247,
+    5.5502938327393044e+249, 8.047926057471992e+251, 1.1749972043909107e+254, 1.727245890454639e+256,
+    2.5563239178728654e+258, 3.80892263763057e+260, 5.713383956445855e+262, 8.62720977423324e+264,
+    1.3113358856834524e+267, 2.0063439050956823e+269, 3.0897696138473508e+271, 4.789142901463394e+273,
+    7.471062926282894e+275, 1.1729568794264145e+278, 1.853271869493735e+280, 2.9467022724950384e+282,
+    4.7147236359920616e+284, 7.590705053947219e+286, 1.2296942187394494e+289, 2.0044015765453026e+291,
+    3.287218585534296e+293, 5.423910666131589e+295, 9.003691705778438e+297, 1.503616514864999e+300,
+    2.5260757449731984e+302, 4.269068009004705e+304, 7.257415615307999e+306
+};
+
+double calc_factorial(double x) {
+    if (x >= 0 && x <= 170 && x == (int)x)
+        return fact_table[(int)x];
+    return tgamma(x + 1);
+}
+
+/* x^n par élévations au carré successives (OP_POWI) */
+double calc_powi(double x, int n) {
+    double r = 1;
+    for (;;) {
+        if (n & 1)
+            r *= x;
+        n >>= 1;
+        if (!n)
+            return r;
+        x *= x;
+    }
+}
+
+/* Exécution en nombres complexes : le cas général */
+CalcErrorCode calc_exec_complex(CalcContext *ctx, const CalcProgram *prog, int from, int to,
+                                double complex *stack, int *depth) {
+    double complex *regs = stack + prog->max_depth;
+    const Instr *ip = prog->code + from;
+    const Instr *end = prog->code + to;
+    double complex *sp = stack + *depth; /* pointe sur la première case libre */
+
+    for (; ip < end; ip++) {
+        switch (ip->op) {
+        case OP_CONST:
+        case OP_CCONST:
+            *sp++ = prog->consts[ip->arg];
+            break;
+        case OP_ADD:
+            sp--;
+            sp[-1] += sp[0];
+            break;
+        case OP_SUB:
+            sp--;
+            sp[-1] -= sp[0];
+            break;
+        case OP_MUL:
+            sp--;
+            sp[-1] *= sp[0];
+            break;
+        case OP_DIV:
+            sp--;
+            if (cabs(sp[0]) < 1e-12)
+                goto fail_div;
+            sp[-1] /= sp[0];
+            break;
+        case OP_IDIV:
+            sp--;
+            if (cabs(sp[0]) < 1e-12)
+                goto fail_idiv;
+            sp[-1] = trunc(creal(sp[-1]) / creal(sp[0]));
+            break;
+        case OP_POW:
+            sp--;
+            sp[-1] = cpow(sp[-1], sp[0]);
+            break;
+        case OP_NEG:
+            sp[-1] = -sp[-1];
+            break;
+        case OP_FACT:
+            /* Factorielle définie uniquement pour les réels non négatifs */
+            if (cimag(sp[-1]) != 0 || creal(sp[-1]) < 0)
+                goto fail_fact;
+            sp[-1] = calc_factorial(creal(sp[-1]));
+            break;
+        case OP_PERCENT:
+            sp[-1] = sp[-1] / 100.0;
+            break;
+        case OP_LOG:
+            sp[-1] = clog(sp[-1]);
+            break;
+        case OP_COS:
+            sp[-1] = ccos(sp[-1]);
+            break;
+        case OP_SIN:
+            sp[-1] = csin(sp[-1]);
+            break;
+        case OP_TAN:
+            sp[-1] = ctan(sp[-1]);
+            break;
+        case OP_ACOS:
+            sp[-1] = cacos(sp[-1]);
+            break;
+        case OP_ASIN:
+            sp[-1] = casin(sp[-1]);
+            break;
+        case OP_ATAN:
+            sp[-1] = catan(sp[-1]);
+            break;
+        case OP_SQRT:
+            sp[-1] = csqrt(sp[-1]);
+            break;
+        case OP_ROOT:
+            sp--;
+            sp[-1] = cpow(sp[-1], 1.0 / sp[0]);
+            break;
+        case OP_CALL:
+            sp -= ip->argc;
+            *sp = calc_symbol(ip->arg)->cfn(sp, ip->argc);
+            sp++;
+            break;
+        case OP_POWI:
+            /* x^n réécrit par opt.c : cpow() comme le programme d'origine */
+            sp[-1] = cpow(sp[-1], ip->arg);
+            break;
+        case OP_SCALE:
+            /* x / c réécrit par opt.c : la division complexe par 1/c (exacte)
+               donne les mêmes zéros signés que le programme d'origine */
+            sp--;
+            sp[-1] /= CMPLX(1.0 / creal(sp[0]), 0.0);
+            break;
+        case OP_STORE:
+            regs[ip->arg] = sp[-1];
+            break;
+        case OP_LOAD:
+            *sp++ = regs[ip->arg];
+            break;
+        case OP_VAR:
+            *sp++ = ctx->vars[ip->arg];
+            break;
+        case OP_INTEGRATE:
+        case OP_SOLVE:
+        case OP_DIFF:
+        case OP_SUM:
+        case OP_PROD:
+            sp -= ip->argc;
+            if (calc_exec_binder(ctx, prog, ip, sp, sp) != CALC_OK)
+                return ctx->err.code;
+            sp++;
+            break;
+        }
+    }
+    *depth = sp - stack;
+    return CALC_OK;
+
+fail_div:
+    calc_set_error(ctx, CALC_ERR_DIV_ZERO, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+fail_idiv:
+    calc_set_error(ctx, CALC_ERR_IDIV_ZERO, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+fail_fact:
+    calc_set_error(ctx, CALC_ERR_FACTORIAL, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+}
+
+/* Exécution chronométrée : le programme est découpé autour de chaque
+   appel de fonction, dont la durée est mesurée à part */
+static int exec_timed(CalcContext *ctx, const CalcProgram *prog, void *stack, int *depth, int real) {
+    int from = 0, code;
+    for (int k = 0; k <= prog->len; k++) {
+        int slot = k < prog->len ? calc_stats_slot(&prog->code[k]) : -1;
+        if (slot < 0 && k < prog->len)
+            continue;
+        code = real ? calc_exec_real(ctx, prog, from, k, stack, depth)
+                    : (int)calc_exec_complex(ctx, prog, from, k, stack, depth);
+        if (code != CALC_OK || k == prog->len)
+            return code;
+        unsigned long long t0 = calc_stats_now_ns();
+        code = real ? calc_exec_real(ctx, prog, k, k + 1, stack, depth)
+                    : (int)calc_exec_complex(ctx, prog, k, k + 1, stack, depth);
+        FuncCounters *f = &ctx->stats.funcs[slot];
+        STAT_ADD(f->sampled_ns, calc_stats_now_ns() - t0);
+        STAT_ADD(f->sampled, 1);
+        if (code != CALC_OK)
+            return code;
+        from = k + 1;
+    }
+    return CALC_OK;
+}
+
+static CalcErrorCode run_complex(CalcContext *ctx, const CalcProgram *prog, double complex *result) {
+    double complex local[64];
+    double complex *stack = local;
+    int need = prog->max_depth + prog->nregs;
+    if (need > 64) {
+        if (need > ctx->stack_cap) {
+            double complex *s = realloc(ctx->stack, need * sizeof(double complex));
+            if (!s) {
+                calc_set_error(ctx, CALC_ERR_NOMEM, 0);
+                return CALC_ERR_NOMEM;
+            }
+            ctx->stack = s;
+            ctx->stack_cap = need;
+        }
+        stack = ctx->stack;
+    }
+    int depth = 0;
+    CalcErrorCode code = ctx->timed ? (CalcErrorCode)exec_timed(ctx, prog, stack, &depth, 0)
+                                    : calc_exec_complex(ctx, prog, 0, prog->len, stack, &depth);
+    if (code == CALC_OK)
+        *result = stack[depth - 1];
+    return code;
+}
+
+/* Exécution d'un programme réel en double, avec les fonctions réelles de
+   libm. Dès qu'une opération sortirait des réels (racine ou logarithme
+   d'un négatif, arccos/arcsin hors de [-1, 1], puissance non entière
+   d'un négatif), ou qu'un infini apparaît, on abandonne et le programme
+   est relancé en complexe : le résultat est alors celui de run_complex().
+   Il en va de même d'un produit, d'un quotient ou d'une puissance nuls :
+   le signe de ce zéro dépend en complexe de celui des parties
+   imaginaires nulles, que le chemin réel ne suit pas. */
+int calc_exec_real(CalcContext *ctx, const CalcProgram *prog, int from, int to,
+                   double *stack, int *depth) {
+    double *regs = stack + prog->max_depth;
+    const Instr *ip = prog->code + from;
+    const Instr *end = prog->code + to;
+    double *sp = stack + *depth; /* pointe sur la première case libre */
+
+    for (; ip < end; ip++) {
+        switch (ip->op) {
+        case OP_CONST:
+            *sp++ = prog->rconsts[ip->arg];
+            break;
+        case OP_CCONST:
+            return RUN_PROMOTE;
+        case OP_ADD:
+            sp--;
+            sp[-1] += sp[0];
+            break;
+        case OP_SUB:
+            sp--;
+            sp[-1] -= sp[0];
+            break;
+        case OP_MUL:
+            sp--;
+            sp[-1] *= sp[0];
+            if (sp[-1] == 0)
+                return RUN_PROMOTE;
+            break;
+        case OP_DIV:
+            sp--;
+            if (fabs(sp[0]) < 1e-12)
+                goto fail_div;
+            if (!isfinite(sp[0]))
+                return RUN_PROMOTE;
+            sp[-1] /= sp[0];
+            if (sp[-1] == 0)
+                return RUN_PROMOTE;
+            break;
+        case OP_IDIV:
+            sp--;
+            if (fabs(sp[0]) < 1e-12)
+                goto fail_idiv;
+            if (!isfinite(sp[0]))
+                return RUN_PROMOTE;
+            sp[-1] = trunc(sp[-1] / sp[0]);
+            break;
+        case OP_POW:
+            sp--;
+            /* 0^y est laissé à cpow (0^0 y donne NaN) */
+            if (sp[-1] == 0 || (sp[-1] < 0 && sp[0] != trunc(sp[0])) ||
+                !isfinite(sp[-1]) || !isfinite(sp[0]))
+                return RUN_PROMOTE;
+            sp[-1] = pow(sp[-1], sp[0]);
+            if (!isfinite(sp[-1]) || sp[-1] == 0)
+                return RUN_PROMOTE;
+            break;
+        case OP_NEG:
+            sp[-1] = -sp[-1];
+            break;
+        case OP_FACT:
+            if (sp[-1] < 0)
+                goto fail_fact;
+            sp[-1] = calc_factorial(sp[-1]);
+            break;
+        case OP_PERCENT:
+            sp[-1] = sp[-1] / 100.0;
+            break;
+        case OP_LOG:
+            if (sp[-1] <= 0)
+                return RUN_PROMOTE;
+            sp[-1] = log(sp[-1]);
+            break;
+        case OP_COS:
+            sp[-1] = cos(sp[-1]);
+            break;
+        case OP_SIN:
+            sp[-1] = sin(sp[-1]);
+            break;
+        case OP_TAN:
+            sp[-1] = tan(sp[-1]);
+            break;
+        case OP_ACOS:
+            if (fabs(sp[-1]) > 1)
+                return RUN_PROMOTE;
+            sp[-1] = acos(sp[-1]);
+            break;
+        case OP_ASIN:
+            if (fabs(sp[-1]) > 1)
+                return RUN_PROMOTE;
+            sp[-1] = asin(sp[-1]);
+            break;
+        case OP_ATAN:
+            if (!isfinite(sp[-1]))
+                return RUN_PROMOTE;
+            sp[-1] = atan(sp[-1]);
+            break;
+        case OP_SQRT:
+            if (sp[-1] < 0)
+                return RUN_PROMOTE;
+            sp[-1] = sqrt(sp[-1]) + 0.0; /* csqrt(-0) = +0 */
+            break;
+        case OP_ROOT:
+            sp--;
+            if (sp[-1] <= 0 || sp[0] == 0 || !isfinite(sp[-1]) || !isfinite(sp[0]))
+                return RUN_PROMOTE;
+            sp[-1] = pow(sp[-1], 1.0 / sp[0]);
+            if (!isfinite(sp[-1]) || sp[-1] == 0)
+                return RUN_PROMOTE;
+            break;
+        case OP_CALL: {
+            const CalcSymbol *sym = calc_symbol(ip->arg);
+            double res;
+            sp -= ip->argc;
+            if (sym->rfn) {
+                res = sym->rfn(sp, ip->argc);
+            } else {
+                /* Pas de version réelle : appel complexe, en restant dans
+                   les réels tant que le résultat l'est */
+                double complex cargs[16];
+                if (ip->argc > 16)
+                    return RUN_PROMOTE;
+                for (int k = 0; k < ip->argc; k++)
+                    cargs[k] = sp[k];
+                double complex z = sym->cfn(cargs, ip->argc);
+                if (cimag(z) != 0)
+                    return RUN_PROMOTE;
+                res = creal(z);
+            }
+            if (!isfinite(res))
+                return RUN_PROMOTE;
+            *sp++ = res;
+            break;
+        }
+        case OP_POWI:
+            /* base nulle laissée à cpow(), comme pour OP_POW */
+            if (sp[-1] == 0 || !isfinite(sp[-1]))
+                return RUN_PROMOTE;
+            sp[-1] = calc_powi(sp[-1], ip->arg);
+            if (!isfinite(sp[-1]) || sp[-1] == 0)
+                return RUN_PROMOTE;
+            break;
+        case OP_SCALE:
+            sp--;
+            sp[-1] *= sp[0];
+            if (sp[-1] == 0)
+                return RUN_PROMOTE;
+            break;
+        case OP_STORE:
+            regs[ip->arg] = sp[-1];
+            break;
+        case OP_LOAD:
+            *sp++ = regs[ip->arg];
+            break;
+        case OP_VAR:
+            *sp++ = creal(ctx->vars[ip->arg]);
+            break;
+        case OP_INTEGRATE:
+        case OP_SOLVE:
+        case OP_DIFF:
+        case OP_SUM:
+        case OP_PROD: {
+            double complex args[4], z;
+            sp -= ip->argc;
+            for (int k = 0; k < ip->argc; k++)
+                args[k] = sp[k];
+            if (calc_exec_binder(ctx, prog, ip, args, &z) != CALC_OK)
+                return ctx->err.code;
+            if (cimag(z) != 0 || !isfinite(creal(z)))
+                return RUN_PROMOTE;
+            *sp++ = creal(z);
+            break;
+        }
+        }
+    }
+    *depth = sp - stack;
+    return CALC_OK;
+
+fail_div:
+    calc_set_error(ctx, CALC_ERR_DIV_ZERO, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+fail_idiv:
+    calc_set_error(ctx, CALC_ERR_IDIV_ZERO, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+fail_fact:
+    calc_set_error(ctx, CALC_ERR_FACTORIAL, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+}
+
+static int run_real(CalcContext *ctx, const CalcProgram *prog, double *result) {
+    double local[64];
+    double *stack = local;
+    int need = prog->max_depth + prog->nregs;
+    if (need > 64) {
+        if (need > ctx->rstack_cap) {
+            double *s = realloc(ctx->rstack, need * sizeof(double));
+            if (!s)
+                return RUN_PROMOTE; /* le chemin complexe signalera l'erreur */
+            ctx->rstack = s;
+            ctx->rstack_cap = need;
+        }
+        stack = ctx->rstack;
+    }
+    /* Le code natif renvoie 1 pour tout ce qui sort du cas courant
+       (erreur, résultat non fini) : l'interpréteur reprend alors depuis
+       le début et produit l'erreur ou le résultat habituels */
+    CalcJitFn fn;
+    if (!ctx->timed && (fn = calc_jit_get(prog)) && fn(stack, prog->rconsts, ctx->vars) == 0) {
+        *result = stack[0];
+        return CALC_OK;
+    }
+    int depth = 0;
+    int code = ctx->timed ? exec_timed(ctx, prog, stack, &depth, 1)
+                          : calc_exec_real(ctx, prog, 0, prog->len, stack, &depth);
+    if (code != CALC_OK)
+        return code;
+    /* Les infinis et NaN réels et complexes ne s'affichent pas de la même
+       façon : on laisse le chemin complexe produire le résultat habituel.
+       De même, les opérations qui peuvent absorber un infini (division,
+       arctan, puissances) passent la main au complexe. */
+    if (!isfinite(stack[depth - 1]))
+        return RUN_PROMOTE;
+    *result = stack[depth - 1];
+    return CALC_OK;
+}
+
+CalcErrorCode calc_exec_program(CalcContext *ctx, const CalcProgram *prog, double complex *result) {
+    reset_error(ctx);
+    if (prog->dd) {
+        CalcDDComplex res;
+        CalcErrorCode code = calc_exec_dd(ctx, prog, &res);
+        if (code == CALC_OK)
+            *result = CMPLX(res.re.hi, res.im.hi);
+        return code;
+    }
+    /* Un opérateur à variable liée déjà calculé par le chemin réel ne
+       l'est pas une seconde fois par le complexe */
+    ctx->memo_on = prog->binders;
+    ctx->nmemo = 0;
+    if (prog->real_only && ctx->vars_real) {
+        double res;
+        int code = run_real(ctx, prog, &res);
+        if (code != RUN_PROMOTE) {
+            ctx->memo_on = 0;
+            if (code == CALC_OK)
+                *result = res;
+            return code;
+        }
+    }
+    CalcErrorCode code = run_complex(ctx, prog, result);
+    ctx->memo_on = 0;
+    return code;
+}
+
+/* Les échantillons de durée totale et ceux de durée par fonction sont
+   pris sur des exécutions différentes, pour que les mesures des uns ne
+   faussent pas les autres */
+static CalcErrorCode run(CalcContext *ctx, const CalcProgram *prog, double complex *result) {
+    if (!STATS_ON())
+        return calc_exec_program(ctx, prog, result);
+    StatsBlock *st = &ctx->stats;
+    unsigned long long n = atomic_load_explicit(&st->runs, memory_order_relaxed);
+    CalcErrorCode code;
+    if (n % CALC_STATS_SAMPLE == 0) {
+        unsigned long long t0 = calc_stats_now_ns();
+        code = calc_exec_program(ctx, prog, result);
+        STAT_ADD(st->run_ns, calc_stats_now_ns() - t0);
+        STAT_ADD(st->sampled_runs, 1);
+    } else if (n % CALC_STATS_SAMPLE == CALC_STATS_SAMPLE / 2 && prog->nfuncs > 0) {
+        ctx->timed = 1;
+        code = calc_exec_program(ctx, prog, result);
+        ctx->timed = 0;
+    } else {
+        code = calc_exec_program(ctx, prog, result);
+    }
+    STAT_ADD(st->runs, 1);
+    for (int k = 0; k < prog->nfuncs; k++)
+        STAT_ADD(st->funcs[prog->funcs[k].slot].calls, prog->funcs[k].count);
+    if (code != CALC_OK)
+        STAT_ADD(st->errors[code], 1);
+    return code;
+}
+
+static CalcErrorCode missing_vars(CalcContext *ctx) {
+    reset_error(ctx);
+    calc_set_error(ctx, CALC_ERR_VARIABLE, 0);
+    if (STATS_ON())
+        STAT_ADD(ctx->stats.errors[CALC_ERR_VARIABLE], 1);
+    return CALC_ERR_VARIABLE;
+}
+
+CalcErrorCode calc_run_vars(CalcContext *ctx, const CalcProgram *prog,
+                            const double complex *values, double complex *result) {
+    if (prog->nvars > 0 && !values)
+        return missing_vars(ctx);
+    ctx->vars = values;
+    ctx->vars_real = 1;
+    for (int k = 0; k < prog->nvars; k++)
+        if (cimag(values[k]) != 0)
+            ctx->vars_real = 0;
+    CalcErrorCode code = run(ctx, prog, result);
+    ctx->vars = NULL;
+    return code;
+}
+
+CalcErrorCode calc_run(CalcContext *ctx, const CalcProgram *prog, double complex *result) {
+    return calc_run_vars(ctx, prog, NULL, result);
+}
+
+/* Statistiques des exécutions qui ne passent pas par run() */
+static void count_run(CalcContext *ctx, const CalcProgram *prog, CalcErrorCode code) {
+    if (!STATS_ON())
+        return;
+    StatsBlock *st = &ctx->stats;
+    STAT_ADD(st->runs, 1);
+    for (int k = 0; k < prog->nfuncs; k++)
+        STAT_ADD(st->funcs[prog->funcs[k].slot].calls, prog->funcs[k].count);
+    if (code != CALC_OK)
+        STAT_ADD(st->errors[code], 1);
+}
+
+CalcErrorCode calc_run_dd(CalcContext *ctx, const CalcProgram *prog,
+                          const double complex *values, CalcDDComplex *result) {
+    if (prog->nvars > 0 && !values)
+        return missing_vars(ctx);
+    reset_error(ctx);
+    ctx->vars = values;
+    CalcErrorCode code = calc_exec_dd(ctx, prog, result);
+    ctx->vars = NULL;
+    count_run(ctx, prog, code);
+    return code;
+}
+
+CalcErrorCode calc_run_dual(CalcContext *ctx, const CalcProgram *prog,
+                            const double complex *values, const double complex *direction,
+                            double complex *result, double complex *deriv) {
+    if (prog->nvars > 0 && (!values || !direction))
+        return missing_vars(ctx);
+    ctx->vars = values;
+    CalcErrorCode code = calc_exec_dual(ctx, prog, direction, 1, result, deriv);
+    ctx->vars = NULL;
+    count_run(ctx, prog, code);
+    return code;
+}
+
+CalcErrorCode calc_run_gradient(CalcContext *ctx, const CalcProgram *prog,
+                                const double complex *values, double complex *result,
+                                double complex *grad) {
+    if (prog->nvars > 0 && !values)
+        return missing_vars(ctx);
+    ctx->vars = values;
+    CalcErrorCode code = calc_exec_dual(ctx, prog, NULL, prog->nvars, result, grad);
+    ctx->vars = NULL;
+    count_run(ctx, prog, code);
+    return code;
+}
+
+/* Précalcul d'un programme constant (opt.c) : on garde la valeur de chacun
+   des deux chemins, pour que le programme optimisé donne exactement ce
+   qu'aurait donné l'original. *real_ok vaut 0 si le chemin réel aurait
+   basculé en complexe. */
+CalcErrorCode calc_run_both(CalcContext *ctx, const CalcProgram *prog,
+                            double complex *cres, double *rres, int *real_ok) {
+    reset_error(ctx);
+    *real_ok = 0;
+    /* Les opérateurs à variable liée ne sont calculés qu'une fois */
+    ctx->memo_on = 1;
+    ctx->nmemo = 0;
+    CalcErrorCode code = run_complex(ctx, prog, cres);
+    int rcode = code;
+    if (code == CALC_OK && prog->real_only) {
+        rcode = run_real(ctx, prog, rres);
+        if (rcode == RUN_PROMOTE)
+            rcode = CALC_OK;
+        else
+            *real_ok = rcode == CALC_OK;
+    }
+    ctx->memo_on = 0;
+    return rcode;
+}
+
+/* Le programme n'est exécuté qu'une fois : l'optimiser coûterait plus
+   qu'il ne rapporte. Seuls les corps des opérateurs à variable liée,
+   exécutés en boucle, le sont (end_body). */
+static CalcErrorCode eval(CalcContext *ctx, const char *src, double complex *result) {
+    CalcProgram *prog = compile_sampled(ctx, src, NULL, 0, 0);
+    if (!prog)
+        return ctx->err.code;
+    CalcErrorCode code = calc_run(ctx, prog, result);
+    calc_program_free(prog);
+    return code;
+}
+
+/* La latence est mesurée à l'écart des échantillons de calc_compile()
+   et calc_run() */
+CalcErrorCode calc_eval(CalcContext *ctx, const char *src, double complex *result) {
+    if (!STATS_ON())
+        return eval(ctx, src, result);
+    StatsBlock *st = &ctx->stats;
+    unsigned long long n = atomic_load_explicit(&st->evals, memory_order_relaxed);
+    STAT_ADD(st->evals, 1);
+    if (n % CALC_STATS_SAMPLE != CALC_STATS_SAMPLE / 4)
+        return eval(ctx, src, result);
+    unsigned long long t0 = calc_stats_now_ns();
+    CalcErrorCode code = eval(ctx, src, result);
+    calc_stats_latency(st, calc_stats_now_ns() - t0);
+    return code;
+}
+
+CalcErrorCode calc_eval_dd(CalcContext *ctx, const char *src, CalcDDComplex *result) {
+    int precision = ctx->precision;
+    ctx->precision = CALC_PRECISION_DD;
+    CalcProgram *prog = calc_compile(ctx, src);
+    ctx->precision = precision;
+    if (!prog)
+        return ctx->err.code;
+    CalcErrorCode code = calc_run_dd(ctx, prog, NULL, result);
+    calc_program_free(prog);
+    return code;
+}
+
+/* ============================= */
+/* Partie Messages               */
+/* ============================= */
+
+const char *calc_strerror(CalcErrorCode code) {
+    switch (code) {
+    case CALC_OK:                return "pas d'erreur";
+    case CALC_ERR_NOMEM:         return "mémoire insuffisante";
+    case CALC_ERR_UNEXPECTED:    return "caractère inattendu";
+    case CALC_ERR_EXPECTED:      return "fermeture attendue";
+    case CALC_ERR_UNKNOWN_FUNC:  return "fonction inconnue";
+    case CALC_ERR_UNKNOWN_IDENT: return "identifiant inconnu";
+    case CALC_ERR_DIV_ZERO:      return "division par 0";
+    case CALC_ERR_IDIV_ZERO:     return "division entière par 0";
+    case CALC_ERR_FACTORIAL:     return "factorielle d'un nombre négatif ou complexe non supportée";
+    case CALC_ERR_ARITY:         return "nombre d'arguments invalide";
+    case CALC_ERR_REGISTER:      return "enregistrement de symbole refusé";
+    case CALC_ERR_CANCELLED:     return "évaluation interrompue";
+    case CALC_ERR_VARIABLE:      return "valeurs des variables manquantes";
+    case CALC_ERR_NO_ROOT:       return "aucune racine trouvée";
+    case CALC_ERR_BOUNDS:        return "bornes invalides";
+    case CALC_ERR_DIVERGENT:     return "l'intégrale ne converge pas";
+    case CALC_ERR_NESTING:       return "opérateurs trop imbriqués";
+    case CALC_ERR_DERIVATIVE:    return "dérivée non calculable";
+    case CALC_ERR_PRECISION:     return "opérateur calculé en double seulement";
+    default:                     return "erreur inconnue";
+    }
+}
+
+int calc_format_error(const CalcError *err, char *buf, size_t size) {
+    switch (err->code) {
+    case CALC_ERR_EXPECTED:
+        return snprintf(buf, size, "Erreur : '%c' attendue (position %zu)", err->expected, err->pos);
+    case CALC_ERR_UNKNOWN_FUNC:
+        return snprintf(buf, size, "Erreur : fonction inconnue '%s' (position %zu)", err->ident, err->pos);
+    case CALC_ERR_ARITY:
+        return snprintf(buf, size, "Erreur : nombre d'arguments invalide pour '%s' (position %zu)",
+                        err->ident, err->pos);
+    case CALC_ERR_UNKNOWN_IDENT:
+        return snprintf(buf, size, "Erreur : identifiant inconnu '%s' (position %zu)", err->ident, err->pos);
+    default:
+        return snprintf(buf, size, "Erreur : %s (position %zu)", calc_strerror(err->code), err->pos);
+    }
+}
+
+int calc_format_result(double complex res, char *buf, size_t size) {
+    if (fabs(cimag(res)) < 1e-12)
+        return snprintf(buf, size, "%g", creal(res));
+    return snprintf(buf, size, "%g+%gi", creal(res), cimag(res));
+}
+
+/* Écriture la plus courte, de 15 à 17 chiffres, qui relit x */
+static void format_full(double x, char *buf, size_t size) {
+    for (int digits = 15; digits <= 17; digits++) {
+        snprintf(buf, size, "%.*g", digits, x);
+        if (strtod(buf, NULL) == x || !isfinite(x))
+            return;
+    }
+}
+
+int calc_format_result_full(double complex res, char *buf, size_t size) {
+    char re[32], im[32];
+    format_full(creal(res), re, sizeof(re));
+    if (fabs(cimag(res)) < 1e-12)
+        return snprintf(buf, size, "%s", re);
+    format_full(cimag(res), im, sizeof(im));
+    return snprintf(buf, size, "%s+%si", re, im);
+}
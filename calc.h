@@ -0,0 +1,270 @@
+#ifndef CALC_H
+#define CALC_H
+
+#include <stddef.h>
+#include <complex.h>
+
+/* ============================= */
+/* libcalc : évaluateur d'expressions */
+/* Grammaire :
+     expression = term { ('+' | '-') term }
+     term       = power { ( 'x' | '/' | "//" ) power }
+     power      = factor [ '^' power ]          (droite associativité)
+     factor     = { '-' } primary { ('!' | '%') }
+     primary    = func_call | constant | number | group
+     func_call  = ident '(' arglist ')'
+     arglist    = expression { ',' expression }
+     constant   = ident         (ou variable, voir calc_compile_vars)
+     ident      = lettre { lettre | chiffre }
+     group      = '(' expression ')' | '[' expression ']' | '{' expression '}'
+   L'analyse se fait sans récursion : la longueur de l'expression et la
+   profondeur des groupes ne sont limitées que par la mémoire.
+
+   Les fonctions et constantes sont recherchées dans un registre (table
+   de hachage) : fonctions de base (log, ln, cos, sin, tan, arccos,
+   arcsin, arctan, sqrt, root, exp, abs, sinh, cosh, tanh, atan2, min,
+   max), constantes pi, e, i, et tout ce qui a été ajouté par
+   calc_register_function() / calc_register_constant().
+   integrate(expr, t, a, b) et solve(expr, t, x0) lient la variable t
+   dans expr : intégrale de a à b (Gauss-Kronrod adaptatif, singularités
+   intégrables aux bornes comprises, comme celle de 1/sqrt(t) en 0) et
+   racine de expr = 0 cherchée à partir de x0 (Newton, Brent sur un changement de
+   signe, Newton complexe en dernier recours). diff(expr, t, x0) est la
+   dérivée de expr par rapport à t en x0, exacte (nombres duaux, voir
+   calc_run_dual). sum(k, a, b, expr) et
+   prod(k, a, b, expr) parcourent k = a, a + 1, ... jusqu'à b ; les
+   termes sont calculés par blocs et répartis sur les cœurs, avec une
+   somme compensée dont le résultat ne dépend pas du nombre de threads.
+   Ces opérateurs s'imbriquent sur CALC_MAX_NESTING niveaux au plus :
+   chaque niveau exécute le corps du suivant.
+
+   Une expression est compilée une fois en un CalcProgram (immuable, donc
+   partageable entre threads), puis exécutée autant de fois que voulu.
+   Tout l'état mutable (parseur, pile, dernière erreur) vit dans un
+   CalcContext : un contexte par thread suffit, sans verrou.
+   La bibliothèque ne fait aucune entrée/sortie. */
+/* ============================= */
+
+typedef enum {
+    CALC_OK = 0,
+    CALC_ERR_NOMEM,          /* mémoire insuffisante */
+    CALC_ERR_UNEXPECTED,     /* caractère inattendu */
+    CALC_ERR_EXPECTED,       /* fermeture attendue (voir CalcError.expected) */
+    CALC_ERR_UNKNOWN_FUNC,   /* fonction inconnue ou nombre d'arguments invalide */
+    CALC_ERR_UNKNOWN_IDENT,  /* identifiant inconnu */
+    CALC_ERR_DIV_ZERO,       /* division par 0 */
+    CALC_ERR_IDIV_ZERO,      /* division entière par 0 */
+    CALC_ERR_FACTORIAL,      /* factorielle d'un négatif ou d'un complexe */
+    CALC_ERR_ARITY,          /* nombre d'arguments invalide */
+    CALC_ERR_REGISTER,       /* enregistrement de symbole refusé */
+    CALC_ERR_CANCELLED,      /* évaluation interrompue (calc_session_cancel) */
+    CALC_ERR_VARIABLE,       /* programme à variables exécuté sans leurs valeurs */
+    CALC_ERR_NO_ROOT,        /* solve() n'a pas trouvé de racine */
+    CALC_ERR_BOUNDS,         /* bornes de sum() ou prod() non réelles, ou
+                                plus de 2^53 termes */
+    CALC_ERR_DIVERGENT,      /* integrate() ne converge pas */
+    CALC_ERR_NESTING,        /* plus de CALC_MAX_NESTING opérateurs à
+                                variable liée imbriqués */
+    CALC_ERR_DERIVATIVE,     /* dérivée non calculable exactement (voir
+                                calc_run_dual) */
+    CALC_ERR_PRECISION,      /* opérateur à variable liée en précision
+                                CALC_PRECISION_DD (voir calc_run_dd) */
+    CALC_ERR_COUNT
+} CalcErrorCode;
+
+#define CALC_MAX_NESTING 64
+
+typedef struct {
+    CalcErrorCode code;
+    size_t pos;         /* position (en octets) du problème dans l'expression */
+    char expected;      /* caractère attendu pour CALC_ERR_EXPECTED */
+    char ident[32];     /* nom en cause pour CALC_ERR_UNKNOWN_* */
+} CalcError;
+
+typedef struct CalcContext CalcContext;
+typedef struct CalcProgram CalcProgram;
+typedef struct CalcSession CalcSession;
+
+CalcContext *calc_context_new(void);
+void calc_context_free(CalcContext *ctx);
+
+/* Options d'un contexte, valables pour les compilations suivantes */
+typedef enum {
+    CALC_OPTION_OPTIMIZE,    /* passe d'optimisation des programmes de
+                                calc_compile() et des corps d'opérateurs à
+                                variable liée ; calc_eval(), qui n'exécute
+                                son programme qu'une fois, ne l'optimise
+                                pas (1 par défaut) */
+    CALC_OPTION_JIT,         /* code natif pour les programmes réels souvent
+                                exécutés, sur x86-64 (1 par défaut) */
+    CALC_OPTION_PRECISION    /* CALC_PRECISION_DOUBLE (défaut) ou
+                                CALC_PRECISION_DD, voir calc_run_dd() */
+} CalcOption;
+
+enum {
+    CALC_PRECISION_DOUBLE = 0,
+    CALC_PRECISION_DD
+};
+
+void calc_set_option(CalcContext *ctx, CalcOption option, int value);
+
+/* Dernière erreur rencontrée avec ce contexte (code CALC_OK sinon) */
+const CalcError *calc_last_error(const CalcContext *ctx);
+
+/* Compile l'expression ; NULL en cas d'erreur (voir calc_last_error).
+   Les sous-expressions constantes sont précalculées à la compilation ;
+   les erreurs qu'elles provoqueraient restent signalées par calc_run(). */
+CalcProgram *calc_compile(CalcContext *ctx, const char *src);
+void calc_program_free(CalcProgram *prog);
+
+/* Exécute un programme compilé ; renvoie CALC_OK ou un code d'erreur */
+CalcErrorCode calc_run(CalcContext *ctx, const CalcProgram *prog, double complex *result);
+
+/* Variables : les identifiants names[0..nvars-1] (qui masquent les
+   constantes du même nom) désignent des valeurs fournies à l'exécution,
+   values[k] pour names[k]. Les noms ne sont lus que pendant la
+   compilation. Un programme à variables exécuté par calc_run() échoue
+   avec CALC_ERR_VARIABLE. */
+CalcProgram *calc_compile_vars(CalcContext *ctx, const char *src,
+                               const char *const *names, int nvars);
+CalcErrorCode calc_run_vars(CalcContext *ctx, const CalcProgram *prog,
+                            const double complex *values, double complex *result);
+
+/* Exécution en colonnes : la ligne r prend cols[k][r] pour la variable
+   k, et son résultat va dans re[r] et im[r]. errors[r], si errors n'est
+   pas NULL, reçoit le code d'erreur de la ligne (CALC_OK, ...) ; re[r]
+   et im[r] valent NaN pour une ligne en erreur. Renvoie le nombre de
+   lignes en erreur ; calc_last_error() décrit la première.
+   Les opérations arithmétiques, sqrt, sin, cos et log sont calculées
+   par blocs de lignes, avec les instructions vectorielles du processeur
+   (AVX2 s'il est disponible). sin, cos et log y diffèrent de la libm
+   de 1 ulp au plus ; tout le reste donne exactement le résultat de
+   calc_run_vars(), erreurs comprises. */
+size_t calc_run_columns(CalcContext *ctx, const CalcProgram *prog,
+                        const double *const *cols, size_t nrows,
+                        double *re, double *im, unsigned char *errors);
+
+/* Compile puis exécute */
+CalcErrorCode calc_eval(CalcContext *ctx, const char *src, double complex *result);
+
+/* Valeur exacte d'une expression qui ne fait intervenir que des nombres
+   écrits en décimal et les opérations + - x / // ! % et ^ (exposant
+   entier) : entiers sur 64 bits tant qu'ils suffisent, puis entiers et
+   rationnels de taille arbitraire. Écrit dans buf l'entier ou le nombre
+   décimal exact (25! donne 15511210043330985984000000) et renvoie sa
+   longueur ; renvoie -1 si l'expression sort de ce cadre (constante,
+   fonction, puissance non entière, erreur), si le résultat n'a pas
+   d'écriture décimale finie (1/3) ou s'il ne tient pas dans buf.
+   À appeler après calc_eval(), qui signale les erreurs et donne la
+   valeur approchée à afficher dans tous ces cas. */
+int calc_eval_exact(CalcContext *ctx, const char *src, char *buf, size_t size);
+
+/* Précision étendue : un double-double est la somme hi + lo de deux
+   double (|lo| <= ulp(hi) / 2), soit environ 32 chiffres significatifs */
+typedef struct { double hi, lo; } CalcDD;
+typedef struct { CalcDD re, im; } CalcDDComplex;
+
+/* Exécution en double-double d'un programme compilé avec la précision
+   CALC_PRECISION_DD : les nombres écrits et les constantes pi et e
+   gardent alors leurs 32 chiffres, et le programme n'est pas optimisé.
+   Les fonctions de base sont calculées en double-double, à quelques
+   exceptions près calculées en double (arccos et arcsin complexes,
+   sinh, cosh et tanh complexes, fonctions externes). Les opérateurs à
+   variable liée, dont le corps n'est calculé qu'en double, sont refusés
+   dans cette précision (CALC_ERR_PRECISION) : leurs 30 chiffres
+   affichés seraient faux au-delà du 17e. Un tel programme
+   exécuté par calc_run() ou calc_run_vars() donne le résultat arrondi
+   en double. values comme pour calc_run_vars() (NULL sans variable). */
+CalcErrorCode calc_run_dd(CalcContext *ctx, const CalcProgram *prog,
+                          const double complex *values, CalcDDComplex *result);
+
+/* Dérivation automatique : le programme est exécuté sur des nombres
+   duaux, dont chaque valeur porte ses dérivées. La valeur et ses
+   dérivées exactes sortent d'une seule exécution, pour un coût de deux à
+   trois exécutions ordinaires, à travers toutes les opérations et
+   fonctions de base (x! par la fonction digamma), et à travers les
+   opérateurs à variable liée : somme ou intégrale de la dérivée du corps
+   (plus les termes des bornes d'une intégrale), règle du produit pour
+   prod, fonctions implicites pour solve, et dérivée seconde exacte pour
+   diff(diff(...)). Seules les fonctions externes sont dérivées par
+   différences centrées. Une dérivée que ces règles ne donnent pas
+   (troisième ordre, diff d'un opérateur à variable liée ou d'une
+   fonction externe dans un diff, racine multiple de solve) renvoie
+   CALC_ERR_DERIVATIVE. values comme pour calc_run_vars().
+   calc_run_dual : dérivée dans la direction direction[0..nvars-1], soit
+   la dérivée par rapport à la variable k pour direction = e_k.
+   calc_run_gradient : les nvars dérivées partielles dans grad. */
+CalcErrorCode calc_run_dual(CalcContext *ctx, const CalcProgram *prog,
+                            const double complex *values, const double complex *direction,
+                            double complex *result, double complex *deriv);
+CalcErrorCode calc_run_gradient(CalcContext *ctx, const CalcProgram *prog,
+                                const double complex *values, double complex *result,
+                                double complex *grad);
+
+/* Compile en précision CALC_PRECISION_DD puis exécute */
+CalcErrorCode calc_eval_dd(CalcContext *ctx, const char *src, CalcDDComplex *result);
+
+/* Comme calc_format_result(), avec 30 chiffres significatifs */
+int calc_format_result_dd(const CalcDDComplex *res, char *buf, size_t size);
+
+/* Libellé d'un code d'erreur, et message complet d'une erreur */
+const char *calc_strerror(CalcErrorCode code);
+int calc_format_error(const CalcError *err, char *buf, size_t size);
+
+/* Formate un résultat comme la touche '=' : "%g" ou "%g+%gi" */
+int calc_format_result(double complex res, char *buf, size_t size);
+
+/* Comme calc_format_result(), avec les chiffres qui identifient chaque
+   double (17 au plus) : affichage d'un résultat en double dans les modes
+   double-double (voir CALC_ERR_PRECISION) */
+int calc_format_result_full(double complex res, char *buf, size_t size);
+
+/* ============================= */
+/* Évaluation incrémentale       */
+/* Une session réévalue un texte qui change peu d'un appel à l'autre,
+   comme l'aperçu pendant la saisie. L'état du parseur et de la pile
+   d'exécution est conservé à intervalles réguliers : seule la partie qui
+   suit le premier caractère modifié est ré-analysée et ré-exécutée. Le
+   résultat est celui de calc_eval(). Une session n'est utilisable que par un thread à la
+   fois ; calc_session_cancel() peut être appelée depuis n'importe lequel. */
+/* ============================= */
+
+CalcSession *calc_session_new(void);
+void calc_session_free(CalcSession *s);
+
+CalcErrorCode calc_session_eval(CalcSession *s, const char *src, double complex *result);
+const CalcError *calc_session_error(const CalcSession *s);
+
+/* Interrompt l'évaluation en cours (ou la prochaine), qui renvoie alors
+   CALC_ERR_CANCELLED ; le travail déjà fait reste réutilisable */
+void calc_session_cancel(CalcSession *s);
+
+/* Avancement de la somme ou du produit en cours d'évaluation, en
+   millièmes, ou -1 ; peut être lu depuis n'importe quel thread */
+int calc_session_progress(const CalcSession *s);
+
+/* ============================= */
+/* Fonctions et constantes externes */
+/* Le registre est global au processus. Les enregistrements doivent être
+   faits avant de compiler depuis plusieurs threads ; un symbole ne peut
+   être ni remplacé ni retiré. Un nom est une lettre suivie de lettres ou
+   de chiffres (31 caractères au plus). */
+/* ============================= */
+
+#define CALC_VARIADIC (-1)
+
+/* Version complexe d'une fonction : args[0..argc-1] */
+typedef double complex (*CalcFunc)(const double complex *args, int argc);
+/* Version réelle facultative, utilisée par l'exécution en double ; un
+   résultat infini ou NaN fait repasser l'évaluation en complexe. */
+typedef double (*CalcRealFunc)(const double *args, int argc);
+
+/* L'arité est vérifiée ici (0 <= min_args <= max_args, ou max_args =
+   CALC_VARIADIC), puis à chaque appel lors de la compilation. Une fonction
+   externe n'est jamais précalculée par l'optimiseur.
+   Renvoie CALC_OK ou CALC_ERR_REGISTER. */
+CalcErrorCode calc_register_function(const char *name, int min_args, int max_args,
+                                     CalcFunc fn, CalcRealFunc rfn);
+CalcErrorCode calc_register_constant(const char *name, double complex value);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef CALC_CACHE_H
+#define CALC_CACHE_H
+
+#include <stddef.h>
+#include <complex.h>
+#include "calc.h"
+
+/* ============================= */
+/* Cache des résultats           */
+/* Les résultats sont rangés sous une forme normalisée de l'expression :
+   espaces superflus retirés (ceux dont le retrait ne change pas la
+   lecture du texte) et crochets/accolades ramenés à des parenthèses (si
+   elles sont bien imbriquées), précédée des options du contexte qui
+   changent le résultat (optimisation, précision). La table est associative
+   par ensembles de CALC_CACHE_WAYS entrées, avec éviction LRU dans chaque
+   ensemble : la mémoire est bornée par la capacité demandée.
+
+   Avec un chemin de fichier, la table est projetée en mémoire partagée :
+   elle survit au redémarrage et peut être utilisée en même temps par
+   plusieurs processus (verrou par ensemble, dans le fichier). Un fichier
+   écrit par une version dont les résultats peuvent différer est
+   réinitialisé. Seuls les résultats sans erreur sont conservés ; les
+   expressions normalisées de plus de CALC_CACHE_KEY_MAX - 2 octets ne
+   sont pas mises en cache. */
+/* ============================= */
+
+#define CALC_CACHE_WAYS 8
+#define CALC_CACHE_KEY_MAX 112
+
+typedef struct CalcCache CalcCache;
+
+typedef struct {
+    unsigned long long hits;       /* compteurs partagés par tous les */
+    unsigned long long misses;     /* utilisateurs du fichier          */
+    unsigned long long inserts;
+    unsigned long long evictions;
+    size_t capacity;               /* nombre maximal d'entrées */
+    size_t entries;                /* entrées occupées */
+} CalcCacheStats;
+
+/* path NULL : cache en mémoire, propre au processus.
+   capacity : nombre d'entrées (ignoré si le fichier existe déjà). */
+CalcCache *calc_cache_open(const char *path, size_t capacity);
+void calc_cache_close(CalcCache *cache);
+
+/* Recherche / ajout direct, pour les options par défaut ; lookup renvoie
+   1 si trouvé, 0 sinon */
+int calc_cache_lookup(CalcCache *cache, const char *src, double complex *result);
+void calc_cache_store(CalcCache *cache, const char *src, double complex result);
+
+/* Comme calc_eval(), en passant d'abord par le cache. Les expressions qui
+   font appel à une fonction ou une constante enregistrée ne sont pas mises
+   en cache. */
+CalcErrorCode calc_eval_cached(CalcContext *ctx, CalcCache *cache, const char *src,
+                               double complex *result);
+
+void calc_cache_stats(CalcCache *cache, CalcCacheStats *stats);
+
+/* Forme normalisée de src ; renvoie sa longueur, ou (size_t)-1 si elle
+   ne tient pas dans size octets */
+size_t calc_normalize(const char *src, char *dest, size_t size);
+
+#endif
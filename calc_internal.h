@@ -0,0 +1,418 @@
+#ifndef CALC_INTERNAL_H
+#define CALC_INTERNAL_H
+
+/* Définitions internes partagées par les fichiers de libcalc */
+
+#include <stddef.h>
+#include <complex.h>
+#include <stdatomic.h>
+#include "calc.h"
+#include "calc_stats.h"
+
+/* Définitions de constantes mathématiques */
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+#ifndef M_E
+#define M_E 2.71828182845904523536
+#endif
+
+/* Jeu d'instructions de la machine à pile */
+typedef enum {
+    OP_CONST,    /* empile consts[arg] (constante réelle) */
+    OP_CCONST,   /* empile consts[arg] (constante complexe, ex. 'i') */
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_IDIV,     /* division entière "//" */
+    OP_POW,
+    OP_NEG,
+    OP_FACT,     /* '!' */
+    OP_PERCENT,  /* '%' */
+    OP_LOG,
+    OP_COS,
+    OP_SIN,
+    OP_TAN,
+    OP_ACOS,
+    OP_ASIN,
+    OP_ATAN,
+    OP_SQRT,
+    OP_ROOT,     /* root(x,n) = x^(1/n) */
+    OP_CALL,     /* appelle le symbole arg avec argc arguments */
+    OP_POWI,     /* x^arg par multiplications (arg >= 2), voir opt.c */
+    OP_SCALE,    /* produit par un réel, composante par composante */
+    OP_STORE,    /* copie le sommet de pile dans le registre arg */
+    OP_LOAD,     /* empile le registre arg */
+    OP_VAR,      /* empile la valeur de la variable arg */
+    /* Opérateurs à variable liée (calculus.c) : arg indexe le corps dans
+       CalcProgram.subs, argc compte les arguments numériques */
+    OP_INTEGRATE, /* integrate(corps, x, a, b) */
+    OP_SOLVE,     /* solve(corps, x, départ) */
+    OP_DIFF,      /* diff(corps, x, point) */
+    OP_SUM,       /* sum(k, a, b, corps) */
+    OP_PROD       /* prod(k, a, b, corps) */
+} OpCode;
+
+#define OP_FIRST_BINDER OP_INTEGRATE
+/* À partir d'ici, le corps vient en dernier : name(variable, ..., corps) */
+#define OP_FIRST_RANGE OP_SUM
+
+typedef struct {
+    unsigned short op;
+    unsigned short argc;  /* nombre d'arguments pour OP_CALL et les opérateurs
+                             à variable liée */
+    int arg;
+} Instr;
+
+/* Code natif d'un programme réel (jit.c) : renvoie 0 avec le résultat
+   dans stack[0], ou 1 si l'interpréteur doit reprendre l'exécution */
+typedef int (*CalcJitFn)(double *stack, const double *rconsts, const double complex *vars);
+
+/* Programme compilé : code, constantes et positions source sont rangés
+   dans un seul bloc mémoire, libéré par calc_program_free().
+   Un programme sans constante complexe est dit réel : il est d'abord
+   exécuté en double (voir run_real), et ne passe en complexe que si une
+   opération sort des réels.
+   Le corps d'un opérateur à variable liée est un programme à part, dont
+   la variable liée est la variable 0, suivie des variables du programme
+   qui le contient. */
+struct CalcProgram {
+    int len;              /* nombre d'instructions */
+    int nconsts;          /* nombre de constantes */
+    int max_depth;        /* profondeur de pile maximale à l'exécution */
+    int nregs;            /* registres des sous-expressions communes */
+    int real_only;        /* aucune instruction OP_CCONST */
+    int nvars;            /* variables déclarées à la compilation */
+    int dd;               /* compilé en CALC_PRECISION_DD (voir dd.c) */
+    int nvars_used;       /* seules les nvars_used premières variables sont lues */
+    int binders;          /* opérateurs à variable liée : ni code natif ni
+                             exécution par blocs */
+    CalcProgram **subs;   /* corps des opérateurs à variable liée */
+    int nsubs;
+    Instr *code;
+    double complex *consts;
+    double *rconsts;      /* valeurs pour le chemin réel */
+    double *clo;          /* parties basses des constantes réelles (dd), ou NULL */
+    unsigned *pos;        /* position source de chaque instruction (erreurs) */
+    int nfuncs;           /* appels de fonctions, par emplacement de statistiques */
+    struct ProgramFunc { unsigned short slot; unsigned count; } *funcs;
+    /* Code natif (jit.c), seule partie modifiée après la compilation */
+    atomic_int jit_state;
+    atomic_uint jit_runs;
+    void *jit_code;
+    size_t jit_size;
+    CalcJitFn jit_fn;
+};
+
+/* Tampon de génération de code utilisé pendant la compilation */
+typedef struct {
+    Instr *code;
+    unsigned *pos;
+    int len, cap;
+    double complex *consts;
+    double *rconsts;       /* partie réelle, ou valeur du chemin réel */
+    int nconsts, consts_cap;
+    double *clo;           /* parties basses, en CALC_PRECISION_DD */
+    int clo_cap;
+    int depth, max_depth;
+    int nregs;
+    CalcProgram **subs;    /* corps compilés, cédés au programme final */
+    int nsubs, subs_cap;
+} CodeBuf;
+
+/* Opérateur binaire en attente de son opérande droit */
+typedef struct PendingOp {
+    int op;
+    size_t pos;
+} PendingOp;
+
+/* Groupe ou appel de fonction ouvert, fermé par 'close' */
+typedef struct OpenGroup {
+    int call;             /* appel de fonction (sinon simple groupe) */
+    char close;
+    int neg;              /* négation du facteur, appliquée à la fermeture */
+    size_t neg_pos;
+    int base;             /* hauteur de la pile d'opérateurs à l'ouverture */
+    /* Appels : symbole, nom (len octets à la position start) et arguments */
+    int index;
+    size_t len;
+    size_t start;
+    int nargs;
+    /* Opérateurs à variable liée : indice du corps (-1 tant qu'il n'est
+       pas compilé), variable liée (var_len octets à la position var), et
+       pour name(corps, variable, ...) la position du premier argument
+       numérique, où reprendre après le corps (0 sinon) */
+    int sub;
+    size_t var, var_len;
+    size_t resume;
+    int body;             /* corps en cours, fermé par 'close' sans le lire */
+} OpenGroup;
+
+/* Corps d'opérateur à variable liée en cours de compilation : son code va
+   dans un tampon à part, le code extérieur est mis de côté. Le tampon
+   est gardé d'une compilation à l'autre. */
+typedef struct BodyFrame {
+    CodeBuf outer;        /* tampon du code extérieur */
+    CodeBuf spare;        /* tampon du corps, hors de son ouverture */
+    size_t var, var_len;  /* variable liée */
+} BodyFrame;
+
+typedef struct {
+    const char *src;      /* début de l'expression */
+    const char *cur;      /* position courante */
+    CodeBuf out;          /* programme en cours de génération */
+    /* Piles explicites du parseur, conservées d'une compilation à l'autre */
+    PendingOp *ops;
+    int nops, ops_cap;
+    OpenGroup *groups;
+    int ngroups, groups_cap;
+    BodyFrame *bodies;    /* corps ouverts (CALC_MAX_NESTING au plus), du
+                             plus extérieur au plus intérieur : la variable
+                             liée du corps k est la variable nbodies - 1 - k
+                             du code courant */
+    int nbodies, bodies_cap;
+    unsigned *arg_end;    /* pour chaque ouvrante, position de la première
+                             virgule hors de tout groupe ou de la fermeture
+                             (scan_arguments), calculée au premier besoin */
+    unsigned *arg_stack;
+    size_t arg_cap;
+    int arg_scanned;
+    CalcSession *session; /* points de reprise à enregistrer (session.c) */
+    const char *const *vars; /* noms des variables (calc_compile_vars) */
+    int nvars;
+    int external;         /* la dernière expression compilée fait appel à
+                             une fonction ou une constante enregistrée par
+                             l'application : son résultat n'est pas mis en
+                             cache (cache.c) */
+} Parser;
+
+/* ============================= */
+/* Statistiques (stats.c)        */
+/* ============================= */
+
+/* Compteur écrit par un seul thread : pas d'instruction atomique
+   coûteuse, mais une lecture sûre depuis un autre thread */
+#define STAT_ADD(c, n) \
+    atomic_store_explicit(&(c), atomic_load_explicit(&(c), memory_order_relaxed) + (n), \
+                          memory_order_relaxed)
+
+typedef struct {
+    atomic_ullong calls, sampled, sampled_ns;
+} FuncCounters;
+
+/* Compteurs d'un contexte (voir CalcStats) */
+typedef struct StatsBlock {
+    atomic_ullong compiles, sampled_compiles, compile_ns;
+    atomic_ullong runs, sampled_runs, run_ns;
+    atomic_ullong evals;
+    atomic_ullong errors[CALC_ERR_COUNT];
+    atomic_ullong latency[CALC_STATS_HIST];
+    FuncCounters funcs[CALC_STATS_FUNCS];
+    struct StatsBlock *prev, *next;   /* contextes vivants */
+} StatsBlock;
+
+extern atomic_int calc_stats_on;
+
+#define STATS_ON() atomic_load_explicit(&calc_stats_on, memory_order_relaxed)
+
+void calc_stats_attach(StatsBlock *st);
+void calc_stats_detach(StatsBlock *st);
+/* Emplacement de statistiques d'un appel de fonction, -1 pour les
+   autres instructions */
+int calc_stats_slot(const Instr *ins);
+unsigned long long calc_stats_now_ns(void);
+void calc_stats_latency(StatsBlock *st, unsigned long long ns);
+
+/* Résultat d'un opérateur à variable liée, gardé d'un chemin
+   d'exécution à l'autre par calc_run_both() */
+typedef struct {
+    const Instr *ins;
+    double complex a, b, result;
+} BinderMemo;
+
+#define CALC_MEMO 4
+
+struct CalcContext {
+    Parser p;
+    CalcError err;
+    int optimize;          /* CALC_OPTION_OPTIMIZE */
+    int jit;               /* CALC_OPTION_JIT */
+    int precision;         /* CALC_OPTION_PRECISION */
+    double complex *stack; /* pile d'exécution des programmes profonds */
+    int stack_cap;
+    double *rstack;        /* idem pour l'exécution réelle */
+    int rstack_cap;
+    int timed;             /* exécution chronométrée fonction par fonction */
+    const double complex *vars; /* valeurs des variables pendant l'exécution */
+    int vars_real;         /* toutes les valeurs sont réelles */
+    CalcDDComplex *ddstack; /* idem pour l'exécution en double-double */
+    int ddstack_cap;
+    double *block;         /* pile de blocs de calc_run_columns() (vec.c) */
+    size_t block_cap;
+    CalcContext *child;    /* exécution des corps d'opérateurs à variable
+                              liée (calculus.c), créé au premier besoin */
+    atomic_int *cancel;    /* demande d'interruption des sommes et produits,
+                              et avancement en millièmes (-1 hors calcul) :
+                              ceux de la session, NULL sinon */
+    atomic_int *progress;
+    int memo_on;           /* calc_run_both() en cours */
+    BinderMemo memo[CALC_MEMO];
+    int nmemo;
+    double complex *dual;  /* pile et dérivées de calc_exec_dual() (dual.c) */
+    size_t dual_cap;
+    StatsBlock stats;
+};
+
+void calc_set_error(CalcContext *ctx, CalcErrorCode code, size_t pos);
+
+/* Libère les corps compilés de p.out au-delà des keep premiers */
+void calc_drop_subs(CodeBuf *out, int keep);
+
+/* Effet d'une instruction sur la hauteur de pile */
+int calc_stack_effect(const Instr *ins);
+
+/* Poursuit l'analyse depuis l'état courant du parseur jusqu'à la fin de
+   l'expression ; le code est ajouté à p.out */
+void calc_parse_from(CalcContext *ctx);
+
+/* Appelé par le parseur à chaque début d'opérande quand p.session est
+   défini : l'état du parseur peut y être sauvegardé (session.c) */
+void calc_session_checkpoint(CalcContext *ctx);
+
+/* Valeur renvoyée par l'exécution réelle quand le calcul doit passer en
+   complexe */
+#define RUN_PROMOTE (-1)
+
+/* Exécute les instructions [from, to) sur une pile qui contient déjà
+   *depth valeurs ; la pile doit avoir prog->max_depth + prog->nregs
+   cases. calc_exec_real() peut renvoyer RUN_PROMOTE. */
+CalcErrorCode calc_exec_complex(CalcContext *ctx, const CalcProgram *prog, int from, int to,
+                                double complex *stack, int *depth);
+int calc_exec_real(CalcContext *ctx, const CalcProgram *prog, int from, int to,
+                   double *stack, int *depth);
+
+/* x! (OP_FACT, x >= 0) : table des factorielles entières jusqu'à 170!,
+   tgamma(x + 1) au-delà et pour les non-entiers */
+double calc_factorial(double x);
+
+/* x^n pour n >= 1 (OP_POWI), par élévations au carré successives */
+double calc_powi(double x, int n);
+
+/* Optimise le programme en cours de génération (opt.c) */
+void calc_optimize(CalcContext *ctx);
+
+/* Exécution d'un programme, avec les valeurs de variables de ctx->vars,
+   sans statistiques */
+CalcErrorCode calc_exec_program(CalcContext *ctx, const CalcProgram *prog, double complex *result);
+
+/* Compilation native des programmes réels (jit.c) : après
+   CALC_JIT_THRESHOLD exécutions, calc_jit_get() traduit le programme en
+   code x86-64 ; elle renvoie NULL tant que ce code n'est pas prêt, ou
+   sur les autres architectures */
+#define CALC_JIT_THRESHOLD 1000
+
+void calc_jit_init(CalcProgram *prog, int enabled);
+CalcJitFn calc_jit_get(const CalcProgram *prog);
+void calc_jit_free(CalcProgram *prog);
+
+/* Double-double (dd.c) : exécution d'un programme, avec les valeurs de
+   variables de ctx->vars, et partie basse du nombre écrit [s, end) dont
+   strtod() a donné hi */
+CalcErrorCode calc_exec_dd(CalcContext *ctx, const CalcProgram *prog, CalcDDComplex *result);
+double calc_dd_literal_lo(const char *s, const char *end, double hi);
+
+/* Opérateurs à variable liée (calculus.c) : calcule l'instruction ins de
+   prog, d'arguments numériques args[0..ins->argc-1], avec les valeurs de
+   variables de ctx->vars. Le corps est exécuté en double, y compris dans
+   un programme double-double. */
+CalcErrorCode calc_exec_binder(CalcContext *ctx, const CalcProgram *prog, const Instr *ins,
+                               const double complex *args, double complex *result);
+
+/* Dérivée de integrate et sum dans une direction (dual.c) : targs donne
+   les dérivées des arguments, dvars celles des variables du corps (la
+   variable liée puis les variables extérieures). L'intégrale de la
+   dérivée du corps, plus les termes des bornes ; pour sum, la somme des
+   dérivées des termes (les bornes entières ne varient pas). */
+CalcErrorCode calc_exec_tangent(CalcContext *ctx, const CalcProgram *prog, const Instr *ins,
+                                const double complex *args, const double complex *targs,
+                                const double complex *dvars, double complex *result);
+
+/* Nombres duaux (dual.c) : exécution d'un programme avec les valeurs de
+   variables de ctx->vars, dont les dérivées sont dans dvars (width par
+   variable, ou NULL pour les dérivées partielles : width = nombre de
+   variables) ; deriv reçoit les width dérivées du résultat. Un programme
+   double-double est exécuté en double. */
+CalcErrorCode calc_exec_dual(CalcContext *ctx, const CalcProgram *prog, const double complex *dvars,
+                             int width, double complex *result, double complex *deriv);
+
+/* Au second ordre : deux directions (dvars en donne deux par variable),
+   et mixed reçoit la dérivée seconde croisée du résultat */
+CalcErrorCode calc_exec_dual2(CalcContext *ctx, const CalcProgram *prog, const double complex *dvars,
+                              double complex *result, double complex *deriv,
+                              double complex *mixed);
+
+/* Exécute un programme constant par les deux chemins, réel et complexe */
+CalcErrorCode calc_run_both(CalcContext *ctx, const CalcProgram *prog,
+                            double complex *cres, double *rres, int *real_ok);
+
+/* ============================= */
+/* Registre des symboles         */
+/* ============================= */
+
+typedef enum {
+    SYM_OPCODE,    /* fonction compilée en une instruction dédiée */
+    SYM_FUNC,      /* fonction appelée via OP_CALL */
+    SYM_BINDER,    /* opérateur à variable liée (OP_FIRST_BINDER et suivants) */
+    SYM_CONST      /* constante */
+} SymbolKind;
+
+#define CALC_MAX_NAME 32
+
+/* Version double-double d'une fonction : renvoie 0 avec le résultat dans
+   *res, ou -1 pour que l'appel soit fait en double */
+typedef int (*CalcDDFunc)(const CalcDDComplex *args, int argc, CalcDDComplex *res);
+
+/* Dérivée d'une fonction dans la direction dargs, value valant déjà
+   f(args) (voir dual.c) */
+typedef double complex (*CalcDiffFunc)(const double complex *args, const double complex *dargs,
+                                       int argc, double complex value);
+
+/* Dérivée seconde croisée d'une fonction dans les directions d0 et d1,
+   sans les dérivées secondes des arguments (portées par CalcDiffFunc),
+   value valant déjà f(args) */
+typedef double complex (*CalcDiff2Func)(const double complex *args, const double complex *d0,
+                                        const double complex *d1, int argc, double complex value);
+
+typedef struct {
+    char name[CALC_MAX_NAME];
+    SymbolKind kind;
+    int op;                /* SYM_OPCODE, SYM_BINDER : instruction émise */
+    int min_args;          /* SYM_BINDER : arguments numériques */
+    int max_args;          /* CALC_VARIADIC : pas de limite */
+    int pure;              /* sans effet de bord : peut être précalculée */
+    CalcFunc cfn;          /* SYM_FUNC : version complexe */
+    CalcRealFunc rfn;      /* SYM_FUNC : version réelle (facultative) */
+    CalcDDFunc ddfn;       /* SYM_FUNC : version double-double (facultative) */
+    CalcDiffFunc dfn;      /* SYM_FUNC : dérivée (facultative) */
+    CalcDiff2Func d2fn;    /* SYM_FUNC : dérivée seconde (facultative) */
+    double complex value;  /* SYM_CONST */
+    double lo;             /* SYM_CONST : partie basse de la valeur réelle */
+} CalcSymbol;
+
+/* Versions double-double des fonctions de base (dd.c) */
+int calc_ddfn_exp(const CalcDDComplex *a, int n, CalcDDComplex *res);
+int calc_ddfn_abs(const CalcDDComplex *a, int n, CalcDDComplex *res);
+int calc_ddfn_sinh(const CalcDDComplex *a, int n, CalcDDComplex *res);
+int calc_ddfn_cosh(const CalcDDComplex *a, int n, CalcDDComplex *res);
+int calc_ddfn_tanh(const CalcDDComplex *a, int n, CalcDDComplex *res);
+int calc_ddfn_atan2(const CalcDDComplex *a, int n, CalcDDComplex *res);
+int calc_ddfn_min(const CalcDDComplex *a, int n, CalcDDComplex *res);
+int calc_ddfn_max(const CalcDDComplex *a, int n, CalcDDComplex *res);
+
+/* Recherche d'un nom (len octets) ; renvoie l'indice ou -1 */
+int calc_lookup(const char *name, size_t len);
+const CalcSymbol *calc_symbol(int index);
+int calc_symbol_count(void);
+
+#endif
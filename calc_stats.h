@@ -0,0 +1,59 @@
+#ifndef CALC_STATS_H
+#define CALC_STATS_H
+
+#include <stddef.h>
+#include "calc.h"
+
+/* ============================= */
+/* Statistiques d'exécution      */
+/* Chaque contexte tient ses propres compteurs (un seul thread écrit,
+   sans instruction atomique coûteuse) ; calc_stats_collect() fait la
+   somme de tous les contextes, vivants ou libérés, depuis n'importe
+   quel thread.
+
+   Toujours comptés : compilations, exécutions, erreurs par code, et
+   appels de fonctions (le décompte de chaque programme est établi à la
+   compilation, puis ajouté en une fois à chaque exécution).
+   Chronométrés une fois sur CALC_STATS_SAMPLE : durée de l'analyse, de
+   l'exécution, de chaque appel de fonction, et latence de calc_eval()
+   (histogramme). Les durées cumulées affichées sont extrapolées à
+   partir de cet échantillon.
+
+   Les compteurs sont actifs par défaut ; calc_stats_enable(0) les
+   suspend. Les sessions (aperçu de l'interface) ne sont pas comptées. */
+/* ============================= */
+
+#define CALC_STATS_SAMPLE 64
+#define CALC_STATS_HIST 32       /* classe k : latence dans [2^k, 2^(k+1)) ns */
+#define CALC_STATS_FUNCS 64      /* fonctions suivies, voir calc_stats_func_name() */
+
+typedef struct {
+    unsigned long long calls;
+    unsigned long long sampled;     /* appels chronométrés */
+    unsigned long long sampled_ns;  /* durée totale des appels chronométrés */
+} CalcFuncStats;
+
+typedef struct {
+    unsigned long long compiles;
+    unsigned long long sampled_compiles, compile_ns;
+    unsigned long long runs;
+    unsigned long long sampled_runs, run_ns;
+    unsigned long long errors[CALC_ERR_COUNT];
+    unsigned long long latency[CALC_STATS_HIST];  /* calc_eval() chronométrés */
+    CalcFuncStats funcs[CALC_STATS_FUNCS];
+} CalcStats;
+
+void calc_stats_enable(int on);
+void calc_stats_collect(CalcStats *stats);
+void calc_stats_reset(void);
+
+/* Nom de la fonction k ("^ (cpow)", "! (tgamma)", "exp", ...) ; NULL si
+   l'emplacement n'est associé à aucune fonction */
+const char *calc_stats_func_name(int k);
+
+/* Rapport lisible, une information par ligne, au plus max_funcs
+   fonctions (les plus coûteuses). Renvoie la longueur écrite, comme
+   snprintf. */
+int calc_stats_format(const CalcStats *stats, int max_funcs, char *buf, size_t size);
+
+#endif
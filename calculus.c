@@ -0,0 +1,1130 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <complex.h>
+#include "calc.h"
+#include "calc_internal.h"
+#include "pool.h"
+
+/* ============================= */
+/* Partie Intégration et résolution */
+/* integrate(corps, x, a, b), solve(corps, x, départ), diff(corps, x,
+   point), sum(k, a, b, corps) et prod(k, a, b, corps). Le corps est
+   compilé une fois avec l'expression qui le contient (voir parse_binder
+   dans calc.c), puis exécuté pour chaque valeur de la variable dans un
+   contexte à part : celui de l'expression est suspendu au milieu de son
+   exécution.
+   - integrate : quadrature de Gauss-Kronrod à 21 points, adaptative.
+     Chaque tour coupe en deux les intervalles dont l'erreur estimée est
+     la plus grande ; les nouveaux intervalles d'un tour sont calculés en
+     parallèle quand le travail le justifie. Le résultat ne dépend pas du
+     nombre de threads : les intervalles sont choisis et sommés dans un
+     ordre fixé. Près d'une singularité à une borne, le dernier
+     intervalle est prolongé depuis ses voisins (quad_edge).
+   - solve : méthode de Newton amortie (dérivée par différences centrées),
+     qui passe à la méthode de Brent dès qu'un changement de signe encadre
+     une racine réelle ; à défaut de racine réelle, Newton est relancé
+     dans le plan complexe.
+   - diff : une exécution du corps sur des nombres duaux (dual.c).
+     Les dérivées de integrate et sum (calc_exec_tangent) passent par les
+     mêmes méthodes, appliquées à la dérivée du corps.
+   - sum, prod : les termes sont calculés par blocs avec
+     calc_run_columns() (instructions vectorielles), dans des tranches
+     réparties sur le pool ; somme compensée de Neumaier, produit
+     compensé, et réunion des tranches dans l'ordre. */
+/* ============================= */
+
+/* Exécution du corps : contexte, et valeurs des variables, la variable
+   liée puis celles du programme qui contient l'opérateur */
+typedef struct {
+    CalcContext *ctx;
+    const CalcProgram *body;
+    double complex *vals;
+    int outer_real;
+    const double complex *dvars;  /* non NULL : le corps donne sa dérivée
+                                     dans cette direction (calc_exec_tangent) */
+} Runner;
+
+/* Variables lues par le corps (la variable liée au moins) : les
+   suivantes ne sont ni recopiées ni allouées, ce qui garde linéaire le
+   coût des opérateurs profondément imbriqués */
+static int body_vars(const CalcProgram *body) {
+    return body->nvars_used > 1 ? body->nvars_used : 1;
+}
+
+static CalcErrorCode runner_eval(Runner *r, double complex x, double complex *res) {
+    r->vals[0] = x;
+    r->ctx->vars = r->vals;
+    if (r->dvars) {
+        double complex value;
+        return calc_exec_dual(r->ctx, r->body, r->dvars, 1, &value, res);
+    }
+    r->ctx->vars_real = r->outer_real && cimag(x) == 0;
+    return calc_exec_program(r->ctx, r->body, res);
+}
+
+/* Copie de r avec un contexte neuf, pour une tâche parallèle */
+static int runner_clone(Runner *copy, const Runner *r) {
+    copy->ctx = calc_context_new();
+    copy->vals = malloc(body_vars(r->body) * sizeof(double complex));
+    if (!copy->ctx || !copy->vals) {
+        calc_context_free(copy->ctx);
+        free(copy->vals);
+        return -1;
+    }
+    /* la variable liée est écrite à chaque exécution */
+    memcpy(copy->vals + 1, r->vals + 1, (body_vars(r->body) - 1) * sizeof(double complex));
+    copy->ctx->cancel = r->ctx->cancel;
+    copy->body = r->body;
+    copy->outer_real = r->outer_real;
+    copy->dvars = r->dvars;
+    return 0;
+}
+
+/* Pool de la bibliothèque, créé au premier calcul qui en a besoin */
+static ThreadPool *calc_pool;
+static pthread_once_t calc_pool_once = PTHREAD_ONCE_INIT;
+
+static void create_pool(void) {
+    calc_pool = pool_create(0);
+}
+
+/* ============================= */
+/* Intégration                   */
+/* ============================= */
+
+/* Intervalles au plus, et tolérances sur l'erreur estimée : relative au
+   résultat, ou à l'intégrale de |f| pour un résultat proche de 0 */
+#define QUAD_MAX_PIECES 2000
+#define QUAD_RELTOL 1e-12
+#define QUAD_ABSTOL 1e-13
+/* Tours consécutifs sans progrès de l'erreur avant abandon */
+#define QUAD_STALL 4
+/* Erreur relative estimée au-delà de laquelle un abandon est signalé
+   (CALC_ERR_DIVERGENT) : les chiffres affichés ne seraient pas sûrs */
+#define QUAD_FAILTOL 1e-6
+/* Durée estimée d'un tour au-delà de laquelle il est réparti sur le pool */
+#define QUAD_PARALLEL_NS 50000
+/* Raison maximale de la progression prolongée jusqu'à une borne
+   (quad_tail) : singularités en |x - borne|^-α jusqu'à α = 0.93 */
+#define QUAD_TAIL_RATIO 0.95
+/* Largeur minimale d'un intervalle au bord, en ulp de la borne (racine
+   de 1 / DBL_EPSILON : erreur d'arrondi des nœuds et erreur de la
+   progression de quad_tail du même ordre) */
+#define QUAD_EDGE_ULPS 0x1p26
+/* À cette largeur, la progression ne remplace la quadrature que si son
+   erreur est bien moindre : une singularité faible (logarithmique), que
+   la quadrature intègre déjà presque bien, continue d'être coupée */
+#define QUAD_TAIL_GAIN 1e-3
+
+/* Abscisses de Kronrod sur [0, 1] (symétriques, le centre en dernier) ;
+   celles d'indice impair sont les abscisses de Gauss à 10 points */
+static const double xgk[11] = {
+    0.995657163025808080735527280689003, 0.973906528517171720077964012084452,
+    0.930157491355708226001207180059508, 0.865063366688984510732096688423493,
+    0.780817726586416897063717578345042, 0.679409568299024406234327365114874,
+    0.562757134668604683339000099272694, 0.433395394129247190799265943165784,
+    0.294392862701460198131126603103866, 0.148874338981631210884826001129720,
+    0.000000000000000000000000000000000
+};
+static const double wgk[11] = {
+    0.011694638867371874278064396062192, 0.032558162307964727478818972459390,
+    0.054755896574351996031381300244580, 0.075039674810919952767043140916190,
+    0.093125454583697605535065465083366, 0.109387158802297641899210590325805,
+    0.123491976262065851077208980612971, 0.134709217311473325928054001771707,
+    0.142775938577060080797094273138717, 0.147739104901338491374841515972068,
+    0.149445554002916905664936468389821
+};
+static const double wg[5] = {
+    0.066671344308688137593568809893332, 0.149451349150580593145776339657697,
+    0.219086362515982043995534934228163, 0.269266719309996355091226921569469,
+    0.295524224714752870173892994651338
+};
+
+/* Intervalle [t0, t1] du paramètre t de x = a + (b - a) t, t dans [0, 1] */
+typedef struct {
+    double t0, t1;
+    double complex value;  /* intégrale sur l'intervalle, en t */
+    double err;            /* erreur estimée */
+    double resabs;         /* intégrale de |f| */
+    CalcErrorCode code;    /* erreur d'exécution du corps */
+    size_t pos;
+    int frozen;            /* plus jamais coupé : un nœud tombe sur une
+                              borne, ou la valeur vient de quad_tail() */
+} Piece;
+
+typedef struct {
+    double complex a, b, span;
+    Piece *pieces;
+    int npieces;
+    int *todo;             /* intervalles à calculer pendant le tour */
+    int ntodo;
+    Runner *runners;       /* contextes des tâches, runners[0] pour le
+                              calcul séquentiel */
+    int nrunners;
+    int cloned;            /* runners[1..] déjà créés */
+    int ntasks;            /* tâches du tour en cours */
+} Quad;
+
+static double complex quad_point(const Quad *q, double t) {
+    /* depuis la borne la plus proche, pour garder la précision près de b */
+    return t <= 0.5 ? q->a + q->span * t : q->b - q->span * (1 - t);
+}
+
+/* Nœud d'abscisse t de l'intervalle p : un nœud arrondi sur une borne
+   arrête le découpage de p, qui n'apporterait plus de nouveau point */
+static double complex quad_node(const Quad *q, Piece *p, double t) {
+    double complex x = quad_point(q, t);
+    if (x == q->a || x == q->b)
+        p->frozen = 1;
+    return x;
+}
+
+/* Règle de Gauss-Kronrod à 21 points, et estimation de l'erreur de
+   QUADPACK (QK21) */
+static void gauss_kronrod(const Quad *q, Runner *r, Piece *p) {
+    double c = (p->t0 + p->t1) / 2, h = (p->t1 - p->t0) / 2;
+    double complex f1[10], f2[10], fc;
+    p->code = runner_eval(r, quad_node(q, p, c), &fc);
+    for (int j = 0; j < 10 && p->code == CALC_OK; j++) {
+        p->code = runner_eval(r, quad_node(q, p, c - h * xgk[j]), &f1[j]);
+        if (p->code == CALC_OK)
+            p->code = runner_eval(r, quad_node(q, p, c + h * xgk[j]), &f2[j]);
+    }
+    if (p->code != CALC_OK) {
+        p->pos = r->ctx->err.pos;
+        return;
+    }
+    double complex resk = wgk[10] * fc, resg = 0;
+    double resabs = wgk[10] * cabs(fc);
+    for (int j = 0; j < 10; j++) {
+        resk += wgk[j] * (f1[j] + f2[j]);
+        resabs += wgk[j] * (cabs(f1[j]) + cabs(f2[j]));
+        if (j & 1)
+            resg += wg[j / 2] * (f1[j] + f2[j]);
+    }
+    double complex mean = resk / 2;
+    double resasc = wgk[10] * cabs(fc - mean);
+    for (int j = 0; j < 10; j++)
+        resasc += wgk[j] * (cabs(f1[j] - mean) + cabs(f2[j] - mean));
+    p->value = resk * h;
+    p->resabs = resabs * h;
+    resasc *= h;
+    double err = cabs((resk - resg) * h);
+    if (resasc != 0 && err != 0)
+        err = resasc * fmin(1, pow(200 * err / resasc, 1.5));
+    if (p->resabs > DBL_MIN / (50 * DBL_EPSILON))
+        err = fmax(50 * DBL_EPSILON * p->resabs, err);
+    p->err = err;
+}
+
+/* Somme des intervalles compris dans [t0, t1] ; -1 s'ils ne le couvrent
+   pas entièrement ou n'ont pas tous une valeur */
+static int quad_range(const Quad *q, double t0, double t1, double complex *v) {
+    double len = 0;
+    *v = 0;
+    for (int k = 0; k < q->npieces; k++) {
+        const Piece *p = &q->pieces[k];
+        if (p->t0 >= t0 && p->t1 <= t1) {
+            if (p->code != CALC_OK || p->frozen)
+                return -1;
+            *v += p->value;
+            len += p->t1 - p->t0;
+        }
+    }
+    return len == t1 - t0 ? 0 : -1;
+}
+
+/* Largeur en x d'un intervalle au bord en deçà de laquelle ses nœuds,
+   arrondis à la résolution de x près de la borne (et de t près de 1),
+   ne sont plus assez précis pour une singularité : quad_edge() */
+static int quad_at_limit(const Quad *q, const Piece *p) {
+    double w = cabs(q->span) * (p->t1 - p->t0);
+    if (p->t0 == 0)
+        return w <= QUAD_EDGE_ULPS * DBL_EPSILON * cabs(q->a);
+    if (p->t1 == 1)
+        return w <= QUAD_EDGE_ULPS * DBL_EPSILON * fmax(cabs(q->b), cabs(q->span));
+    return 0;
+}
+
+/* Intégrale de p, au bord de [0, 1], prolongée jusqu'à la borne depuis
+   ses voisins. Pour une singularité en |x - borne|^-α, les intégrales
+   sur les voisins de longueurs w, 2w et 4w décroissent vers la borne en
+   progression géométrique de raison 2^(α - 1) : la somme de cette
+   progression remplace celle de p, et l'écart avec la même somme
+   calculée un voisin plus loin en est l'erreur. Renvoie 1 si la
+   progression ne décroît pas assez vite (1/x : intégrale divergente), -1
+   si p n'est pas au bord ou que ses voisins ne sont pas calculés. */
+static int quad_tail(const Quad *q, const Piece *p, double complex *tail, double *err) {
+    double w = p->t1 - p->t0;
+    int left = p->t0 == 0;
+    if ((!left && p->t1 != 1) || 8 * w > 1)
+        return -1;
+    double complex v[3];
+    for (int k = 0; k < 3; k++) {
+        double lo = w * (1 << k), hi = 2 * lo; /* distances à la borne */
+        if (quad_range(q, left ? lo : 1 - hi, left ? hi : 1 - lo, &v[k]) < 0)
+            return -1;
+    }
+    double complex r1 = v[0] / v[1], r2 = v[1] / v[2];
+    if (!(cabs(r1) <= QUAD_TAIL_RATIO) || !(cabs(r2) <= QUAD_TAIL_RATIO))
+        return 1;
+    *tail = v[0] * r1 / (1 - r1);
+    *err = cabs(*tail - (v[1] * r2 / (1 - r2) - v[0])) + 50 * DBL_EPSILON * cabs(*tail);
+    return 0;
+}
+
+/* Intervalle au bord qui ne peut plus être coupé utilement : le corps y
+   échoue (division par un nombre trop petit près d'une singularité comme
+   celle de 1/sqrt(x) en 0), un nœud est tombé sur la borne, ou sa
+   largeur a atteint quad_at_limit(). Son intégrale est remplacée par
+   celle prolongée depuis ses voisins (quad_tail) si le corps échoue, ou
+   si l'erreur en est bien moindre, et il n'est plus coupé. Une erreur du
+   corps devient CALC_ERR_DIVERGENT (à la position de l'opérateur) près
+   d'une singularité non intégrable ou quand un nœud est sur la borne ;
+   ailleurs, elle reste signalée telle quelle. */
+static void quad_edge(const Quad *q, Piece *p, size_t pos) {
+    double complex tail;
+    double err;
+    int t = quad_tail(q, p, &tail, &err);
+    if (t == 0 && (p->code != CALC_OK || p->frozen || err < QUAD_TAIL_GAIN * p->err)) {
+        p->code = CALC_OK;
+        p->value = tail;
+        p->resabs = cabs(tail);
+        p->err = err;
+        p->frozen = 1;
+    } else if (p->code != CALC_OK && (t == 1 || p->frozen)) {
+        p->code = CALC_ERR_DIVERGENT;
+        p->pos = pos;
+    }
+}
+
+/* Tâche k d'un tour parallèle : sa part des intervalles, avec son propre
+   contexte */
+static void quad_task(void *arg, size_t k) {
+    Quad *q = arg;
+    size_t n = q->ntasks;
+    for (size_t i = q->ntodo * k / n; i < q->ntodo * (k + 1) / n; i++)
+        gauss_kronrod(q, &q->runners[k], &q->pieces[q->todo[i]]);
+}
+
+/* Intervalle à couper : erreur décroissante, puis position */
+typedef struct {
+    double err, t0;
+    int index;
+} Candidate;
+
+static int compare_candidates(const void *pa, const void *pb) {
+    const Candidate *a = pa, *b = pb;
+    if (a->err != b->err)
+        return a->err < b->err ? 1 : -1;
+    return (a->t0 > b->t0) - (a->t0 < b->t0);
+}
+
+/* Nombre de tâches d'un tour parallèle, dont les contextes sont créés au
+   premier tour qui en a besoin */
+static int quad_tasks(Quad *q) {
+    pthread_once(&calc_pool_once, create_pool);
+    if (!q->cloned) {
+        q->cloned = 1;
+        int n = pool_size(calc_pool);
+        while (q->nrunners < n && runner_clone(&q->runners[q->nrunners], &q->runners[0]) == 0)
+            q->nrunners++;
+    }
+    return q->ntodo < q->nrunners ? q->ntodo : q->nrunners;
+}
+
+static CalcErrorCode integrate(Runner *r, double complex a, double complex b,
+                               double complex *result, size_t *pos) {
+    *result = 0;
+    if (a == b)
+        return CALC_OK;
+    Quad q;
+    memset(&q, 0, sizeof(q));
+    q.a = a;
+    q.b = b;
+    q.span = b - a;
+    int nthreads = pool_default_threads();
+    q.pieces = malloc(QUAD_MAX_PIECES * sizeof(Piece));
+    q.todo = malloc(QUAD_MAX_PIECES * sizeof(int));
+    Candidate *cands = malloc(QUAD_MAX_PIECES * sizeof(Candidate));
+    q.runners = calloc(nthreads, sizeof(Runner));
+    if (!q.pieces || !q.todo || !cands || !q.runners) {
+        free(q.pieces);
+        free(q.todo);
+        free(cands);
+        free(q.runners);
+        return CALC_ERR_NOMEM;
+    }
+    q.runners[0] = *r;
+    q.nrunners = 1;
+    memset(&q.pieces[0], 0, sizeof(Piece));
+    q.pieces[0].t1 = 1;
+    q.npieces = 1;
+    q.todo[0] = 0;
+    q.ntodo = 1;
+
+    CalcErrorCode code = CALC_OK;
+    double complex sum = 0;
+    double last_err = INFINITY, err = 0, resabs = 0;
+    unsigned long long cost = 0; /* durée d'un intervalle, en ns */
+    int stalled = 0, converged = 0;
+    for (;;) {
+        q.ntasks = 1;
+        if (nthreads > 1 && q.ntodo > 1 && cost * q.ntodo >= QUAD_PARALLEL_NS)
+            q.ntasks = quad_tasks(&q);
+        if (q.ntasks > 1) {
+            pool_run(calc_pool, q.ntasks, quad_task, &q);
+        } else {
+            unsigned long long t0 = calc_stats_now_ns();
+            for (int i = 0; i < q.ntodo; i++)
+                gauss_kronrod(&q, &q.runners[0], &q.pieces[q.todo[i]]);
+            cost = (calc_stats_now_ns() - t0) / q.ntodo;
+        }
+        /* Première erreur dans l'ordre de l'intervalle, quel que soit le
+           découpage entre les tâches, hors singularités aux bornes */
+        const Piece *failed = NULL;
+        for (int i = 0; i < q.ntodo; i++) {
+            Piece *p = &q.pieces[q.todo[i]];
+            if (p->code != CALC_OK || p->frozen || quad_at_limit(&q, p))
+                quad_edge(&q, p, *pos);
+            if (p->code != CALC_OK && (!failed || p->t0 < failed->t0))
+                failed = p;
+        }
+        if (failed) {
+            code = failed->code;
+            *pos = failed->pos;
+            break;
+        }
+
+        err = resabs = 0;
+        sum = 0;
+        for (int k = 0; k < q.npieces; k++) {
+            sum += q.pieces[k].value;
+            err += q.pieces[k].err;
+            resabs += q.pieces[k].resabs;
+        }
+        double tol = fmax(QUAD_RELTOL * cabs(sum), QUAD_ABSTOL * resabs);
+        if (!(err > tol)) {
+            converged = 1; /* ou NaN */
+            break;
+        }
+        stalled = err < last_err ? 0 : stalled + 1;
+        if (stalled >= QUAD_STALL)
+            break;
+        last_err = err;
+
+        /* Les plus grandes erreurs d'abord, jusqu'à ce que le reste passe
+           sous la tolérance */
+        for (int k = 0; k < q.npieces; k++)
+            cands[k] = (Candidate){ q.pieces[k].err, q.pieces[k].t0, k };
+        qsort(cands, q.npieces, sizeof(Candidate), compare_candidates);
+        int nsplit = 0;
+        for (int k = 0; k < q.npieces && err > tol && q.npieces + nsplit < QUAD_MAX_PIECES; k++) {
+            Piece *p = &q.pieces[cands[k].index];
+            double mid = (p->t0 + p->t1) / 2;
+            if (p->frozen || mid <= p->t0 || mid >= p->t1) {
+                /* intervalle qui ne peut plus être coupé : son erreur ne
+                   doit pas faire couper tous les autres */
+                err -= p->err;
+                continue;
+            }
+            err -= p->err;
+            Piece *right = &q.pieces[q.npieces + nsplit];
+            memset(right, 0, sizeof(*right));
+            right->t0 = mid;
+            right->t1 = p->t1;
+            p->t1 = mid;
+            q.todo[2 * nsplit] = cands[k].index;
+            q.todo[2 * nsplit + 1] = q.npieces + nsplit;
+            nsplit++;
+        }
+        if (nsplit == 0)
+            break;
+        q.npieces += nsplit;
+        q.ntodo = 2 * nsplit;
+    }
+    /* Abandon (erreur qui ne diminue plus, ou trop d'intervalles) : une
+       intégrale divergente, comme celle de 1/t sur [0, 1], s'arrête ici
+       sur une erreur du même ordre que le résultat */
+    if (code == CALC_OK && !converged && err > QUAD_FAILTOL * fmax(cabs(sum), resabs))
+        code = CALC_ERR_DIVERGENT;
+    if (code == CALC_OK)
+        *result = q.span * sum;
+
+    for (int k = 1; k < q.nrunners; k++) {
+        calc_context_free(q.runners[k].ctx);
+        free(q.runners[k].vals);
+    }
+    free(q.pieces);
+    free(q.todo);
+    free(cands);
+    free(q.runners);
+    return code;
+}
+
+/* ============================= */
+/* Résolution                    */
+/* ============================= */
+
+#define SOLVE_MAX_ITER 100
+/* Pas des différences centrées, relatif à |x| : racine cubique de
+   DBL_EPSILON */
+#define SOLVE_STEP 6e-6
+/* Pas de Newton accepté comme convergé quand les itérations ne
+   progressent plus (racine multiple, bruit d'arrondi) */
+#define SOLVE_LOOSE 1e-8
+
+/* f(x) ; 0 si l'exécution réussit avec une valeur finie */
+static int eval_at(Runner *r, double complex x, double complex *fx) {
+    if (runner_eval(r, x, fx) != CALC_OK)
+        return -1;
+    return isfinite(creal(*fx)) && isfinite(cimag(*fx)) ? 0 : -1;
+}
+
+static int eval_real(Runner *r, double x, double *fx) {
+    double complex z;
+    if (eval_at(r, x, &z) < 0 || cimag(z) != 0)
+        return -1;
+    *fx = creal(z);
+    return 0;
+}
+
+static int opposite(double a, double b) {
+    return (a < 0 && b > 0) || (a > 0 && b < 0);
+}
+
+/* Méthode de Brent sur [a, b], où f change de signe. Un changement de
+   signe sans racine (pôle) est rejeté : |f| y reste grand. */
+static int brent(Runner *r, double a, double b, double fa, double fb, double *root) {
+    double bound = fmax(fabs(fa), fabs(fb));
+    double c = a, fc = fa, d = b - a, e = d;
+    /* assez de tours pour une bissection qui descendrait jusqu'à DBL_MIN */
+    for (int it = 0; it < 2000; it++) {
+        if (fabs(fc) < fabs(fb)) {
+            a = b; b = c; c = a;
+            fa = fb; fb = fc; fc = fa;
+        }
+        double tol = 2 * DBL_EPSILON * fabs(b) + DBL_MIN;
+        double m = (c - b) / 2;
+        if (fabs(m) <= tol || fb == 0) {
+            if (fabs(fb) > bound)
+                return -1;
+            *root = b;
+            return 0;
+        }
+        if (fabs(e) >= tol && fabs(fa) > fabs(fb)) {
+            /* interpolation : sécante ou quadratique inverse */
+            double s = fb / fa, p, q;
+            if (a == c) {
+                p = 2 * m * s;
+                q = 1 - s;
+            } else {
+                double t = fa / fc, u = fb / fc;
+                p = s * (2 * m * t * (t - u) - (b - a) * (u - 1));
+                q = (t - 1) * (u - 1) * (s - 1);
+            }
+            if (p > 0)
+                q = -q;
+            p = fabs(p);
+            if (2 * p < fmin(3 * m * q - fabs(tol * q), fabs(e * q))) {
+                e = d;
+                d = p / q;
+            } else {
+                d = e = m;
+            }
+        } else {
+            d = e = m; /* bissection */
+        }
+        a = b;
+        fa = fb;
+        b += fabs(d) > tol ? d : copysign(tol, m);
+        if (eval_real(r, b, &fb) < 0)
+            return -1;
+        if (!opposite(fb, fc) && fb != 0) {
+            c = a;
+            fc = fa;
+            d = e = b - a;
+        }
+    }
+    return -1;
+}
+
+/* Racine réelle près de x0 (f(x0) = f0) */
+static int solve_real(Runner *r, double x0, double f0, double *root) {
+    double x = x0, fx = f0, step = INFINITY;
+    for (int it = 0; it < SOLVE_MAX_ITER; it++) {
+        if (fx == 0) {
+            *root = x;
+            return 0;
+        }
+        /* Pas absolu, puis relatif si la différence s'annule (x proche
+           d'une racine multiple en 0) */
+        double h = SOLVE_STEP * fmax(fabs(x), 1), fp, fm, full = INFINITY;
+        for (int k = 0; k < 2 && !isfinite(full); k++, h = SOLVE_STEP * fabs(x)) {
+            if (h == 0 || eval_real(r, x + h, &fp) < 0 || eval_real(r, x - h, &fm) < 0)
+                break;
+            if (opposite(fx, fp))
+                return brent(r, x, x + h, fx, fp, root);
+            if (opposite(fx, fm))
+                return brent(r, x - h, x, fm, fx, root);
+            full = fx / ((fp - fm) / (2 * h));
+        }
+        if (!isfinite(full))
+            break;
+        step = full;
+        if (fabs(step) <= 4 * DBL_EPSILON * fabs(x)) {
+            *root = x;
+            return 0;
+        }
+        /* Pas amorti jusqu'à ce que |f| diminue */
+        double s = step, xn = x, fn = fx;
+        int k;
+        for (k = 0; k < 60; k++, s /= 2) {
+            xn = x - s;
+            if (eval_real(r, xn, &fn) < 0)
+                continue;
+            if (opposite(fx, fn))
+                return brent(r, x, xn, fx, fn, root);
+            if (fabs(fn) < fabs(fx))
+                break;
+        }
+        if (k == 60)
+            break;
+        x = xn;
+        fx = fn;
+    }
+    if (fabs(step) <= SOLVE_LOOSE * fmax(fabs(x), 1)) {
+        *root = x;
+        return 0;
+    }
+    /* Changement de signe de part et d'autre du départ */
+    double fl = f0, fr = f0, xl = x0, xr = x0;
+    for (double d = 0.01 * fmax(fabs(x0), 1); d < 1e300; d *= 1.6) {
+        double f;
+        if (eval_real(r, x0 + d, &f) == 0) {
+            if (opposite(fr, f))
+                return brent(r, xr, x0 + d, fr, f, root);
+            xr = x0 + d;
+            fr = f;
+        }
+        if (eval_real(r, x0 - d, &f) == 0) {
+            if (opposite(fl, f))
+                return brent(r, x0 - d, xl, f, fl, root);
+            xl = x0 - d;
+            fl = f;
+        }
+    }
+    return -1;
+}
+
+/* Newton amorti dans le plan complexe */
+static int solve_complex(Runner *r, double complex x, double complex fx, double complex *root) {
+    double complex step = INFINITY;
+    for (int it = 0; it < SOLVE_MAX_ITER; it++) {
+        if (fx == 0) {
+            *root = x;
+            return 0;
+        }
+        double h = SOLVE_STEP * fmax(cabs(x), 1);
+        double complex fp, fm, full = INFINITY;
+        for (int k = 0; k < 2 && !isfinite(cabs(full)); k++, h = SOLVE_STEP * cabs(x)) {
+            if (h == 0 || eval_at(r, x + h, &fp) < 0 || eval_at(r, x - h, &fm) < 0)
+                break;
+            full = fx / ((fp - fm) / (2 * h));
+        }
+        if (!isfinite(creal(full)) || !isfinite(cimag(full)))
+            break;
+        step = full;
+        if (cabs(step) <= 4 * DBL_EPSILON * cabs(x)) {
+            *root = x;
+            return 0;
+        }
+        double complex s = step, xn = x, fn = fx;
+        int k;
+        for (k = 0; k < 60; k++, s /= 2) {
+            xn = x - s;
+            if (eval_at(r, xn, &fn) == 0 && cabs(fn) < cabs(fx))
+                break;
+        }
+        if (k == 60)
+            break;
+        x = xn;
+        fx = fn;
+    }
+    if (cabs(step) <= SOLVE_LOOSE * fmax(cabs(x), 1)) {
+        *root = x;
+        return 0;
+    }
+    return -1;
+}
+
+static CalcErrorCode solve(Runner *r, double complex x0, double complex *result, size_t *pos) {
+    double complex f0;
+    CalcErrorCode code = runner_eval(r, x0, &f0);
+    if (code != CALC_OK) {
+        *pos = r->ctx->err.pos;
+        return code;
+    }
+    if (!isfinite(creal(f0)) || !isfinite(cimag(f0)))
+        return CALC_ERR_NO_ROOT;
+    if (cimag(x0) == 0 && cimag(f0) == 0) {
+        double root;
+        if (solve_real(r, creal(x0), creal(f0), &root) == 0) {
+            *result = root;
+            return CALC_OK;
+        }
+        /* Pas de racine réelle trouvée : départ hors de l'axe réel */
+        x0 = CMPLX(creal(x0), 0.5 * fmax(fabs(creal(x0)), 1));
+        if (eval_at(r, x0, &f0) < 0)
+            return CALC_ERR_NO_ROOT;
+    }
+    return solve_complex(r, x0, f0, result) == 0 ? CALC_OK : CALC_ERR_NO_ROOT;
+}
+
+/* ============================= */
+/* Dérivation                    */
+/* ============================= */
+
+/* La variable liée a pour dérivée 1, les variables extérieures 0 */
+static CalcErrorCode diff(Runner *r, double complex x, double complex *result, size_t *pos) {
+    double complex *dvars = calloc(body_vars(r->body), sizeof(double complex)), value;
+    if (!dvars)
+        return CALC_ERR_NOMEM;
+    dvars[0] = 1;
+    r->vals[0] = x;
+    r->ctx->vars = r->vals;
+    CalcErrorCode code = calc_exec_dual(r->ctx, r->body, dvars, 1, &value, result);
+    if (code != CALC_OK)
+        *pos = r->ctx->err.pos;
+    free(dvars);
+    return code;
+}
+
+/* ============================= */
+/* Sommes et produits            */
+/* ============================= */
+
+/* Les termes sont répartis en tranches consécutives, qui sont les tâches
+   du pool. La taille d'une tranche ne dépend que du nombre de termes :
+   chaque tranche est accumulée dans l'ordre, puis les tranches sont
+   réunies dans l'ordre, et le résultat est le même quel que soit le
+   nombre de threads. */
+#define SUM_CHUNK 65536
+#define SUM_MAX_CHUNKS 65536
+/* Termes calculés d'un coup par calc_run_columns() ; l'interruption et
+   l'avancement sont vus à ce rythme */
+#define SUM_BLOCK 1024
+/* Sommes partielles indépendantes dans un bloc */
+#define SUM_LANES 4
+/* Au-delà de 2^53 termes, k = a + i n'est plus exact */
+#define SUM_MAX_TERMS 9007199254740992.0
+/* Le produit est ramené vers 1 quand il sort de [2^-64, 2^64] */
+#define PROD_RESCALE 0x1p64
+
+/* Somme compensée de Neumaier, partie réelle et imaginaire ; produit
+   (p + pc) 2^e, compensé (erreur de chaque multiplication récupérée par
+   fma) tant qu'il reste réel */
+typedef struct {
+    double re, re_c, im, im_c;
+    double complex p;
+    double pc;
+    long long e;
+    CalcErrorCode code;    /* premier terme en erreur */
+    size_t pos;
+} Acc;
+
+/* La compensation n'a de sens que tant que la somme reste finie : elle
+   est ignorée à la fin sinon (voir sum_value) */
+static void neumaier(double *s, double *c, double x) {
+    double t = *s + x;
+    *c += fabs(*s) >= fabs(x) ? (*s - t) + x : (x - t) + *s;
+    *s = t;
+}
+
+/* Ajoute x[0..n-1] : SUM_LANES sommes partielles indépendantes (terme j
+   dans la somme j modulo SUM_LANES), réunies ensuite dans l'ordre */
+static void neumaier_block(double *s, double *c, const double *x, int n) {
+    double ls[SUM_LANES] = { 0 }, lc[SUM_LANES] = { 0 };
+    int j = 0;
+    for (; j + SUM_LANES <= n; j += SUM_LANES)
+        for (int l = 0; l < SUM_LANES; l++)
+            neumaier(&ls[l], &lc[l], x[j + l]);
+    for (int l = 0; j < n; j++, l++)
+        neumaier(&ls[l], &lc[l], x[j]);
+    for (int l = 0; l < SUM_LANES; l++) {
+        neumaier(s, c, ls[l]);
+        *c += lc[l];
+    }
+}
+
+static double sum_value(double s, double c) {
+    return isfinite(s) ? s + c : s;
+}
+
+static void acc_mul(Acc *acc, double complex x) {
+    if (cimag(x) == 0 && cimag(acc->p) == 0) {
+        double p = creal(acc->p), y = creal(x), py = p * y;
+        acc->pc = acc->pc * y + fma(p, y, -py);
+        acc->p = py;
+    } else {
+        acc->p = (acc->p + acc->pc) * x;
+        acc->pc = 0;
+    }
+    double m = fmax(fabs(creal(acc->p)), fabs(cimag(acc->p)));
+    if ((m > PROD_RESCALE || m < 1 / PROD_RESCALE) && m != 0 && isfinite(m)) {
+        int k;
+        frexp(m, &k);
+        acc->p = CMPLX(scalbn(creal(acc->p), -k), scalbn(cimag(acc->p), -k));
+        acc->pc = scalbn(acc->pc, -k);
+        acc->e += k;
+    }
+}
+
+typedef struct {
+    Runner r;
+    const double **cols;   /* k, puis les variables extérieures */
+    double *buf;           /* colonnes, puis parties réelles et imaginaires */
+} SumRunner;
+
+typedef struct {
+    int prod;
+    double a;
+    unsigned long long n;      /* termes */
+    unsigned long long chunk;  /* termes par tranche */
+    Acc *chunks;
+    int columns;               /* termes calculés par calc_run_columns() */
+    size_t pos;                /* position de l'opérateur */
+    Runner *base;
+    /* Contextes libres, créés à la demande : autant que de threads */
+    pthread_mutex_t lock;
+    SumRunner **spare;
+    int nspare;
+    SumRunner **all;
+    int nall, cap;
+    atomic_ullong failed;      /* première tranche en erreur */
+    atomic_ullong done;        /* termes calculés */
+    atomic_int *cancel, *progress;
+} Sum;
+
+static void free_sum_runner(SumRunner *w, int own) {
+    if (own) {
+        calc_context_free(w->r.ctx);
+        free(w->r.vals);
+    }
+    free(w->cols);
+    free(w->buf);
+    free(w);
+}
+
+/* Le premier contexte est celui de l'appelant, les suivants des copies */
+static SumRunner *new_sum_runner(Sum *s) {
+    int nvars = body_vars(s->base->body), own = s->nall > 0;
+    SumRunner *w = calloc(1, sizeof(SumRunner));
+    if (!w)
+        return NULL;
+    if (!own) {
+        w->r = *s->base;
+    } else if (runner_clone(&w->r, s->base) < 0) {
+        free(w);
+        return NULL;
+    }
+    w->cols = malloc(nvars * sizeof(double *));
+    w->buf = malloc((nvars + 2) * SUM_BLOCK * sizeof(double));
+    if (!w->cols || !w->buf) {
+        free_sum_runner(w, own);
+        return NULL;
+    }
+    /* Les variables extérieures sont des colonnes constantes */
+    for (int k = 0; k < nvars; k++)
+        w->cols[k] = w->buf + k * SUM_BLOCK;
+    for (int k = 1; k < nvars; k++)
+        for (int j = 0; j < SUM_BLOCK; j++)
+            w->buf[k * SUM_BLOCK + j] = creal(s->base->vals[k]);
+    s->all[s->nall++] = w;
+    return w;
+}
+
+static SumRunner *take_runner(Sum *s) {
+    SumRunner *w = NULL;
+    pthread_mutex_lock(&s->lock);
+    if (s->nspare > 0)
+        w = s->spare[--s->nspare];
+    else if (s->nall < s->cap)
+        w = new_sum_runner(s);
+    pthread_mutex_unlock(&s->lock);
+    return w;
+}
+
+static void give_runner(Sum *s, SumRunner *w) {
+    pthread_mutex_lock(&s->lock);
+    s->spare[s->nspare++] = w;
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Termes [i, i + m) de la somme, accumulés dans acc */
+static void sum_block(Sum *s, SumRunner *w, unsigned long long i, int m, Acc *acc) {
+    int nvars = body_vars(s->base->body);
+    double *re = w->buf + nvars * SUM_BLOCK, *im = re + SUM_BLOCK;
+    double *k = w->buf;
+    for (int j = 0; j < m; j++)
+        k[j] = s->a + (double)(i + j);
+    if (s->columns) {
+        if (calc_run_columns(w->r.ctx, s->base->body, w->cols, m, re, im, NULL) > 0) {
+            acc->code = w->r.ctx->err.code;
+            acc->pos = w->r.ctx->err.pos;
+            return;
+        }
+    } else {
+        for (int j = 0; j < m; j++) {
+            double complex z;
+            acc->code = runner_eval(&w->r, k[j], &z);
+            if (acc->code != CALC_OK) {
+                acc->pos = w->r.ctx->err.pos;
+                return;
+            }
+            re[j] = creal(z);
+            im[j] = cimag(z);
+        }
+    }
+    if (s->prod) {
+        for (int j = 0; j < m; j++)
+            acc_mul(acc, CMPLX(re[j], im[j]));
+    } else {
+        neumaier_block(&acc->re, &acc->re_c, re, m);
+        for (int j = 0; j < m; j++) {
+            if (im[j] != 0) {
+                neumaier_block(&acc->im, &acc->im_c, im, m);
+                break;
+            }
+        }
+    }
+}
+
+/* Tranche c : s'arrête dès qu'une tranche précédente a échoué */
+static void sum_task(void *arg, size_t c) {
+    Sum *s = arg;
+    Acc *acc = &s->chunks[c];
+    memset(acc, 0, sizeof(*acc));
+    acc->p = 1;
+    SumRunner *w = take_runner(s);
+    if (!w) {
+        acc->code = CALC_ERR_NOMEM;
+        acc->pos = s->pos;
+    }
+    unsigned long long i = c * s->chunk;
+    unsigned long long end = i + s->chunk < s->n ? i + s->chunk : s->n;
+    while (acc->code == CALC_OK && i < end && c < atomic_load(&s->failed)) {
+        if (s->cancel && atomic_load(s->cancel)) {
+            acc->code = CALC_ERR_CANCELLED;
+            acc->pos = s->pos;
+            break;
+        }
+        int m = end - i < SUM_BLOCK ? (int)(end - i) : SUM_BLOCK;
+        sum_block(s, w, i, m, acc);
+        i += m;
+        unsigned long long done = atomic_fetch_add(&s->done, m) + m;
+        if (s->progress)
+            atomic_store(s->progress, (int)(done * 1000 / s->n));
+    }
+    if (acc->code != CALC_OK) {
+        unsigned long long first = atomic_load(&s->failed);
+        while (c < first && !atomic_compare_exchange_weak(&s->failed, &first, c))
+            ;
+    }
+    if (w)
+        give_runner(s, w);
+}
+
+static CalcErrorCode sum(CalcContext *ctx, Runner *r, int prod, double complex a,
+                         double complex b, double complex *result, size_t *pos) {
+    if (cimag(a) != 0 || cimag(b) != 0 || !isfinite(creal(a)) || !isfinite(creal(b)) ||
+        creal(b) - creal(a) >= SUM_MAX_TERMS)
+        return CALC_ERR_BOUNDS;
+    *result = prod;
+    if (creal(b) < creal(a))
+        return CALC_OK; /* somme ou produit vide */
+    Sum s;
+    memset(&s, 0, sizeof(s));
+    s.prod = prod;
+    s.a = creal(a);
+    s.n = (unsigned long long)floor(creal(b) - creal(a)) + 1;
+    s.chunk = SUM_CHUNK;
+    if ((s.n + s.chunk - 1) / s.chunk > SUM_MAX_CHUNKS)
+        s.chunk = (s.n + SUM_MAX_CHUNKS - 1) / SUM_MAX_CHUNKS;
+    size_t nchunks = (s.n + s.chunk - 1) / s.chunk;
+    s.columns = r->outer_real && !r->dvars;
+    s.pos = *pos;
+    s.base = r;
+    s.cancel = ctx->cancel;
+    s.progress = ctx->progress;
+    atomic_init(&s.failed, nchunks);
+    atomic_init(&s.done, 0);
+    pthread_once(&calc_pool_once, create_pool);
+    s.cap = pool_size(calc_pool);
+    s.chunks = malloc(nchunks * sizeof(Acc));
+    s.spare = malloc(s.cap * sizeof(SumRunner *));
+    s.all = malloc(s.cap * sizeof(SumRunner *));
+    if (!s.chunks || !s.spare || !s.all) {
+        free(s.chunks);
+        free(s.spare);
+        free(s.all);
+        return CALC_ERR_NOMEM;
+    }
+    pthread_mutex_init(&s.lock, NULL);
+    if (s.progress)
+        atomic_store(s.progress, 0);
+
+    pool_run(calc_pool, nchunks, sum_task, &s);
+
+    Acc total;
+    memset(&total, 0, sizeof(total));
+    total.p = 1;
+    for (size_t c = 0; c < nchunks && total.code == CALC_OK; c++) {
+        const Acc *acc = &s.chunks[c];
+        if (acc->code != CALC_OK) {
+            total.code = acc->code;
+            *pos = acc->pos;
+        } else if (prod) {
+            acc_mul(&total, acc->p + acc->pc);
+            total.e += acc->e;
+        } else {
+            neumaier(&total.re, &total.re_c, acc->re);
+            neumaier(&total.im, &total.im_c, acc->im);
+            total.re_c += acc->re_c;
+            total.im_c += acc->im_c;
+        }
+    }
+    if (prod) {
+        int e = total.e > INT_MAX / 2 ? INT_MAX / 2 : total.e < INT_MIN / 2 ? INT_MIN / 2
+                                                                        : (int)total.e;
+        double complex p = total.p + total.pc;
+        *result = CMPLX(scalbn(creal(p), e), scalbn(cimag(p), e));
+    } else {
+        *result = CMPLX(sum_value(total.re, total.re_c), sum_value(total.im, total.im_c));
+    }
+    /* Une demande d'interruption arrivée pendant le calcul est consommée,
+       qu'une tranche l'ait vue ou non */
+    if (s.cancel && atomic_exchange(s.cancel, 0)) {
+        total.code = CALC_ERR_CANCELLED;
+        *pos = s.pos;
+    }
+    if (s.progress)
+        atomic_store(s.progress, -1);
+
+    for (int k = 0; k < s.nall; k++)
+        free_sum_runner(s.all[k], k > 0);
+    pthread_mutex_destroy(&s.lock);
+    free(s.chunks);
+    free(s.spare);
+    free(s.all);
+    return total.code;
+}
+
+/* ============================= */
+/* Partie API                    */
+/* ============================= */
+
+/* Exécution du corps de l'opérateur ins dans le contexte enfant de ctx ;
+   renvoie -1 si la mémoire manque */
+static int binder_runner(CalcContext *ctx, const CalcProgram *prog, const Instr *ins, Runner *r) {
+    r->body = prog->subs[ins->arg];
+    r->dvars = NULL;
+    if (!ctx->child)
+        ctx->child = calc_context_new();
+    r->ctx = ctx->child;
+    if (r->ctx)
+        r->ctx->cancel = ctx->cancel;
+    int nvars = body_vars(r->body);
+    r->vals = malloc(nvars * sizeof(double complex));
+    if (!r->ctx || !r->vals) {
+        free(r->vals);
+        return -1;
+    }
+    /* Seules les variables lues par le corps sont recopiées : le repliement
+       des constantes évalue les intégrales sans variables extérieures */
+    r->outer_real = 1;
+    for (int k = 1; k < nvars; k++) {
+        r->vals[k] = ctx->vars[k - 1];
+        if (cimag(r->vals[k]) != 0)
+            r->outer_real = 0;
+    }
+    return 0;
+}
+
+CalcErrorCode calc_exec_binder(CalcContext *ctx, const CalcProgram *prog, const Instr *ins,
+                               const double complex *args, double complex *result) {
+    size_t pos = prog->pos[ins - prog->code];
+    double complex a = args[0], b = ins->argc > 1 ? args[1] : 0;
+    int nmemo = ctx->nmemo < CALC_MEMO ? ctx->nmemo : CALC_MEMO;
+    for (int k = 0; ctx->memo_on && k < nmemo; k++) {
+        const BinderMemo *m = &ctx->memo[k];
+        if (m->ins == ins && m->a == a && m->b == b) {
+            *result = m->result;
+            return CALC_OK;
+        }
+    }
+    Runner r;
+    if (binder_runner(ctx, prog, ins, &r) < 0) {
+        calc_set_error(ctx, CALC_ERR_NOMEM, pos);
+        return ctx->err.code;
+    }
+    CalcErrorCode code;
+    if (ins->op == OP_INTEGRATE)
+        code = integrate(&r, a, b, result, &pos);
+    else if (ins->op == OP_SOLVE)
+        code = solve(&r, a, result, &pos);
+    else if (ins->op == OP_DIFF)
+        code = diff(&r, a, result, &pos);
+    else
+        code = sum(ctx, &r, ins->op == OP_PROD, a, b, result, &pos);
+    free(r.vals);
+    if (code != CALC_OK)
+        calc_set_error(ctx, code, pos);
+    else if (ctx->memo_on)
+        ctx->memo[ctx->nmemo++ % CALC_MEMO] = (BinderMemo){ ins, a, b, *result };
+    return code;
+}
+
+/* Règle de Leibniz : d/dθ ∫[a, b] f(x, θ) dx = ∫[a, b] ∂f/∂θ dx
+   + f(b) b' - f(a) a' */
+CalcErrorCode calc_exec_tangent(CalcContext *ctx, const CalcProgram *prog, const Instr *ins,
+                                const double complex *args, const double complex *targs,
+                                const double complex *dvars, double complex *result) {
+    size_t pos = prog->pos[ins - prog->code];
+    Runner r;
+    if (binder_runner(ctx, prog, ins, &r) < 0) {
+        calc_set_error(ctx, CALC_ERR_NOMEM, pos);
+        return ctx->err.code;
+    }
+    int varies = 0;
+    for (int k = 1; k < body_vars(r.body); k++)
+        varies |= dvars[k] != 0;
+    CalcErrorCode code = CALC_OK;
+    *result = 0;
+    if (varies) {
+        r.dvars = dvars;
+        if (ins->op == OP_INTEGRATE)
+            code = integrate(&r, args[0], args[1], result, &pos);
+        else
+            code = sum(ctx, &r, 0, args[0], args[1], result, &pos);
+        r.dvars = NULL;
+    }
+    for (int k = 1; ins->op == OP_INTEGRATE && k >= 0 && code == CALC_OK; k--) {
+        double complex f;
+        if (targs[k] == 0)
+            continue;
+        code = runner_eval(&r, args[k], &f);
+        if (code != CALC_OK)
+            pos = r.ctx->err.pos;
+        else
+            *result += (k == 1 ? f : -f) * targs[k];
+    }
+    free(r.vals);
+    if (code != CALC_OK)
+        calc_set_error(ctx, code, pos);
+    return code;
+}
@@ -0,0 +1,156 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon.h"
+
+/* ============================= */
+/* Partie Client                 */
+/* calc_client [-s SOCKET] [expression...]
+   Envoie les expressions données en arguments, ou à défaut les lignes
+   de l'entrée standard, au démon calcd et écrit ses réponses sur la
+   sortie standard, une ligne par expression. L'envoi et la réception
+   se font en même temps : une longue entrée n'attend jamais les
+   réponses. */
+/* ============================= */
+
+#define CLIENT_BUF_SIZE (64 << 10)
+
+static int connect_to(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s : chemin trop long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *path = getenv(CALCD_SOCKET_ENV);
+    int k = 1;
+    if (k + 1 < argc && strcmp(argv[k], "-s") == 0) {
+        path = argv[k + 1];
+        k += 2;
+    } else if (k < argc && argv[k][0] == '-' && argv[k][1] == '-') {
+        fprintf(stderr, "Usage : %s [-s SOCKET] [expression...]\n", argv[0]);
+        return 2;
+    }
+    if (!path || !*path)
+        path = CALCD_SOCKET_DEFAULT;
+    int fd = connect_to(path);
+    if (fd < 0)
+        return 1;
+
+    /* Données à envoyer : les arguments, ou l'entrée standard par morceaux */
+    char *out = NULL;
+    size_t out_len = 0, out_pos = 0;
+    int from_stdin = k == argc;
+    if (from_stdin) {
+        out = malloc(CLIENT_BUF_SIZE);
+    } else {
+        for (int a = k; a < argc; a++)
+            out_len += strlen(argv[a]) + 1;
+        out = malloc(out_len + 1);
+        out_len = 0;
+        for (int a = k; a < argc; a++)
+            out_len += sprintf(out + out_len, "%s\n", argv[a]);
+    }
+    char *in = malloc(CLIENT_BUF_SIZE);
+    if (!out || !in) {
+        perror("malloc");
+        return 1;
+    }
+
+    /* L'entrée standard n'est lue que lorsqu'elle a des données : les
+       réponses déjà arrivées sont écrites pendant qu'elle attend */
+    int sending = 1, ret = 0;
+    for (;;) {
+        if (sending && out_pos == out_len && !from_stdin) {
+            shutdown(fd, SHUT_WR); /* le démon répond à la dernière ligne puis ferme */
+            sending = 0;
+        }
+        int want_stdin = sending && from_stdin && out_pos == out_len;
+        struct pollfd pfd[2] = {
+            { fd, POLLIN | (sending && out_pos < out_len ? POLLOUT : 0), 0 },
+            { want_stdin ? STDIN_FILENO : -1, POLLIN, 0 }
+        };
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            ret = 1;
+            break;
+        }
+        if (pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, in, CLIENT_BUF_SIZE);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0) {
+                perror("read");
+                ret = 1;
+                break;
+            }
+            if (n == 0)
+                break;
+            if (write_all(STDOUT_FILENO, in, n) < 0) {
+                perror("write");
+                ret = 1;
+                break;
+            }
+        }
+        if (pfd[0].revents & POLLOUT) {
+            ssize_t n = send(fd, out + out_pos, out_len - out_pos, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n < 0 && errno != EINTR && errno != EAGAIN) {
+                perror("send");
+                ret = 1;
+                break;
+            }
+            if (n > 0)
+                out_pos += n;
+        }
+        if (pfd[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(STDIN_FILENO, out, CLIENT_BUF_SIZE);
+            if (n > 0) {
+                out_len = n;
+                out_pos = 0;
+            } else if (n == 0 || errno != EINTR) {
+                if (n < 0)
+                    perror("read");
+                from_stdin = 0;
+            }
+        }
+    }
+    close(fd);
+    free(out);
+    free(in);
+    return ret;
+}
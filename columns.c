@@ -0,0 +1,501 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "columns.h"
+#include "calc.h"
+#include "pool.h"
+#include "strbuf.h"
+
+/* ============================= */
+/* Partie Mode Colonnes          */
+/* Évalue une même expression, à variables, sur chaque ligne d'un
+   tableau de valeurs, sans initialiser ncurses.
+
+   Par défaut l'entrée est en CSV : une ligne par jeu de valeurs,
+   séparées par des virgules, dans l'ordre des variables. La première
+   ligne de chaque fichier donne les noms des variables, sauf si --vars
+   les fournit. Chaque ligne produit exactement une ligne de sortie :
+   le résultat, ou le message d'erreur, comme en mode batch.
+
+   Avec --binary (et --vars), chaque ligne d'entrée est faite de nvars
+   doubles natifs, et chaque ligne de sortie d'un double : le résultat,
+   ou NaN pour une erreur ou un résultat non réel.
+
+   Découpage du mode batch : fenêtres de COLUMNS_WINDOW octets, morceaux
+   d'environ COLUMNS_CHUNK octets évalués en parallèle. Chaque morceau
+   est transposé en colonnes puis exécuté par calc_run_columns() ; le
+   programme est compilé une fois et partagé par tous les morceaux. */
+/* ============================= */
+
+#define COLUMNS_IO_SIZE (1 << 20)
+#define COLUMNS_WINDOW (16 << 20)
+#define COLUMNS_CHUNK (256 << 10)
+#define COLUMNS_MAX_VARS 64
+
+/* Morceau de l'entrée évalué par une seule tâche */
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t cap;             /* lignes que peuvent recevoir les tableaux */
+    double *vals;           /* colonne k : vals[k * cap ...] */
+    double *re, *im;
+    unsigned char *errors;
+    unsigned char *invalid; /* ligne CSV mal formée */
+    StrBuf line;            /* ligne CSV courante, terminée par '\0' */
+    StrBuf out;             /* résultats du morceau */
+    int nomem;
+    CalcContext *ctx;       /* contexte d'exécution propre au morceau */
+} Chunk;
+
+typedef struct {
+    Chunk *chunks;
+    size_t nchunks, cap;
+    ThreadPool *pool;
+    const char *expr;
+    CalcProgram *prog;
+    char *names[COLUMNS_MAX_VARS];
+    int nvars;
+    int binary;
+    int need_header;        /* les noms viennent de la première ligne */
+} Columns;
+
+static void free_names(Columns *c) {
+    for (int k = 0; k < c->nvars; k++)
+        free(c->names[k]);
+    c->nvars = 0;
+}
+
+/* Découpe une liste de noms séparés par des virgules (len octets) */
+static int set_names(Columns *c, const char *list, size_t len) {
+    free_names(c);
+    const char *end = list + len;
+    while (list <= end) {
+        const char *comma = memchr(list, ',', end - list);
+        const char *stop = comma ? comma : end;
+        while (list < stop && (*list == ' ' || *list == '\t'))
+            list++;
+        const char *last = stop;
+        while (last > list && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r'))
+            last--;
+        if (c->nvars == COLUMNS_MAX_VARS) {
+            fprintf(stderr, "Erreur : plus de %d variables\n", COLUMNS_MAX_VARS);
+            return 1;
+        }
+        c->names[c->nvars] = strndup(list, last - list);
+        if (!c->names[c->nvars]) {
+            perror("strndup");
+            return 1;
+        }
+        c->nvars++;
+        list = stop + 1;
+    }
+    return 0;
+}
+
+static int compile_program(Columns *c) {
+    CalcContext *ctx = calc_context_new();
+    if (!ctx) {
+        fprintf(stderr, "Erreur : mémoire insuffisante\n");
+        return 1;
+    }
+    calc_program_free(c->prog);
+    c->prog = calc_compile_vars(ctx, c->expr, (const char *const *)c->names, c->nvars);
+    if (!c->prog) {
+        char msg[256];
+        calc_format_error(calc_last_error(ctx), msg, sizeof(msg));
+        fprintf(stderr, "%s : %s\n", c->expr, msg);
+    }
+    calc_context_free(ctx);
+    return c->prog ? 0 : 1;
+}
+
+static int chunk_reserve(Chunk *ch, int nvars, size_t rows) {
+    if (rows <= ch->cap)
+        return 0;
+    free(ch->vals);
+    free(ch->re);
+    free(ch->im);
+    free(ch->errors);
+    free(ch->invalid);
+    ch->vals = malloc(rows * nvars * sizeof(double));
+    ch->re = malloc(rows * sizeof(double));
+    ch->im = malloc(rows * sizeof(double));
+    ch->errors = malloc(rows);
+    ch->invalid = malloc(rows);
+    ch->cap = rows;
+    if (!ch->vals || !ch->re || !ch->im || !ch->errors || !ch->invalid) {
+        ch->cap = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static size_t count_lines(const char *data, size_t size) {
+    size_t n = 0;
+    for (const char *p = data, *end = data + size; p < end; n++) {
+        const char *nl = memchr(p, '\n', end - p);
+        p = nl ? nl + 1 : end;
+    }
+    return n;
+}
+
+/* Lit les nvars valeurs de la ligne s (terminée par '\0') dans la
+   ligne r des colonnes ; renvoie -1 si elle est mal formée */
+static int parse_row(const char *s, double *vals, size_t cap, int nvars, size_t r) {
+    for (int k = 0; k < nvars; k++) {
+        char *end;
+        vals[k * cap + r] = strtod(s, &end);
+        if (end == s)
+            return -1;
+        s = end;
+        while (*s == ' ' || *s == '\t')
+            s++;
+        if (*s != (k + 1 < nvars ? ',' : '\0'))
+            return -1;
+        s++;
+    }
+    return 0;
+}
+
+static size_t load_csv(Columns *c, Chunk *ch) {
+    size_t r = 0;
+    for (const char *p = ch->data, *end = p + ch->size; p < end; r++) {
+        const char *nl = memchr(p, '\n', end - p);
+        size_t len = (nl ? nl : end) - p;
+        if (len > 0 && p[len - 1] == '\r')
+            len--;
+        ch->line.len = 0;
+        ch->invalid[r] = 1;
+        if (strbuf_reserve(&ch->line, len + 1) == 0) {
+            memcpy(ch->line.data, p, len);
+            ch->line.data[len] = '\0';
+            ch->invalid[r] = parse_row(ch->line.data, ch->vals, ch->cap, c->nvars, r) < 0;
+        }
+        if (ch->invalid[r])
+            for (int k = 0; k < c->nvars; k++)
+                ch->vals[k * ch->cap + r] = 0;
+        p = nl ? nl + 1 : end;
+    }
+    return r;
+}
+
+static size_t load_binary(Columns *c, Chunk *ch) {
+    size_t rows = ch->size / (c->nvars * sizeof(double));
+    const char *p = ch->data;
+    for (size_t r = 0; r < rows; r++)
+        for (int k = 0; k < c->nvars; k++, p += sizeof(double))
+            memcpy(&ch->vals[k * ch->cap + r], p, sizeof(double));
+    return rows;
+}
+
+static void write_text(Columns *c, Chunk *ch, size_t rows) {
+    for (size_t r = 0; r < rows; r++) {
+        char result[256];
+        int n;
+        if (ch->invalid[r]) {
+            n = snprintf(result, sizeof(result) - 1, "Erreur : ligne invalide (%d valeurs attendues)",
+                         c->nvars);
+        } else if (ch->errors[r] != CALC_OK) {
+            /* Le message d'erreur vient de la réexécution de la ligne seule */
+            double complex vals[COLUMNS_MAX_VARS], res;
+            for (int k = 0; k < c->nvars; k++)
+                vals[k] = ch->vals[k * ch->cap + r];
+            calc_run_vars(ch->ctx, c->prog, vals, &res);
+            n = calc_format_error(calc_last_error(ch->ctx), result, sizeof(result) - 1);
+        } else {
+            n = calc_format_result(CMPLX(ch->re[r], ch->im[r]), result, sizeof(result) - 1);
+        }
+        if (n < 0)
+            n = 0;
+        if (n > (int)sizeof(result) - 2)
+            n = sizeof(result) - 2;
+        result[n++] = '\n';
+        if (strbuf_reserve(&ch->out, n) < 0) {
+            ch->nomem = 1;
+            return;
+        }
+        memcpy(ch->out.data + ch->out.len, result, n);
+        ch->out.len += n;
+    }
+}
+
+static void write_binary(Chunk *ch, size_t rows) {
+    if (strbuf_reserve(&ch->out, rows * sizeof(double)) < 0) {
+        ch->nomem = 1;
+        return;
+    }
+    for (size_t r = 0; r < rows; r++) {
+        /* non réel : même seuil que l'affichage */
+        double v = ch->errors[r] != CALC_OK || fabs(ch->im[r]) >= 1e-12 ? NAN : ch->re[r];
+        memcpy(ch->out.data + ch->out.len, &v, sizeof(double));
+        ch->out.len += sizeof(double);
+    }
+}
+
+static void columns_eval_chunk(void *arg, size_t index) {
+    Columns *c = arg;
+    Chunk *ch = &c->chunks[index];
+    if (!ch->ctx)
+        ch->ctx = calc_context_new();
+    size_t rows = c->binary ? ch->size / (c->nvars * sizeof(double))
+                            : count_lines(ch->data, ch->size);
+    if (!ch->ctx || chunk_reserve(ch, c->nvars, rows) < 0) {
+        ch->nomem = 1;
+        return;
+    }
+    rows = c->binary ? load_binary(c, ch) : load_csv(c, ch);
+    if (c->binary)
+        memset(ch->invalid, 0, rows);
+
+    const double *cols[COLUMNS_MAX_VARS];
+    for (int k = 0; k < c->nvars; k++)
+        cols[k] = ch->vals + k * ch->cap;
+    calc_run_columns(ch->ctx, c->prog, cols, rows, ch->re, ch->im, ch->errors);
+
+    if (c->binary)
+        write_binary(ch, rows);
+    else
+        write_text(c, ch, rows);
+}
+
+/* Fin d'un morceau qui devrait s'arrêter vers end : après une fin de
+   ligne en CSV, sur une limite de ligne en binaire */
+static size_t cut(const Columns *c, const char *data, size_t size, size_t end) {
+    if (c->binary) {
+        size_t row = c->nvars * sizeof(double);
+        if (end % row)
+            end += row - end % row;
+    } else if (end < size) {
+        const char *nl = memchr(data + end, '\n', size - end);
+        end = nl ? (size_t)(nl - data) + 1 : size;
+    }
+    return end < size ? end : size;
+}
+
+/* Évalue un bloc de lignes complètes (en CSV, la dernière peut ne pas
+   avoir de '\n') en parallèle et écrit les résultats dans l'ordre. */
+static int columns_eval_block(Columns *c, const char *data, size_t size) {
+    if (c->need_header) {
+        const char *nl = memchr(data, '\n', size);
+        size_t len = nl ? (size_t)(nl - data) : size;
+        if (set_names(c, data, len) != 0 || compile_program(c) != 0)
+            return 1;
+        c->need_header = 0;
+        data += nl ? len + 1 : len;
+        size -= nl ? len + 1 : len;
+    }
+    size_t pos = 0;
+    c->nchunks = 0;
+    while (pos < size) {
+        size_t end = cut(c, data, size, pos + COLUMNS_CHUNK);
+        if (c->nchunks == c->cap) {
+            size_t cap = c->cap ? c->cap * 2 : 64;
+            Chunk *chunks = realloc(c->chunks, cap * sizeof(Chunk));
+            if (!chunks) {
+                perror("realloc");
+                return 1;
+            }
+            memset(chunks + c->cap, 0, (cap - c->cap) * sizeof(Chunk));
+            c->chunks = chunks;
+            c->cap = cap;
+        }
+        Chunk *ch = &c->chunks[c->nchunks++];
+        ch->data = data + pos;
+        ch->size = end - pos;
+        ch->out.len = 0;
+        pos = end;
+    }
+
+    pool_run(c->pool, c->nchunks, columns_eval_chunk, c);
+
+    for (size_t k = 0; k < c->nchunks; k++) {
+        if (c->chunks[k].nomem) {
+            fprintf(stderr, "Erreur : mémoire insuffisante\n");
+            return 1;
+        }
+        fwrite(c->chunks[k].out.data, 1, c->chunks[k].out.len, stdout);
+    }
+    return 0;
+}
+
+/* Partie de used octets qui ne contient que des lignes complètes */
+static size_t complete(const Columns *c, const char *buf, size_t used) {
+    if (c->binary)
+        return used - used % (c->nvars * sizeof(double));
+    const char *last = memrchr(buf, '\n', used);
+    return last ? (size_t)(last - buf) + 1 : 0;
+}
+
+static int columns_eval_fd(Columns *c, int fd) {
+    char *buf = malloc(COLUMNS_WINDOW);
+    size_t cap = COLUMNS_WINDOW, used = 0;
+    if (!buf) {
+        perror("malloc");
+        return 1;
+    }
+    for (;;) {
+        if (used == cap) { /* ligne plus longue que le tampon */
+            char *nbuf = realloc(buf, cap * 2);
+            if (!nbuf) {
+                perror("realloc");
+                free(buf);
+                return 1;
+            }
+            buf = nbuf;
+            cap *= 2;
+        }
+        ssize_t n = read(fd, buf + used, cap - used);
+        if (n < 0) {
+            perror("read");
+            free(buf);
+            return 1;
+        }
+        if (n == 0)
+            break;
+        used += n;
+        if (used < cap)
+            continue; /* remplir la fenêtre avant de lancer les threads */
+        size_t done = complete(c, buf, used);
+        if (done == 0)
+            continue;
+        if (columns_eval_block(c, buf, done) != 0) {
+            free(buf);
+            return 1;
+        }
+        memmove(buf, buf + done, used - done);
+        used -= done;
+    }
+    int ret = 0;
+    if (c->binary && used % (c->nvars * sizeof(double)) != 0) {
+        fprintf(stderr, "Erreur : ligne binaire incomplète ignorée à la fin de l'entrée\n");
+        used -= used % (c->nvars * sizeof(double));
+        ret = 1;
+    }
+    if (used > 0)
+        ret |= columns_eval_block(c, buf, used);
+    free(buf);
+    return ret;
+}
+
+static int columns_eval_file(Columns *c, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        /* Pas un fichier ordinaire (tube, ...) : lecture classique */
+        int ret = columns_eval_fd(c, fd);
+        close(fd);
+        return ret;
+    }
+    size_t size = st.st_size;
+    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return 1;
+    }
+    posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+    int ret = 0;
+    size_t start = 0;
+    if (c->binary && size % (c->nvars * sizeof(double)) != 0) {
+        fprintf(stderr, "%s : ligne binaire incomplète ignorée à la fin du fichier\n", path);
+        size -= size % (c->nvars * sizeof(double));
+        ret = 1;
+    }
+    while (start < size) {
+        size_t end = cut(c, data, size, start + COLUMNS_WINDOW);
+        if (columns_eval_block(c, data + start, end - start) != 0) {
+            ret = 1;
+            break;
+        }
+        start = end;
+    }
+    munmap(data, st.st_size);
+    return ret;
+}
+
+/* cal_ncurses --columns EXPRESSION [-j N] [--vars a,b,...] [--binary] [fichier...]
+   "-" ou aucun fichier = entrée standard ; N threads (défaut : un par cœur).
+   --binary demande --vars. */
+int run_columns(int argc, char **argv) {
+    Columns c;
+    memset(&c, 0, sizeof(c));
+    int ret = 0, jobs = 0, nfiles = 0, vars = 0;
+    char **files = calloc(argc + 1, sizeof(char *));
+    if (!files) {
+        perror("calloc");
+        return 1;
+    }
+    for (int k = 0; k < argc; k++) {
+        if (strcmp(argv[k], "-j") == 0 && k + 1 < argc) {
+            jobs = atoi(argv[++k]);
+        } else if (strcmp(argv[k], "--vars") == 0 && k + 1 < argc) {
+            if (set_names(&c, argv[k + 1], strlen(argv[k + 1])) != 0) {
+                ret = 2;
+                goto out;
+            }
+            vars = 1;
+            k++;
+        } else if (strcmp(argv[k], "--binary") == 0) {
+            c.binary = 1;
+        } else if (!c.expr) {
+            c.expr = argv[k];
+        } else {
+            files[nfiles++] = argv[k];
+        }
+    }
+    if (!c.expr || (c.binary && !vars)) {
+        fprintf(stderr, "Usage : cal_ncurses --columns EXPRESSION [-j N] [--vars a,b,...] [--binary]\n"
+                        "                    [fichier...]\n"
+                        "        (--binary demande --vars)\n");
+        ret = 2;
+        goto out;
+    }
+    if (vars && compile_program(&c) != 0) {
+        ret = 2;
+        goto out;
+    }
+    if (nfiles == 0)
+        files[nfiles++] = "-";
+
+    c.pool = pool_create(jobs);
+    setvbuf(stdout, NULL, _IOFBF, COLUMNS_IO_SIZE);
+    for (int k = 0; k < nfiles && ret == 0; k++) {
+        c.need_header = !vars;
+        if (strcmp(files[k], "-") == 0)
+            ret = columns_eval_fd(&c, STDIN_FILENO);
+        else
+            ret = columns_eval_file(&c, files[k]);
+    }
+    fflush(stdout);
+
+    for (size_t k = 0; k < c.cap; k++) {
+        Chunk *ch = &c.chunks[k];
+        free(ch->vals);
+        free(ch->re);
+        free(ch->im);
+        free(ch->errors);
+        free(ch->invalid);
+        free(ch->line.data);
+        free(ch->out.data);
+        calc_context_free(ch->ctx);
+    }
+    free(c.chunks);
+    pool_destroy(c.pool);
+out:
+    calc_program_free(c.prog);
+    free_names(&c);
+    free(files);
+    return ret;
+}
@@ -0,0 +1,9 @@
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+/* Mode colonnes : cal_ncurses --columns EXPRESSION [-j N] [--vars a,b,...]
+                                         [--binary] [fichier...]
+   argc/argv ne contiennent que les arguments qui suivent "--columns". */
+int run_columns(int argc, char **argv);
+
+#endif
@@ -0,0 +1,571 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <complex.h>
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "calc.h"
+#include "calc_cache.h"
+#include "daemon.h"
+#include "pool.h"
+#include "strbuf.h"
+
+/* ============================= */
+/* Partie Démon                  */
+/* Le thread principal gère toutes les connexions (epoll, sockets non
+   bloquants) et n'évalue rien lui-même. Les lignes complètes reçues sur
+   une connexion sont découpées en morceaux d'au plus DAEMON_CHUNK lignes,
+   copiés dans une file commune où les threads d'évaluation les prennent
+   dans l'ordre d'arrivée ; chaque thread a son propre contexte. Un
+   morceau terminé est rendu à la boucle par une liste protégée par un
+   verrou, avec un eventfd pour la réveiller ; ses réponses sont ajoutées
+   au tampon de sortie de sa connexion dès que les morceaux qui le
+   précèdent sur cette connexion le sont aussi.
+
+   Chaque connexion a au plus un morceau de moins qu'il n'y a de threads
+   dans la file ou en cours d'évaluation : un client qui envoie un long
+   lot, ou une ligne lente, laisse toujours un thread aux autres
+   connexions, dont les requêtes sont servies au fur et à mesure.
+
+   Une connexion n'est plus lue tant qu'elle a plus de DAEMON_OUT_MAX
+   octets de réponses en attente, ou plus de DAEMON_IN_MAX octets reçus
+   pas encore évalués : un client qui n'écoute pas ses réponses ne fait
+   pas grossir la mémoire du démon. */
+/* ============================= */
+
+#define DAEMON_MAX_EVENTS 64
+#define DAEMON_READ_SIZE (64 << 10)
+#define DAEMON_READ_MAX (1 << 20)   /* lu au plus par connexion et par tour de boucle */
+#define DAEMON_OUT_MAX (1 << 20)    /* réponses en attente au-delà desquelles on cesse de lire */
+#define DAEMON_LINE_MAX (16 << 20)  /* ligne plus longue : connexion fermée */
+#define DAEMON_IN_MAX DAEMON_LINE_MAX
+#define DAEMON_CHUNK 64
+
+typedef struct Chunk Chunk;
+
+typedef struct {
+    int fd;
+    StrBuf in;          /* octets reçus, pas encore confiés aux threads */
+    StrBuf out;         /* réponses, dont les sent premiers octets sont envoyés */
+    size_t sent;
+    Chunk *first, *last; /* morceaux en cours, dans l'ordre des lignes */
+    int inflight;
+    unsigned events;    /* événements epoll demandés */
+    int eof;            /* plus rien à lire : fermer une fois tout envoyé */
+    int dead;           /* erreur : fermer sans rien envoyer de plus (une
+                           fois les morceaux en cours rendus) */
+    int queued;         /* dans la liste des connexions du tour */
+} Conn;
+
+/* Lignes consécutives d'une connexion évaluées par un thread (au moins
+   une ligne, éventuellement vide). Les champs in, out et failed
+   appartiennent au thread tant que le morceau est dans la file. */
+struct Chunk {
+    Conn *conn;
+    StrBuf in;          /* copie des lignes ; chacune est terminée sur place */
+    StrBuf out;
+    int failed;         /* mémoire insuffisante pour une réponse */
+    int done;           /* rendu à la boucle */
+    Chunk *next;        /* file commune, liste des morceaux rendus, ou
+                           morceaux libres */
+    Chunk *conn_next;   /* morceau suivant de la même connexion */
+};
+
+typedef struct {
+    int epfd, listen_fd;
+    int wake_fd;        /* eventfd : des morceaux ont été rendus */
+    CalcCache *cache;   /* facultatif */
+    pthread_t *threads;
+    int nthreads;
+    int conn_max;       /* morceaux en cours par connexion */
+    /* File des morceaux à évaluer et liste des morceaux rendus */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    Chunk *todo, *todo_last;
+    Chunk *finished;
+    int stopping;
+    Chunk *spare;       /* morceaux libres (boucle seulement) */
+    Conn **ready;       /* connexions à traiter pendant le tour */
+    size_t nready, ready_cap;
+} Daemon;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void eval_chunk(Daemon *d, CalcContext *ctx, Chunk *chunk) {
+    char *data = chunk->in.data, *end = chunk->in.data + chunk->in.len;
+    for (;;) {
+        char *nl = memchr(data, '\n', end - data);
+        char *stop = nl ? nl : end;
+        if (stop > data && stop[-1] == '\r')
+            stop[-1] = '\0';
+        *stop = '\0';
+
+        char result[256];
+        double complex res;
+        int n;
+        if (!ctx)
+            n = snprintf(result, sizeof(result) - 1, "Erreur : mémoire insuffisante");
+        else if (calc_eval_cached(ctx, d->cache, data, &res) != CALC_OK)
+            n = calc_format_error(calc_last_error(ctx), result, sizeof(result) - 1);
+        else
+            n = calc_format_result(res, result, sizeof(result) - 1);
+        if (n < 0)
+            n = 0;
+        if (n > (int)sizeof(result) - 2)
+            n = sizeof(result) - 2;
+        result[n++] = '\n';
+        if (strbuf_append(&chunk->out, result, n) < 0)
+            chunk->failed = 1; /* une réponse manquante décalerait toutes les suivantes */
+        if (!nl)
+            break;
+        data = nl + 1;
+    }
+}
+
+/* Thread d'évaluation : prend les morceaux de la file dans l'ordre */
+static void *worker_main(void *arg) {
+    Daemon *d = arg;
+    CalcContext *ctx = calc_context_new();
+    pthread_mutex_lock(&d->lock);
+    for (;;) {
+        while (!d->todo && !d->stopping)
+            pthread_cond_wait(&d->cond, &d->lock);
+        if (d->stopping)
+            break;
+        Chunk *chunk = d->todo;
+        d->todo = chunk->next;
+        pthread_mutex_unlock(&d->lock);
+
+        eval_chunk(d, ctx, chunk);
+
+        pthread_mutex_lock(&d->lock);
+        chunk->next = d->finished;
+        d->finished = chunk;
+        uint64_t one = 1;
+        if (write(d->wake_fd, &one, sizeof(one)) < 0) {
+            /* compteur saturé : la boucle a déjà de quoi se réveiller */
+        }
+    }
+    pthread_mutex_unlock(&d->lock);
+    calc_context_free(ctx);
+    return NULL;
+}
+
+static Chunk *new_chunk(Daemon *d) {
+    Chunk *chunk = d->spare;
+    if (chunk)
+        d->spare = chunk->next;
+    else if (!(chunk = calloc(1, sizeof(Chunk))))
+        return NULL;
+    chunk->in.len = chunk->out.len = 0;
+    chunk->failed = chunk->done = 0;
+    chunk->next = chunk->conn_next = NULL;
+    return chunk;
+}
+
+static void free_chunks(Chunk *chunk) {
+    while (chunk) {
+        Chunk *next = chunk->next;
+        free(chunk->in.data);
+        free(chunk->out.data);
+        free(chunk);
+        chunk = next;
+    }
+}
+
+/* Confie aux threads les lignes complètes de conn, par morceaux, dans la
+   limite de d->conn_max morceaux en cours */
+static void take_lines(Daemon *d, Conn *conn) {
+    char *data = conn->in.data;
+    size_t size = conn->in.len;
+    if (!conn->eof) {
+        char *last = size ? memrchr(data, '\n', size) : NULL;
+        size = last ? (size_t)(last - data) + 1 : 0;
+    } else if (size > 0 && data[size - 1] != '\n') {
+        /* dernière ligne sans '\n' : in a toujours un octet libre (voir conn_read) */
+        data[size++] = '\n';
+        conn->in.len = size;
+    }
+    Chunk *batch = NULL, **tail = &batch;
+    size_t pos = 0;
+    while (pos < size && conn->inflight < d->conn_max) {
+        size_t end = pos;
+        for (int k = 0; k < DAEMON_CHUNK && end < size; k++)
+            end = (char *)memchr(data + end, '\n', size - end) - data + 1;
+        Chunk *chunk = new_chunk(d);
+        /* le dernier '\n' devient le '\0' final */
+        if (!chunk || strbuf_append(&chunk->in, data + pos, end - pos) < 0) {
+            if (chunk) {
+                chunk->next = d->spare;
+                d->spare = chunk;
+            }
+            conn->dead = 1;
+            break;
+        }
+        chunk->in.len--;
+        chunk->conn = conn;
+        if (conn->last)
+            conn->last->conn_next = chunk;
+        else
+            conn->first = chunk;
+        conn->last = chunk;
+        conn->inflight++;
+        *tail = chunk;
+        tail = &chunk->next;
+        pos = end;
+    }
+    if (pos > 0) {
+        memmove(conn->in.data, conn->in.data + pos, conn->in.len - pos);
+        conn->in.len -= pos;
+    }
+    if (batch) {
+        pthread_mutex_lock(&d->lock);
+        if (d->todo)
+            d->todo_last->next = batch;
+        else
+            d->todo = batch;
+        d->todo_last = (Chunk *)((char *)tail - offsetof(Chunk, next));
+        pthread_cond_broadcast(&d->cond);
+        pthread_mutex_unlock(&d->lock);
+    }
+}
+
+/* Ajoute aux réponses de conn ses premiers morceaux rendus */
+static void deliver(Daemon *d, Conn *conn) {
+    while (conn->first && conn->first->done) {
+        Chunk *chunk = conn->first;
+        conn->first = chunk->conn_next;
+        if (!conn->first)
+            conn->last = NULL;
+        conn->inflight--;
+        if (chunk->failed || strbuf_append(&conn->out, chunk->out.data, chunk->out.len) < 0)
+            conn->dead = 1;
+        chunk->next = d->spare;
+        d->spare = chunk;
+    }
+}
+
+/* Une connexion qui n'attend plus que ses morceaux en cours est retirée
+   d'epoll : EPOLLHUP y serait signalé à chaque tour */
+static void conn_update(Daemon *d, Conn *conn) {
+    size_t pending = conn->out.len - conn->sent;
+    unsigned events = 0;
+    if (!conn->dead) {
+        if (!conn->eof && pending < DAEMON_OUT_MAX && conn->in.len < DAEMON_IN_MAX)
+            events |= EPOLLIN;
+        if (pending > 0)
+            events |= EPOLLOUT;
+    }
+    if (events == conn->events)
+        return;
+    struct epoll_event ev = { .events = events, .data.ptr = conn };
+    if (!events)
+        epoll_ctl(d->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    else
+        epoll_ctl(d->epfd, conn->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, conn->fd, &ev);
+    conn->events = events;
+}
+
+static void conn_close(Daemon *d, Conn *conn) {
+    if (conn->events)
+        epoll_ctl(d->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    free(conn->in.data);
+    free(conn->out.data);
+    free(conn);
+}
+
+static void conn_read(Conn *conn) {
+    for (size_t total = 0; total < DAEMON_READ_MAX; ) {
+        /* +1 : place pour terminer une dernière ligne sans '\n' */
+        if (strbuf_reserve(&conn->in, DAEMON_READ_SIZE + 1) < 0) {
+            conn->dead = 1;
+            return;
+        }
+        ssize_t n = read(conn->fd, conn->in.data + conn->in.len, DAEMON_READ_SIZE);
+        if (n > 0) {
+            conn->in.len += n;
+            total += n;
+            continue;
+        }
+        if (n == 0)
+            conn->eof = 1;
+        else if (errno == EINTR)
+            continue;
+        else if (errno != EAGAIN)
+            conn->dead = 1;
+        return;
+    }
+}
+
+static void conn_flush(Conn *conn) {
+    while (conn->sent < conn->out.len) {
+        ssize_t n = send(conn->fd, conn->out.data + conn->sent, conn->out.len - conn->sent,
+                         MSG_NOSIGNAL);
+        if (n >= 0) {
+            conn->sent += n;
+        } else if (errno != EINTR) {
+            if (errno != EAGAIN)
+                conn->dead = 1;
+            return;
+        }
+    }
+    conn->out.len = conn->sent = 0;
+}
+
+static void accept_all(Daemon *d) {
+    for (;;) {
+        int fd = accept4(d->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN)
+                perror("accept");
+            return;
+        }
+        Conn *conn = calloc(1, sizeof(Conn));
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+        if (!conn || epoll_ctl(d->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            free(conn);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->events = EPOLLIN;
+    }
+}
+
+static void queue_conn(Daemon *d, Conn *conn) {
+    if (conn->queued)
+        return;
+    if (d->nready == d->ready_cap) {
+        size_t cap = d->ready_cap ? d->ready_cap * 2 : 64;
+        Conn **ready = realloc(d->ready, cap * sizeof(Conn *));
+        if (!ready) {
+            conn->dead = 1;
+            return;
+        }
+        d->ready = ready;
+        d->ready_cap = cap;
+    }
+    d->ready[d->nready++] = conn;
+    conn->queued = 1;
+}
+
+/* Morceaux rendus par les threads : leurs connexions sont à traiter */
+static void collect_finished(Daemon *d) {
+    uint64_t count;
+    if (read(d->wake_fd, &count, sizeof(count)) < 0) {
+        /* rien à lire : un tour précédent a déjà tout pris */
+    }
+    pthread_mutex_lock(&d->lock);
+    Chunk *chunk = d->finished;
+    d->finished = NULL;
+    pthread_mutex_unlock(&d->lock);
+    while (chunk) {
+        Chunk *next = chunk->next;
+        chunk->done = 1;
+        queue_conn(d, chunk->conn);
+        chunk = next;
+    }
+}
+
+/* Un tour de boucle : lectures et morceaux rendus, puis pour chaque
+   connexion concernée réponses, nouveaux morceaux et envois */
+static void daemon_step(Daemon *d, struct epoll_event *events, int nevents) {
+    d->nready = 0;
+    for (int k = 0; k < nevents; k++) {
+        if (events[k].data.ptr == NULL) {
+            accept_all(d);
+            continue;
+        }
+        if (events[k].data.ptr == d) {
+            collect_finished(d);
+            continue;
+        }
+        Conn *conn = events[k].data.ptr;
+        if (events[k].events & EPOLLOUT)
+            conn_flush(conn);
+        if (events[k].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            conn_read(conn);
+        queue_conn(d, conn);
+    }
+
+    for (size_t k = 0; k < d->nready; k++) {
+        Conn *conn = d->ready[k];
+        conn->queued = 0;
+        deliver(d, conn);
+        if (!conn->dead)
+            take_lines(d, conn);
+        if (!conn->dead)
+            conn_flush(conn);
+        /* ligne trop longue : in est plein sans aucune ligne complète */
+        if (!conn->eof && conn->in.len >= DAEMON_LINE_MAX && !memchr(conn->in.data, '\n', conn->in.len))
+            conn->dead = 1;
+        if (conn->inflight == 0 &&
+            (conn->dead || (conn->eof && conn->in.len == 0 && conn->sent == conn->out.len)))
+            conn_close(d, conn);
+        else
+            conn_update(d, conn);
+    }
+}
+
+static int listen_on(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s : chemin trop long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    /* Un socket qui n'accepte plus de connexion est un reste d'un démon arrêté */
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 || errno == EAGAIN) {
+        fprintf(stderr, "%s : un démon écoute déjà\n", path);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* calcd [-s SOCKET] [-j N] [--cache FICHIER] [--cache-size N]
+   Reste au premier plan ; SIGINT ou SIGTERM l'arrêtent proprement. */
+int main(int argc, char **argv) {
+    const char *path = getenv(CALCD_SOCKET_ENV);
+    const char *cache_path = NULL;
+    size_t cache_size = 65536;
+    int jobs = 0, use_cache = 0;
+    for (int k = 1; k < argc; k++) {
+        if (strcmp(argv[k], "-s") == 0 && k + 1 < argc) {
+            path = argv[++k];
+        } else if (strcmp(argv[k], "-j") == 0 && k + 1 < argc) {
+            jobs = atoi(argv[++k]);
+        } else if (strcmp(argv[k], "--cache") == 0 && k + 1 < argc) {
+            cache_path = argv[++k];
+            use_cache = 1;
+        } else if (strcmp(argv[k], "--cache-size") == 0 && k + 1 < argc) {
+            cache_size = strtoul(argv[++k], NULL, 10);
+            use_cache = 1;
+        } else {
+            fprintf(stderr, "Usage : %s [-s SOCKET] [-j N] [--cache FICHIER] [--cache-size N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!path || !*path)
+        path = CALCD_SOCKET_DEFAULT;
+
+    Daemon d;
+    memset(&d, 0, sizeof(d));
+    d.listen_fd = listen_on(path);
+    if (d.listen_fd < 0)
+        return 1;
+    d.epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (d.epfd < 0 || epoll_ctl(d.epfd, EPOLL_CTL_ADD, d.listen_fd, &ev) < 0) {
+        perror("epoll");
+        unlink(path);
+        return 1;
+    }
+    d.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ev.data.ptr = &d;
+    if (d.wake_fd < 0 || epoll_ctl(d.epfd, EPOLL_CTL_ADD, d.wake_fd, &ev) < 0) {
+        perror("eventfd");
+        unlink(path);
+        return 1;
+    }
+    if (use_cache) {
+        d.cache = calc_cache_open(cache_path, cache_size);
+        if (!d.cache)
+            perror(cache_path ? cache_path : "cache");
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal; /* sans SA_RESTART : epoll_wait est interrompu */
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Les threads sont créés après sigaction et bloquent les signaux :
+       c'est epoll_wait du thread principal qui doit être interrompu */
+    pthread_mutex_init(&d.lock, NULL);
+    pthread_cond_init(&d.cond, NULL);
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    d.nthreads = jobs > 0 ? jobs : pool_default_threads();
+    d.threads = calloc(d.nthreads, sizeof(pthread_t));
+    int started = 0;
+    while (d.threads && started < d.nthreads &&
+           pthread_create(&d.threads[started], NULL, worker_main, &d) == 0)
+        started++;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    d.conn_max = started > 1 ? started - 1 : 1;
+    if (started == 0) {
+        fprintf(stderr, "calcd : impossible de créer les threads\n");
+        stop_requested = 1;
+    }
+
+    struct epoll_event events[DAEMON_MAX_EVENTS];
+    while (!stop_requested) {
+        int n = epoll_wait(d.epfd, events, DAEMON_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        daemon_step(&d, events, n);
+    }
+
+    unlink(path);
+    pthread_mutex_lock(&d.lock);
+    d.stopping = 1;
+    pthread_cond_broadcast(&d.cond);
+    pthread_mutex_unlock(&d.lock);
+    for (int k = 0; k < started; k++)
+        pthread_join(d.threads[k], NULL);
+    /* Les morceaux encore dans la file ou rendus sont aussi dans la liste
+       de leur connexion ; seuls les libres sont à nous */
+    free_chunks(d.spare);
+    free(d.threads);
+    pthread_mutex_destroy(&d.lock);
+    pthread_cond_destroy(&d.cond);
+    close(d.listen_fd);
+    close(d.wake_fd);
+    close(d.epfd);
+    free(d.ready);
+    calc_cache_close(d.cache);
+    return started ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+/* ============================= */
+/* Protocole du démon calcd      */
+/* Socket Unix de type flux. Le client envoie une expression par ligne
+   (terminée par '\n', un '\r' final est ignoré) ; le démon répond par
+   exactement une ligne par expression, dans l'ordre d'envoi : le
+   résultat, ou le message d'erreur, formatés comme en mode batch.
+   Le client peut envoyer autant de lignes qu'il veut sans attendre les
+   réponses. Après shutdown(SHUT_WR), la dernière ligne peut ne pas
+   avoir de '\n' ; le démon ferme la connexion une fois tout envoyé. */
+/* ============================= */
+
+/* Chemin du socket si ni -s ni la variable CALCD_SOCKET ne sont donnés */
+#define CALCD_SOCKET_DEFAULT "/tmp/calcd.sock"
+#define CALCD_SOCKET_ENV "CALCD_SOCKET"
+
+#endif
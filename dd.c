@@ -0,0 +1,1129 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <complex.h>
+#include "calc.h"
+#include "calc_internal.h"
+
+/* ============================= */
+/* Partie Double-double          */
+/* Un nombre double-double est la somme non évaluée hi + lo de deux
+   double, avec |lo| <= ulp(hi) / 2 : 106 bits de mantisse, soit un peu
+   plus de 31 chiffres significatifs, pour un coût de l'ordre de dix
+   opérations en double par opération. Les algorithmes sont ceux de
+   Dekker et de la bibliothèque QD (Hida, Li, Bailey) : sommes et
+   produits exacts de deux double, puis renormalisation.
+
+   Les exposants restent ceux des double : les dépassements donnent les
+   mêmes infinis qu'en double, avec lo = 0. Quelques cas rares sont
+   calculés en double (lo = 0) : arccos et arcsin complexes, puissances
+   de 0, arguments trop grands des fonctions trigonométriques et
+   hyperboliques complexes, fonctions externes. */
+/* ============================= */
+
+typedef CalcDD DD;
+typedef CalcDDComplex DDC;
+
+static const DD DD_PI = { 3.141592653589793, 1.2246467991473532e-16 };
+static const DD DD_PI_2 = { 1.5707963267948966, 6.123233995736766e-17 };
+static const double PI_2_P3 = -1.4973849048591698e-33;   /* suite de pi/2 */
+static const DD DD_LN2 = { 0.6931471805599453, 2.3190468138462996e-17 };
+static const double LN2_P3 = 5.707708438416212e-34;
+static const DD DD_HALF_LN_2PI = { 0.9189385332046728, -3.8782941580672414e-17 };
+
+/* 1/n! pour n = 0..29 (séries de exp, sin, sinh) */
+static const DD inv_fact[30] = {
+    { 1.0, 0.0 }, { 1.0, 0.0 }, { 0.5, 0.0 },
+    { 0.16666666666666666, 9.25185853854297e-18 },
+    { 0.041666666666666664, 2.3129646346357427e-18 },
+    { 0.008333333333333333, 1.1564823173178714e-19 },
+    { 0.001388888888888889, -5.300543954373577e-20 },
+    { 0.0001984126984126984, 1.7209558293420705e-22 },
+    { 2.48015873015873e-05, 2.1511947866775882e-23 },
+    { 2.7557319223985893e-06, -1.858393274046472e-22 },
+    { 2.755731922398589e-07, 2.3767714622250297e-23 },
+    { 2.505210838544172e-08, -1.448814070935912e-24 },
+    { 2.08767569878681e-09, -1.20734505911326e-25 },
+    { 1.6059043836821613e-10, 1.2585294588752098e-26 },
+    { 1.1470745597729725e-11, 2.0655512752830745e-28 },
+    { 7.647163731819816e-13, 7.03872877733453e-30 },
+    { 4.779477332387385e-14, 4.399205485834081e-31 },
+    { 2.8114572543455206e-15, 1.6508842730861433e-31 },
+    { 1.5619206968586225e-16, 1.1910679660273754e-32 },
+    { 8.22063524662433e-18, 2.2141894119604265e-34 },
+    { 4.110317623312165e-19, 1.4412973378659527e-36 },
+    { 1.9572941063391263e-20, -1.3643503830087908e-36 },
+    { 8.896791392450574e-22, -7.911402614872376e-38 },
+    { 3.868170170630684e-23, -8.843177655482344e-40 },
+    { 1.6117375710961184e-24, -3.6846573564509766e-41 },
+    { 6.446950284384474e-26, -1.9330404233703465e-42 },
+    { 2.4795962632247976e-27, -1.2953730964765229e-43 },
+    { 9.183689863795546e-29, 1.4303150396787322e-45 },
+    { 3.279889237069838e-30, 1.5117542744029879e-46 },
+    { 1.1309962886447716e-31, 1.0498015412959506e-47 }
+};
+
+/* Série de Stirling : B(2k) / (2k (2k - 1)) pour k = 1..14 */
+static const DD stirling[14] = {
+    { 0.08333333333333333, 4.625929269271485e-18 },
+    { -0.002777777777777778, 1.0601087908747154e-19 },
+    { 0.0007936507936507937, 6.883823317368282e-22 },
+    { -0.0005952380952380953, 5.36938218754726e-20 },
+    { 0.0008417508417508417, 3.6870174889237694e-20 },
+    { -0.0019175269175269176, 1.0675702776872475e-19 },
+    { 0.00641025641025641, 2.2240044563805217e-19 },
+    { -0.029550653594771242, 4.861760957508855e-19 },
+    { 0.17964437236883057, -6.401600482710946e-19 },
+    { -1.3924322169059011, 1.5837056989230303e-17 },
+    { 13.402864044168393, -6.154114101993966e-16 },
+    { -156.84828462600203, 9.391823141715389e-15 },
+    { 2193.1033333333335, -1.3339255626002948e-13 },
+    { -36108.77125372499, 5.897583353514365e-13 }
+};
+
+static inline DD dd(double hi) {
+    return (DD){ hi, 0 };
+}
+
+/* a + b exact, si |a| >= |b| */
+static inline DD quick_two_sum(double a, double b) {
+    double s = a + b;
+    return (DD){ s, b - (s - a) };
+}
+
+/* a + b exact */
+static inline DD two_sum(double a, double b) {
+    double s = a + b, bb = s - a;
+    return (DD){ s, (a - (s - bb)) + (b - bb) };
+}
+
+/* a x b exact (FMA, ou découpage de Dekker en deux moitiés de 26 bits) */
+static inline DD two_prod(double a, double b) {
+    double p = a * b;
+#ifdef __FP_FAST_FMA
+    double e = fma(a, b, -p);
+#else
+    double c = 134217729.0 * a, ah = c - (c - a), al = a - ah;
+    c = 134217729.0 * b;
+    double bh = c - (c - b), bl = b - bh;
+    double e = ((ah * bh - p) + ah * bl + al * bh) + al * bl;
+#endif
+    return (DD){ p, isfinite(e) ? e : 0 };
+}
+
+static inline DD dd_neg(DD a) {
+    return (DD){ -a.hi, -a.lo };
+}
+
+static inline DD dd_add(DD a, DD b) {
+    DD s = two_sum(a.hi, b.hi), t = two_sum(a.lo, b.lo);
+    if (!isfinite(s.hi))
+        return dd(s.hi);
+    s.lo += t.hi;
+    s = quick_two_sum(s.hi, s.lo);
+    s.lo += t.lo;
+    s = quick_two_sum(s.hi, s.lo);
+    /* Somme nulle : le zéro signé de la somme en double */
+    return s.hi == 0 ? dd(a.hi + b.hi) : s;
+}
+
+static inline DD dd_sub(DD a, DD b) {
+    return dd_add(a, dd_neg(b));
+}
+
+static inline DD dd_add_d(DD a, double b) {
+    DD s = two_sum(a.hi, b);
+    if (!isfinite(s.hi))
+        return dd(s.hi);
+    s.lo += a.lo;
+    s = quick_two_sum(s.hi, s.lo);
+    return s.hi == 0 ? dd(a.hi + b) : s;
+}
+
+static inline DD dd_mul(DD a, DD b) {
+    DD p = two_prod(a.hi, b.hi);
+    if (!isfinite(p.hi) || p.hi == 0)
+        return dd(p.hi);
+    p.lo += a.hi * b.lo + a.lo * b.hi;
+    return quick_two_sum(p.hi, p.lo);
+}
+
+static inline DD dd_mul_d(DD a, double b) {
+    DD p = two_prod(a.hi, b);
+    if (!isfinite(p.hi) || p.hi == 0)
+        return dd(p.hi);
+    p.lo += a.lo * b;
+    return quick_two_sum(p.hi, p.lo);
+}
+
+/* Quotient en double, puis correction par le reste a - q1 b : le reste
+   est calculé sans perte, ses parties hautes s'annulant exactement */
+static DD dd_div(DD a, DD b) {
+    double q1 = a.hi / b.hi;
+    if (!isfinite(q1) || !isfinite(b.hi) || q1 == 0)
+        return dd(q1);
+    DD r = dd_mul_d(b, q1);
+    DD s = two_sum(a.hi, -r.hi);
+    s.lo = s.lo - r.lo + a.lo;
+    double q2 = (s.hi + s.lo) / b.hi;
+    return quick_two_sum(q1, q2);
+}
+
+static inline DD dd_ldexp(DD a, int k) {
+    return (DD){ ldexp(a.hi, k), ldexp(a.lo, k) };
+}
+
+static inline int dd_lt(DD a, DD b) {
+    return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+/* Une itération de Newton sur la racine en double (Karp) */
+static DD dd_sqrt(DD a) {
+    if (a.hi <= 0 || !isfinite(a.hi))
+        return dd(sqrt(a.hi));
+    double x = 1.0 / sqrt(a.hi), ax = a.hi * x;
+    return dd_add_d(dd(ax), dd_sub(a, two_prod(ax, ax)).hi * (x * 0.5));
+}
+
+static DD dd_floor(DD a) {
+    double f = floor(a.hi);
+    if (f != a.hi || a.lo == 0)
+        return dd(f);
+    return quick_two_sum(f, floor(a.lo));
+}
+
+static DD dd_trunc(DD a) {
+    double t = trunc(a.hi);
+    if (t != a.hi || a.lo == 0)
+        return dd(t);
+    return quick_two_sum(t, a.hi >= 0 ? floor(a.lo) : ceil(a.lo));
+}
+
+static int dd_is_int(DD a) {
+    return isfinite(a.hi) && a.hi == floor(a.hi) && a.lo == floor(a.lo);
+}
+
+/* a^n, n >= 0, par élévations au carré */
+static DD dd_powu(DD a, unsigned long long n) {
+    DD r = dd(1);
+    for (;;) {
+        if (n & 1)
+            r = dd_mul(r, a);
+        n >>= 1;
+        if (!n)
+            return r;
+        a = dd_mul(a, a);
+    }
+}
+
+/* Valeur de b en entier, si b est un entier de moins de 2^53 */
+static int dd_int_exponent(DD b, long long *n) {
+    if (!dd_is_int(b) || b.lo != 0 || fabs(b.hi) >= 0x1p53)
+        return 0;
+    *n = (long long)b.hi;
+    return 1;
+}
+
+static DD dd_powi(DD a, long long n) {
+    if (n >= 0)
+        return dd_powu(a, n);
+    return dd_div(dd(1), dd_powu(a, -(unsigned long long)n));
+}
+
+/* Série x (1 ± x²/3! + x⁴/5! ± ...) jusqu'au terme en x^29, alternée
+   pour le sinus. Pour |x| < 1, les termes à partir de x^17 n'ont besoin
+   que de la précision double : ils sont évalués en double. */
+static DD odd_series(DD x, int alternate) {
+    DD x2 = dd_mul(x, x);
+    if (alternate)
+        x2 = dd_neg(x2);
+    double t = inv_fact[29].hi;
+    for (int n = 27; n >= 17; n -= 2)
+        t = t * x2.hi + inv_fact[n].hi;
+    DD s = dd(t);
+    for (int n = 15; n >= 1; n -= 2)
+        s = dd_add(dd_mul(s, x2), inv_fact[n]);
+    return dd_mul(s, x);
+}
+
+/* ============================= */
+/* Fonctions réelles             */
+/* ============================= */
+
+/* exp(a) = 2^k (1 + s), avec a = k ln 2 + 256 r : e^r - 1 par la série
+   de Taylor (termes de degré 6 et plus en double), puis huit fois
+   s <- 2s + s² */
+static DD dd_exp(DD a) {
+    if (a.hi > 746)
+        return dd(INFINITY);
+    if (a.hi < -746)
+        return dd(0);
+    if (isnan(a.hi))
+        return a;
+    if (a.hi == 0)
+        return dd(1);
+    double k = nearbyint(a.hi / DD_LN2.hi);
+    DD r = dd_sub(a, dd_mul_d(DD_LN2, k));
+    r = dd_ldexp(dd_add_d(r, -k * LN2_P3), -8);
+    double t = inv_fact[10].hi;
+    for (int n = 9; n >= 6; n--)
+        t = t * r.hi + inv_fact[n].hi;
+    DD s = dd(t);
+    for (int n = 5; n >= 1; n--)
+        s = dd_add(dd_mul(s, r), inv_fact[n]);
+    s = dd_mul(s, r);
+    for (int n = 0; n < 8; n++)
+        s = dd_mul(s, dd_add_d(s, 2));
+    return dd_ldexp(dd_add_d(s, 1), (int)k);
+}
+
+/* log(a), a > 0 : près de 1, 2 atanh((a - 1) / (a + 1)), pour garder la
+   précision relative ; ailleurs une itération de Newton sur exp depuis
+   le log en double */
+static DD dd_log(DD a) {
+    if (a.hi <= 0 || !isfinite(a.hi))
+        return dd(log(a.hi));
+    if (fabs(a.hi - 1) < 0.0625) {
+        /* |u| < 1/32 : termes en u^7 et au-delà en double */
+        static const DD third = { 0.3333333333333333, 1.850371707708594e-17 };
+        static const DD fifth = { 0.2, -1.1102230246251566e-17 };
+        DD u = dd_div(dd_add_d(a, -1), dd_add_d(a, 1));
+        DD u2 = dd_mul(u, u);
+        double t = 1.0 / 25;
+        for (int n = 23; n >= 7; n -= 2)
+            t = t * u2.hi + 1.0 / n;
+        DD s = dd_add(dd_mul(dd(t), u2), fifth);
+        s = dd_add(dd_mul(s, u2), third);
+        s = dd_add_d(dd_mul(s, u2), 1);
+        return dd_ldexp(dd_mul(s, u), 1);
+    }
+    DD x = dd(log(a.hi));
+    return dd_add_d(dd_add(x, dd_mul(a, dd_exp(dd_neg(x)))), -1);
+}
+
+/* 2/pi = somme des m_i 2^(-24 (i + 1)) : 1536 bits, de quoi réduire
+   exactement le plus grand double */
+static const uint32_t two_over_pi[64] = {
+    0xA2F983, 0x6E4E44, 0x1529FC, 0x2757D1, 0xF534DD, 0xC0DB62, 0x95993C, 0x439041,
+    0xFE5163, 0xABDEBB, 0xC561B7, 0x246E3A, 0x424DD2, 0xE00649, 0x2EEA09, 0xD1921C,
+    0xFE1DEB, 0x1CB129, 0xA73EE8, 0x8235F5, 0x2EBB44, 0x84E99C, 0x7026B4, 0x5F7E41,
+    0x3991D6, 0x398353, 0x39F49C, 0x845F8B, 0xBDF928, 0x3B1FF8, 0x97FFDE, 0x05980F,
+    0xEF2F11, 0x8B5A0A, 0x6D1F6D, 0x367ECF, 0x27CB09, 0xB74F46, 0x3F669E, 0x5FEA2D,
+    0x7527BA, 0xC7EBE5, 0xF17B3D, 0x0739F7, 0x8A5292, 0xEA6BFB, 0x5FB11F, 0x8D5D08,
+    0x560330, 0x46FC7B, 0x6BABF0, 0xCFBC20, 0x9AF436, 0x1DA9E3, 0x91615E, 0xE61B08,
+    0x659985, 0x5F14A0, 0x68408D, 0xFFD880, 0x4D7327, 0x310606, 0x1556CA, 0x73A8C9,
+};
+
+/* Somme exacte b + e[0] + ... + e[n-1] (développement de Shewchuk :
+   termes sans chevauchement, par valeurs absolues croissantes, zéros
+   retirés). Renvoie le nouveau nombre de termes. */
+static int grow_expansion(double *e, int n, double b) {
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        DD t = two_sum(b, e[i]);
+        b = t.hi;
+        if (t.lo != 0)
+            e[m++] = t.lo;
+    }
+    if (b != 0)
+        e[m++] = b;
+    return m;
+}
+
+/* Réduction de Payne et Hanek : a 2/pi = k + f avec k entier et
+   |f| <= 1/2 environ, pour les grands arguments où k pi/2 n'est plus
+   assez précis. Chaque composante x = X 2^(e-52) de a est multipliée
+   par les seuls morceaux de 2/pi qui ne donnent pas un multiple de 4 ;
+   les produits exacts, réduits modulo 4, sont sommés sans erreur. */
+static DD dd_reduce_pi_2(DD a, double *k) {
+    double e[64];
+    int n = 0;
+    double parts[2] = { a.hi, a.lo };
+    for (int j = 0; j < 2; j++) {
+        double x = parts[j];
+        if (x == 0)
+            continue;
+        int ex = ilogb(x), i = 0;
+        while (i < 63 && ex - 52 - 24 * (i + 1) >= 2)
+            i++;
+        for (int last = i + 14; i <= last && i < 64; i++) {
+            DD p = two_prod(ldexp(x, -24 * (i + 1)), two_over_pi[i]);
+            n = grow_expansion(e, n, fmod(p.hi, 4));
+            n = grow_expansion(e, n, fmod(p.lo, 4));
+        }
+    }
+    double sum = 0;
+    for (int i = n - 1; i >= 0; i--)
+        sum += e[i];
+    *k = nearbyint(sum);
+    n = grow_expansion(e, n, -*k);
+    DD f = dd(0);
+    for (int i = 0; i < n; i++)
+        f = dd_add_d(f, e[i]);
+    return dd_add_d(dd_mul(f, DD_PI_2), f.hi * PI_2_P3);
+}
+
+/* sin et cos de a (s ou c peut être NULL) : réduction par k pi/2 (pi/2
+   sur trois double, ou 2/pi sur 1536 bits au-delà de 1e15), série de
+   Taylor du sinus sur [-pi/4, pi/4], cosinus par sqrt(1 - sin²)
+   seulement s'il est demandé. */
+static void dd_sincos(DD a, DD *s, DD *c) {
+    if (!isfinite(a.hi)) {
+        if (s)
+            *s = dd(sin(a.hi));
+        if (c)
+            *c = dd(cos(a.hi));
+        return;
+    }
+    double k;
+    DD r;
+    if (fabs(a.hi) > 1e15) {
+        r = dd_reduce_pi_2(a, &k);
+    } else {
+        k = nearbyint(a.hi / DD_PI_2.hi);
+        r = dd_sub(a, two_prod(k, DD_PI_2.hi));
+        r = dd_sub(r, two_prod(k, DD_PI_2.lo));
+        r = dd_add_d(r, -k * PI_2_P3);
+    }
+    int q = (long long)k & 3;
+    DD sr = odd_series(r, 1), cr = sr;
+    if ((q & 1) ? s != NULL : c != NULL)
+        cr = dd_sqrt(dd_mul(dd_sub(dd(1), sr), dd_add_d(sr, 1)));
+    DD rs = (q & 1) ? cr : sr, rc = (q & 1) ? sr : cr;
+    if (s)
+        *s = (q == 2 || q == 3) ? dd_neg(rs) : rs;
+    if (c)
+        *c = (q == 1 || q == 2) ? dd_neg(rc) : rc;
+}
+
+/* Argument de x + iy : atan2 en double, corrigé par une itération de
+   Newton (tan(t - z) = (y cos z - x sin z) / (x cos z + y sin z)) */
+static DD dd_atan2(DD y, DD x) {
+    double z = atan2(y.hi, x.hi);
+    if ((y.hi == 0 && x.hi == 0) || !isfinite(y.hi) || !isfinite(x.hi))
+        return dd(z);
+    DD s, c;
+    dd_sincos(dd(z), &s, &c);
+    DD num = dd_sub(dd_mul(y, c), dd_mul(x, s));
+    DD den = dd_add(dd_mul(x, c), dd_mul(y, s));
+    return dd_add_d(dd_div(num, den), z);
+}
+
+/* sinh(a) : série de Taylor près de 0, (e^a - e^-a) / 2 ailleurs */
+static DD dd_sinh(DD a) {
+    if (fabs(a.hi) < 0.5)
+        return odd_series(a, 0);
+    DD e = dd_exp(a);
+    return dd_ldexp(dd_sub(e, dd_div(dd(1), e)), -1);
+}
+
+static DD dd_cosh(DD a) {
+    DD e = dd_exp(a);
+    return dd_ldexp(dd_add(e, dd_div(dd(1), e)), -1);
+}
+
+static DD dd_tanh(DD a) {
+    if (fabs(a.hi) > 40)
+        return dd(a.hi > 0 ? 1 : -1);
+    return dd_div(dd_sinh(a), dd_cosh(a));
+}
+
+/* a! pour a >= 0 : produit exact jusqu'à 20!, produit en double-double
+   jusqu'à 170!, et pour les non-entiers Gamma(a + 1) par la série de
+   Stirling, l'argument étant d'abord porté au-delà de 30 */
+static DD dd_fact(DD a) {
+    if (a.hi > 170 || !isfinite(a.hi))
+        return dd(calc_factorial(a.hi));
+    if (dd_is_int(a)) {
+        int n = (int)a.hi;
+        uint64_t v = 1;
+        for (int k = 2; k <= n && k <= 20; k++)
+            v *= k;
+        DD r = quick_two_sum((double)v, (double)(int64_t)(v - (uint64_t)(double)v));
+        for (int k = 21; k <= n; k++)
+            r = dd_mul_d(r, k);
+        return r;
+    }
+    DD z = dd_add_d(a, 1), prod = dd(1);
+    while (z.hi < 30) {
+        prod = dd_mul(prod, z);
+        z = dd_add_d(z, 1);
+    }
+    DD w = dd_div(dd(1), dd_mul(z, z));
+    DD s = stirling[13];
+    for (int k = 12; k >= 0; k--)
+        s = dd_add(dd_mul(s, w), stirling[k]);
+    s = dd_div(s, z);
+    DD lg = dd_sub(dd_mul(dd_add_d(z, -0.5), dd_log(z)), z);
+    lg = dd_add(dd_add(lg, DD_HALF_LN_2PI), s);
+    return dd_div(dd_exp(lg), prod);
+}
+
+/* a^b pour a et b réels : puissance entière par multiplications, sinon
+   exp(b log a) ; a doit être positif si b n'est pas entier */
+static DD dd_pow(DD a, DD b) {
+    long long n;
+    if (dd_int_exponent(b, &n) && llabs(n) <= 1 << 20)
+        return dd_powi(a, n);
+    DD r = dd_exp(dd_mul(b, dd_log(a.hi < 0 ? dd_neg(a) : a)));
+    if (a.hi < 0 && fmod(b.hi, 2) != 0)
+        r = dd_neg(r);
+    return r;
+}
+
+/* ============================= */
+/* Fonctions complexes           */
+/* ============================= */
+
+static inline int is_real(const DDC *z) {
+    return z->im.hi == 0;
+}
+
+static inline DDC ddc(DD re, DD im) {
+    return (DDC){ re, im };
+}
+
+static inline DDC ddc_real(DD re) {
+    return (DDC){ re, dd(0) };
+}
+
+static inline DDC from_complex(double complex z) {
+    return (DDC){ dd(creal(z)), dd(cimag(z)) };
+}
+
+static inline double complex to_complex(const DDC *z) {
+    return CMPLX(z->re.hi, z->im.hi);
+}
+
+/* Une composante nulle prend le zéro signé du calcul en double complex
+   (ref), comme dans calc_exec_complex() : les coupures de log, sqrt et
+   des puissances en dépendent (log(-1 - 0i) = -i pi) */
+static inline void fix_zero(DD *x, double ref) {
+    if (x->hi == 0 && ref == 0)
+        x->hi = ref;
+}
+
+static inline int ddc_finite(const DDC *z) {
+    return isfinite(z->re.hi) && isfinite(z->im.hi);
+}
+
+/* Produit et quotient complexes par les formules de la multiplication et
+   de la division complexes en C, pour les mêmes zéros signés ; les
+   infinis et NaN suivent directement l'arithmétique complexe du C */
+static DDC ddc_mul(DDC a, DDC b) {
+    if (!ddc_finite(&a) || !ddc_finite(&b))
+        return from_complex(to_complex(&a) * to_complex(&b));
+    return ddc(dd_sub(dd_mul(a.re, b.re), dd_mul(a.im, b.im)),
+               dd_add(dd_mul(a.re, b.im), dd_mul(a.im, b.re)));
+}
+
+static DDC ddc_div(DDC a, DDC b) {
+    DDC q;
+    double complex ref = to_complex(&a) / to_complex(&b);
+    if (!ddc_finite(&a) || !ddc_finite(&b))
+        return from_complex(ref);
+    if (is_real(&b)) {
+        q = ddc(dd_div(a.re, b.re), dd_div(a.im, b.re));
+    } else {
+        DD d = dd_add(dd_mul(b.re, b.re), dd_mul(b.im, b.im));
+        DD re = dd_add(dd_mul(a.re, b.re), dd_mul(a.im, b.im));
+        DD im = dd_sub(dd_mul(a.im, b.re), dd_mul(a.re, b.im));
+        q = ddc(dd_div(re, d), dd_div(im, d));
+    }
+    fix_zero(&q.re, creal(ref));
+    fix_zero(&q.im, cimag(ref));
+    return q;
+}
+
+static DD ddc_abs(DDC z) {
+    return dd_sqrt(dd_add(dd_mul(z.re, z.re), dd_mul(z.im, z.im)));
+}
+
+/* Les modules trop grands ou trop petits pour z² sont calculés en double */
+static int ddc_huge(const DDC *z) {
+    double m = fmax(fabs(z->re.hi), fabs(z->im.hi));
+    return m > 1e150 || m < 1e-150 || !isfinite(m);
+}
+
+static DDC ddc_log(DDC z) {
+    if (is_real(&z) && z.re.hi > 0 && isfinite(z.re.hi))
+        return ddc(dd_log(z.re), z.im);
+    if (ddc_huge(&z))
+        return from_complex(clog(to_complex(&z)));
+    if (is_real(&z))
+        return ddc(dd_log(dd_neg(z.re)), signbit(z.im.hi) ? dd_neg(DD_PI) : DD_PI);
+    DD m2 = dd_add(dd_mul(z.re, z.re), dd_mul(z.im, z.im));
+    return ddc(dd_ldexp(dd_log(m2), -1), dd_atan2(z.im, z.re));
+}
+
+static DDC ddc_exp(DDC z) {
+    if (is_real(&z))
+        return ddc(dd_exp(z.re), z.im);
+    if (!isfinite(z.re.hi) || !isfinite(z.im.hi))
+        return from_complex(cexp(to_complex(&z)));
+    DD e = dd_exp(z.re), s, c;
+    dd_sincos(z.im, &s, &c);
+    return ddc(dd_mul(e, c), dd_mul(e, s));
+}
+
+/* z^n par élévations au carré */
+static DDC ddc_powi(DDC z, long long n) {
+    DDC r = ddc_real(dd(1));
+    unsigned long long k = n < 0 ? -(unsigned long long)n : (unsigned long long)n;
+    for (;;) {
+        if (k & 1)
+            r = ddc_mul(r, z);
+        k >>= 1;
+        if (!k)
+            break;
+        z = ddc_mul(z, z);
+    }
+    if (n < 0)
+        r = ddc_div(ddc_real(dd(1)), r);
+    return r;
+}
+
+/* a^b ; les cas que l'exécution réelle en double laisse à cpow() (base
+   nulle, valeurs non finies) sont calculés par cpow() */
+static DDC ddc_pow(DDC a, DDC b) {
+    if (a.re.hi == 0 && a.im.hi == 0)
+        return from_complex(cpow(to_complex(&a), to_complex(&b)));
+    if (!isfinite(a.re.hi) || !isfinite(a.im.hi) || !isfinite(b.re.hi) || !isfinite(b.im.hi))
+        return from_complex(cpow(to_complex(&a), to_complex(&b)));
+    long long n;
+    if (is_real(&a) && is_real(&b) && a.re.hi > 0) {
+        /* cpow(a, b) = cexp(b clog(a)) : partie imaginaire nulle, du signe
+           de b.re a.im + b.im log(a) */
+        return ddc(dd_pow(a.re, b.re), dd(b.re.hi * a.im.hi + b.im.hi * (a.re.hi - 1)));
+    }
+    if (is_real(&a) && is_real(&b) && dd_is_int(b.re)) {
+        /* Base négative : cpow() donne une petite partie imaginaire, dont
+           on garde le signe */
+        double im = cimag(cpow(to_complex(&a), to_complex(&b)));
+        return ddc(dd_pow(a.re, b.re), dd(copysign(0, im)));
+    }
+    if (is_real(&b) && dd_int_exponent(b.re, &n) && llabs(n) <= 1 << 20)
+        return ddc_powi(a, n);
+    return ddc_exp(ddc_mul(b, ddc_log(a)));
+}
+
+static DDC ddc_sqrt(DDC z) {
+    if (is_real(&z)) {
+        if (z.re.hi >= 0)
+            return ddc(dd_sqrt(z.re), z.im);
+        DD t = dd_sqrt(dd_neg(z.re));
+        return ddc(dd(0), signbit(z.im.hi) ? dd_neg(t) : t);
+    }
+    if (ddc_huge(&z))
+        return from_complex(csqrt(to_complex(&z)));
+    DD r = ddc_abs(z);
+    if (z.re.hi >= 0) {
+        DD t = dd_sqrt(dd_ldexp(dd_add(r, z.re), -1));
+        return ddc(t, dd_div(z.im, dd_ldexp(t, 1)));
+    }
+    DD t = dd_sqrt(dd_ldexp(dd_sub(r, z.re), -1));
+    DD im = z.im.hi < 0 ? dd_neg(t) : t;
+    return ddc(dd_div(z.im.hi < 0 ? dd_neg(z.im) : z.im, dd_ldexp(t, 1)), im);
+}
+
+/* sin(x + iy) = sin x cosh y + i cos x sinh y, et de même pour cos */
+static DDC ddc_sin(DDC z, int cosine) {
+    DD s, c;
+    if (is_real(&z)) {
+        /* sin(x ± 0i) = sin x ± 0 cos x i, cos(x ± 0i) = cos x ∓ 0 sin x i */
+        dd_sincos(z.re, cosine ? NULL : &s, cosine ? &c : NULL);
+        if (cosine)
+            return ddc(c, dd(-z.im.hi * sin(z.re.hi)));
+        return ddc(s, dd(z.im.hi * cos(z.re.hi)));
+    }
+    if (fabs(z.im.hi) > 700 || !isfinite(z.re.hi)) {
+        double complex w = to_complex(&z);
+        return from_complex(cosine ? ccos(w) : csin(w));
+    }
+    dd_sincos(z.re, &s, &c);
+    DD ch = dd_cosh(z.im), sh = dd_sinh(z.im);
+    if (cosine)
+        return ddc(dd_mul(c, ch), dd_neg(dd_mul(s, sh)));
+    return ddc(dd_mul(s, ch), dd_mul(c, sh));
+}
+
+static DDC ddc_tan(DDC z) {
+    if (is_real(&z)) {
+        DD s, c;
+        dd_sincos(z.re, &s, &c);
+        return ddc(dd_div(s, c), z.im);
+    }
+    if (fabs(z.im.hi) > 20 || !isfinite(z.re.hi))
+        return from_complex(ctan(to_complex(&z)));
+    return ddc_div(ddc_sin(z, 0), ddc_sin(z, 1));
+}
+
+/* atan(x + iy) = atan2(2x, 1 - x² - y²) / 2
+                  + i log((x² + (y + 1)²) / (x² + (y - 1)²)) / 4 */
+static DDC ddc_atan(DDC z) {
+    if (is_real(&z)) {
+        if (!isfinite(z.re.hi))
+            return from_complex(catan(to_complex(&z)));
+        return ddc(dd_atan2(z.re, dd(1)), z.im);
+    }
+    if ((z.re.hi == 0 && fabs(z.im.hi) == 1) || ddc_huge(&z))
+        return from_complex(catan(to_complex(&z)));
+    DD x2 = dd_mul(z.re, z.re);
+    DD yp = dd_add_d(z.im, 1), ym = dd_add_d(z.im, -1);
+    DD re = dd_atan2(dd_ldexp(z.re, 1), dd_sub(dd_sub(dd(1), x2), dd_mul(z.im, z.im)));
+    DD num = dd_add(x2, dd_mul(yp, yp)), den = dd_add(x2, dd_mul(ym, ym));
+    return ddc(dd_ldexp(re, -1), dd_ldexp(dd_log(dd_div(num, den)), -2));
+}
+
+/* arcsin et arccos réels dans [-1, 1] : atan2(x, sqrt((1 - x)(1 + x))) */
+static DDC ddc_asin(DDC z, int cosine) {
+    if (!is_real(&z) || !(fabs(z.re.hi) <= 1)) {
+        double complex w = to_complex(&z);
+        return from_complex(cosine ? cacos(w) : casin(w));
+    }
+    /* |x| = 1 + lo au-delà de 1 : arrondi à ±1 comme en double */
+    DD t = dd_mul(dd_sub(dd(1), z.re), dd_add_d(z.re, 1));
+    DD c = t.hi > 0 ? dd_sqrt(t) : dd(0);
+    if (cosine)
+        return ddc(dd_atan2(c, z.re), dd_neg(z.im));
+    return ddc(dd_atan2(z.re, c), z.im);
+}
+
+/* ============================= */
+/* Fonctions de base (registre)  */
+/* ============================= */
+
+int calc_ddfn_exp(const CalcDDComplex *a, int n, CalcDDComplex *res) {
+    (void)n;
+    *res = ddc_exp(a[0]);
+    return 0;
+}
+
+int calc_ddfn_abs(const CalcDDComplex *a, int n, CalcDDComplex *res) {
+    (void)n;
+    if (is_real(&a[0]))
+        *res = ddc_real(a[0].re.hi < 0 ? dd_neg(a[0].re) : a[0].re);
+    else if (ddc_huge(&a[0]))
+        *res = ddc_real(dd(cabs(to_complex(&a[0]))));
+    else
+        *res = ddc_real(ddc_abs(a[0]));
+    return 0;
+}
+
+/* Les versions complexes de sinh, cosh et tanh restent en double */
+int calc_ddfn_sinh(const CalcDDComplex *a, int n, CalcDDComplex *res) {
+    (void)n;
+    if (!is_real(&a[0]) || fabs(a[0].re.hi) > 700)
+        return -1;
+    *res = ddc(dd_sinh(a[0].re), a[0].im);
+    return 0;
+}
+
+int calc_ddfn_cosh(const CalcDDComplex *a, int n, CalcDDComplex *res) {
+    (void)n;
+    if (!is_real(&a[0]) || fabs(a[0].re.hi) > 700)
+        return -1;
+    *res = ddc(dd_cosh(a[0].re), dd(a[0].im.hi * a[0].re.hi));
+    return 0;
+}
+
+int calc_ddfn_tanh(const CalcDDComplex *a, int n, CalcDDComplex *res) {
+    (void)n;
+    if (!is_real(&a[0]) || !isfinite(a[0].re.hi))
+        return -1;
+    *res = ddc(dd_tanh(a[0].re), a[0].im);
+    return 0;
+}
+
+int calc_ddfn_atan2(const CalcDDComplex *a, int n, CalcDDComplex *res) {
+    (void)n;
+    if (!is_real(&a[0]) || !is_real(&a[1]))
+        return -1;
+    *res = ddc_real(dd_atan2(a[0].re, a[1].re));
+    return 0;
+}
+
+int calc_ddfn_min(const CalcDDComplex *a, int n, CalcDDComplex *res) {
+    DDC m = a[0];
+    for (int k = 1; k < n; k++)
+        if (dd_lt(a[k].re, m.re))
+            m = a[k];
+    *res = m;
+    return 0;
+}
+
+int calc_ddfn_max(const CalcDDComplex *a, int n, CalcDDComplex *res) {
+    DDC m = a[0];
+    for (int k = 1; k < n; k++)
+        if (dd_lt(m.re, a[k].re))
+            m = a[k];
+    *res = m;
+    return 0;
+}
+
+/* Fonction sans version double-double (ou qui la refuse) : appel en
+   double, comme le ferait l'exécution en double */
+static DDC call_double(const CalcSymbol *sym, const DDC *args, int argc) {
+    double rlocal[16];
+    double complex clocal[16];
+    double *rargs = rlocal;
+    double complex *cargs = clocal;
+    int real = 1;
+    if (argc > 16) {
+        rargs = malloc(argc * sizeof(double));
+        cargs = malloc(argc * sizeof(double complex));
+        if (!rargs || !cargs) {
+            free(rargs);
+            free(cargs);
+            return from_complex(CMPLX(NAN, NAN));
+        }
+    }
+    for (int k = 0; k < argc; k++) {
+        rargs[k] = args[k].re.hi;
+        cargs[k] = to_complex(&args[k]);
+        if (!is_real(&args[k]))
+            real = 0;
+    }
+    double complex z = NAN;
+    int done = 0;
+    if (real && sym->rfn) {
+        double r = sym->rfn(rargs, argc);
+        if (isfinite(r)) {
+            z = r;
+            done = 1;
+        }
+    }
+    if (!done)
+        z = sym->cfn(cargs, argc);
+    if (rargs != rlocal) {
+        free(rargs);
+        free(cargs);
+    }
+    return from_complex(z);
+}
+
+/* ============================= */
+/* Partie Exécution              */
+/* ============================= */
+
+/* Quotient de OP_DIV : zéro imaginaire signé comme dans la division
+   complexe */
+static void divide(DDC *a, const DDC *b) {
+    if (is_real(a) && is_real(b) && ddc_finite(a) && ddc_finite(b)) {
+        double r = b->im.hi / b->re.hi;
+        a->im = dd((a->im.hi - a->re.hi * r) / (b->re.hi + b->im.hi * r));
+        a->re = dd_div(a->re, b->re);
+    } else
+        *a = ddc_div(*a, *b);
+}
+
+/* Diviseur nul au sens de calc_exec_complex() : |z| < 1e-12 */
+static inline int near_zero(const DDC *z) {
+    return is_real(z) ? fabs(z->re.hi) < 1e-12 : hypot(z->re.hi, z->im.hi) < 1e-12;
+}
+
+/* Les vérifications (division par 0, factorielle) sont celles de
+   calc_exec_complex(), et les valeurs réelles restent réelles : une
+   opération sur deux réels coûte une opération double-double. */
+static CalcErrorCode exec_dd(CalcContext *ctx, const CalcProgram *prog, DDC *stack,
+                             DDC *result) {
+    DDC *regs = stack + prog->max_depth;
+    const Instr *ip = prog->code;
+    const Instr *end = prog->code + prog->len;
+    DDC *sp = stack;
+
+    for (; ip < end; ip++) {
+        switch (ip->op) {
+        case OP_CONST:
+            *sp++ = ddc_real((DD){ prog->rconsts[ip->arg],
+                                   prog->clo ? prog->clo[ip->arg] : 0 });
+            break;
+        case OP_CCONST:
+            *sp++ = from_complex(prog->consts[ip->arg]);
+            break;
+        case OP_ADD:
+            sp--;
+            sp[-1] = ddc(dd_add(sp[-1].re, sp[0].re), dd_add(sp[-1].im, sp[0].im));
+            break;
+        case OP_SUB:
+            sp--;
+            sp[-1] = ddc(dd_sub(sp[-1].re, sp[0].re), dd_sub(sp[-1].im, sp[0].im));
+            break;
+        case OP_MUL:
+            sp--;
+            if (is_real(&sp[-1]) && is_real(&sp[0]) && ddc_finite(&sp[-1]) && ddc_finite(&sp[0])) {
+                /* Zéro imaginaire signé comme dans la multiplication complexe */
+                sp[-1].im = dd(sp[-1].re.hi * sp[0].im.hi + sp[-1].im.hi * sp[0].re.hi);
+                sp[-1].re = dd_mul(sp[-1].re, sp[0].re);
+            } else
+                sp[-1] = ddc_mul(sp[-1], sp[0]);
+            break;
+        case OP_DIV:
+            sp--;
+            if (near_zero(&sp[0]))
+                goto fail_div;
+            divide(&sp[-1], &sp[0]);
+            break;
+        case OP_IDIV:
+            sp--;
+            if (near_zero(&sp[0]))
+                goto fail_idiv;
+            sp[-1] = ddc_real(dd_trunc(dd_div(sp[-1].re, sp[0].re)));
+            break;
+        case OP_POW:
+            sp--;
+            sp[-1] = ddc_pow(sp[-1], sp[0]);
+            break;
+        case OP_NEG:
+            sp[-1] = ddc(dd_neg(sp[-1].re), dd_neg(sp[-1].im));
+            break;
+        case OP_FACT:
+            if (!is_real(&sp[-1]) || sp[-1].re.hi < 0)
+                goto fail_fact;
+            sp[-1] = ddc_real(dd_fact(sp[-1].re));
+            break;
+        case OP_PERCENT:
+            sp[-1] = ddc(dd_div(sp[-1].re, dd(100)), dd_div(sp[-1].im, dd(100)));
+            break;
+        case OP_LOG:
+            sp[-1] = ddc_log(sp[-1]);
+            break;
+        case OP_COS:
+            sp[-1] = ddc_sin(sp[-1], 1);
+            break;
+        case OP_SIN:
+            sp[-1] = ddc_sin(sp[-1], 0);
+            break;
+        case OP_TAN:
+            sp[-1] = ddc_tan(sp[-1]);
+            break;
+        case OP_ACOS:
+            sp[-1] = ddc_asin(sp[-1], 1);
+            break;
+        case OP_ASIN:
+            sp[-1] = ddc_asin(sp[-1], 0);
+            break;
+        case OP_ATAN:
+            sp[-1] = ddc_atan(sp[-1]);
+            break;
+        case OP_SQRT:
+            sp[-1] = ddc_sqrt(sp[-1]);
+            break;
+        case OP_ROOT:
+            sp--;
+            sp[-1] = ddc_pow(sp[-1], ddc_div(ddc_real(dd(1)), sp[0]));
+            break;
+        case OP_CALL: {
+            const CalcSymbol *sym = calc_symbol(ip->arg);
+            DDC res;
+            sp -= ip->argc;
+            if (!sym->ddfn || sym->ddfn(sp, ip->argc, &res) != 0)
+                res = call_double(sym, sp, ip->argc);
+            *sp++ = res;
+            break;
+        }
+        case OP_POWI:
+            /* x^n réécrit par opt.c : même calcul que OP_POW */
+            sp[-1] = ddc_pow(sp[-1], ddc_real(dd(ip->arg)));
+            break;
+        case OP_SCALE: {
+            /* x / c réécrit par opt.c : divisé par 1/c, exact */
+            sp--;
+            DDC c = ddc_real(dd(1.0 / sp[0].re.hi));
+            divide(&sp[-1], &c);
+            break;
+        }
+        case OP_STORE:
+            regs[ip->arg] = sp[-1];
+            break;
+        case OP_LOAD:
+            *sp++ = regs[ip->arg];
+            break;
+        case OP_VAR:
+            *sp++ = from_complex(ctx->vars[ip->arg]);
+            break;
+        case OP_INTEGRATE:
+        case OP_SOLVE:
+        case OP_DIFF:
+        case OP_SUM:
+        case OP_PROD: {
+            double complex args[4], z;
+            sp -= ip->argc;
+            for (int k = 0; k < ip->argc; k++)
+                args[k] = to_complex(&sp[k]);
+            if (calc_exec_binder(ctx, prog, ip, args, &z) != CALC_OK)
+                return ctx->err.code;
+            *sp++ = from_complex(z);
+            break;
+        }
+        }
+    }
+    *result = sp[-1];
+    return CALC_OK;
+
+fail_div:
+    calc_set_error(ctx, CALC_ERR_DIV_ZERO, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+fail_idiv:
+    calc_set_error(ctx, CALC_ERR_IDIV_ZERO, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+fail_fact:
+    calc_set_error(ctx, CALC_ERR_FACTORIAL, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+}
+
+CalcErrorCode calc_exec_dd(CalcContext *ctx, const CalcProgram *prog, CalcDDComplex *result) {
+    DDC local[32];
+    DDC *stack = local;
+    int need = prog->max_depth + prog->nregs;
+    if (need > 32) {
+        if (need > ctx->ddstack_cap) {
+            DDC *s = realloc(ctx->ddstack, need * sizeof(DDC));
+            if (!s) {
+                calc_set_error(ctx, CALC_ERR_NOMEM, 0);
+                return CALC_ERR_NOMEM;
+            }
+            ctx->ddstack = s;
+            ctx->ddstack_cap = need;
+        }
+        stack = ctx->ddstack;
+    }
+    return exec_dd(ctx, prog, stack, result);
+}
+
+/* ============================= */
+/* Partie Nombres écrits         */
+/* ============================= */
+
+static DD dd_pow10(int n) {
+    return n >= 0 ? dd_powu(dd(10), n) : dd_div(dd(1), dd_powu(dd(10), -n));
+}
+
+/* Partie basse du nombre décimal [s, end), dont strtod() a donné hi :
+   la mantisse est accumulée en double-double (exacte sur 32 chiffres),
+   puis multipliée par la puissance de 10 */
+double calc_dd_literal_lo(const char *s, const char *end, double hi) {
+    if (end - s > 1 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+        return 0; /* hexadécimal : exact en double */
+    if (hi == 0 || !isfinite(hi))
+        return 0;
+    DD m = dd(0);
+    int exp10 = 0, digits = 0, dot = 0;
+    for (; s < end; s++) {
+        if (*s == '.') {
+            dot = 1;
+        } else if (*s >= '0' && *s <= '9') {
+            if (digits < 36) {
+                m = dd_add_d(dd_mul_d(m, 10), *s - '0');
+                if (m.hi != 0)
+                    digits++;
+                exp10 -= dot;
+            } else {
+                exp10 += !dot;
+            }
+        } else {
+            break; /* exposant */
+        }
+    }
+    if (s < end) {
+        long e = strtol(s + 1, NULL, 10);
+        if (e > 1000 || e < -1000)
+            return 0;
+        exp10 += (int)e;
+    }
+    if (exp10 > 290 || exp10 < -290)
+        return 0; /* hors des puissances de 10 représentables */
+    DD v = exp10 >= 0 ? dd_mul(m, dd_pow10(exp10)) : dd_div(m, dd_pow10(-exp10));
+    return isfinite(v.hi) ? dd_add_d(v, -hi).hi : 0;
+}
+
+/* ============================= */
+/* Partie Affichage              */
+/* ============================= */
+
+#define DD_DIGITS 30
+
+/* Comme "%g", avec DD_DIGITS chiffres significatifs */
+static int format_dd(DD x, char *buf, size_t size) {
+    if (!isfinite(x.hi) || x.hi == 0)
+        return snprintf(buf, size, "%g", x.hi);
+    int neg = x.hi < 0;
+    if (neg)
+        x = dd_neg(x);
+    int e = (int)floor(log10(x.hi));
+    /* y = x / 10^e dans [1, 10), en deux fois près des limites des double */
+    DD y = x;
+    int k = e;
+    if (k < -290) {
+        y = dd_mul(y, dd_pow10(290));
+        k += 290;
+    }
+    y = k >= 0 ? dd_div(y, dd_pow10(k)) : dd_mul(y, dd_pow10(-k));
+    if (y.hi < 1) {
+        y = dd_mul_d(y, 10);
+        e--;
+    } else if (y.hi >= 10) {
+        y = dd_div(y, dd(10));
+        e++;
+    }
+    char d[DD_DIGITS + 1];
+    for (int i = 0; i <= DD_DIGITS; i++) {
+        int q = (int)dd_floor(y).hi;
+        q = q < 0 ? 0 : q > 9 ? 9 : q;
+        d[i] = (char)q;
+        y = dd_mul_d(dd_add_d(y, -q), 10);
+    }
+    /* Arrondi au plus près sur le chiffre de garde */
+    if (d[DD_DIGITS] >= 5) {
+        int i = DD_DIGITS - 1;
+        while (i >= 0 && ++d[i] == 10)
+            d[i--] = 0;
+        if (i < 0) {
+            d[0] = 1;
+            e++;
+        }
+    }
+    int n = DD_DIGITS;
+    while (n > 1 && d[n - 1] == 0)
+        n--;
+
+    char tmp[DD_DIGITS + 16];
+    int len = 0;
+    if (neg)
+        tmp[len++] = '-';
+    if (e < -4 || e >= DD_DIGITS) {
+        tmp[len++] = '0' + d[0];
+        if (n > 1)
+            tmp[len++] = '.';
+        for (int i = 1; i < n; i++)
+            tmp[len++] = '0' + d[i];
+        len += sprintf(tmp + len, "e%c%02d", e < 0 ? '-' : '+', abs(e));
+    } else if (e >= 0) {
+        for (int i = 0; i <= e; i++)
+            tmp[len++] = '0' + (i < n ? d[i] : 0);
+        if (n > e + 1)
+            tmp[len++] = '.';
+        for (int i = e + 1; i < n; i++)
+            tmp[len++] = '0' + d[i];
+    } else {
+        tmp[len++] = '0';
+        tmp[len++] = '.';
+        for (int i = 0; i < -e - 1; i++)
+            tmp[len++] = '0';
+        for (int i = 0; i < n; i++)
+            tmp[len++] = '0' + d[i];
+    }
+    tmp[len] = '\0';
+    return snprintf(buf, size, "%s", tmp);
+}
+
+int calc_format_result_dd(const CalcDDComplex *res, char *buf, size_t size) {
+    char re[DD_DIGITS + 16], im[DD_DIGITS + 16];
+    format_dd(res->re, re, sizeof(re));
+    if (fabs(res->im.hi) < 1e-12)
+        return snprintf(buf, size, "%s", re);
+    format_dd(res->im, im, sizeof(im));
+    return snprintf(buf, size, "%s+%si", re, im);
+}
@@ -0,0 +1,721 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include "calc.h"
+#include "calc_internal.h"
+
+/* ============================= */
+/* Partie Nombres duaux          */
+/* Un nombre dual x + x'ε (avec ε² = 0) porte une valeur et sa dérivée :
+   chaque opération f y devient f(x) + f'(x) x'ε, si bien qu'une seule
+   exécution du programme donne la valeur et la dérivée exacte, sans
+   différences finies. Chaque valeur porte ici width dérivées, une par
+   direction : le gradient d'une expression à n variables sort d'une
+   seule exécution à n directions.
+   Les valeurs suivent le chemin réel (fonctions réelles de libm) tant
+   qu'elles restent dans son domaine, le complexe au-delà ; les dérivées
+   sont complexes. Les opérateurs à variable liée sont dérivés
+   exactement (binder_tangent) : sum et integrate par la somme ou
+   l'intégrale de la dérivée du corps, prod par la règle du produit,
+   solve par le théorème des fonctions implicites, et diff par une
+   exécution du corps au second ordre, qui porte en plus la dérivée
+   croisée de deux directions. Seules les fonctions externes, dont la
+   dérivée n'est pas connue, passent par des différences centrées
+   d'ordre 4 ; au second ordre, elles et les opérateurs à variable liée
+   donnent CALC_ERR_DERIVATIVE. */
+/* ============================= */
+
+/* Pas des différences centrées, relatif à la plus grande valeur décalée */
+#define DIFF_STEP 1e-3
+
+typedef struct {
+    CalcContext *ctx;
+    const CalcProgram *prog;
+    int w;                        /* dérivées par valeur */
+    const double complex *dvars;  /* dérivées des variables, w chacune ;
+                                     NULL : la variable k a la dérivée 1
+                                     dans la direction k (gradient) */
+    double complex *val;          /* pile, puis registres */
+    double complex *tan;          /* w dérivées par case de val */
+    double complex *mix;          /* second ordre (w = 2) : dérivée croisée
+                                     par case de val ; NULL au premier */
+} Dual;
+
+/* ============================= */
+/* Valeurs                       */
+/* ============================= */
+
+/* Mêmes fonctions que le chemin réel dans son domaine, celles du chemin
+   complexe ailleurs */
+
+static int on_axis(double complex z) {
+    return cimag(z) == 0;
+}
+
+static double complex d_log(double complex x) {
+    return on_axis(x) && creal(x) >= 0 ? log(creal(x)) : clog(x);
+}
+
+static double complex d_sqrt(double complex x) {
+    return on_axis(x) && creal(x) >= 0 ? sqrt(creal(x)) : csqrt(x);
+}
+
+static double complex d_cos(double complex x) {
+    return on_axis(x) ? cos(creal(x)) : ccos(x);
+}
+
+static double complex d_sin(double complex x) {
+    return on_axis(x) ? sin(creal(x)) : csin(x);
+}
+
+/* a^b ; neg : base négative admise pour un exposant entier (OP_POW,
+   mais pas OP_ROOT) */
+static double complex d_pow(double complex a, double complex b, int neg) {
+    double x = creal(a), y = creal(b);
+    if (on_axis(a) && on_axis(b) && isfinite(x) && isfinite(y) &&
+        (x > 0 || (neg && x < 0 && y == trunc(y)))) {
+        double r = pow(x, y);
+        if (isfinite(r))
+            return r;
+    }
+    return cpow(a, b);
+}
+
+/* a^b dérivé par rapport à a, de valeur v */
+static double complex pow_da(double complex a, double complex b, double complex v) {
+    if (a != 0)
+        return b * v / a;
+    /* en a = 0 : b 0^(b - 1), infini réel pour b < 1 */
+    return b == 1 ? 1 : on_axis(b) ? creal(b) * pow(0, creal(b) - 1) : b * cpow(a, b - 1);
+}
+
+/* ψ(x) = Γ'(x) / Γ(x) pour x >= 1, dérivée de x! = Γ(x + 1) divisée par
+   x! : récurrence ψ(x) = ψ(x + 1) - 1/x jusqu'à x >= 10, puis
+   développement asymptotique (erreur inférieure à 1e-16) */
+static double digamma(double x) {
+    double r = 0;
+    for (; x < 10; x++)
+        r -= 1 / x;
+    double f = 1 / (x * x);
+    return r + log(x) - 0.5 / x -
+           f * (1.0 / 12 - f * (1.0 / 120 - f * (1.0 / 252 - f * (1.0 / 240 -
+           f * (1.0 / 132 - f * (691.0 / 32760 - f / 12))))));
+}
+
+/* ψ'(x) pour x >= 1, même méthode */
+static double trigamma(double x) {
+    double r = 0;
+    for (; x < 10; x++)
+        r += 1 / (x * x);
+    double f = 1 / (x * x);
+    return r + 1 / x + f / 2 +
+           f / x * (1.0 / 6 - f * (1.0 / 30 - f * (1.0 / 42 - f * (1.0 / 30 -
+           f * (5.0 / 66 - f * (691.0 / 2730 - f * 7 / 6))))));
+}
+
+/* ============================= */
+/* Règle de dérivation           */
+/* ============================= */
+
+/* f t, sans passer par le produit complexe quand f ou t est réel : une
+   dérivée infinie y aurait une partie imaginaire NaN */
+static double complex mul(double complex f, double complex t) {
+    if (on_axis(f) && on_axis(t))
+        return creal(f) * creal(t);
+    if (on_axis(f))
+        return CMPLX(creal(f) * creal(t), creal(f) * cimag(t));
+    if (on_axis(t))
+        return CMPLX(creal(f) * creal(t), cimag(f) * creal(t));
+    return f * t;
+}
+
+static double complex recip(double complex z) {
+    return on_axis(z) ? 1 / creal(z) : 1 / z;
+}
+
+/* t = f t. Une dérivée nulle le reste, même là où f est infinie
+   (sqrt en 0 d'une constante par exemple). */
+static void chain(double complex *t, int w, double complex f) {
+    for (int j = 0; j < w; j++)
+        if (t[j] != 0)
+            t[j] = mul(f, t[j]);
+}
+
+/* t = f t + g u */
+static void chain2(double complex *t, const double complex *u, int w,
+                   double complex f, double complex g) {
+    for (int j = 0; j < w; j++)
+        t[j] = (t[j] != 0 ? mul(f, t[j]) : 0) + (u[j] != 0 ? mul(g, u[j]) : 0);
+}
+
+/* Second ordre : la dérivée croisée m devient f' m + f'' t0 t1 pour
+   f(a), a de dérivées t ; les termes nuls le restent */
+static double complex lin(double complex f, double complex m) {
+    return m != 0 ? mul(f, m) : 0;
+}
+
+static double complex term(double complex f, double complex x, double complex y) {
+    return x != 0 && y != 0 ? mul(f, mul(x, y)) : 0;
+}
+
+/* Fonction d'une variable, de dérivées f1 et f2 (f2 n'est lue qu'au
+   second ordre) */
+static void unary(double complex *t, int w, double complex *m, double complex f1,
+                  double complex f2) {
+    if (m)
+        *m = lin(f1, *m) + term(f2, t[0], t[1]);
+    chain(t, w, f1);
+}
+
+/* Dérivée croisée de a / b, de valeur v, r valant 1 / b */
+static double complex mixed_div(double complex ma, double complex mb, const double complex *ta,
+                                const double complex *tb, double complex v, double complex r) {
+    double complex r2 = mul(r, r);
+    return lin(r, ma) - lin(mul(v, r), mb) - term(r2, ta[0], tb[1]) - term(r2, ta[1], tb[0]) +
+           term(2 * mul(v, r2), tb[0], tb[1]);
+}
+
+/* Dérivée de la variable k dans la direction j */
+static double complex var_tangent(const Dual *d, int k, int j) {
+    return d->dvars ? d->dvars[(size_t)k * d->w + j] : k == j;
+}
+
+static int constant(const double complex *t, int w) {
+    for (int j = 0; j < w; j++)
+        if (t[j] != 0)
+            return 0;
+    return 1;
+}
+
+/* ============================= */
+/* Différences centrées          */
+/* ============================= */
+
+/* Dérivée d'une fonction externe dans la direction j, 0 si aucun
+   argument ne varie ; tmp a la place des arguments décalés */
+static double complex central(const Dual *d, const Instr *ins, const double complex *args,
+                              const double complex *targs, int j, double complex *tmp) {
+    const CalcSymbol *sym = calc_symbol(ins->arg);
+    double scale = 1, tmax = 0;
+    for (int k = 0; k < ins->argc; k++) {
+        double complex t = targs[k * d->w + j];
+        if (t != 0) {
+            scale = fmax(scale, cabs(args[k]));
+            tmax = fmax(tmax, cabs(t));
+        }
+    }
+    if (tmax == 0)
+        return 0;
+    static const double steps[4] = { 1, -1, 2, -2 };
+    double h = DIFF_STEP * scale / tmax;
+    double complex f[4];
+    for (int k = 0; k < 4; k++) {
+        for (int i = 0; i < ins->argc; i++)
+            tmp[i] = args[i] + steps[k] * h * targs[i * d->w + j];
+        f[k] = sym->cfn(tmp, ins->argc);
+    }
+    return (8 * (f[0] - f[1]) - (f[2] - f[3])) / (12 * h);
+}
+
+/* Dérivées d'un appel de fonction d'arguments args (dérivées t, dérivées
+   croisées m au second ordre) et de valeur v : écrites en place de
+   celles du premier argument */
+static CalcErrorCode call_tangent(Dual *d, const Instr *ins, const double complex *args,
+                                  double complex *t, double complex *m, double complex v) {
+    const CalcSymbol *sym = calc_symbol(ins->arg);
+    int n = ins->argc, w = d->w;
+    double complex local[24], *dargs = local, *d1 = local + 8, *tmp = local + 16;
+    if (m && !sym->d2fn) {
+        calc_set_error(d->ctx, CALC_ERR_DERIVATIVE, d->prog->pos[ins - d->prog->code]);
+        return CALC_ERR_DERIVATIVE;
+    }
+    if (n > 8) {
+        dargs = malloc(3 * n * sizeof(double complex));
+        if (!dargs) {
+            calc_set_error(d->ctx, CALC_ERR_NOMEM, d->prog->pos[ins - d->prog->code]);
+            return CALC_ERR_NOMEM;
+        }
+        d1 = dargs + n;
+        tmp = d1 + n;
+    }
+    /* f' m (linéaire en m, comme en t) + f'' t0 t1, avant que t0 et t1
+       ne soient remplacées */
+    if (m) {
+        for (int k = 0; k < n; k++) {
+            dargs[k] = t[k * w];
+            d1[k] = t[k * w + 1];
+        }
+        double complex cross = sym->d2fn(args, dargs, d1, n, v);
+        m[0] = (constant(m, n) ? 0 : sym->dfn(args, m, n, v)) + cross;
+    }
+    /* la dérivée j est écrite sur celle du premier argument dans la même
+       direction, qui n'est plus lue ensuite */
+    for (int j = 0; j < w; j++) {
+        double complex dv;
+        if (sym->dfn) {
+            for (int k = 0; k < n; k++)
+                dargs[k] = t[k * w + j];
+            dv = constant(dargs, n) ? 0 : sym->dfn(args, dargs, n, v);
+        } else {
+            dv = central(d, ins, args, t, j, tmp);
+        }
+        t[j] = dv;
+    }
+    if (dargs != local)
+        free(dargs);
+    return CALC_OK;
+}
+
+/* ============================= */
+/* Opérateurs à variable liée    */
+/* ============================= */
+
+/* Dérivées, dans les w directions, de l'opérateur ins d'arguments args
+   (dérivées t) et de valeur v : écrites en place de celles du premier
+   argument. Le corps est exécuté dans le contexte enfant, déjà créé par
+   calc_exec_binder(), avec les valeurs vals de ses variables (la
+   variable liée puis les variables extérieures lues) et leurs dérivées
+   dvars. */
+static CalcErrorCode binder_tangent(Dual *d, const Instr *ins, const double complex *args,
+                                    double complex *t, double complex v) {
+    CalcContext *ctx = d->ctx, *child = ctx->child;
+    const CalcProgram *body = d->prog->subs[ins->arg];
+    size_t pos = d->prog->pos[ins - d->prog->code];
+    int w = d->w, nv = body->nvars_used > 1 ? body->nvars_used : 1;
+    /* arguments dont la dérivée compte : les bornes d'une intégrale, le
+       point de diff ; ni le départ de solve ni les bornes entières */
+    int nargs = ins->op == OP_INTEGRATE || ins->op == OP_DIFF ? ins->argc : 0;
+    int varies = 0;
+    for (int j = 0; j < w; j++) {
+        for (int k = 0; k < nargs; k++)
+            varies |= t[k * w + j] != 0;
+        for (int k = 1; k < nv; k++)
+            varies |= var_tangent(d, k - 1, j) != 0;
+    }
+    if (!varies) {
+        memset(t, 0, w * sizeof(double complex));
+        return CALC_OK;
+    }
+    /* w dérivées du résultat et w + 1 d'un terme, valeurs des variables
+       et jusqu'à w + 1 dérivées par variable */
+    double complex *res = malloc((2 * w + 1 + nv + (size_t)nv * (w + 1)) * sizeof(double complex));
+    if (!res) {
+        calc_set_error(ctx, CALC_ERR_NOMEM, pos);
+        return CALC_ERR_NOMEM;
+    }
+    double complex *tf = res + w, *vals = tf + w + 1, *dv = vals + nv, f;
+    for (int k = 1; k < nv; k++)
+        vals[k] = ctx->vars[k - 1];
+    CalcErrorCode code = CALC_OK;
+    if (ins->op == OP_INTEGRATE || ins->op == OP_SUM) {
+        for (int j = 0; j < w && code == CALC_OK; j++) {
+            double complex targs[2] = { t[j], t[w + j] };
+            dv[0] = 0;
+            for (int k = 1; k < nv; k++)
+                dv[k] = var_tangent(d, k - 1, j);
+            code = calc_exec_tangent(ctx, d->prog, ins, args, targs, dv, &res[j]);
+        }
+    } else if (ins->op == OP_PROD) {
+        /* (p, p') (f, f') = (p f, p' f + p f'), dans l'ordre des termes */
+        for (int k = 0; k < nv; k++)
+            for (int j = 0; j < w; j++)
+                dv[k * w + j] = k > 0 ? var_tangent(d, k - 1, j) : 0;
+        memset(res, 0, w * sizeof(double complex));
+        double complex p = 1;
+        double a = creal(args[0]), b = creal(args[1]);
+        unsigned long long n = b >= a ? (unsigned long long)floor(b - a) + 1 : 0;
+        for (unsigned long long i = 0; i < n; i++) {
+            /* interruption vue tous les 1024 termes, comme dans sum() */
+            if (i % 1024 == 0 && ctx->cancel && atomic_exchange(ctx->cancel, 0)) {
+                calc_set_error(ctx, CALC_ERR_CANCELLED, pos);
+                code = CALC_ERR_CANCELLED;
+                break;
+            }
+            vals[0] = a + (double)i;
+            child->vars = vals;
+            code = calc_exec_dual(child, body, dv, w, &f, tf);
+            if (code != CALC_OK)
+                break;
+            for (int j = 0; j < w; j++)
+                res[j] = lin(f, res[j]) + lin(p, tf[j]);
+            p = mul(p, f);
+        }
+    } else if (ins->op == OP_SOLVE) {
+        /* g(r(θ), θ) = 0 : r' = -∂g/∂θ / ∂g/∂x, à la racine v */
+        for (int k = 0; k < nv; k++) {
+            dv[k * (w + 1)] = k == 0;
+            for (int j = 0; j < w; j++)
+                dv[k * (w + 1) + 1 + j] = k > 0 ? var_tangent(d, k - 1, j) : 0;
+        }
+        vals[0] = v;
+        child->vars = vals;
+        code = calc_exec_dual(child, body, dv, w + 1, &f, tf);
+        if (code == CALC_OK && tf[0] == 0) {
+            calc_set_error(ctx, CALC_ERR_DERIVATIVE, pos);
+            code = CALC_ERR_DERIVATIVE;
+        }
+        for (int j = 0; j < w && code == CALC_OK; j++)
+            res[j] = -tf[1 + j] / tf[0];
+    } else {
+        /* diff(g, x, p) : dérivée croisée de g dans la direction de x et
+           dans celle de (p, θ) */
+        for (int j = 0; j < w && code == CALC_OK; j++) {
+            for (int k = 0; k < nv; k++) {
+                dv[2 * k] = k == 0;
+                dv[2 * k + 1] = k > 0 ? var_tangent(d, k - 1, j) : t[j];
+            }
+            vals[0] = args[0];
+            child->vars = vals;
+            code = calc_exec_dual2(child, body, dv, &f, tf, &res[j]);
+        }
+    }
+    /* erreur du corps, à sa position */
+    if (code != CALC_OK)
+        calc_set_error(ctx, child->err.code != CALC_OK ? child->err.code : code,
+                       child->err.code != CALC_OK ? child->err.pos : pos);
+    else
+        memcpy(t, res, w * sizeof(double complex));
+    free(res);
+    return code;
+}
+
+/* ============================= */
+/* Exécution                     */
+/* ============================= */
+
+static int binary(int op) {
+    switch (op) {
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+    case OP_IDIV: case OP_POW: case OP_ROOT: case OP_SCALE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static CalcErrorCode exec_dual(Dual *d, double complex *result, double complex *deriv,
+                               double complex *mixed) {
+    CalcContext *ctx = d->ctx;
+    const CalcProgram *prog = d->prog;
+    int w = d->w;
+    size_t ws = w * sizeof(double complex);
+    double complex *regs = d->val + prog->max_depth;
+    double complex *rtan = d->tan + (size_t)prog->max_depth * w;
+    double complex *rmix = d->mix ? d->mix + prog->max_depth : NULL;
+    double complex *sp = d->val;  /* première case libre */
+    double complex *tp = d->tan;  /* ses dérivées */
+    const Instr *ip;
+
+    for (ip = prog->code; ip < prog->code + prog->len; ip++) {
+        /* opérandes : a au sommet, ou a et b pour une opération binaire */
+        double complex a = 0, b = 0, v, *ta, *tb = tp;
+        if (binary(ip->op)) {
+            sp--;
+            tp -= w;
+            tb = tp;
+            b = sp[0];
+        }
+        ta = tp - w;
+        if (sp > d->val)
+            a = sp[-1];
+        /* second ordre : dérivées croisées de la case sp (b, ou la valeur
+           empilée) et de celle de a */
+        double complex *mb = d->mix ? d->mix + (sp - d->val) : NULL;
+        double complex *ma = mb && sp > d->val ? mb - 1 : NULL;
+        switch (ip->op) {
+        case OP_CONST:
+        case OP_CCONST:
+            /* valeur du chemin réel pour une constante réelle */
+            *sp++ = ip->op == OP_CONST ? prog->rconsts[ip->arg] : prog->consts[ip->arg];
+            memset(tp, 0, ws);
+            tp += w;
+            if (mb)
+                *mb = 0;
+            break;
+        case OP_ADD:
+            sp[-1] = a + b;
+            for (int j = 0; j < w; j++)
+                ta[j] += tb[j];
+            if (ma)
+                *ma += *mb;
+            break;
+        case OP_SUB:
+            sp[-1] = a - b;
+            for (int j = 0; j < w; j++)
+                ta[j] -= tb[j];
+            if (ma)
+                *ma -= *mb;
+            break;
+        case OP_MUL:
+            sp[-1] = mul(a, b);
+            if (ma)
+                *ma = lin(b, *ma) + lin(a, *mb) + term(1, ta[0], tb[1]) + term(1, ta[1], tb[0]);
+            chain2(ta, tb, w, b, a);
+            break;
+        case OP_DIV:
+            if (cabs(b) < 1e-12)
+                goto fail_div;
+            v = on_axis(a) && on_axis(b) && isfinite(creal(b)) ? creal(a) / creal(b) : a / b;
+            b = recip(b);
+            if (ma)
+                *ma = mixed_div(*ma, *mb, ta, tb, v, b);
+            chain2(ta, tb, w, b, -mul(v, b));
+            sp[-1] = v;
+            break;
+        case OP_IDIV:
+            if (cabs(b) < 1e-12)
+                goto fail_idiv;
+            sp[-1] = trunc(creal(a) / creal(b));
+            memset(ta, 0, ws);
+            if (ma)
+                *ma = 0;
+            break;
+        case OP_POW:
+        case OP_ROOT: {
+            /* root(a, n) = a^(1/n), d(1/n) = -dn / n² */
+            double complex db = 1;
+            if (ip->op == OP_ROOT) {
+                db = -1 / (b * b);
+                b = 1.0 / b;
+            }
+            int neg = ip->op == OP_POW;
+            v = d_pow(a, b, neg);
+            double complex fa = 0, fb = 0;
+            if (!constant(ta, w))
+                fa = pow_da(a, b, v);
+            /* a^b ln a tend vers 0 avec a^b */
+            if (!constant(tb, w) && v != 0)
+                fb = v * d_log(a) * db;
+            if (ma) {
+                /* exposant c = b (1/n pour root) : c' = db n', et
+                   c'' = db n'' + 2 n' n' / n³ pour root */
+                double complex tc0 = db * tb[0], tc1 = db * tb[1];
+                double complex mc = lin(db, *mb) + (neg ? 0 : term(2 * b * b * b, tb[0], tb[1]));
+                double complex la = d_log(a), fac = d_pow(a, b - 1, neg) * (1 + b * la);
+                *ma = lin(pow_da(a, b, v), *ma) + lin(v * la, mc) +
+                      term(b * (b - 1) * d_pow(a, b - 2, neg), ta[0], ta[1]) +
+                      term(fac, ta[0], tc1) + term(fac, ta[1], tc0) + term(v * la * la, tc0, tc1);
+            }
+            chain2(ta, tb, w, fa, fb);
+            sp[-1] = v;
+            break;
+        }
+        case OP_NEG:
+            sp[-1] = -a;
+            for (int j = 0; j < w; j++)
+                ta[j] = -ta[j];
+            if (ma)
+                *ma = -*ma;
+            break;
+        case OP_FACT:
+            if (cimag(a) != 0 || creal(a) < 0)
+                goto fail_fact;
+            v = calc_factorial(creal(a));
+            if (ma || !constant(ta, w)) {
+                double psi = digamma(creal(a) + 1);
+                unary(ta, w, ma, v * psi, ma ? v * (psi * psi + trigamma(creal(a) + 1)) : 0);
+            }
+            sp[-1] = v;
+            break;
+        case OP_PERCENT:
+            sp[-1] = a / 100.0;
+            for (int j = 0; j < w; j++)
+                ta[j] /= 100.0;
+            if (ma)
+                *ma /= 100.0;
+            break;
+        case OP_LOG:
+            sp[-1] = d_log(a);
+            if (ma || !constant(ta, w)) {
+                v = recip(a);
+                unary(ta, w, ma, v, -mul(v, v));
+            }
+            break;
+        case OP_COS:
+            v = d_cos(a);
+            if (ma || !constant(ta, w))
+                unary(ta, w, ma, -d_sin(a), -v);
+            sp[-1] = v;
+            break;
+        case OP_SIN:
+            v = d_sin(a);
+            if (ma || !constant(ta, w))
+                unary(ta, w, ma, d_cos(a), -v);
+            sp[-1] = v;
+            break;
+        case OP_TAN:
+            v = on_axis(a) ? tan(creal(a)) : ctan(a);
+            if (ma || !constant(ta, w))
+                unary(ta, w, ma, 1 + mul(v, v), 2 * mul(v, 1 + mul(v, v)));
+            sp[-1] = v;
+            break;
+        case OP_ACOS:
+        case OP_ASIN:
+            if (on_axis(a) && fabs(creal(a)) <= 1)
+                v = ip->op == OP_ACOS ? acos(creal(a)) : asin(creal(a));
+            else
+                v = ip->op == OP_ACOS ? cacos(a) : casin(a);
+            if (ma || !constant(ta, w)) {
+                double complex f = (ip->op == OP_ACOS ? -1 : 1) * recip(d_sqrt(1 - mul(a, a)));
+                unary(ta, w, ma, f, mul(mul(f, a), recip(1 - mul(a, a))));
+            }
+            sp[-1] = v;
+            break;
+        case OP_ATAN:
+            sp[-1] = on_axis(a) && isfinite(creal(a)) ? atan(creal(a)) : catan(a);
+            if (ma || !constant(ta, w)) {
+                v = recip(1 + mul(a, a));
+                unary(ta, w, ma, v, -2 * mul(a, mul(v, v)));
+            }
+            break;
+        case OP_SQRT:
+            v = d_sqrt(a);
+            if (ma || !constant(ta, w)) {
+                double complex f = recip(2 * v);
+                unary(ta, w, ma, f, -mul(mul(f, f), recip(v)));
+            }
+            sp[-1] = v;
+            break;
+        case OP_CALL: {
+            const CalcSymbol *sym = calc_symbol(ip->arg);
+            sp -= ip->argc;
+            tp -= (size_t)ip->argc * w;
+            int real = sym->rfn != NULL && ip->argc <= 16;
+            for (int k = 0; k < ip->argc && real; k++)
+                real = on_axis(sp[k]);
+            v = NAN;
+            if (real) {
+                double rargs[16];
+                for (int k = 0; k < ip->argc; k++)
+                    rargs[k] = creal(sp[k]);
+                v = sym->rfn(rargs, ip->argc);
+            }
+            if (!isfinite(creal(v)))
+                v = sym->cfn(sp, ip->argc);
+            if (call_tangent(d, ip, sp, tp, d->mix ? d->mix + (sp - d->val) : NULL, v) !=
+                CALC_OK)
+                return ctx->err.code;
+            *sp++ = v;
+            tp += w;
+            break;
+        }
+        case OP_POWI:
+            /* x^n réécrit par opt.c : valeur et dérivée de OP_POW */
+            v = d_pow(a, ip->arg, 1);
+            if (ma || !constant(ta, w))
+                unary(ta, w, ma, a != 0 ? ip->arg * v / a : ip->arg == 1,
+                      ma ? ip->arg * (ip->arg - 1) * d_pow(a, ip->arg - 2, 1) : 0);
+            sp[-1] = v;
+            break;
+        case OP_SCALE:
+            /* x / c réécrit par opt.c : calculé comme x / (1/c), pour les
+               mêmes zéros signés que OP_DIV */
+            b = CMPLX(1.0 / creal(b), 0.0);
+            v = on_axis(a) && isfinite(creal(b)) ? creal(a) / creal(b) : a / b;
+            b = recip(b);
+            if (ma)
+                *ma = mixed_div(*ma, *mb, ta, tb, v, b);
+            chain2(ta, tb, w, b, -mul(v, b));
+            sp[-1] = v;
+            break;
+        case OP_STORE:
+            regs[ip->arg] = sp[-1];
+            memcpy(rtan + (size_t)ip->arg * w, tp - w, ws);
+            if (ma)
+                rmix[ip->arg] = *ma;
+            break;
+        case OP_LOAD:
+            *sp++ = regs[ip->arg];
+            memcpy(tp, rtan + (size_t)ip->arg * w, ws);
+            tp += w;
+            if (mb)
+                *mb = rmix[ip->arg];
+            break;
+        case OP_VAR:
+            *sp++ = ctx->vars[ip->arg];
+            for (int j = 0; j < w; j++)
+                tp[j] = var_tangent(d, ip->arg, j);
+            tp += w;
+            if (mb)
+                *mb = 0;
+            break;
+        case OP_INTEGRATE:
+        case OP_SOLVE:
+        case OP_DIFF:
+        case OP_SUM:
+        case OP_PROD:
+            /* au second ordre, il faudrait la dérivée seconde du corps */
+            if (d->mix)
+                goto fail_derivative;
+            sp -= ip->argc;
+            tp -= (size_t)ip->argc * w;
+            if (calc_exec_binder(ctx, prog, ip, sp, &v) != CALC_OK ||
+                binder_tangent(d, ip, sp, tp, v) != CALC_OK)
+                return ctx->err.code;
+            *sp++ = v;
+            tp += w;
+            break;
+        }
+    }
+    *result = sp[-1];
+    if (w > 0)
+        memcpy(deriv, tp - w, ws);
+    if (d->mix)
+        *mixed = d->mix[sp - 1 - d->val];
+    return CALC_OK;
+
+fail_div:
+    calc_set_error(ctx, CALC_ERR_DIV_ZERO, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+fail_idiv:
+    calc_set_error(ctx, CALC_ERR_IDIV_ZERO, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+fail_fact:
+    calc_set_error(ctx, CALC_ERR_FACTORIAL, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+fail_derivative:
+    calc_set_error(ctx, CALC_ERR_DERIVATIVE, prog->pos[ip - prog->code]);
+    return ctx->err.code;
+}
+
+/* Pile, registres et dérivées dans ctx->dual ; second ordre si mixed */
+static CalcErrorCode run_dual(CalcContext *ctx, const CalcProgram *prog,
+                              const double complex *dvars, int width, double complex *result,
+                              double complex *deriv, double complex *mixed) {
+    double complex local[64];
+    Dual d = { ctx, prog, width, dvars, local, NULL, NULL };
+    size_t slots = prog->max_depth + prog->nregs;
+    size_t need = slots * (1 + width + (mixed != NULL));
+    memset(&ctx->err, 0, sizeof(ctx->err));
+    if (need > 64) {
+        if (need > ctx->dual_cap) {
+            double complex *s = realloc(ctx->dual, need * sizeof(double complex));
+            if (!s) {
+                calc_set_error(ctx, CALC_ERR_NOMEM, 0);
+                return CALC_ERR_NOMEM;
+            }
+            ctx->dual = s;
+            ctx->dual_cap = need;
+        }
+        d.val = ctx->dual;
+    }
+    d.tan = d.val + slots;
+    if (mixed)
+        d.mix = d.tan + slots * width;
+    /* les dérivées des opérateurs à variable liée exécutent leur corps
+       en d'autres points : pas de mémo */
+    ctx->memo_on = 0;
+    return exec_dual(&d, result, deriv, mixed);
+}
+
+CalcErrorCode calc_exec_dual(CalcContext *ctx, const CalcProgram *prog, const double complex *dvars,
+                             int width, double complex *result, double complex *deriv) {
+    return run_dual(ctx, prog, dvars, width, result, deriv, NULL);
+}
+
+CalcErrorCode calc_exec_dual2(CalcContext *ctx, const CalcProgram *prog, const double complex *dvars,
+                              double complex *result, double complex *deriv,
+                              double complex *mixed) {
+    return run_dual(ctx, prog, dvars, 2, result, deriv, mixed);
+}
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+#include "editbuf.h"
+
+#define EDITBUF_INITIAL 256
+
+int editbuf_init(EditBuf *eb) {
+    eb->buf = malloc(EDITBUF_INITIAL);
+    if (!eb->buf)
+        return -1;
+    eb->cap = EDITBUF_INITIAL;
+    eb->gap = eb->cursor = 0;
+    eb->gap_end = eb->cap;
+    eb->version = 0;
+    return 0;
+}
+
+void editbuf_free(EditBuf *eb) {
+    free(eb->buf);
+    eb->buf = NULL;
+    eb->cap = eb->gap = eb->gap_end = eb->cursor = 0;
+}
+
+size_t editbuf_length(const EditBuf *eb) {
+    return eb->cap - (eb->gap_end - eb->gap);
+}
+
+size_t editbuf_cursor(const EditBuf *eb) {
+    return eb->cursor;
+}
+
+/* Déplace le trou en pos, en ne recopiant que le texte qui les sépare */
+static void move_gap(EditBuf *eb, size_t pos) {
+    if (pos < eb->gap) {
+        size_t n = eb->gap - pos;
+        memmove(eb->buf + eb->gap_end - n, eb->buf + pos, n);
+        eb->gap_end -= n;
+    } else if (pos > eb->gap) {
+        size_t n = pos - eb->gap;
+        memmove(eb->buf + eb->gap, eb->buf + eb->gap_end, n);
+        eb->gap_end += n;
+    }
+    eb->gap = pos;
+}
+
+/* Agrandit le tampon pour que le trou fasse plus de need octets */
+static int grow(EditBuf *eb, size_t need) {
+    size_t len = editbuf_length(eb);
+    size_t cap = eb->cap * 2;
+    while (cap - len <= need)
+        cap *= 2;
+    char *buf = realloc(eb->buf, cap);
+    if (!buf)
+        return -1;
+    size_t tail = eb->cap - eb->gap_end;
+    memmove(buf + cap - tail, buf + eb->gap_end, tail);
+    eb->buf = buf;
+    eb->gap_end = cap - tail;
+    eb->cap = cap;
+    return 0;
+}
+
+int editbuf_insert(EditBuf *eb, const char *text, size_t len) {
+    /* Le trou garde au moins un octet, pour le '\0' de editbuf_text() */
+    if (eb->gap_end - eb->gap <= len && grow(eb, len) < 0)
+        return -1;
+    move_gap(eb, eb->cursor);
+    memcpy(eb->buf + eb->gap, text, len);
+    eb->gap += len;
+    eb->cursor = eb->gap;
+    eb->version++;
+    return 0;
+}
+
+void editbuf_delete(EditBuf *eb) {
+    if (eb->cursor == 0)
+        return;
+    move_gap(eb, eb->cursor);
+    eb->gap--;
+    eb->cursor--;
+    eb->version++;
+}
+
+void editbuf_move(EditBuf *eb, size_t pos) {
+    size_t len = editbuf_length(eb);
+    eb->cursor = pos < len ? pos : len;
+}
+
+void editbuf_clear(EditBuf *eb) {
+    eb->gap = eb->cursor = 0;
+    eb->gap_end = eb->cap;
+    eb->version++;
+}
+
+int editbuf_set(EditBuf *eb, const char *text) {
+    editbuf_clear(eb);
+    return editbuf_insert(eb, text, strlen(text));
+}
+
+size_t editbuf_copy(const EditBuf *eb, size_t from, size_t len, char *dest) {
+    size_t total = editbuf_length(eb);
+    if (from >= total)
+        return 0;
+    if (len > total - from)
+        len = total - from;
+    size_t n = 0;
+    if (from < eb->gap) {
+        n = eb->gap - from < len ? eb->gap - from : len;
+        memcpy(dest, eb->buf + from, n);
+    }
+    if (n < len)
+        memcpy(dest + n, eb->buf + eb->gap_end + (from + n - eb->gap), len - n);
+    return len;
+}
+
+const char *editbuf_text(EditBuf *eb) {
+    move_gap(eb, editbuf_length(eb));
+    eb->buf[eb->gap] = '\0';
+    return eb->buf;
+}
@@ -0,0 +1,54 @@
+#ifndef EDITBUF_H
+#define EDITBUF_H
+
+#include <stddef.h>
+
+/* ============================= */
+/* Tampon d'édition à trou       */
+/* Le texte est rangé de part et d'autre d'un trou. Le trou rejoint le
+   curseur à la première modification qui suit un déplacement, en ne
+   déplaçant que les octets qui les séparent : une suite d'insertions ou
+   d'effacements au curseur ne coûte rien de plus. Le tampon double de
+   taille quand le trou est plein, sans autre limite que la mémoire. */
+/* ============================= */
+
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t gap;            /* début du trou */
+    size_t gap_end;        /* fin du trou, jamais égale à gap */
+    size_t cursor;
+    unsigned long version; /* incrémenté à chaque modification du texte */
+} EditBuf;
+
+int editbuf_init(EditBuf *eb);
+void editbuf_free(EditBuf *eb);
+
+size_t editbuf_length(const EditBuf *eb);
+size_t editbuf_cursor(const EditBuf *eb);
+
+/* Insère len octets au curseur, qui passe après eux ; -1 si la mémoire
+   manque (le texte est alors inchangé) */
+int editbuf_insert(EditBuf *eb, const char *text, size_t len);
+
+/* Efface l'octet avant le curseur */
+void editbuf_delete(EditBuf *eb);
+
+/* Place le curseur à pos (bornée à la longueur du texte) */
+void editbuf_move(EditBuf *eb, size_t pos);
+
+void editbuf_clear(EditBuf *eb);
+
+/* Remplace tout le texte ; le curseur est placé à la fin */
+int editbuf_set(EditBuf *eb, const char *text);
+
+/* Copie au plus len octets à partir de from dans dest, sans toucher au
+   trou ; renvoie le nombre d'octets copiés (dest n'est pas terminée) */
+size_t editbuf_copy(const EditBuf *eb, size_t from, size_t len, char *dest);
+
+/* Texte contigu terminé par '\0', lu en place : le trou est repoussé
+   après le texte, le curseur ne bouge pas. Le pointeur reste valable
+   jusqu'à la modification suivante. */
+const char *editbuf_text(EditBuf *eb);
+
+#endif
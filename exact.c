@@ -0,0 +1,788 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <math.h>
+#include <complex.h>
+#include "calc.h"
+#include "calc_internal.h"
+
+/* ============================= */
+/* Partie Calcul exact           */
+/* calc_eval_exact() exécute le programme non optimisé sur des nombres
+   rationnels exacts. Une valeur reste sur 64 bits (numérateur et
+   dénominateur int64_t) tant qu'elle y tient : les opérations sont alors
+   faites sur 128 bits, puis réduites. Au-delà, elle passe en rationnel
+   de taille arbitraire (Nat : chiffres de 32 bits, poids faible
+   d'abord), et revient sur 64 bits dès qu'elle le peut.
+
+   Toute instruction hors de ce cadre (constante nommée, fonction,
+   puissance non entière, division par 0) abandonne le calcul exact :
+   la valeur approchée de calc_eval() reste alors la bonne. La taille
+   des nombres est bornée d'après celle du tampon de sortie, pour qu'une
+   expression comme 99999999! échoue tout de suite. */
+/* ============================= */
+
+/* Entier naturel de taille arbitraire ; len = 0 pour zéro, et le
+   chiffre de poids fort n'est jamais nul */
+typedef struct {
+    uint32_t *d;
+    int len, cap;
+} Nat;
+
+static int nat_reserve(Nat *a, int n) {
+    if (n <= a->cap)
+        return 0;
+    int cap = a->cap ? a->cap : 4;
+    while (cap < n)
+        cap *= 2;
+    uint32_t *d = realloc(a->d, cap * sizeof(uint32_t));
+    if (!d)
+        return -1;
+    a->d = d;
+    a->cap = cap;
+    return 0;
+}
+
+static void nat_trim(Nat *a) {
+    while (a->len > 0 && a->d[a->len - 1] == 0)
+        a->len--;
+}
+
+static void nat_swap(Nat *a, Nat *b) {
+    Nat t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static int nat_set(Nat *a, unsigned __int128 v) {
+    if (nat_reserve(a, 4) < 0)
+        return -1;
+    a->len = 0;
+    for (; v; v >>= 32)
+        a->d[a->len++] = (uint32_t)v;
+    return 0;
+}
+
+static int nat_copy(Nat *r, const Nat *a) {
+    if (nat_reserve(r, a->len) < 0)
+        return -1;
+    if (a->len)
+        memcpy(r->d, a->d, a->len * sizeof(uint32_t));
+    r->len = a->len;
+    return 0;
+}
+
+static int nat_cmp(const Nat *a, const Nat *b) {
+    if (a->len != b->len)
+        return a->len < b->len ? -1 : 1;
+    for (int k = a->len - 1; k >= 0; k--)
+        if (a->d[k] != b->d[k])
+            return a->d[k] < b->d[k] ? -1 : 1;
+    return 0;
+}
+
+static int nat_is_one(const Nat *a) {
+    return a->len == 1 && a->d[0] == 1;
+}
+
+static size_t nat_bits(const Nat *a) {
+    if (a->len == 0)
+        return 0;
+    return (size_t)(a->len - 1) * 32 + 32 - __builtin_clz(a->d[a->len - 1]);
+}
+
+/* Les opérations à trois arguments écrivent dans r, distinct de a et b */
+static int nat_add(Nat *r, const Nat *a, const Nat *b) {
+    if (a->len < b->len) {
+        const Nat *t = a;
+        a = b;
+        b = t;
+    }
+    if (nat_reserve(r, a->len + 1) < 0)
+        return -1;
+    uint64_t c = 0;
+    for (int k = 0; k < a->len; k++) {
+        c += (uint64_t)a->d[k] + (k < b->len ? b->d[k] : 0);
+        r->d[k] = (uint32_t)c;
+        c >>= 32;
+    }
+    r->d[a->len] = (uint32_t)c;
+    r->len = a->len + 1;
+    nat_trim(r);
+    return 0;
+}
+
+/* r = a - b, avec a >= b */
+static int nat_sub(Nat *r, const Nat *a, const Nat *b) {
+    if (nat_reserve(r, a->len) < 0)
+        return -1;
+    int64_t borrow = 0;
+    for (int k = 0; k < a->len; k++) {
+        int64_t v = (int64_t)a->d[k] - (k < b->len ? b->d[k] : 0) - borrow;
+        borrow = v < 0;
+        r->d[k] = (uint32_t)v;
+    }
+    r->len = a->len;
+    nat_trim(r);
+    return 0;
+}
+
+static int nat_mul(Nat *r, const Nat *a, const Nat *b) {
+    if (a->len == 0 || b->len == 0) {
+        r->len = 0;
+        return 0;
+    }
+    if (nat_reserve(r, a->len + b->len) < 0)
+        return -1;
+    memset(r->d, 0, (a->len + b->len) * sizeof(uint32_t));
+    for (int i = 0; i < a->len; i++) {
+        uint64_t c = 0;
+        for (int j = 0; j < b->len; j++) {
+            c += (uint64_t)a->d[i] * b->d[j] + r->d[i + j];
+            r->d[i + j] = (uint32_t)c;
+            c >>= 32;
+        }
+        r->d[i + b->len] = (uint32_t)c;
+    }
+    r->len = a->len + b->len;
+    nat_trim(r);
+    return 0;
+}
+
+/* a *= m, sur place */
+static int nat_mul_small(Nat *a, uint32_t m) {
+    if (nat_reserve(a, a->len + 1) < 0)
+        return -1;
+    uint64_t c = 0;
+    for (int k = 0; k < a->len; k++) {
+        c += (uint64_t)a->d[k] * m;
+        a->d[k] = (uint32_t)c;
+        c >>= 32;
+    }
+    a->d[a->len++] = (uint32_t)c;
+    nat_trim(a);
+    return 0;
+}
+
+/* a /= m, sur place ; renvoie le reste */
+static uint32_t nat_div_small(Nat *a, uint32_t m) {
+    uint64_t rem = 0;
+    for (int k = a->len - 1; k >= 0; k--) {
+        uint64_t cur = rem << 32 | a->d[k];
+        a->d[k] = (uint32_t)(cur / m);
+        rem = cur % m;
+    }
+    nat_trim(a);
+    return (uint32_t)rem;
+}
+
+/* q = a / b et r = a % b (r peut être NULL), b non nul : division
+   longue de Knuth (algorithme D), sur des chiffres de 32 bits */
+static int nat_divmod(Nat *q, Nat *r, const Nat *a, const Nat *b) {
+    if (nat_cmp(a, b) < 0) {
+        q->len = 0;
+        return r ? nat_copy(r, a) : 0;
+    }
+    if (b->len == 1) {
+        if (nat_copy(q, a) < 0)
+            return -1;
+        uint32_t rem = nat_div_small(q, b->d[0]);
+        return r ? nat_set(r, rem) : 0;
+    }
+    int m = a->len, n = b->len;
+    int s = __builtin_clz(b->d[n - 1]);
+    uint32_t *un = malloc((m + 1 + n) * sizeof(uint32_t));
+    if (!un || nat_reserve(q, m - n + 1) < 0) {
+        free(un);
+        return -1;
+    }
+    uint32_t *vn = un + m + 1;
+    /* Normalisation : le chiffre de poids fort du diviseur a son bit
+       de poids fort à 1 */
+    for (int i = n - 1; i > 0; i--)
+        vn[i] = b->d[i] << s | (s ? b->d[i - 1] >> (32 - s) : 0);
+    vn[0] = b->d[0] << s;
+    un[m] = s ? a->d[m - 1] >> (32 - s) : 0;
+    for (int i = m - 1; i > 0; i--)
+        un[i] = a->d[i] << s | (s ? a->d[i - 1] >> (32 - s) : 0);
+    un[0] = a->d[0] << s;
+
+    const uint64_t base = 1ull << 32;
+    for (int j = m - n; j >= 0; j--) {
+        uint64_t num = (uint64_t)un[j + n] << 32 | un[j + n - 1];
+        uint64_t qhat = num / vn[n - 1], rhat = num % vn[n - 1];
+        while (qhat >= base || qhat * vn[n - 2] > (rhat << 32 | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >= base)
+                break;
+        }
+        /* un[j..j+n] -= qhat * vn */
+        int64_t borrow = 0, t;
+        for (int i = 0; i < n; i++) {
+            uint64_t p = qhat * vn[i];
+            t = (int64_t)un[i + j] - borrow - (int64_t)(p & 0xffffffffu);
+            un[i + j] = (uint32_t)t;
+            borrow = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)un[j + n] - borrow;
+        un[j + n] = (uint32_t)t;
+        q->d[j] = (uint32_t)qhat;
+        if (t < 0) { /* qhat était trop grand d'une unité */
+            q->d[j]--;
+            uint64_t c = 0;
+            for (int i = 0; i < n; i++) {
+                c += (uint64_t)un[i + j] + vn[i];
+                un[i + j] = (uint32_t)c;
+                c >>= 32;
+            }
+            un[j + n] += (uint32_t)c;
+        }
+    }
+    q->len = m - n + 1;
+    nat_trim(q);
+    int ret = 0;
+    if (r) {
+        if (nat_reserve(r, n) < 0) {
+            ret = -1;
+        } else {
+            for (int i = 0; i < n; i++)
+                r->d[i] = un[i] >> s | (s ? un[i + 1] << (32 - s) : 0);
+            r->len = n;
+            nat_trim(r);
+        }
+    }
+    free(un);
+    return ret;
+}
+
+/* Nombre rationnel exact ; petite valeur num/den (den > 0), ou grande
+   valeur (-1)^neg n/d. Dans les deux cas la fraction est irréductible. */
+typedef struct {
+    int big;
+    int64_t num, den;
+    int neg;
+    Nat n, d;
+} Exact;
+
+/* Tampons de travail et borne de taille d'une évaluation */
+typedef struct {
+    Nat t[4];
+    size_t max_bits;
+} ExactRun;
+
+static void exact_free(Exact *x) {
+    free(x->n.d);
+    free(x->d.d);
+}
+
+static unsigned __int128 gcd128(unsigned __int128 a, unsigned __int128 b) {
+    while (b) {
+        unsigned __int128 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* x = n/d (d > 0), réduit ; petite valeur si elle tient sur 64 bits */
+static int set_i128(Exact *x, __int128 n, unsigned __int128 d) {
+    unsigned __int128 mag = n < 0 ? -(unsigned __int128)n : (unsigned __int128)n;
+    unsigned __int128 g = gcd128(mag, d);
+    if (g > 1) {
+        mag /= g;
+        d /= g;
+    }
+    if (mag <= INT64_MAX && d <= INT64_MAX) {
+        x->big = 0;
+        x->num = n < 0 ? -(int64_t)mag : (int64_t)mag;
+        x->den = (int64_t)d;
+        return 0;
+    }
+    x->big = 1;
+    x->neg = n < 0;
+    if (nat_set(&x->n, mag) < 0 || nat_set(&x->d, d) < 0)
+        return -1;
+    return 0;
+}
+
+static int to_big(Exact *x) {
+    if (x->big)
+        return 0;
+    x->big = 1;
+    x->neg = x->num < 0;
+    uint64_t mag = x->num < 0 ? -(uint64_t)x->num : (uint64_t)x->num;
+    if (nat_set(&x->n, mag) < 0 || nat_set(&x->d, (uint64_t)x->den) < 0)
+        return -1;
+    return 0;
+}
+
+/* Grande valeur : réduction de la fraction, contrôle de la taille, puis
+   retour sur 64 bits si possible */
+static int normalize(ExactRun *er, Exact *x) {
+    Nat *a = &er->t[0], *b = &er->t[1], *q = &er->t[2], *r = &er->t[3];
+    if (x->n.len == 0) {
+        x->big = 0;
+        x->num = 0;
+        x->den = 1;
+        return 0;
+    }
+    if (!nat_is_one(&x->d)) {
+        /* pgcd par divisions successives */
+        if (nat_copy(a, &x->n) < 0 || nat_copy(b, &x->d) < 0)
+            return -1;
+        while (b->len) {
+            if (nat_divmod(q, r, a, b) < 0)
+                return -1;
+            nat_swap(a, b);
+            nat_swap(b, r);
+        }
+        if (!nat_is_one(a)) {
+            if (nat_divmod(q, NULL, &x->n, a) < 0)
+                return -1;
+            nat_swap(&x->n, q);
+            if (nat_divmod(q, NULL, &x->d, a) < 0)
+                return -1;
+            nat_swap(&x->d, q);
+        }
+    }
+    if (nat_bits(&x->n) + nat_bits(&x->d) > er->max_bits)
+        return -1;
+    if (nat_bits(&x->n) <= 63 && nat_bits(&x->d) <= 63) {
+        uint64_t n = 0, d = 0;
+        for (int k = x->n.len - 1; k >= 0; k--)
+            n = n << 32 | x->n.d[k];
+        for (int k = x->d.len - 1; k >= 0; k--)
+            d = d << 32 | x->d.d[k];
+        x->big = 0;
+        x->num = x->neg ? -(int64_t)n : (int64_t)n;
+        x->den = (int64_t)d;
+    }
+    return 0;
+}
+
+/* a = a ± b */
+static int exact_add(ExactRun *er, Exact *a, Exact *b, int sub) {
+    if (!a->big && !b->big) {
+        int64_t r;
+        if (a->den == 1 && b->den == 1 &&
+            !(sub ? __builtin_sub_overflow(a->num, b->num, &r)
+                  : __builtin_add_overflow(a->num, b->num, &r))) {
+            a->num = r;
+            return 0;
+        }
+        __int128 n1 = (__int128)a->num * b->den, n2 = (__int128)b->num * a->den;
+        return set_i128(a, sub ? n1 - n2 : n1 + n2, (unsigned __int128)a->den * b->den);
+    }
+    if (to_big(a) < 0 || to_big(b) < 0)
+        return -1;
+    Nat *n1 = &er->t[0], *n2 = &er->t[1], *d = &er->t[2];
+    if (nat_mul(n1, &a->n, &b->d) < 0 || nat_mul(n2, &b->n, &a->d) < 0 ||
+        nat_mul(d, &a->d, &b->d) < 0)
+        return -1;
+    int bneg = b->neg ^ sub;
+    if (a->neg == bneg) {
+        if (nat_add(&a->n, n1, n2) < 0)
+            return -1;
+    } else if (nat_cmp(n1, n2) >= 0) {
+        if (nat_sub(&a->n, n1, n2) < 0)
+            return -1;
+    } else {
+        if (nat_sub(&a->n, n2, n1) < 0)
+            return -1;
+        a->neg = bneg;
+    }
+    nat_swap(&a->d, d);
+    return normalize(er, a);
+}
+
+/* a = a x b, ou a / b (b non nul) */
+static int exact_mul(ExactRun *er, Exact *a, Exact *b, int div) {
+    if (!a->big && !b->big) {
+        int64_t bn = div ? b->den : b->num, bd = div ? b->num : b->den;
+        if (bd < 0) {
+            bn = -bn;
+            bd = -bd;
+        }
+        return set_i128(a, (__int128)a->num * bn, (unsigned __int128)a->den * bd);
+    }
+    if (to_big(a) < 0 || to_big(b) < 0)
+        return -1;
+    if (div)
+        nat_swap(&b->n, &b->d);
+    Nat *n = &er->t[0], *d = &er->t[1];
+    if (nat_mul(n, &a->n, &b->n) < 0 || nat_mul(d, &a->d, &b->d) < 0)
+        return -1;
+    nat_swap(&a->n, n);
+    nat_swap(&a->d, d);
+    a->neg ^= b->neg;
+    return normalize(er, a);
+}
+
+/* a = trunc(a / b), b non nul */
+static int exact_idiv(ExactRun *er, Exact *a, Exact *b) {
+    if (!a->big && !b->big) {
+        __int128 n = (__int128)a->num * b->den, d = (__int128)a->den * b->num;
+        return set_i128(a, n / d, 1);
+    }
+    if (to_big(a) < 0 || to_big(b) < 0)
+        return -1;
+    Nat *n = &er->t[0], *d = &er->t[1], *q = &er->t[2];
+    if (nat_mul(n, &a->n, &b->d) < 0 || nat_mul(d, &a->d, &b->n) < 0 ||
+        nat_divmod(q, NULL, n, d) < 0)
+        return -1;
+    nat_swap(&a->n, q);
+    if (nat_set(&a->d, 1) < 0)
+        return -1;
+    a->neg ^= b->neg;
+    if (a->n.len == 0)
+        a->neg = 0;
+    return normalize(er, a);
+}
+
+/* r = a^e (e > 0) par élévations au carré ; a et r distincts */
+static int nat_pow(ExactRun *er, Nat *r, const Nat *a, uint64_t e) {
+    Nat *x = &er->t[0], *t = &er->t[1];
+    if (nat_copy(x, a) < 0 || nat_set(r, 1) < 0)
+        return -1;
+    for (;;) {
+        if (e & 1) {
+            if (nat_mul(t, r, x) < 0)
+                return -1;
+            nat_swap(r, t);
+        }
+        e >>= 1;
+        if (!e)
+            return 0;
+        if (nat_mul(t, x, x) < 0)
+            return -1;
+        nat_swap(x, t);
+    }
+}
+
+/* a = a^b, b entier */
+static int exact_pow(ExactRun *er, Exact *a, Exact *b) {
+    if (b->big || b->den != 1)
+        return -1;
+    int64_t e = b->num;
+    if (!a->big && a->num == 0)
+        return e > 0 ? 0 : -1; /* 0^0 et 0^-n restent au calcul approché */
+    if (e == 0)
+        return set_i128(a, 1, 1);
+    if (e < 0) { /* a^-n = (1/a)^n */
+        if (a->big) {
+            nat_swap(&a->n, &a->d);
+        } else {
+            int64_t n = a->num < 0 ? -a->den : a->den;
+            a->den = a->num < 0 ? -a->num : a->num;
+            a->num = n;
+        }
+    }
+    uint64_t n = e < 0 ? -(uint64_t)e : (uint64_t)e;
+    if (!a->big) { /* tant que ça tient sur 64 bits */
+        int64_t rn = 1, rd = 1, xn = a->num, xd = a->den;
+        int over = 0;
+        for (uint64_t k = n;;) {
+            if (k & 1)
+                over |= __builtin_mul_overflow(rn, xn, &rn) | __builtin_mul_overflow(rd, xd, &rd);
+            k >>= 1;
+            if (!k || over)
+                break;
+            over |= __builtin_mul_overflow(xn, xn, &xn) | __builtin_mul_overflow(xd, xd, &xd);
+        }
+        if (!over)
+            return set_i128(a, rn, (uint64_t)rd);
+    }
+    if (to_big(a) < 0)
+        return -1;
+    /* Taille du résultat : (bits - 1) x n en est un minorant */
+    size_t nb = nat_bits(&a->n), db = nat_bits(&a->d);
+    if ((nb > 1 && n > er->max_bits / (nb - 1)) || (db > 1 && n > er->max_bits / (db - 1)))
+        return -1;
+    Nat *r = &er->t[2];
+    if (nat_pow(er, r, &a->n, n) < 0)
+        return -1;
+    nat_swap(&a->n, r);
+    if (nat_pow(er, r, &a->d, n) < 0)
+        return -1;
+    nat_swap(&a->d, r);
+    a->neg = a->neg && (n & 1);
+    return normalize(er, a);
+}
+
+/* Factorielles qui tiennent sur 64 bits */
+static const uint64_t fact_small[21] = {
+    1ull, 1ull, 2ull, 6ull, 24ull, 120ull, 720ull, 5040ull, 40320ull,
+    362880ull, 3628800ull, 39916800ull, 479001600ull, 6227020800ull,
+    87178291200ull, 1307674368000ull, 20922789888000ull,
+    355687428096000ull, 6402373705728000ull, 121645100408832000ull,
+    2432902008176640000ull
+};
+
+/* r = a x (a + 1) x ... x b par scission binaire : les produits
+   partiels restent de tailles voisines */
+static int product_range(Nat *r, uint32_t a, uint32_t b) {
+    if (b - a < 16) {
+        if (nat_set(r, a) < 0)
+            return -1;
+        for (uint32_t k = a + 1; k <= b; k++)
+            if (nat_mul_small(r, k) < 0)
+                return -1;
+        return 0;
+    }
+    uint32_t m = a + (b - a) / 2;
+    Nat left = { 0 }, right = { 0 };
+    int ret = -1;
+    if (product_range(&left, a, m) == 0 && product_range(&right, m + 1, b) == 0)
+        ret = nat_mul(r, &left, &right);
+    free(left.d);
+    free(right.d);
+    return ret;
+}
+
+static int exact_fact(ExactRun *er, Exact *a) {
+    if (a->big || a->den != 1 || a->num < 0)
+        return -1;
+    if (a->num <= 20)
+        return set_i128(a, fact_small[a->num], 1);
+    /* log2(n!) avant tout calcul */
+    if (a->num > (int64_t)er->max_bits || a->num >= 1 << 30 ||
+        lgamma(a->num + 1.0) / log(2.0) > er->max_bits)
+        return -1;
+    Nat *r = &er->t[0];
+    if (to_big(a) < 0 || product_range(r, 2, (uint32_t)a->num) < 0)
+        return -1;
+    nat_swap(&a->n, r);
+    if (nat_set(&a->d, 1) < 0)
+        return -1;
+    return normalize(er, a);
+}
+
+/* Nombre écrit en décimal, lu comme strtod() l'a lu à la compilation :
+   chiffres, point, exposant ; les autres formes (hexadécimal) sont
+   laissées au calcul approché */
+static int exact_literal(ExactRun *er, Exact *x, const char *s) {
+    char *end;
+    strtod(s, &end);
+    if (end - s <= 18) { /* entier qui tient sur 64 bits */
+        const char *p = s;
+        while (p < end && isdigit((unsigned char)*p))
+            p++;
+        if (p == end && p > s)
+            return set_i128(x, strtoll(s, NULL, 10), 1);
+    }
+    const char *p = s;
+    int frac = 0, digits = 0;
+    if (to_big(x) < 0 || nat_set(&x->n, 0) < 0 || nat_set(&x->d, 1) < 0)
+        return -1;
+    x->neg = 0;
+    for (int point = 0;; p++) {
+        if (*p == '.' && !point) {
+            point = 1;
+        } else if (isdigit((unsigned char)*p)) {
+            if (nat_mul_small(&x->n, 10) < 0)
+                return -1;
+            if (*p != '0') {
+                Nat *t = &er->t[0], *dig = &er->t[1];
+                if (nat_set(dig, *p - '0') < 0 || nat_add(t, &x->n, dig) < 0)
+                    return -1;
+                nat_swap(&x->n, t);
+            }
+            frac += point;
+            digits++;
+        } else {
+            break;
+        }
+    }
+    long exp10 = 0;
+    if ((*p == 'e' || *p == 'E') && p < end) {
+        char *q;
+        exp10 = strtol(p + 1, &q, 10);
+        p = q;
+        if (exp10 > 100000 || exp10 < -100000)
+            return -1;
+    }
+    if (digits == 0 || p != end)
+        return -1;
+    exp10 -= frac;
+    /* valeur = chiffres x 10^exp10 */
+    Exact ten = { 0 };
+    int ret = set_i128(&ten, 10, 1);
+    Exact e = { 0 };
+    if (ret == 0)
+        ret = set_i128(&e, exp10 < 0 ? -exp10 : exp10, 1);
+    if (ret == 0)
+        ret = exact_pow(er, &ten, &e);
+    if (ret == 0)
+        ret = normalize(er, x);
+    if (ret == 0)
+        ret = exact_mul(er, x, &ten, exp10 < 0);
+    exact_free(&ten);
+    exact_free(&e);
+    return ret;
+}
+
+/* Écriture décimale exacte : entier, ou nombre à développement fini
+   (dénominateur de la forme 2^a 5^b) ; -1 sinon ou si buf est trop petit */
+static int format_exact(ExactRun *er, Exact *x, char *buf, size_t size) {
+    if (!x->big && x->den == 1) {
+        int n = snprintf(buf, size, "%lld", (long long)x->num);
+        return n >= 0 && (size_t)n < size ? n : -1;
+    }
+    if (to_big(x) < 0)
+        return -1;
+    Nat *d = &er->t[0], *m = &er->t[1];
+    if (nat_copy(d, &x->d) < 0 || nat_copy(m, &x->n) < 0)
+        return -1;
+    /* 1/2^a5^b = 2^(k-a)5^(k-b)/10^k avec k = max(a, b) */
+    long twos = 0, fives = 0;
+    while (d->len && (d->d[0] & 1) == 0) {
+        nat_div_small(d, 2);
+        twos++;
+    }
+    Nat *t = &er->t[2];
+    for (;;) {
+        if (nat_copy(t, d) < 0)
+            return -1;
+        if (nat_div_small(t, 5) != 0)
+            break;
+        nat_swap(d, t);
+        fives++;
+    }
+    if (!nat_is_one(d))
+        return -1;
+    long k = twos > fives ? twos : fives;
+    if ((size_t)k >= size)
+        return -1;
+    for (long j = twos; j < k; j++)
+        if (nat_mul_small(m, 2) < 0)
+            return -1;
+    for (long j = fives; j < k; j++)
+        if (nat_mul_small(m, 5) < 0)
+            return -1;
+
+    /* Chiffres de m, par tranches de 9, du poids faible au poids fort */
+    size_t ndig = nat_bits(m) * 30103 / 100000 + 10;
+    if (ndig < (size_t)k + 1)
+        ndig = k + 1;
+    char *digits = malloc(ndig + 9);
+    if (!digits)
+        return -1;
+    size_t len = 0;
+    do {
+        uint32_t chunk = nat_div_small(m, 1000000000u);
+        for (int j = 0; j < 9; j++) {
+            digits[len++] = '0' + chunk % 10;
+            chunk /= 10;
+        }
+    } while (m->len);
+    while (len > 1 && digits[len - 1] == '0')
+        len--;
+    while (len < (size_t)k + 1)
+        digits[len++] = '0';
+
+    size_t need = x->neg + len + (k > 0) + 1;
+    int ret = -1;
+    if (need <= size) {
+        size_t pos = 0;
+        if (x->neg)
+            buf[pos++] = '-';
+        for (size_t j = len; j-- > 0;) {
+            buf[pos++] = digits[j];
+            if (j == (size_t)k && k > 0)
+                buf[pos++] = '.';
+        }
+        buf[pos] = '\0';
+        ret = (int)pos;
+    }
+    free(digits);
+    return ret;
+}
+
+int calc_eval_exact(CalcContext *ctx, const char *src, char *buf, size_t size) {
+    if (size == 0)
+        return -1;
+    /* Le programme non optimisé, pour qu'aucune constante ne soit
+       précalculée en double */
+    int optimize = ctx->optimize;
+    ctx->optimize = 0;
+    CalcProgram *prog = calc_compile(ctx, src);
+    ctx->optimize = optimize;
+    if (!prog)
+        return -1;
+    Exact *stack = calloc(prog->max_depth + 1, sizeof(Exact));
+    ExactRun er;
+    memset(&er, 0, sizeof(er));
+    /* 10^size s'écrit avec size x log2(10) < 4 size bits ; les résultats
+       intermédiaires peuvent être un peu plus grands que le résultat */
+    er.max_bits = 16 * size + 4096;
+    int ret = stack ? 0 : -1;
+    Exact *sp = stack;
+    for (int k = 0; k < prog->len && ret == 0; k++) {
+        const Instr *ins = &prog->code[k];
+        switch (ins->op) {
+        case OP_CONST:
+            if (!isdigit((unsigned char)src[prog->pos[k]]) && src[prog->pos[k]] != '.') {
+                ret = -1; /* constante nommée */
+                break;
+            }
+            ret = exact_literal(&er, sp++, src + prog->pos[k]);
+            break;
+        case OP_ADD:
+        case OP_SUB:
+            sp--;
+            ret = exact_add(&er, sp - 1, sp, ins->op == OP_SUB);
+            break;
+        case OP_MUL:
+            sp--;
+            ret = exact_mul(&er, sp - 1, sp, 0);
+            break;
+        case OP_DIV:
+        case OP_IDIV:
+            sp--;
+            if (!sp->big && sp->num == 0)
+                ret = -1;
+            else if (ins->op == OP_DIV)
+                ret = exact_mul(&er, sp - 1, sp, 1);
+            else
+                ret = exact_idiv(&er, sp - 1, sp);
+            break;
+        case OP_POW:
+            sp--;
+            ret = exact_pow(&er, sp - 1, sp);
+            break;
+        case OP_NEG:
+            if (sp[-1].big)
+                sp[-1].neg = !sp[-1].neg && sp[-1].n.len;
+            else
+                sp[-1].num = -sp[-1].num;
+            break;
+        case OP_FACT:
+            ret = exact_fact(&er, sp - 1);
+            break;
+        case OP_PERCENT: {
+            Exact hundred = { 0 };
+            ret = set_i128(&hundred, 100, 1);
+            if (ret == 0)
+                ret = exact_mul(&er, sp - 1, &hundred, 1);
+            exact_free(&hundred);
+            break;
+        }
+        default: /* constante complexe, fonction */
+            ret = -1;
+            break;
+        }
+    }
+    if (ret == 0)
+        ret = format_exact(&er, &stack[0], buf, size);
+    if (stack)
+        for (int k = 0; k <= prog->max_depth; k++)
+            exact_free(&stack[k]);
+    for (int k = 0; k < 4; k++)
+        free(er.t[k].d);
+    free(stack);
+    calc_program_free(prog);
+    return ret;
+}
@@ -0,0 +1,39 @@
+#include <ctype.h>
+#include <string.h>
+#include "format.h"
+
+/* Convertit une expression contenant '^' en affichant les exposants en superscript */
+void format_expression(const char *src, char *dest, size_t dest_size) {
+    size_t j = 0;
+    for (size_t i = 0; src[i] && j < dest_size - 1; i++) {
+        if (src[i] == '^') {
+            i++;
+            while (src[i] && (src[i] == '-' || isdigit(src[i]) || src[i]=='.')) {
+                const char *sup = NULL;
+                if (src[i] == '-') sup = "⁻";
+                else if (src[i] == '0') sup = "⁰";
+                else if (src[i] == '1') sup = "¹";
+                else if (src[i] == '2') sup = "²";
+                else if (src[i] == '3') sup = "³";
+                else if (src[i] == '4') sup = "⁴";
+                else if (src[i] == '5') sup = "⁵";
+                else if (src[i] == '6') sup = "⁶";
+                else if (src[i] == '7') sup = "⁷";
+                else if (src[i] == '8') sup = "⁸";
+                else if (src[i] == '9') sup = "⁹";
+                else if (src[i] == '.') { dest[j++] = src[i]; i++; continue; }
+                else { dest[j++] = src[i]; i++; continue; }
+                size_t len = strlen(sup);
+                if (j + len < dest_size) {
+                    strcpy(&dest[j], sup);
+                    j += len;
+                }
+                i++;
+            }
+            i--;
+        } else {
+            dest[j++] = src[i];
+        }
+    }
+    dest[j] = '\0';
+}
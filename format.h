@@ -0,0 +1,9 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stddef.h>
+
+/* Convertit une expression contenant '^' en affichant les exposants en superscript */
+void format_expression(const char *src, char *dest, size_t dest_size);
+
+#endif
@@ -0,0 +1,450 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <complex.h>
+#include "calc.h"
+#include "calc_internal.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define CALC_JIT_NATIVE 1
+#endif
+
+/* ============================= */
+/* Partie Compilation native     */
+/* Un programme réel exécuté plus de CALC_JIT_THRESHOLD fois est traduit
+   en code x86-64 (SSE2) : les opérations arithmétiques et les tests du
+   chemin réel sont en ligne, les fonctions transcendantes sont celles
+   de la libm, et pow, root et les fonctions du registre passent par de
+   petites fonctions C. Chaque instruction fait exactement le calcul de
+   calc_exec_real() : le résultat est le même au bit près.
+
+   Le code ne traite que le cas courant : dès que calc_exec_real()
+   basculerait en complexe ou signalerait une erreur, la fonction
+   native renvoie 1 et l'interpréteur reprend l'exécution depuis le
+   début. Sur une autre architecture, rien n'est compilé.
+
+   Le sommet de pile vit dans xmm0 ; les autres cases, et les registres
+   des sous-expressions communes, dans la pile d'exécution (rbx), à des
+   adresses connues à la compilation puisque la hauteur de pile l'est.
+   rbx = pile, r12 = constantes réelles, r13 = valeurs des variables. */
+/* ============================= */
+
+enum { JIT_OFF, JIT_COUNTING, JIT_COMPILING, JIT_READY };
+
+void calc_jit_init(CalcProgram *prog, int enabled) {
+    atomic_init(&prog->jit_state, enabled && prog->real_only ? JIT_COUNTING : JIT_OFF);
+    atomic_init(&prog->jit_runs, 0);
+    prog->jit_code = NULL;
+    prog->jit_size = 0;
+    prog->jit_fn = NULL;
+}
+
+#ifdef CALC_JIT_NATIVE
+
+/* Fonctions appelées par le code natif ; 0 si le résultat est dans
+   sp[0], 1 pour repasser par l'interpréteur */
+static int jit_pow(double *sp) {
+    double a = sp[0], b = sp[1];
+    if (a == 0 || (a < 0 && b != trunc(b)) || !isfinite(a) || !isfinite(b))
+        return 1;
+    sp[0] = pow(a, b);
+    return !isfinite(sp[0]) || sp[0] == 0;
+}
+
+static int jit_root(double *sp) {
+    double a = sp[0], b = sp[1];
+    if (a <= 0 || b == 0 || !isfinite(a) || !isfinite(b))
+        return 1;
+    sp[0] = pow(a, 1.0 / b);
+    return !isfinite(sp[0]) || sp[0] == 0;
+}
+
+static int jit_call(double *sp, int argc, int index) {
+    const CalcSymbol *sym = calc_symbol(index);
+    double res;
+    if (sym->rfn) {
+        res = sym->rfn(sp, argc);
+    } else {
+        double complex cargs[16];
+        if (argc > 16)
+            return 1;
+        for (int k = 0; k < argc; k++)
+            cargs[k] = sp[k];
+        double complex z = sym->cfn(cargs, argc);
+        if (cimag(z) != 0)
+            return 1;
+        res = creal(z);
+    }
+    if (!isfinite(res))
+        return 1;
+    sp[0] = res;
+    return 0;
+}
+
+/* Constantes des tests, en tête du code (alignées sur 16 octets pour
+   andpd et xorpd) */
+#define POOL_ABS 0
+#define POOL_SIGN 16
+#define POOL_EPS 32
+#define POOL_MAX 40
+#define POOL_ONE 48
+#define POOL_HUNDRED 56
+#define POOL_SIZE 64
+
+/* Registres généraux utilisés comme base d'adressage */
+#define RBX 3
+#define R12 12
+#define R13 13
+
+typedef struct {
+    unsigned char *buf;
+    size_t len;
+    size_t fail;           /* sortie « repasser par l'interpréteur » */
+    size_t epilogue;
+} Jit;
+
+static void emit1(Jit *j, unsigned b) {
+    j->buf[j->len++] = (unsigned char)b;
+}
+
+static void emit4(Jit *j, uint32_t v) {
+    memcpy(j->buf + j->len, &v, 4);
+    j->len += 4;
+}
+
+/* Instruction SSE : préfixe (0 si aucun), 0F, opcode */
+static void sse_op(Jit *j, unsigned prefix, unsigned op, int base) {
+    if (prefix)
+        emit1(j, prefix);
+    if (base >= 8)
+        emit1(j, 0x41); /* REX.B */
+    emit1(j, 0x0f);
+    emit1(j, op);
+}
+
+/* op xmm(reg), [base + disp] (ou l'inverse pour un rangement) */
+static void sse_mem(Jit *j, unsigned prefix, unsigned op, int reg, int base, int32_t disp) {
+    sse_op(j, prefix, op, base);
+    emit1(j, 0x80 | reg << 3 | (base & 7));
+    if ((base & 7) == 4)
+        emit1(j, 0x24); /* SIB de r12 */
+    emit4(j, (uint32_t)disp);
+}
+
+/* op xmm(reg), [constante du début du code] */
+static void sse_pool(Jit *j, unsigned prefix, unsigned op, int reg, size_t off) {
+    sse_op(j, prefix, op, 0);
+    emit1(j, reg << 3 | 5);
+    emit4(j, (uint32_t)(off - (j->len + 4)));
+}
+
+static void sse_reg(Jit *j, unsigned prefix, unsigned op, int dst, int src) {
+    sse_op(j, prefix, op, 0);
+    emit1(j, 0xc0 | dst << 3 | src);
+}
+
+#define MOVSD_LOAD(j, reg, base, disp) sse_mem(j, 0xf2, 0x10, reg, base, disp)
+#define MOVSD_STORE(j, reg, base, disp) sse_mem(j, 0xf2, 0x11, reg, base, disp)
+#define MOVAPD(j, dst, src) sse_reg(j, 0x66, 0x28, dst, src)
+#define XORPD_SELF(j, reg) sse_reg(j, 0x66, 0x57, reg, reg)
+#define UCOMISD_POOL(j, reg, off) sse_pool(j, 0x66, 0x2e, reg, off)
+
+/* Saut conditionnel vers la sortie d'échec (cc : 0x82 jb, 0x87 ja,
+   0x8a jp, 0x85 jne, 0x84 je, 0x86 jbe) */
+static void jump_fail(Jit *j, unsigned cc) {
+    emit1(j, 0x0f);
+    emit1(j, cc);
+    emit4(j, (uint32_t)(j->fail - (j->len + 4)));
+}
+
+typedef void (*JitTarget)(void);
+
+static void call_abs(Jit *j, JitTarget fn) {
+    uint64_t addr = (uint64_t)(uintptr_t)fn;
+    emit1(j, 0x48); /* mov rax, imm64 */
+    emit1(j, 0xb8);
+    memcpy(j->buf + j->len, &addr, 8);
+    j->len += 8;
+    emit1(j, 0xff); /* call rax */
+    emit1(j, 0xd0);
+}
+
+/* Échec si reg n'est pas fini, ou (eps) si |reg| < 1e-12 */
+static void check_finite(Jit *j, int reg, int eps) {
+    MOVAPD(j, 2, reg);
+    sse_pool(j, 0x66, 0x54, 2, POOL_ABS); /* andpd */
+    if (eps) {
+        UCOMISD_POOL(j, 2, POOL_EPS);
+        jump_fail(j, 0x82);
+    }
+    UCOMISD_POOL(j, 2, POOL_MAX);
+    jump_fail(j, 0x87);
+    jump_fail(j, 0x8a);
+}
+
+/* Échec si xmm0 < 0 (ou NaN) ; xmm1 vaut ensuite 0 */
+static void check_nonneg(Jit *j) {
+    XORPD_SELF(j, 1);
+    sse_reg(j, 0x66, 0x2e, 0, 1); /* ucomisd xmm0, xmm1 */
+    jump_fail(j, 0x82);
+}
+
+/* Échec si xmm0 est nul (ou NaN), ou (cc = 0x86, jbe) s'il est <= 0 */
+static void check_zero(Jit *j, unsigned cc) {
+    XORPD_SELF(j, 1);
+    sse_reg(j, 0x66, 0x2e, 0, 1); /* ucomisd xmm0, xmm1 */
+    jump_fail(j, cc);
+}
+
+/* Appel d'une fonction C (double *sp, ...) : 0 si le résultat est en
+   sp[0] ; le sommet de pile doit déjà être rangé */
+static void call_helper(Jit *j, int32_t sp_disp, JitTarget fn) {
+    emit1(j, 0x48); /* lea rdi, [rbx + disp] */
+    emit1(j, 0x8d);
+    emit1(j, 0xbb);
+    emit4(j, (uint32_t)sp_disp);
+    call_abs(j, fn);
+    emit1(j, 0x85); /* test eax, eax */
+    emit1(j, 0xc0);
+    jump_fail(j, 0x85);
+    MOVSD_LOAD(j, 0, RBX, sp_disp);
+}
+
+/* Taille maximale du code d'une instruction (OP_POWI : 2 multiplications
+   par bit de l'exposant) */
+#define JIT_INSTR_MAX 160
+
+/* Constantes, puis sorties : elles précèdent l'entrée pour que tous les
+   sauts aient une cible connue */
+static void emit_stubs(Jit *j) {
+    static const uint64_t pool[] = {
+        0x7fffffffffffffffull, 0x7fffffffffffffffull,
+        0x8000000000000000ull, 0x8000000000000000ull
+    };
+    static const double pool_d[] = { 1e-12, DBL_MAX, 1.0, 100.0 };
+    memcpy(j->buf, pool, sizeof(pool));
+    memcpy(j->buf + POOL_EPS, pool_d, sizeof(pool_d));
+    j->len = POOL_SIZE;
+
+    j->fail = j->len;
+    emit1(j, 0xb8); /* mov eax, 1 */
+    emit4(j, 1);
+    j->epilogue = j->len;
+    emit1(j, 0x41); /* pop r13 */
+    emit1(j, 0x5d);
+    emit1(j, 0x41); /* pop r12 */
+    emit1(j, 0x5c);
+    emit1(j, 0x5b); /* pop rbx */
+    emit1(j, 0xc3); /* ret */
+}
+
+static void translate(Jit *j, const CalcProgram *prog) {
+    static const unsigned char prologue[] = {
+        0x53,             /* push rbx */
+        0x41, 0x54,       /* push r12 */
+        0x41, 0x55,       /* push r13 */
+        0x48, 0x89, 0xfb, /* mov rbx, rdi */
+        0x49, 0x89, 0xf4, /* mov r12, rsi */
+        0x49, 0x89, 0xd5  /* mov r13, rdx */
+    };
+    memcpy(j->buf + j->len, prologue, sizeof(prologue));
+    j->len += sizeof(prologue);
+
+    int d = 0; /* hauteur de pile, sommet compris */
+    int32_t regs = prog->max_depth * (int32_t)sizeof(double);
+#define SLOT(k) ((int32_t)((k) * sizeof(double)))
+#define SPILL() do { if (d > 0) MOVSD_STORE(j, 0, RBX, SLOT(d - 1)); } while (0)
+    for (const Instr *ip = prog->code; ip < prog->code + prog->len; ip++) {
+        switch (ip->op) {
+        case OP_CONST:
+            SPILL();
+            MOVSD_LOAD(j, 0, R12, SLOT(ip->arg));
+            d++;
+            break;
+        case OP_VAR: /* partie réelle de la valeur complexe */
+            SPILL();
+            MOVSD_LOAD(j, 0, R13, (int32_t)(ip->arg * sizeof(double complex)));
+            d++;
+            break;
+        case OP_LOAD:
+            SPILL();
+            MOVSD_LOAD(j, 0, RBX, regs + SLOT(ip->arg));
+            d++;
+            break;
+        case OP_STORE:
+            MOVSD_STORE(j, 0, RBX, regs + SLOT(ip->arg));
+            break;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_SCALE:
+        case OP_DIV: case OP_IDIV: {
+            MOVAPD(j, 1, 0);
+            MOVSD_LOAD(j, 0, RBX, SLOT(d - 2));
+            d--;
+            unsigned op = ip->op == OP_ADD ? 0x58 : ip->op == OP_SUB ? 0x5c
+                        : ip->op == OP_MUL || ip->op == OP_SCALE ? 0x59 : 0x5e;
+            if (op == 0x5e)
+                check_finite(j, 1, 1);
+            sse_reg(j, 0xf2, op, 0, 1);
+            if (ip->op == OP_IDIV)
+                call_abs(j, (JitTarget)trunc);
+            else if (ip->op != OP_ADD && ip->op != OP_SUB)
+                check_zero(j, 0x84); /* zéro signé : chemin complexe */
+            break;
+        }
+        case OP_NEG:
+            sse_pool(j, 0x66, 0x57, 0, POOL_SIGN); /* xorpd */
+            break;
+        case OP_PERCENT:
+            sse_pool(j, 0xf2, 0x5e, 0, POOL_HUNDRED); /* divsd */
+            break;
+        case OP_SQRT:
+            check_nonneg(j);
+            sse_reg(j, 0xf2, 0x51, 0, 0); /* sqrtsd */
+            sse_reg(j, 0xf2, 0x58, 0, 1); /* addsd xmm0, 0 */
+            break;
+        case OP_LOG:
+            check_zero(j, 0x86);
+            call_abs(j, (JitTarget)log);
+            break;
+        case OP_FACT:
+            check_nonneg(j);
+            call_abs(j, (JitTarget)calc_factorial);
+            break;
+        case OP_COS:
+            call_abs(j, (JitTarget)cos);
+            break;
+        case OP_SIN:
+            call_abs(j, (JitTarget)sin);
+            break;
+        case OP_TAN:
+            call_abs(j, (JitTarget)tan);
+            break;
+        case OP_ACOS:
+        case OP_ASIN:
+            MOVAPD(j, 2, 0);
+            sse_pool(j, 0x66, 0x54, 2, POOL_ABS);
+            UCOMISD_POOL(j, 2, POOL_ONE);
+            jump_fail(j, 0x87);
+            jump_fail(j, 0x8a);
+            call_abs(j, ip->op == OP_ACOS ? (JitTarget)acos : (JitTarget)asin);
+            break;
+        case OP_ATAN:
+            check_finite(j, 0, 0);
+            call_abs(j, (JitTarget)atan);
+            break;
+        case OP_POWI: {
+            /* base nulle (ou NaN) laissée à cpow(), comme pour OP_POW */
+            check_zero(j, 0x84);
+            /* même suite de produits que calc_powi() */
+            sse_pool(j, 0xf2, 0x10, 1, POOL_ONE); /* movsd xmm1, 1.0 */
+            for (int n = ip->arg;;) {
+                if (n & 1)
+                    sse_reg(j, 0xf2, 0x59, 1, 0); /* r *= x */
+                n >>= 1;
+                if (!n)
+                    break;
+                sse_reg(j, 0xf2, 0x59, 0, 0);     /* x *= x */
+            }
+            MOVAPD(j, 0, 1);
+            check_finite(j, 0, 0);
+            check_zero(j, 0x84);
+            break;
+        }
+        case OP_POW:
+        case OP_ROOT:
+            SPILL();
+            d--;
+            call_helper(j, SLOT(d - 1), ip->op == OP_POW ? (JitTarget)jit_pow
+                                                          : (JitTarget)jit_root);
+            break;
+        case OP_CALL:
+            SPILL();
+            d -= ip->argc;
+            emit1(j, 0xbe); /* mov esi, argc */
+            emit4(j, ip->argc);
+            emit1(j, 0xba); /* mov edx, indice */
+            emit4(j, (uint32_t)ip->arg);
+            call_helper(j, SLOT(d), (JitTarget)jit_call);
+            d++;
+            break;
+        default: /* OP_CCONST : programme non réel, jamais compilé */
+            break;
+        }
+    }
+#undef SLOT
+#undef SPILL
+    /* comme run_real() : un résultat infini ou NaN passe en complexe */
+    check_finite(j, 0, 0);
+    MOVSD_STORE(j, 0, RBX, 0);
+    emit1(j, 0x31); /* xor eax, eax */
+    emit1(j, 0xc0);
+    emit1(j, 0xe9); /* jmp épilogue */
+    emit4(j, (uint32_t)(j->epilogue - (j->len + 4)));
+}
+
+static void jit_compile(CalcProgram *prog) {
+    size_t size = POOL_SIZE + 64 + (size_t)prog->len * JIT_INSTR_MAX + 64;
+    long page = 4096;
+    size = (size + page - 1) & ~(size_t)(page - 1);
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        atomic_store_explicit(&prog->jit_state, JIT_OFF, memory_order_relaxed);
+        return;
+    }
+    Jit j = { mem, 0, 0, 0 };
+    emit_stubs(&j);
+    size_t entry = j.len;
+    translate(&j, prog);
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        atomic_store_explicit(&prog->jit_state, JIT_OFF, memory_order_relaxed);
+        return;
+    }
+    prog->jit_code = mem;
+    prog->jit_size = size;
+    prog->jit_fn = (CalcJitFn)(uintptr_t)((unsigned char *)mem + entry);
+    atomic_store_explicit(&prog->jit_state, JIT_READY, memory_order_release);
+}
+
+CalcJitFn calc_jit_get(const CalcProgram *cprog) {
+    CalcProgram *prog = (CalcProgram *)cprog; /* seuls les champs atomiques changent */
+    int state = atomic_load_explicit(&prog->jit_state, memory_order_acquire);
+    if (state == JIT_READY)
+        return prog->jit_fn;
+    if (state != JIT_COUNTING)
+        return NULL;
+    /* Compteur approximatif : des incréments concurrents peuvent se
+       perdre, la compilation n'en est que retardée */
+    unsigned runs = atomic_load_explicit(&prog->jit_runs, memory_order_relaxed) + 1;
+    atomic_store_explicit(&prog->jit_runs, runs, memory_order_relaxed);
+    if (runs < CALC_JIT_THRESHOLD)
+        return NULL;
+    int expected = JIT_COUNTING;
+    if (!atomic_compare_exchange_strong(&prog->jit_state, &expected, JIT_COMPILING))
+        return NULL;
+    jit_compile(prog);
+    return atomic_load_explicit(&prog->jit_state, memory_order_acquire) == JIT_READY
+           ? prog->jit_fn : NULL;
+}
+
+void calc_jit_free(CalcProgram *prog) {
+    if (prog->jit_code)
+        munmap(prog->jit_code, prog->jit_size);
+}
+
+#else /* pas de génération de code sur cette architecture */
+
+CalcJitFn calc_jit_get(const CalcProgram *prog) {
+    (void)prog;
+    return NULL;
+}
+
+void calc_jit_free(CalcProgram *prog) {
+    (void)prog;
+}
+
+#endif
@@ -0,0 +1,482 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include "calc.h"
+#include "calc_internal.h"
+
+/* ============================= */
+/* Partie Optimisation           */
+/* Passe appliquée par calc_compile() au programme postfixé :
+   1. précalcul des sous-expressions constantes ;
+   2. reconstruction du programme en graphe, avec les simplifications
+      algébriques et la réduction de force ; les sous-expressions
+      identiques n'y apparaissent qu'une fois ;
+   3. réémission du code : une sous-expression partagée est calculée une
+      seule fois puis rangée dans un registre (OP_STORE / OP_LOAD).
+   Les erreurs d'exécution restent celles du programme d'origine : si une
+   sous-expression constante échoue (division par 0, factorielle d'un
+   négatif...), le programme est laissé tel quel et l'erreur sera levée à
+   l'exécution, à la même position. */
+/* ============================= */
+
+/* Exposant maximal réécrit en multiplications (OP_POWI) */
+#define POWI_MAX 64
+
+typedef struct {
+    unsigned short op;
+    unsigned short argc;
+    int arg;
+    int kids, nkids;       /* fils : Opt.kids[kids .. kids + nkids - 1] */
+    unsigned pos;
+    double complex cval;   /* constantes : valeur des deux chemins */
+    double rval;
+    unsigned hash;
+    int refs;              /* nombre de parents dans le programme final */
+    int slot;              /* registre, ou indice de constante */
+} Node;
+
+typedef struct {
+    CalcContext *ctx;
+    const Instr *code;
+    const unsigned *pos;
+    int len;
+    /* Arbre du programme d'origine, indexé par instruction */
+    int *first;            /* première instruction du sous-arbre */
+    int *tkids;            /* fils de l'instruction i : tkids[tstart[i] ...] */
+    int *tstart;
+    char *konst;           /* sous-arbre sans variable ni appel de fonction externe */
+    int *fold;             /* fold[first[i]] = i : sous-arbre i précalculé */
+    double complex *fc;
+    double *fr;
+    char *freal;
+    int *stack;
+    /* Graphe reconstruit */
+    Node *nodes;
+    int nnodes, nodes_cap;
+    int *kids;
+    int nkids, kids_cap;
+    int *table;            /* table de hachage des noeuds partagés */
+    unsigned table_mask;
+} Opt;
+
+static int op_arity(const Instr *ins) {
+    switch (ins->op) {
+    case OP_CONST: case OP_CCONST: case OP_LOAD: case OP_VAR:
+        return 0;
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+    case OP_IDIV: case OP_POW: case OP_ROOT: case OP_SCALE:
+        return 2;
+    case OP_CALL: case OP_INTEGRATE: case OP_SOLVE: case OP_DIFF:
+    case OP_SUM: case OP_PROD:
+        return ins->argc;
+    default:
+        return 1;
+    }
+}
+
+static int body_pure(const CalcProgram *body);
+
+/* Une fonction externe peut avoir des effets de bord : jamais précalculée
+   ni partagée, pas plus qu'un opérateur à variable liée qui l'appelle */
+static int op_pure(const Opt *o, const Instr *ins) {
+    if (ins->op >= OP_FIRST_BINDER)
+        return body_pure(o->ctx->p.out.subs[ins->arg]);
+    return ins->op != OP_CALL || calc_symbol(ins->arg)->pure;
+}
+
+static int body_pure(const CalcProgram *body) {
+    for (int k = 0; k < body->len; k++) {
+        const Instr *ins = &body->code[k];
+        if (ins->op == OP_CALL && !calc_symbol(ins->arg)->pure)
+            return 0;
+        if (ins->op >= OP_FIRST_BINDER && !body_pure(body->subs[ins->arg]))
+            return 0;
+    }
+    return 1;
+}
+
+/* ============================= */
+/* Arbre et précalcul            */
+/* ============================= */
+
+static void build_tree(Opt *o) {
+    int sp = 0, nk = 0;
+    for (int i = 0; i < o->len; i++) {
+        const Instr *ins = &o->code[i];
+        int n = op_arity(ins);
+        /* un corps qui lit une variable extérieure n'est pas constant */
+        int k = op_pure(o, ins) && ins->op != OP_VAR &&
+                (ins->op < OP_FIRST_BINDER || o->ctx->p.out.subs[ins->arg]->nvars_used <= 1);
+        sp -= n;
+        o->tstart[i] = nk;
+        for (int j = 0; j < n; j++) {
+            o->tkids[nk++] = o->stack[sp + j];
+            k &= o->konst[o->stack[sp + j]];
+        }
+        o->first[i] = n ? o->first[o->stack[sp]] : i;
+        o->konst[i] = (char)k;
+        o->fold[i] = -1;
+        o->stack[sp++] = i;
+    }
+}
+
+/* Précalcule les plus grands sous-arbres constants. Renvoie 0 si l'un
+   d'eux échoue : le programme est alors laissé tel quel. */
+static int fold_constants(Opt *o) {
+    CodeBuf *out = &o->ctx->p.out;
+    int sp = 0;
+    o->stack[sp++] = o->len - 1;
+    while (sp > 0) {
+        int i = o->stack[--sp];
+        int n = op_arity(&o->code[i]);
+        if (n == 0)
+            continue;
+        if (!o->konst[i]) {
+            for (int j = 0; j < n; j++)
+                o->stack[sp++] = o->tkids[o->tstart[i] + j];
+            continue;
+        }
+        CalcProgram slice;
+        memset(&slice, 0, sizeof(slice));
+        slice.len = i - o->first[i] + 1;
+        slice.nconsts = out->nconsts;
+        slice.max_depth = out->max_depth; /* majorant */
+        slice.real_only = 1;
+        slice.code = out->code + o->first[i];
+        slice.consts = out->consts;
+        slice.rconsts = out->rconsts;
+        slice.pos = out->pos + o->first[i];
+        slice.subs = out->subs;
+        slice.nsubs = out->nsubs;
+        for (int k = 0; k < slice.len; k++)
+            if (slice.code[k].op == OP_CCONST)
+                slice.real_only = 0;
+        int real_ok;
+        if (calc_run_both(o->ctx, &slice, &o->fc[i], &o->fr[i], &real_ok) != CALC_OK)
+            return 0;
+        if (slice.real_only && !real_ok) {
+            /* Le chemin réel passe au complexe dans ce sous-arbre (0^-2,
+               sqrt(-1)...) : précalculé, il rendrait tout le programme
+               complexe et une erreur du chemin réel avant ce point ne
+               serait plus levée. Seuls ses fils sont précalculés. */
+            for (int j = 0; j < n; j++)
+                o->stack[sp++] = o->tkids[o->tstart[i] + j];
+            continue;
+        }
+        o->freal[i] = (char)real_ok;
+        o->fold[o->first[i]] = i;
+    }
+    return 1;
+}
+
+/* ============================= */
+/* Graphe                        */
+/* ============================= */
+
+static unsigned mix(unsigned h, unsigned long long v) {
+    h ^= (unsigned)v ^ (unsigned)(v >> 32);
+    return h * 16777619u;
+}
+
+static unsigned long long bits(double d) {
+    unsigned long long u;
+    memcpy(&u, &d, sizeof(u));
+    return u;
+}
+
+static int same_node(const Opt *o, const Node *a, const Node *b) {
+    if (a->op != b->op || a->argc != b->argc || a->arg != b->arg || a->nkids != b->nkids)
+        return 0;
+    if (a->op == OP_CONST || a->op == OP_CCONST)
+        return bits(creal(a->cval)) == bits(creal(b->cval)) &&
+               bits(cimag(a->cval)) == bits(cimag(b->cval)) &&
+               bits(a->rval) == bits(b->rval);
+    return memcmp(&o->kids[a->kids], &o->kids[b->kids], a->nkids * sizeof(int)) == 0;
+}
+
+/* Ajoute le noeud o->nodes[o->nnodes], ou renvoie son double existant */
+static int intern(Opt *o, int shareable) {
+    Node *nd = &o->nodes[o->nnodes];
+    if (!shareable)
+        return o->nnodes++;
+    unsigned h = 2166136261u;
+    h = mix(h, nd->op);
+    h = mix(h, nd->argc);
+    h = mix(h, (unsigned)nd->arg);
+    if (nd->op == OP_CONST || nd->op == OP_CCONST) {
+        h = mix(h, bits(creal(nd->cval)));
+        h = mix(h, bits(cimag(nd->cval)));
+        h = mix(h, bits(nd->rval));
+    }
+    for (int k = 0; k < nd->nkids; k++)
+        h = mix(h, (unsigned)o->kids[nd->kids + k]);
+    nd->hash = h;
+    unsigned slot = h & o->table_mask;
+    while (o->table[slot] >= 0) {
+        const Node *other = &o->nodes[o->table[slot]];
+        if (other->hash == h && same_node(o, other, nd)) {
+            o->nkids = nd->kids; /* fils inutiles */
+            return o->table[slot];
+        }
+        slot = (slot + 1) & o->table_mask;
+    }
+    o->table[slot] = o->nnodes;
+    return o->nnodes++;
+}
+
+static int make_const(Opt *o, int op, double complex cval, double rval, unsigned pos) {
+    Node *nd = &o->nodes[o->nnodes];
+    memset(nd, 0, sizeof(*nd));
+    nd->op = (unsigned short)op;
+    nd->cval = cval;
+    nd->rval = rval;
+    nd->pos = pos;
+    nd->kids = o->nkids;
+    return intern(o, 1);
+}
+
+static int make_raw(Opt *o, int op, int argc, int arg, const int *kids, int n, unsigned pos, int pure) {
+    Node *nd = &o->nodes[o->nnodes];
+    memset(nd, 0, sizeof(*nd));
+    nd->op = (unsigned short)op;
+    nd->argc = (unsigned short)argc;
+    nd->arg = arg;
+    nd->pos = pos;
+    nd->kids = o->nkids;
+    nd->nkids = n;
+    for (int k = 0; k < n; k++)
+        o->kids[o->nkids++] = kids[k];
+    return intern(o, pure);
+}
+
+static int kid(const Opt *o, int id, int k) {
+    return o->kids[o->nodes[id].kids + k];
+}
+
+/* Crée un noeud en appliquant les simplifications. Elles ne changent pas
+   le résultat (au dernier bit près pour x^n, calculé par produits sur le
+   chemin réel), y compris le signe des zéros et des NaN dont dépendent
+   les coupures de log, sqrt ou arccos : x^0 reste tel quel (0^0 donne
+   NaN), x * 1 aussi (le produit complexe ne conserve pas le signe des
+   zéros), x + (-y) aussi (un NaN de y y change de signe, pas dans x - y),
+   et x / c ne devient x * (1/c) (OP_SCALE) que si c est une puissance
+   de 2. En complexe, OP_SCALE et OP_POWI sont exécutés comme la division
+   et cpow() d'origine : la division par c ne conserve pas toujours les
+   zéros signés de x, et cpow() n'est pas exact pour un exposant entier
+   (x^1 n'est donc pas simplifié en x). */
+static int make_node(Opt *o, const Instr *ins, const int *kids, unsigned pos) {
+    int n = op_arity(ins);
+    const Node *b = n == 2 ? &o->nodes[kids[1]] : NULL;
+    switch (ins->op) {
+    case OP_NEG: /* -(-x) = x */
+        if (o->nodes[kids[0]].op == OP_NEG)
+            return kid(o, kids[0], 0);
+        break;
+    case OP_DIV: { /* x / 2^k = x * 2^-k, composante par composante */
+        if (b->op != OP_CONST || cimag(b->cval) != 0 || signbit(cimag(b->cval)) ||
+            b->rval != creal(b->cval))
+            break;
+        int e;
+        double c = b->rval;
+        if (!isfinite(c) || fabs(c) < 1e-12 || fabs(frexp(c, &e)) != 0.5)
+            break;
+        int k2[2] = { kids[0], make_const(o, OP_CONST, 1.0 / c, 1.0 / c, b->pos) };
+        return make_raw(o, OP_SCALE, 0, 0, k2, 2, pos, 1);
+    }
+    case OP_POW: { /* x^n = x * ... * x sur le chemin réel */
+        if (b->op != OP_CONST || cimag(b->cval) != 0 || signbit(cimag(b->cval)) ||
+            b->rval != creal(b->cval))
+            break;
+        double c = b->rval;
+        if (c >= 1 && c <= POWI_MAX && c == trunc(c))
+            return make_raw(o, OP_POWI, 0, (int)c, kids, 1, pos, 1);
+        break;
+    }
+    default:
+        break;
+    }
+    return make_raw(o, ins->op, ins->argc, ins->arg, kids, n, pos, op_pure(o, ins));
+}
+
+static int build_graph(Opt *o) {
+    CodeBuf *out = &o->ctx->p.out;
+    int sp = 0;
+    for (int i = 0; i < o->len;) {
+        const Instr *ins = &o->code[i];
+        int id;
+        if (o->fold[i] >= 0) {
+            int j = o->fold[i];
+            id = make_const(o, o->freal[j] ? OP_CONST : OP_CCONST, o->fc[j], o->fr[j], o->pos[j]);
+            i = j + 1;
+        } else if (ins->op == OP_CONST || ins->op == OP_CCONST) {
+            id = make_const(o, ins->op, out->consts[ins->arg], out->rconsts[ins->arg], o->pos[i]);
+            i++;
+        } else {
+            sp -= op_arity(ins);
+            id = make_node(o, ins, &o->stack[sp], o->pos[i]);
+            i++;
+        }
+        o->stack[sp++] = id;
+    }
+    return o->stack[0];
+}
+
+/* ============================= */
+/* Réémission du code            */
+/* ============================= */
+
+static void count_refs(Opt *o, int root) {
+    int sp = 0;
+    o->stack[sp++] = root;
+    while (sp > 0) {
+        const Node *nd = &o->nodes[o->stack[--sp]];
+        for (int k = 0; k < nd->nkids; k++) {
+            int c = o->kids[nd->kids + k];
+            if (o->nodes[c].refs++ == 0)
+                o->stack[sp++] = c;
+        }
+    }
+}
+
+static int emit_program(Opt *o, int root) {
+    CodeBuf *out = &o->ctx->p.out;
+    int cap = 2 * o->nnodes + o->nkids + 1;
+    Instr *code = malloc(cap * sizeof(Instr));
+    unsigned *pos = malloc(cap * sizeof(unsigned));
+    double complex *consts = malloc(o->nnodes * sizeof(double complex));
+    double *rconsts = malloc(o->nnodes * sizeof(double));
+    int *todo = malloc(2 * (o->nkids + 1) * sizeof(int));
+    if (!code || !pos || !consts || !rconsts || !todo) {
+        free(code);
+        free(pos);
+        free(consts);
+        free(rconsts);
+        free(todo);
+        return 0;
+    }
+    for (int k = 0; k < o->nnodes; k++)
+        o->nodes[k].slot = -1;
+
+    int len = 0, nconsts = 0, nregs = 0, depth = 0, max_depth = 0;
+    int sp = 0;
+    todo[sp++] = root;
+    todo[sp++] = 0;
+    while (sp > 0) {
+        int state = todo[--sp];
+        Node *nd = &o->nodes[todo[--sp]];
+        Instr ins = { nd->op, nd->argc, nd->arg };
+        int leaf = nd->op == OP_CONST || nd->op == OP_CCONST;
+        if (leaf) {
+            if (nd->slot < 0) {
+                consts[nconsts] = nd->cval;
+                rconsts[nconsts] = nd->rval;
+                nd->slot = nconsts++;
+            }
+            ins.arg = nd->slot;
+        } else if (state == 0 && nd->slot >= 0) {
+            /* déjà calculée : relire le registre */
+            ins.op = OP_LOAD;
+            ins.argc = 0;
+            ins.arg = nd->slot;
+        } else if (state == 0) {
+            todo[sp++] = (int)(nd - o->nodes);
+            todo[sp++] = 1;
+            for (int k = nd->nkids - 1; k >= 0; k--) {
+                todo[sp++] = o->kids[nd->kids + k];
+                todo[sp++] = 0;
+            }
+            continue;
+        }
+        code[len] = ins;
+        pos[len++] = nd->pos;
+        depth += calc_stack_effect(&ins);
+        if (depth > max_depth)
+            max_depth = depth;
+        if (!leaf && state == 1 && nd->refs > 1 && nd->op != OP_VAR) {
+            nd->slot = nregs++;
+            code[len] = (Instr){ OP_STORE, 0, nd->slot };
+            pos[len++] = nd->pos;
+        }
+    }
+
+    free(todo);
+    free(out->code);
+    free(out->pos);
+    free(out->consts);
+    free(out->rconsts);
+    out->code = code;
+    out->pos = pos;
+    out->len = len;
+    out->cap = cap;
+    out->consts = consts;
+    out->rconsts = rconsts;
+    out->nconsts = nconsts;
+    out->consts_cap = o->nnodes;
+    out->depth = depth;
+    out->max_depth = max_depth;
+    out->nregs = nregs;
+    return 1;
+}
+
+/* ============================= */
+/* Partie API                    */
+/* ============================= */
+
+void calc_optimize(CalcContext *ctx) {
+    CodeBuf *out = &ctx->p.out;
+    Opt o;
+    memset(&o, 0, sizeof(o));
+    o.ctx = ctx;
+    o.code = out->code;
+    o.pos = out->pos;
+    o.len = out->len;
+    if (o.len == 0)
+        return;
+    /* Chaque instruction crée au plus deux noeuds (x / c : la constante
+       1/c et la multiplication), chacun d'au plus deux fils de plus que
+       l'instruction d'origine. */
+    o.nodes_cap = 2 * o.len + 2;
+    o.kids_cap = 3 * o.len + 4;
+    unsigned tsize = 1;
+    while (tsize < 2u * (unsigned)o.nodes_cap)
+        tsize <<= 1;
+    o.table_mask = tsize - 1;
+    o.first = malloc(o.len * sizeof(int));
+    o.tkids = malloc(o.len * sizeof(int));
+    o.tstart = malloc(o.len * sizeof(int));
+    o.konst = malloc(o.len);
+    o.fold = malloc(o.len * sizeof(int));
+    o.fc = malloc(o.len * sizeof(double complex));
+    o.fr = malloc(o.len * sizeof(double));
+    o.freal = malloc(o.len);
+    o.stack = malloc((o.kids_cap + 1) * sizeof(int));
+    o.nodes = malloc(o.nodes_cap * sizeof(Node));
+    o.kids = malloc(o.kids_cap * sizeof(int));
+    o.table = malloc(tsize * sizeof(int));
+    /* En cas d'échec, le programme reste simplement non optimisé */
+    if (o.first && o.tkids && o.tstart && o.konst && o.fold && o.fc && o.fr &&
+        o.freal && o.stack && o.nodes && o.kids && o.table) {
+        memset(o.table, -1, tsize * sizeof(int));
+        build_tree(&o);
+        if (fold_constants(&o)) {
+            int root = build_graph(&o);
+            count_refs(&o, root);
+            emit_program(&o, root);
+        }
+        /* une erreur du précalcul sera levée à l'exécution */
+        memset(&ctx->err, 0, sizeof(ctx->err));
+    }
+    free(o.first);
+    free(o.tkids);
+    free(o.tstart);
+    free(o.konst);
+    free(o.fold);
+    free(o.fc);
+    free(o.fr);
+    free(o.freal);
+    free(o.stack);
+    free(o.nodes);
+    free(o.kids);
+    free(o.table);
+}
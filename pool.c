@@ -0,0 +1,191 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pool.h"
+
+/* Part de travail d'un thread : l'intervalle [lo, hi) de tâches.
+   Le propriétaire consomme par le début, les voleurs prennent la fin. */
+typedef struct {
+    pthread_mutex_t lock;
+    size_t lo, hi;
+    pthread_t thread;
+    struct ThreadPool *pool;
+    int id;
+} Worker;
+
+struct ThreadPool {
+    int nthreads;             /* threads créés + thread appelant */
+    Worker *workers;
+    pthread_mutex_t run_lock; /* un seul pool_run() à la fois */
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    unsigned long generation; /* incrémenté à chaque pool_run() */
+    int active;               /* threads encore occupés sur le lot courant */
+    int shutdown;
+    pool_task_fn fn;
+    void *arg;
+};
+
+static _Thread_local int in_pool = 0;
+
+int pool_default_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+/* Prend une tâche dans sa propre part, sinon en vole chez un autre */
+static int next_task(ThreadPool *pool, Worker *self, size_t *index) {
+    pthread_mutex_lock(&self->lock);
+    if (self->lo < self->hi) {
+        *index = self->lo++;
+        pthread_mutex_unlock(&self->lock);
+        return 1;
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    for (int k = 1; k < pool->nthreads; k++) {
+        Worker *victim = &pool->workers[(self->id + k) % pool->nthreads];
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->hi - victim->lo;
+        if (left == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        size_t mid = victim->lo + left / 2;
+        size_t hi = victim->hi;
+        victim->hi = mid;
+        pthread_mutex_unlock(&victim->lock);
+
+        /* La première tâche volée est exécutée tout de suite */
+        pthread_mutex_lock(&self->lock);
+        self->lo = mid + 1;
+        self->hi = hi;
+        pthread_mutex_unlock(&self->lock);
+        *index = mid;
+        return 1;
+    }
+    return 0;
+}
+
+static void work(ThreadPool *pool, Worker *self) {
+    size_t index;
+    in_pool = 1;
+    while (next_task(pool, self, &index))
+        pool->fn(pool->arg, index);
+    in_pool = 0;
+}
+
+static void *worker_main(void *data) {
+    Worker *self = data;
+    ThreadPool *pool = self->pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == seen && !pool->shutdown)
+            pthread_cond_wait(&pool->start_cond, &pool->lock);
+        if (pool->shutdown)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        work(pool, self);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool *pool_create(int nthreads) {
+    if (nthreads <= 0)
+        nthreads = pool_default_threads();
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (!pool)
+        return NULL;
+    pool->workers = calloc(nthreads, sizeof(Worker));
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+    pool->nthreads = nthreads;
+    pthread_mutex_init(&pool->run_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    for (int k = 0; k < nthreads; k++) {
+        pthread_mutex_init(&pool->workers[k].lock, NULL);
+        pool->workers[k].pool = pool;
+        pool->workers[k].id = k;
+    }
+    /* Le thread 0 est le thread qui appelle pool_run() */
+    for (int k = 1; k < nthreads; k++) {
+        if (pthread_create(&pool->workers[k].thread, NULL, worker_main, &pool->workers[k]) != 0) {
+            pool->nthreads = k;
+            break;
+        }
+    }
+    return pool;
+}
+
+void pool_destroy(ThreadPool *pool) {
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (int k = 1; k < pool->nthreads; k++)
+        pthread_join(pool->workers[k].thread, NULL);
+    for (int k = 0; k < pool->nthreads; k++)
+        pthread_mutex_destroy(&pool->workers[k].lock);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->run_lock);
+    free(pool->workers);
+    free(pool);
+}
+
+int pool_size(const ThreadPool *pool) {
+    return pool ? pool->nthreads : 1;
+}
+
+void pool_run(ThreadPool *pool, size_t ntasks, pool_task_fn fn, void *arg) {
+    if (ntasks == 0)
+        return;
+    if (!pool || pool->nthreads == 1 || ntasks == 1 || in_pool) {
+        for (size_t k = 0; k < ntasks; k++)
+            fn(arg, k);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->run_lock);
+    int n = pool->nthreads;
+    for (int k = 0; k < n; k++) {
+        pthread_mutex_lock(&pool->workers[k].lock);
+        pool->workers[k].lo = ntasks * k / n;
+        pool->workers[k].hi = ntasks * (k + 1) / n;
+        pthread_mutex_unlock(&pool->workers[k].lock);
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->active = n - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    work(pool, &pool->workers[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->active > 0)
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->run_lock);
+}
@@ -0,0 +1,27 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/* ============================= */
+/* Pool de threads à vol de tâches */
+/* pool_run() exécute fn(arg, k) pour k dans [0, ntasks). L'intervalle est
+   d'abord réparti équitablement entre les threads ; un thread qui a
+   épuisé sa part vole la moitié de la part restante d'un autre. Le thread
+   appelant participe au travail et pool_run() ne rend la main qu'une fois
+   toutes les tâches terminées. */
+/* ============================= */
+
+typedef struct ThreadPool ThreadPool;
+typedef void (*pool_task_fn)(void *arg, size_t index);
+
+/* nthreads <= 0 : un thread par cœur disponible */
+ThreadPool *pool_create(int nthreads);
+void pool_destroy(ThreadPool *pool);
+int pool_size(const ThreadPool *pool);
+int pool_default_threads(void);
+
+/* Un appel imbriqué (depuis une tâche du pool) s'exécute en séquentiel */
+void pool_run(ThreadPool *pool, size_t ntasks, pool_task_fn fn, void *arg);
+
+#endif
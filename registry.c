@@ -0,0 +1,388 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <complex.h>
+#include "calc.h"
+#include "calc_internal.h"
+
+/* ============================= */
+/* Registre des symboles         */
+/* Table de hachage à adressage ouvert (FNV-1a, sondage linéaire), au
+   plus à moitié pleine : une recherche coûte un hachage et en pratique
+   une seule comparaison de nom. Les entrées ne sont jamais déplacées ni
+   retirées ; un indice est publié dans la table seulement après que le
+   symbole est entièrement écrit, si bien que les recherches se font sans
+   verrou. */
+/* ============================= */
+
+#define MAX_SYMBOLS 256
+#define TABLE_SIZE (2 * MAX_SYMBOLS)
+
+static CalcSymbol symbols[MAX_SYMBOLS];
+static int nsymbols = 0;
+static _Atomic int table[TABLE_SIZE]; /* indice + 1, 0 = case vide */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t registry_once = PTHREAD_ONCE_INIT;
+
+static unsigned hash_name(const char *name, size_t len) {
+    unsigned h = 2166136261u;
+    for (size_t k = 0; k < len; k++) {
+        h ^= (unsigned char)name[k];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int find_slot(const char *name, size_t len, int *index) {
+    unsigned slot = hash_name(name, len) & (TABLE_SIZE - 1);
+    for (;;) {
+        int entry = atomic_load_explicit(&table[slot], memory_order_acquire);
+        if (entry == 0) {
+            *index = -1;
+            return slot;
+        }
+        const CalcSymbol *sym = &symbols[entry - 1];
+        if (strncmp(sym->name, name, len) == 0 && sym->name[len] == '\0') {
+            *index = entry - 1;
+            return slot;
+        }
+        slot = (slot + 1) & (TABLE_SIZE - 1);
+    }
+}
+
+static int valid_name(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0 || len >= CALC_MAX_NAME || !isalpha((unsigned char)name[0]))
+        return 0;
+    for (size_t k = 1; k < len; k++)
+        if (!isalnum((unsigned char)name[k]))
+            return 0;
+    return 1;
+}
+
+/* Ajoute un symbole ; l'appelant tient registry_lock */
+static CalcErrorCode add_symbol(const CalcSymbol *sym) {
+    int index;
+    size_t len = strlen(sym->name);
+    if (!valid_name(sym->name) || nsymbols == MAX_SYMBOLS)
+        return CALC_ERR_REGISTER;
+    int slot = find_slot(sym->name, len, &index);
+    if (index >= 0)
+        return CALC_ERR_REGISTER; /* déjà défini */
+    symbols[nsymbols] = *sym;
+    atomic_store_explicit(&table[slot], nsymbols + 1, memory_order_release);
+    nsymbols++;
+    return CALC_OK;
+}
+
+/* ============================= */
+/* Fonctions de base             */
+/* ============================= */
+
+static double complex fn_exp(const double complex *a, int n) { (void)n; return cexp(a[0]); }
+static double rfn_exp(const double *a, int n) { (void)n; return exp(a[0]); }
+static double complex fn_abs(const double complex *a, int n) { (void)n; return cabs(a[0]); }
+static double rfn_abs(const double *a, int n) { (void)n; return fabs(a[0]); }
+static double complex fn_sinh(const double complex *a, int n) { (void)n; return csinh(a[0]); }
+static double rfn_sinh(const double *a, int n) { (void)n; return sinh(a[0]); }
+static double complex fn_cosh(const double complex *a, int n) { (void)n; return ccosh(a[0]); }
+static double rfn_cosh(const double *a, int n) { (void)n; return cosh(a[0]); }
+static double complex fn_tanh(const double complex *a, int n) { (void)n; return ctanh(a[0]); }
+static double rfn_tanh(const double *a, int n) { (void)n; return tanh(a[0]); }
+
+/* atan2(y, x) : argument de x + iy ; prolongé aux complexes par
+   -i log((x + iy) / sqrt(x² + y²)) */
+static double complex fn_atan2(const double complex *a, int n) {
+    (void)n;
+    double complex y = a[0], x = a[1];
+    if (cimag(x) == 0 && cimag(y) == 0)
+        return atan2(creal(y), creal(x));
+    return -I * clog((x + I * y) / csqrt(x * x + y * y));
+}
+static double rfn_atan2(const double *a, int n) { (void)n; return atan2(a[0], a[1]); }
+
+/* min et max comparent les parties réelles */
+static double complex fn_min(const double complex *a, int n) {
+    double complex m = a[0];
+    for (int k = 1; k < n; k++)
+        if (creal(a[k]) < creal(m))
+            m = a[k];
+    return m;
+}
+static double rfn_min(const double *a, int n) {
+    double m = a[0];
+    for (int k = 1; k < n; k++)
+        if (a[k] < m)
+            m = a[k];
+    return m;
+}
+static double complex fn_max(const double complex *a, int n) {
+    double complex m = a[0];
+    for (int k = 1; k < n; k++)
+        if (creal(a[k]) > creal(m))
+            m = a[k];
+    return m;
+}
+static double rfn_max(const double *a, int n) {
+    double m = a[0];
+    for (int k = 1; k < n; k++)
+        if (a[k] > m)
+            m = a[k];
+    return m;
+}
+
+/* Dérivées, dans la direction d (voir dual.c) */
+static double complex dfn_exp(const double complex *a, const double complex *d, int n,
+                              double complex v) {
+    (void)a; (void)n;
+    return v * d[0];
+}
+
+/* |z| n'est pas holomorphe : dérivée Re(conj(z) dz) / |z|, réelle comme
+   |z|, et 0 en z = 0 */
+static double complex dfn_abs(const double complex *a, const double complex *d, int n,
+                              double complex v) {
+    (void)n;
+    return v == 0 ? 0 : creal(conj(a[0]) * d[0]) / creal(v);
+}
+
+static double complex dfn_sinh(const double complex *a, const double complex *d, int n,
+                               double complex v) {
+    (void)n; (void)v;
+    return ccosh(a[0]) * d[0];
+}
+
+static double complex dfn_cosh(const double complex *a, const double complex *d, int n,
+                               double complex v) {
+    (void)n; (void)v;
+    return csinh(a[0]) * d[0];
+}
+
+static double complex dfn_tanh(const double complex *a, const double complex *d, int n,
+                               double complex v) {
+    (void)a; (void)n;
+    return (1 - v * v) * d[0];
+}
+
+static double complex dfn_atan2(const double complex *a, const double complex *d, int n,
+                                double complex v) {
+    (void)n; (void)v;
+    double complex y = a[0], x = a[1];
+    return (x * d[0] - y * d[1]) / (x * x + y * y);
+}
+
+/* min et max : dérivée de l'argument retenu */
+static double complex dfn_min(const double complex *a, const double complex *d, int n,
+                              double complex v) {
+    (void)v;
+    int m = 0;
+    for (int k = 1; k < n; k++)
+        if (creal(a[k]) < creal(a[m]))
+            m = k;
+    return d[m];
+}
+
+static double complex dfn_max(const double complex *a, const double complex *d, int n,
+                              double complex v) {
+    (void)v;
+    int m = 0;
+    for (int k = 1; k < n; k++)
+        if (creal(a[k]) > creal(a[m]))
+            m = k;
+    return d[m];
+}
+
+/* Dérivées secondes croisées, dans les directions d0 et d1 */
+static double complex d2fn_exp(const double complex *a, const double complex *d0,
+                               const double complex *d1, int n, double complex v) {
+    (void)a; (void)n;
+    return v * d0[0] * d1[0];
+}
+
+/* Hessienne de |z| vu comme fonction de (Re z, Im z) : la projection
+   orthogonale à z, divisée par |z| */
+static double complex d2fn_abs(const double complex *a, const double complex *d0,
+                               const double complex *d1, int n, double complex v) {
+    (void)n;
+    if (v == 0)
+        return 0;
+    double r = creal(v), p0 = creal(conj(a[0]) * d0[0]), p1 = creal(conj(a[0]) * d1[0]);
+    return (creal(conj(d0[0]) * d1[0]) - p0 * p1 / (r * r)) / r;
+}
+
+/* sinh'' = sinh, cosh'' = cosh */
+static double complex d2fn_hyp(const double complex *a, const double complex *d0,
+                               const double complex *d1, int n, double complex v) {
+    (void)a; (void)n;
+    return v * d0[0] * d1[0];
+}
+
+static double complex d2fn_tanh(const double complex *a, const double complex *d0,
+                                const double complex *d1, int n, double complex v) {
+    (void)a; (void)n;
+    return -2 * v * (1 - v * v) * d0[0] * d1[0];
+}
+
+static double complex d2fn_atan2(const double complex *a, const double complex *d0,
+                                 const double complex *d1, int n, double complex v) {
+    (void)n; (void)v;
+    double complex y = a[0], x = a[1], r = x * x + y * y;
+    return (2 * x * y * (d0[1] * d1[1] - d0[0] * d1[0]) +
+            (y * y - x * x) * (d0[0] * d1[1] + d0[1] * d1[0])) / (r * r);
+}
+
+/* min et max sont affines par morceaux */
+static double complex d2fn_piecewise(const double complex *a, const double complex *d0,
+                                     const double complex *d1, int n, double complex v) {
+    (void)a; (void)d0; (void)d1; (void)n; (void)v;
+    return 0;
+}
+
+static void init_builtins(void) {
+    static const struct { const char *name; int op, nargs; } opcodes[] = {
+        { "log", OP_LOG, 1 }, { "ln", OP_LOG, 1 },
+        { "cos", OP_COS, 1 }, { "sin", OP_SIN, 1 }, { "tan", OP_TAN, 1 },
+        { "arccos", OP_ACOS, 1 }, { "arcsin", OP_ASIN, 1 }, { "arctan", OP_ATAN, 1 },
+        { "sqrt", OP_SQRT, 1 }, { "root", OP_ROOT, 2 }
+    };
+    /* nargs : arguments numériques, sans le corps ni la variable */
+    static const struct { const char *name; int op, nargs; } binders[] = {
+        { "integrate", OP_INTEGRATE, 2 }, { "solve", OP_SOLVE, 1 },
+        { "diff", OP_DIFF, 1 }, { "sum", OP_SUM, 2 }, { "prod", OP_PROD, 2 }
+    };
+    static const struct {
+        const char *name;
+        int min_args, max_args;
+        CalcFunc cfn;
+        CalcRealFunc rfn;
+        CalcDDFunc ddfn;
+        CalcDiffFunc dfn;
+        CalcDiff2Func d2fn;
+    } funcs[] = {
+        { "exp", 1, 1, fn_exp, rfn_exp, calc_ddfn_exp, dfn_exp, d2fn_exp },
+        { "abs", 1, 1, fn_abs, rfn_abs, calc_ddfn_abs, dfn_abs, d2fn_abs },
+        { "sinh", 1, 1, fn_sinh, rfn_sinh, calc_ddfn_sinh, dfn_sinh, d2fn_hyp },
+        { "cosh", 1, 1, fn_cosh, rfn_cosh, calc_ddfn_cosh, dfn_cosh, d2fn_hyp },
+        { "tanh", 1, 1, fn_tanh, rfn_tanh, calc_ddfn_tanh, dfn_tanh, d2fn_tanh },
+        { "atan2", 2, 2, fn_atan2, rfn_atan2, calc_ddfn_atan2, dfn_atan2, d2fn_atan2 },
+        { "min", 1, CALC_VARIADIC, fn_min, rfn_min, calc_ddfn_min, dfn_min, d2fn_piecewise },
+        { "max", 1, CALC_VARIADIC, fn_max, rfn_max, calc_ddfn_max, dfn_max, d2fn_piecewise }
+    };
+    CalcSymbol sym;
+
+    pthread_mutex_lock(&registry_lock);
+    for (size_t k = 0; k < sizeof(opcodes) / sizeof(opcodes[0]); k++) {
+        memset(&sym, 0, sizeof(sym));
+        strcpy(sym.name, opcodes[k].name);
+        sym.kind = SYM_OPCODE;
+        sym.pure = 1;
+        sym.op = opcodes[k].op;
+        sym.min_args = sym.max_args = opcodes[k].nargs;
+        add_symbol(&sym);
+    }
+    for (size_t k = 0; k < sizeof(binders) / sizeof(binders[0]); k++) {
+        memset(&sym, 0, sizeof(sym));
+        strcpy(sym.name, binders[k].name);
+        sym.kind = SYM_BINDER;
+        sym.pure = 1;
+        sym.op = binders[k].op;
+        sym.min_args = sym.max_args = binders[k].nargs;
+        add_symbol(&sym);
+    }
+    for (size_t k = 0; k < sizeof(funcs) / sizeof(funcs[0]); k++) {
+        memset(&sym, 0, sizeof(sym));
+        strcpy(sym.name, funcs[k].name);
+        sym.kind = SYM_FUNC;
+        sym.min_args = funcs[k].min_args;
+        sym.max_args = funcs[k].max_args;
+        sym.pure = 1;
+        sym.cfn = funcs[k].cfn;
+        sym.rfn = funcs[k].rfn;
+        sym.ddfn = funcs[k].ddfn;
+        sym.dfn = funcs[k].dfn;
+        sym.d2fn = funcs[k].d2fn;
+        add_symbol(&sym);
+    }
+    /* lo : suite de la valeur pour la précision double-double */
+    static const struct { const char *name; double complex value; double lo; } consts[] = {
+        { "pi", M_PI, 1.2246467991473532e-16 },
+        { "e", M_E, 1.4456468917292502e-16 },
+        { "i", I, 0 }
+    };
+    for (size_t k = 0; k < sizeof(consts) / sizeof(consts[0]); k++) {
+        memset(&sym, 0, sizeof(sym));
+        strcpy(sym.name, consts[k].name);
+        sym.kind = SYM_CONST;
+        sym.pure = 1;
+        sym.value = consts[k].value;
+        sym.lo = consts[k].lo;
+        add_symbol(&sym);
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+/* ============================= */
+/* API                           */
+/* ============================= */
+
+int calc_lookup(const char *name, size_t len) {
+    int index;
+    pthread_once(&registry_once, init_builtins);
+    if (len >= CALC_MAX_NAME)
+        return -1;
+    find_slot(name, len, &index);
+    return index;
+}
+
+const CalcSymbol *calc_symbol(int index) {
+    return &symbols[index];
+}
+
+int calc_symbol_count(void) {
+    pthread_mutex_lock(&registry_lock);
+    int n = nsymbols;
+    pthread_mutex_unlock(&registry_lock);
+    return n;
+}
+
+CalcErrorCode calc_register_function(const char *name, int min_args, int max_args,
+                                     CalcFunc fn, CalcRealFunc rfn) {
+    CalcSymbol sym;
+    if (!name || !fn || min_args < 0 ||
+        (max_args != CALC_VARIADIC && max_args < min_args) ||
+        (max_args == CALC_VARIADIC && min_args > 0xffff) || max_args > 0xffff)
+        return CALC_ERR_REGISTER;
+    if (!valid_name(name))
+        return CALC_ERR_REGISTER;
+    memset(&sym, 0, sizeof(sym));
+    strcpy(sym.name, name);
+    sym.kind = SYM_FUNC;
+    sym.min_args = min_args;
+    sym.max_args = max_args;
+    sym.cfn = fn;
+    sym.rfn = rfn;
+
+    pthread_once(&registry_once, init_builtins);
+    pthread_mutex_lock(&registry_lock);
+    CalcErrorCode code = add_symbol(&sym);
+    pthread_mutex_unlock(&registry_lock);
+    return code;
+}
+
+CalcErrorCode calc_register_constant(const char *name, double complex value) {
+    CalcSymbol sym;
+    if (!name || !valid_name(name))
+        return CALC_ERR_REGISTER;
+    memset(&sym, 0, sizeof(sym));
+    strcpy(sym.name, name);
+    sym.kind = SYM_CONST;
+    sym.value = value;
+
+    pthread_once(&registry_once, init_builtins);
+    pthread_mutex_lock(&registry_lock);
+    CalcErrorCode code = add_symbol(&sym);
+    pthread_mutex_unlock(&registry_lock);
+    return code;
+}
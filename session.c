@@ -0,0 +1,347 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include <stdatomic.h>
+#include "calc.h"
+#include "calc_internal.h"
+
+/* ============================= */
+/* Partie Session                */
+/* Points de reprise : à certains débuts d'opérande, on sauvegarde l'état
+   du parseur (position, piles, taille du code émis) puis, lors de
+   l'exécution, le contenu de la pile de la machine après le code émis
+   jusque-là. Le code d'un préfixe ne dépend que du texte lu jusqu'à ce
+   point (caractère courant compris) : un point de reprise reste valable
+   tant que ce préfixe n'a pas changé. */
+/* ============================= */
+
+/* Écart minimal (en octets de texte) entre deux points de reprise. Il
+   croît avec la taille des piles à recopier, pour que le coût total des
+   sauvegardes reste linéaire même pour des imbrications profondes. */
+#define SESSION_GAP 64
+
+enum { SNAP_NONE, SNAP_VALID, SNAP_PROMOTED };
+
+typedef struct {
+    size_t src_off;
+    int code_len, nconsts, depth, max_depth;
+    int nsubs;               /* corps compilés (opérateurs à variable liée) */
+    int ncomplex;            /* instructions OP_CCONST dans le code émis */
+    int nops, ngroups;
+    PendingOp *ops;
+    OpenGroup *groups;
+    int real_state;          /* pile réelle : SNAP_* */
+    double *rvals;
+    int complex_state;       /* pile complexe : SNAP_NONE ou SNAP_VALID */
+    double complex *cvals;
+} Checkpoint;
+
+struct CalcSession {
+    CalcContext *ctx;
+    char *src;               /* dernier texte analysé */
+    size_t len, cap;
+    Checkpoint *cps;
+    int ncps, cps_cap;
+    double *rstack;
+    int rstack_cap;
+    double complex *cstack;
+    int cstack_cap;
+    atomic_int cancel;
+    atomic_int progress;     /* somme ou produit en cours (calculus.c) */
+};
+
+static void drop_checkpoint(Checkpoint *cp) {
+    free(cp->ops);
+    free(cp->groups);
+    free(cp->rvals);
+    free(cp->cvals);
+}
+
+CalcSession *calc_session_new(void) {
+    CalcSession *s = calloc(1, sizeof(CalcSession));
+    if (!s)
+        return NULL;
+    s->ctx = calc_context_new();
+    if (!s->ctx) {
+        free(s);
+        return NULL;
+    }
+    /* Le code émis doit rester le simple reflet du texte */
+    calc_set_option(s->ctx, CALC_OPTION_OPTIMIZE, 0);
+    atomic_init(&s->cancel, 0);
+    atomic_init(&s->progress, -1);
+    s->ctx->cancel = &s->cancel;
+    s->ctx->progress = &s->progress;
+    return s;
+}
+
+void calc_session_free(CalcSession *s) {
+    if (!s)
+        return;
+    for (int k = 0; k < s->ncps; k++)
+        drop_checkpoint(&s->cps[k]);
+    free(s->cps);
+    free(s->src);
+    free(s->rstack);
+    free(s->cstack);
+    calc_context_free(s->ctx);
+    free(s);
+}
+
+const CalcError *calc_session_error(const CalcSession *s) {
+    return calc_last_error(s->ctx);
+}
+
+void calc_session_cancel(CalcSession *s) {
+    atomic_store(&s->cancel, 1);
+}
+
+int calc_session_progress(const CalcSession *s) {
+    return atomic_load(&s->progress);
+}
+
+/* Lit (et consomme) une demande d'interruption */
+static int cancelled(CalcSession *s) {
+    return atomic_exchange(&s->cancel, 0) != 0;
+}
+
+void calc_session_checkpoint(CalcContext *ctx) {
+    Parser *p = &ctx->p;
+    CodeBuf *out = &p->out;
+    CalcSession *s = p->session;
+    size_t off = p->cur - p->src;
+    const Checkpoint *last = s->ncps ? &s->cps[s->ncps - 1] : NULL;
+    size_t gap = SESSION_GAP + p->nops + p->ngroups + out->depth;
+    /* Dans le corps d'un opérateur à variable liée, le code va dans un
+       programme à part, que la reprise ne sait pas reconstituer */
+    if (p->nbodies || off < (last ? last->src_off : 0) + gap)
+        return;
+    if (cancelled(s)) {
+        calc_set_error(ctx, CALC_ERR_CANCELLED, off);
+        return;
+    }
+    if (s->ncps == s->cps_cap) {
+        int cap = s->cps_cap ? s->cps_cap * 2 : 16;
+        Checkpoint *cps = realloc(s->cps, cap * sizeof(Checkpoint));
+        if (!cps)
+            return; /* pas de point de reprise : seulement moins rapide */
+        s->cps = cps;
+        s->cps_cap = cap;
+        last = s->ncps ? &s->cps[s->ncps - 1] : NULL;
+    }
+    Checkpoint *cp = &s->cps[s->ncps];
+    memset(cp, 0, sizeof(*cp));
+    cp->ops = malloc((p->nops ? p->nops : 1) * sizeof(PendingOp));
+    cp->groups = malloc((p->ngroups ? p->ngroups : 1) * sizeof(OpenGroup));
+    if (!cp->ops || !cp->groups) {
+        drop_checkpoint(cp);
+        return;
+    }
+    memcpy(cp->ops, p->ops, p->nops * sizeof(PendingOp));
+    memcpy(cp->groups, p->groups, p->ngroups * sizeof(OpenGroup));
+    cp->nops = p->nops;
+    cp->ngroups = p->ngroups;
+    cp->src_off = off;
+    cp->code_len = out->len;
+    cp->nconsts = out->nconsts;
+    cp->depth = out->depth;
+    cp->max_depth = out->max_depth;
+    cp->nsubs = out->nsubs;
+    cp->ncomplex = last ? last->ncomplex : 0;
+    for (int k = last ? last->code_len : 0; k < out->len; k++)
+        if (out->code[k].op == OP_CCONST)
+            cp->ncomplex++;
+    s->ncps++;
+}
+
+/* Reprend l'analyse au dernier point de reprise encore valable */
+static void parse(CalcSession *s) {
+    CalcContext *ctx = s->ctx;
+    Parser *p = &ctx->p;
+    CodeBuf *out = &p->out;
+    p->src = s->src;
+    if (s->ncps == 0) {
+        p->cur = s->src;
+        p->nops = p->ngroups = 0;
+        out->len = out->nconsts = 0;
+        out->depth = out->max_depth = out->nregs = 0;
+        calc_drop_subs(out, 0);
+    } else {
+        /* Les piles du parseur ont déjà contenu au moins autant d'éléments */
+        const Checkpoint *cp = &s->cps[s->ncps - 1];
+        p->cur = s->src + cp->src_off;
+        memcpy(p->ops, cp->ops, cp->nops * sizeof(PendingOp));
+        memcpy(p->groups, cp->groups, cp->ngroups * sizeof(OpenGroup));
+        p->nops = cp->nops;
+        p->ngroups = cp->ngroups;
+        out->len = cp->code_len;
+        out->nconsts = cp->nconsts;
+        out->depth = cp->depth;
+        out->max_depth = cp->max_depth;
+        out->nregs = 0;
+        calc_drop_subs(out, cp->nsubs);
+    }
+    p->session = s;
+    calc_parse_from(ctx);
+    p->session = NULL;
+}
+
+/* Exécution réelle depuis la dernière pile sauvegardée ; renvoie
+   RUN_PROMOTE si le calcul doit passer en complexe */
+static int run_real(CalcSession *s, const CalcProgram *prog, double *result) {
+    CalcContext *ctx = s->ctx;
+    int k = s->ncps - 1;
+    while (k >= 0 && s->cps[k].real_state == SNAP_NONE)
+        k--;
+    if (k >= 0 && s->cps[k].real_state == SNAP_PROMOTED)
+        return RUN_PROMOTE;
+    int from = 0, depth = 0;
+    if (k >= 0) {
+        from = s->cps[k].code_len;
+        depth = s->cps[k].depth;
+        memcpy(s->rstack, s->cps[k].rvals, depth * sizeof(double));
+    }
+    for (k++; k < s->ncps; k++) {
+        Checkpoint *cp = &s->cps[k];
+        if (cancelled(s)) {
+            calc_set_error(ctx, CALC_ERR_CANCELLED, cp->src_off);
+            return CALC_ERR_CANCELLED;
+        }
+        int code = calc_exec_real(ctx, prog, from, cp->code_len, s->rstack, &depth);
+        if (code == RUN_PROMOTE)
+            cp->real_state = SNAP_PROMOTED;
+        if (code != CALC_OK)
+            return code;
+        cp->rvals = malloc((depth ? depth : 1) * sizeof(double));
+        if (cp->rvals) {
+            memcpy(cp->rvals, s->rstack, depth * sizeof(double));
+            cp->real_state = SNAP_VALID;
+        }
+        from = cp->code_len;
+    }
+    int code = calc_exec_real(ctx, prog, from, prog->len, s->rstack, &depth);
+    if (code != CALC_OK)
+        return code;
+    /* comme calc_run() : les infinis passent par le chemin complexe */
+    if (!isfinite(s->rstack[depth - 1]))
+        return RUN_PROMOTE;
+    *result = s->rstack[depth - 1];
+    return CALC_OK;
+}
+
+static CalcErrorCode run_complex(CalcSession *s, const CalcProgram *prog, double complex *result) {
+    CalcContext *ctx = s->ctx;
+    int k = s->ncps - 1;
+    while (k >= 0 && s->cps[k].complex_state == SNAP_NONE)
+        k--;
+    int from = 0, depth = 0;
+    if (k >= 0) {
+        from = s->cps[k].code_len;
+        depth = s->cps[k].depth;
+        memcpy(s->cstack, s->cps[k].cvals, depth * sizeof(double complex));
+    }
+    for (k++; k < s->ncps; k++) {
+        Checkpoint *cp = &s->cps[k];
+        if (cancelled(s)) {
+            calc_set_error(ctx, CALC_ERR_CANCELLED, cp->src_off);
+            return CALC_ERR_CANCELLED;
+        }
+        CalcErrorCode code = calc_exec_complex(ctx, prog, from, cp->code_len, s->cstack, &depth);
+        if (code != CALC_OK)
+            return code;
+        cp->cvals = malloc((depth ? depth : 1) * sizeof(double complex));
+        if (cp->cvals) {
+            memcpy(cp->cvals, s->cstack, depth * sizeof(double complex));
+            cp->complex_state = SNAP_VALID;
+        }
+        from = cp->code_len;
+    }
+    CalcErrorCode code = calc_exec_complex(ctx, prog, from, prog->len, s->cstack, &depth);
+    if (code == CALC_OK)
+        *result = s->cstack[depth - 1];
+    return code;
+}
+
+CalcErrorCode calc_session_eval(CalcSession *s, const char *src, double complex *result) {
+    CalcContext *ctx = s->ctx;
+    memset(&ctx->err, 0, sizeof(ctx->err));
+
+    /* Les points de reprise qui ont lu un caractère modifié sont perdus */
+    size_t len = strlen(src), common = 0;
+    size_t max = len < s->len ? len : s->len;
+    while (common + 64 <= max && memcmp(src + common, s->src + common, 64) == 0)
+        common += 64;
+    while (common < max && src[common] == s->src[common])
+        common++;
+    while (s->ncps > 0 && s->cps[s->ncps - 1].src_off >= common)
+        drop_checkpoint(&s->cps[--s->ncps]);
+    if (len + 1 > s->cap) {
+        char *buf = realloc(s->src, len + 1);
+        if (!buf) {
+            calc_set_error(ctx, CALC_ERR_NOMEM, 0);
+            return CALC_ERR_NOMEM;
+        }
+        s->src = buf;
+        s->cap = len + 1;
+    }
+    memcpy(s->src + common, src + common, len - common + 1);
+    s->len = len;
+
+    parse(s);
+    if (ctx->err.code != CALC_OK)
+        return ctx->err.code;
+
+    CodeBuf *out = &ctx->p.out;
+    if (out->max_depth > s->rstack_cap) {
+        double *r = realloc(s->rstack, out->max_depth * sizeof(double));
+        if (r) {
+            s->rstack = r;
+            s->rstack_cap = out->max_depth;
+        }
+        double complex *c = realloc(s->cstack, out->max_depth * sizeof(double complex));
+        if (c) {
+            s->cstack = c;
+            s->cstack_cap = out->max_depth;
+        }
+        if (!r || !c) {
+            calc_set_error(ctx, CALC_ERR_NOMEM, 0);
+            return CALC_ERR_NOMEM;
+        }
+    }
+    /* Le programme est lu directement dans le tampon de génération */
+    CalcProgram prog;
+    memset(&prog, 0, sizeof(prog));
+    prog.len = out->len;
+    prog.nconsts = out->nconsts;
+    prog.max_depth = out->max_depth;
+    prog.code = out->code;
+    prog.consts = out->consts;
+    prog.rconsts = out->rconsts;
+    prog.pos = out->pos;
+    prog.subs = out->subs;
+    prog.nsubs = out->nsubs;
+    int ncomplex = s->ncps ? s->cps[s->ncps - 1].ncomplex : 0;
+    for (int k = s->ncps ? s->cps[s->ncps - 1].code_len : 0; k < out->len; k++)
+        if (out->code[k].op == OP_CCONST)
+            ncomplex++;
+    prog.real_only = ncomplex == 0;
+
+    /* Mémo des opérateurs à variable liée, comme calc_exec_program() */
+    ctx->memo_on = 1;
+    ctx->nmemo = 0;
+    if (prog.real_only) {
+        double res;
+        int code = run_real(s, &prog, &res);
+        if (code != RUN_PROMOTE) {
+            ctx->memo_on = 0;
+            if (code == CALC_OK)
+                *result = res;
+            return code;
+        }
+        memset(&ctx->err, 0, sizeof(ctx->err));
+    }
+    CalcErrorCode code = run_complex(s, &prog, result);
+    ctx->memo_on = 0;
+    return code;
+}
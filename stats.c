@@ -0,0 +1,231 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "calc.h"
+#include "calc_internal.h"
+#include "calc_stats.h"
+
+/* ============================= */
+/* Partie Statistiques           */
+/* Les compteurs vivent dans chaque contexte (StatsBlock) ; les contextes
+   vivants sont chaînés pour calc_stats_collect(), et les compteurs d'un
+   contexte libéré sont ajoutés aux totaux « retirés ». Seul le verrou
+   de la liste est pris, à la création et à la libération d'un contexte
+   et pendant une collecte. */
+/* ============================= */
+
+atomic_int calc_stats_on = 1;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static StatsBlock *live = NULL;
+static CalcStats retired;
+
+/* Emplacements des fonctions compilées en une instruction dédiée ; les
+   fonctions appelées par OP_CALL suivent, par indice de symbole, et le
+   dernier emplacement regroupe celles qui ne tiennent pas */
+enum {
+    STAT_POW, STAT_FACT, STAT_LOG, STAT_COS, STAT_SIN, STAT_TAN,
+    STAT_ACOS, STAT_ASIN, STAT_ATAN, STAT_SQRT, STAT_ROOT, STAT_POWI,
+    STAT_CALL
+};
+
+static const char *const op_names[STAT_CALL] = {
+    "^ (cpow)", "! (table, tgamma)", "log (clog)", "cos (ccos)", "sin (csin)", "tan (ctan)",
+    "arccos (cacos)", "arcsin (casin)", "arctan (catan)", "sqrt (csqrt)", "root (cpow)",
+    "^n (puissance entière)"
+};
+
+int calc_stats_slot(const Instr *ins) {
+    switch (ins->op) {
+    case OP_POW: return STAT_POW;
+    case OP_FACT: return STAT_FACT;
+    case OP_LOG: return STAT_LOG;
+    case OP_COS: return STAT_COS;
+    case OP_SIN: return STAT_SIN;
+    case OP_TAN: return STAT_TAN;
+    case OP_ACOS: return STAT_ACOS;
+    case OP_ASIN: return STAT_ASIN;
+    case OP_ATAN: return STAT_ATAN;
+    case OP_SQRT: return STAT_SQRT;
+    case OP_ROOT: return STAT_ROOT;
+    case OP_POWI: return STAT_POWI;
+    case OP_CALL:
+        if (ins->arg < CALC_STATS_FUNCS - 1 - STAT_CALL)
+            return STAT_CALL + ins->arg;
+        return CALC_STATS_FUNCS - 1;
+    default:
+        return -1;
+    }
+}
+
+const char *calc_stats_func_name(int k) {
+    if (k < 0 || k >= CALC_STATS_FUNCS)
+        return NULL;
+    if (k < STAT_CALL)
+        return op_names[k];
+    if (k == CALC_STATS_FUNCS - 1)
+        return "autres fonctions";
+    if (k - STAT_CALL >= calc_symbol_count())
+        return NULL;
+    const CalcSymbol *sym = calc_symbol(k - STAT_CALL);
+    return sym->kind == SYM_FUNC ? sym->name : NULL;
+}
+
+unsigned long long calc_stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void calc_stats_latency(StatsBlock *st, unsigned long long ns) {
+    int k = 0;
+    while (k < CALC_STATS_HIST - 1 && ns >> (k + 1))
+        k++;
+    STAT_ADD(st->latency[k], 1);
+}
+
+void calc_stats_attach(StatsBlock *st) {
+    pthread_mutex_lock(&stats_lock);
+    st->prev = NULL;
+    st->next = live;
+    if (live)
+        live->prev = st;
+    live = st;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+#define LOAD(c) atomic_load_explicit(&(c), memory_order_relaxed)
+
+/* Ajoute les compteurs d'un contexte ; l'appelant tient stats_lock */
+static void add_block(CalcStats *sum, StatsBlock *st) {
+    sum->compiles += LOAD(st->compiles);
+    sum->sampled_compiles += LOAD(st->sampled_compiles);
+    sum->compile_ns += LOAD(st->compile_ns);
+    sum->runs += LOAD(st->runs);
+    sum->sampled_runs += LOAD(st->sampled_runs);
+    sum->run_ns += LOAD(st->run_ns);
+    for (int k = 0; k < CALC_ERR_COUNT; k++)
+        sum->errors[k] += LOAD(st->errors[k]);
+    for (int k = 0; k < CALC_STATS_HIST; k++)
+        sum->latency[k] += LOAD(st->latency[k]);
+    for (int k = 0; k < CALC_STATS_FUNCS; k++) {
+        sum->funcs[k].calls += LOAD(st->funcs[k].calls);
+        sum->funcs[k].sampled += LOAD(st->funcs[k].sampled);
+        sum->funcs[k].sampled_ns += LOAD(st->funcs[k].sampled_ns);
+    }
+}
+
+void calc_stats_detach(StatsBlock *st) {
+    pthread_mutex_lock(&stats_lock);
+    add_block(&retired, st);
+    if (st->prev)
+        st->prev->next = st->next;
+    else
+        live = st->next;
+    if (st->next)
+        st->next->prev = st->prev;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+void calc_stats_enable(int on) {
+    atomic_store_explicit(&calc_stats_on, on != 0, memory_order_relaxed);
+}
+
+void calc_stats_collect(CalcStats *stats) {
+    pthread_mutex_lock(&stats_lock);
+    *stats = retired;
+    for (StatsBlock *st = live; st; st = st->next)
+        add_block(stats, st);
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/* Remet à zéro en retranchant l'état actuel : les contextes vivants
+   continuent d'écrire leurs propres compteurs sans verrou */
+void calc_stats_reset(void) {
+    CalcStats now;
+    calc_stats_collect(&now);
+    pthread_mutex_lock(&stats_lock);
+    unsigned long long *r = (unsigned long long *)&retired;
+    const unsigned long long *n = (const unsigned long long *)&now;
+    for (size_t k = 0; k < sizeof(CalcStats) / sizeof(unsigned long long); k++)
+        r[k] -= n[k];
+    pthread_mutex_unlock(&stats_lock);
+}
+
+/* Borne supérieure de la classe de l'histogramme qui contient le
+   quantile q (en ns) */
+static unsigned long long quantile(const CalcStats *st, double q) {
+    unsigned long long total = 0, seen = 0;
+    for (int k = 0; k < CALC_STATS_HIST; k++)
+        total += st->latency[k];
+    if (total == 0)
+        return 0;
+    for (int k = 0; k < CALC_STATS_HIST; k++) {
+        seen += st->latency[k];
+        if (seen >= q * total)
+            return 2ull << k;
+    }
+    return 2ull << (CALC_STATS_HIST - 1);
+}
+
+/* Durée totale estimée des appels de la fonction k, en ns */
+static double func_time(const CalcFuncStats *f) {
+    return f->sampled ? (double)f->sampled_ns * f->calls / f->sampled : 0;
+}
+
+#define APPEND(...)                                                   \
+    do {                                                              \
+        int n_ = snprintf(buf + (len < size ? len : size),            \
+                          len < size ? size - len : 0, __VA_ARGS__);  \
+        if (n_ > 0)                                                   \
+            len += n_;                                                \
+    } while (0)
+
+int calc_stats_format(const CalcStats *st, int max_funcs, char *buf, size_t size) {
+    size_t len = 0;
+    if (size > 0)
+        buf[0] = '\0';
+    APPEND("Compilations : %llu, analyse %.0f ns en moyenne\n", st->compiles,
+           st->sampled_compiles ? (double)st->compile_ns / st->sampled_compiles : 0.0);
+    APPEND("Exécutions : %llu, %.0f ns en moyenne\n", st->runs,
+           st->sampled_runs ? (double)st->run_ns / st->sampled_runs : 0.0);
+    APPEND("Latence (calc_eval) : p50 < %llu ns, p99 < %llu ns, max < %llu ns\n",
+           quantile(st, 0.5), quantile(st, 0.99), quantile(st, 1.0));
+
+    unsigned long long nerr = 0;
+    for (int k = 1; k < CALC_ERR_COUNT; k++)
+        nerr += st->errors[k];
+    APPEND("Erreurs : %llu", nerr);
+    for (int k = 1; k < CALC_ERR_COUNT; k++)
+        if (st->errors[k])
+            APPEND(", %s %llu", calc_strerror(k), st->errors[k]);
+    APPEND("\n");
+
+    /* Fonctions par durée totale décroissante (sélection simple : il y a
+       peu d'emplacements) */
+    int done[CALC_STATS_FUNCS] = { 0 };
+    for (int shown = 0; shown < max_funcs; shown++) {
+        int best = -1;
+        for (int k = 0; k < CALC_STATS_FUNCS; k++) {
+            if (done[k] || st->funcs[k].calls == 0)
+                continue;
+            if (best < 0 || func_time(&st->funcs[k]) > func_time(&st->funcs[best]))
+                best = k;
+        }
+        if (best < 0)
+            break;
+        done[best] = 1;
+        const CalcFuncStats *f = &st->funcs[best];
+        const char *name = calc_stats_func_name(best);
+        APPEND("  %-24s %12llu appels", name ? name : "?", f->calls);
+        if (f->sampled)
+            APPEND(", %10.3f ms (%.0f ns/appel)", func_time(f) / 1e6,
+                   (double)f->sampled_ns / f->sampled);
+        APPEND("\n");
+    }
+    return (int)len;
+}
@@ -0,0 +1,27 @@
+#include <stdlib.h>
+#include <string.h>
+#include "strbuf.h"
+
+#define STRBUF_INITIAL 256
+
+int strbuf_reserve(StrBuf *sb, size_t extra) {
+    if (sb->len + extra <= sb->cap)
+        return 0;
+    size_t cap = sb->cap ? sb->cap : STRBUF_INITIAL;
+    while (cap < sb->len + extra)
+        cap *= 2;
+    char *data = realloc(sb->data, cap);
+    if (!data)
+        return -1;
+    sb->data = data;
+    sb->cap = cap;
+    return 0;
+}
+
+int strbuf_append(StrBuf *sb, const char *s, size_t len) {
+    if (strbuf_reserve(sb, len) < 0)
+        return -1;
+    memcpy(sb->data + sb->len, s, len);
+    sb->len += len;
+    return 0;
+}
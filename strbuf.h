@@ -0,0 +1,20 @@
+#ifndef STRBUF_H
+#define STRBUF_H
+
+#include <stddef.h>
+
+/* Tampon de caractères extensible, partagé par le mode batch, le mode
+   colonnes et le démon. Un tampon à zéro est vide et prêt à l'emploi ;
+   sa capacité double au besoin. */
+typedef struct {
+    char *data;
+    size_t len, cap;
+} StrBuf;
+
+/* Place pour extra octets de plus ; -1 si la mémoire manque (le tampon
+   est alors inchangé) */
+int strbuf_reserve(StrBuf *sb, size_t extra);
+/* Ajoute len octets ; -1 si la mémoire manque */
+int strbuf_append(StrBuf *sb, const char *s, size_t len);
+
+#endif
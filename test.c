@@ -0,0 +1,1055 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "calc.h"
+#include "calc_cache.h"
+#include "calc_internal.h"
+#include "editbuf.h"
+
+/* ============================= */
+/* Tests (make test)             */
+/* Chaque partie compare des chemins d'évaluation qui doivent donner le
+   même résultat ; les écarts sont écrits sur stderr et le programme rend
+   1 s'il y en a. */
+/* ============================= */
+
+static int failures = 0;
+static const char *const var_names[] = { "a", "b" };
+
+/* Mêmes composantes : signe des zéros et des infinis, NaN ; les valeurs
+   finies peuvent différer du dernier bit (x^n par produits) */
+static int same_part(double x, double y) {
+    if (isnan(x) || isnan(y))
+        return isnan(x) && isnan(y);
+    if (signbit(x) != signbit(y))
+        return 0;
+    if (isinf(x) || isinf(y))
+        return x == y;
+    return fabs(x - y) <= 1e-12 * fmax(1, fmax(fabs(x), fabs(y)));
+}
+
+static void report(const char *part, const char *src, const double complex *vals,
+                   CalcErrorCode ca, double complex a, CalcErrorCode cb, double complex b) {
+    fprintf(stderr, "%s : %s, a = %g, b = %g : ", part, src, creal(vals[0]), creal(vals[1]));
+    if (ca != CALC_OK || cb != CALC_OK)
+        fprintf(stderr, "erreur %d au lieu de %d\n", ca, cb);
+    else
+        fprintf(stderr, "%.17g%+.17gi au lieu de %.17g%+.17gi\n", creal(a), cimag(a), creal(b), cimag(b));
+    failures++;
+}
+
+/* ============================= */
+/* Chemin réel                   */
+/* ============================= */
+
+/* Le chemin réel (interpréteur, code natif, colonnes) doit afficher les
+   zéros avec le signe que leur donne le calcul complexe */
+static const struct {
+    const char *src;
+    double a;
+    const char *want;   /* calc_format_result() */
+} real_cases[] = {
+    { "-a x 0", 1, "0" },
+    { "0/pi x -a", 1, "0" },
+    { "0 x tan(-a%) x 1", 2.5, "0" },
+    { "-a//[sqrt(2)]/100 x 1//10", 1, "0" },
+    { "sqrt(-a)", 0, "0" },
+    { "-(log(a) x -1)", 1, "-0" },
+    { "(-a)^2001", 0.5, "-0" },
+    { "a^2000 x -1", 0.5, "0" },
+    { "-a/3 + 0 x -1", 0, "0" },
+    { "a x -0.5", 0, "0" },
+    { "ln(a - 1) x -2", 2, "0" },
+    { "2^a x -1", 10, "-1024" },
+    { "-a x 0 + 1/a", 4, "0.25" },
+};
+
+static void check_real(const char *part, const char *src, double complex res, const char *want) {
+    char buf[64];
+    calc_format_result(res, buf, sizeof(buf));
+    if (strcmp(buf, want) != 0) {
+        fprintf(stderr, "chemin réel (%s) : %s donne %s au lieu de %s\n", part, src, buf, want);
+        failures++;
+    }
+}
+
+static void test_real(void) {
+    CalcContext *ctx = calc_context_new(), *interp = calc_context_new();
+    calc_set_option(interp, CALC_OPTION_JIT, 0);
+    for (size_t k = 0; k < sizeof(real_cases) / sizeof(*real_cases); k++) {
+        const char *src = real_cases[k].src;
+        CalcProgram *pa = calc_compile_vars(ctx, src, var_names, 2);
+        CalcProgram *pb = calc_compile_vars(interp, src, var_names, 2);
+        if (!pa || !pb) {
+            fprintf(stderr, "chemin réel : %s ne compile pas\n", src);
+            failures++;
+            calc_program_free(pa);
+            calc_program_free(pb);
+            continue;
+        }
+        double complex vals[2] = { real_cases[k].a, 0 }, res = 0;
+        calc_run_vars(interp, pb, vals, &res);
+        check_real("interpréteur", src, res, real_cases[k].want);
+        for (int n = 0; n <= CALC_JIT_THRESHOLD; n++)
+            calc_run_vars(ctx, pa, vals, &res);
+        check_real("code natif", src, res, real_cases[k].want);
+        double a = real_cases[k].a, b = 0, re, im;
+        const double *cols[2] = { &a, &b };
+        calc_run_columns(ctx, pa, cols, 1, &re, &im, NULL);
+        check_real("colonnes", src, CMPLX(re, im), real_cases[k].want);
+        calc_program_free(pa);
+        calc_program_free(pb);
+    }
+    calc_context_free(ctx);
+    calc_context_free(interp);
+}
+
+/* ============================= */
+/* Registre                      */
+/* ============================= */
+
+static double complex fn_moyenne(const double complex *a, int n) {
+    double complex s = 0;
+    for (int k = 0; k < n; k++)
+        s += a[k];
+    return s / n;
+}
+
+static double complex fn_hyp(const double complex *a, int n) {
+    (void)n;
+    return csqrt(a[0] * a[0] + a[1] * a[1]);
+}
+
+static double rfn_hyp(const double *a, int n) {
+    (void)n;
+    return hypot(a[0], a[1]);
+}
+
+/* Arité vérifiée à la compilation, pour les fonctions de base comme
+   pour les fonctions externes, à nombre d'arguments fixe ou variable */
+static const struct {
+    const char *src;
+    CalcErrorCode code;
+    double value;
+} registry_cases[] = {
+    { "moyenne(1, 2, 3, 6)", CALC_OK, 3 },
+    { "moyenne(4)", CALC_OK, 4 },
+    { "moyenne()", CALC_ERR_ARITY, 0 },
+    { "hyp(3, 4) + hyp(5, 12)", CALC_OK, 18 },
+    { "hyp(3)", CALC_ERR_ARITY, 0 },
+    { "hyp(3, 4, 5)", CALC_ERR_ARITY, 0 },
+    { "max(1, 7, 3, -2) - min(4)", CALC_OK, 3 },
+    { "max()", CALC_ERR_ARITY, 0 },
+    { "atan2(1)", CALC_ERR_ARITY, 0 },
+    { "root(8)", CALC_ERR_ARITY, 0 },
+    { "sin(1, 2)", CALC_ERR_ARITY, 0 },
+    { "foo(1)", CALC_ERR_UNKNOWN_FUNC, 0 },
+    { "gravite x 2", CALC_OK, 19.62 },
+    { "gravite2", CALC_ERR_UNKNOWN_IDENT, 0 },
+};
+
+static void expect_register(CalcErrorCode got, CalcErrorCode want, const char *what) {
+    if (got != want) {
+        fprintf(stderr, "registre : %s : erreur %d au lieu de %d\n", what, got, want);
+        failures++;
+    }
+}
+
+static void test_registry(void) {
+    expect_register(calc_register_function("moyenne", 1, CALC_VARIADIC, fn_moyenne, NULL),
+                    CALC_OK, "moyenne");
+    expect_register(calc_register_function("hyp", 2, 2, fn_hyp, rfn_hyp), CALC_OK, "hyp");
+    expect_register(calc_register_constant("gravite", 9.81), CALC_OK, "gravite");
+    expect_register(calc_register_function("moyenne", 1, 1, fn_moyenne, NULL),
+                    CALC_ERR_REGISTER, "nom déjà pris");
+    expect_register(calc_register_function("sin", 1, 1, fn_moyenne, NULL),
+                    CALC_ERR_REGISTER, "fonction de base");
+    expect_register(calc_register_constant("pi", 3), CALC_ERR_REGISTER, "constante de base");
+    expect_register(calc_register_function("f2x", 3, 2, fn_moyenne, NULL),
+                    CALC_ERR_REGISTER, "min_args > max_args");
+    expect_register(calc_register_function("2f", 1, 1, fn_moyenne, NULL),
+                    CALC_ERR_REGISTER, "nom invalide");
+    expect_register(calc_register_constant("abcdefghijklmnopqrstuvwxyzabcdef", 1),
+                    CALC_ERR_REGISTER, "nom trop long");
+
+    CalcContext *ctx = calc_context_new();
+    for (size_t k = 0; k < sizeof(registry_cases) / sizeof(*registry_cases); k++) {
+        double complex res = 0;
+        CalcErrorCode code = calc_eval(ctx, registry_cases[k].src, &res);
+        if (code != registry_cases[k].code ||
+            (code == CALC_OK && res != registry_cases[k].value)) {
+            fprintf(stderr, "registre : %s donne %.17g (erreur %d) au lieu de %.17g (erreur %d)\n",
+                    registry_cases[k].src, creal(res), code, registry_cases[k].value,
+                    registry_cases[k].code);
+            failures++;
+        }
+    }
+    calc_context_free(ctx);
+}
+
+/* ============================= */
+/* Optimiseur                    */
+/* ============================= */
+
+/* Les réécritures de opt.c ne doivent changer ni les erreurs ni le côté
+   des coupures de arccos, sqrt et log (zéros signés, NaN) */
+static const char *const opt_cases[] = {
+    "arccos(10//arcsin(log(a + -b//-3) x 2.5)x-[12/0.5^-7]/2) + .5",
+    "arccos(10//arcsin(log(a) x 2.5)/2)",
+    "arccos(a^4) + sqrt(-(-(a x -b)))",
+    "sqrt(arccos(sqrt((1 x a)^12)))",
+    "sqrt(log(sqrt(cos(b)^sqrt(4))))",
+    "log((a x b)^1 - 1) + sqrt(-b/4)",
+    "log(exp(0 x a + -(0^-b)))",
+    "sqrt(-a/arccos((-2/2)^(3/0.5)) + arctan(0^-2))",
+};
+
+static const double opt_vals[][2] = {
+    { -3, 0 }, { -2, 0.5 }, { -1, -0.0 }, { -0.0, 1 }, { 0, -2 }, { 0.5, 3 }, { 2, -0.5 },
+};
+
+static void test_opt(void) {
+    CalcContext *on = calc_context_new(), *off = calc_context_new();
+    calc_set_option(on, CALC_OPTION_JIT, 0);
+    calc_set_option(off, CALC_OPTION_JIT, 0);
+    calc_set_option(off, CALC_OPTION_OPTIMIZE, 0);
+    for (size_t k = 0; k < sizeof(opt_cases) / sizeof(*opt_cases); k++) {
+        CalcProgram *pa = calc_compile_vars(on, opt_cases[k], var_names, 2);
+        CalcProgram *pb = calc_compile_vars(off, opt_cases[k], var_names, 2);
+        if (!pa || !pb) {
+            fprintf(stderr, "optimiseur : %s ne compile pas\n", opt_cases[k]);
+            failures++;
+        }
+        for (size_t v = 0; pa && pb && v < sizeof(opt_vals) / sizeof(*opt_vals); v++) {
+            double complex vals[2] = { opt_vals[v][0], opt_vals[v][1] }, a = 0, b = 0;
+            CalcErrorCode ca = calc_run_vars(on, pa, vals, &a);
+            CalcErrorCode cb = calc_run_vars(off, pb, vals, &b);
+            if (ca != cb || (ca == CALC_OK && (!same_part(creal(a), creal(b)) ||
+                                               !same_part(cimag(a), cimag(b)))))
+                report("optimiseur", opt_cases[k], vals, ca, a, cb, b);
+        }
+        calc_program_free(pa);
+        calc_program_free(pb);
+    }
+    calc_context_free(on);
+    calc_context_free(off);
+}
+
+/* ============================= */
+/* Imbrication profonde          */
+/* ============================= */
+
+/* Priorités et associativité à droite de '^', comme l'ancien parseur
+   récursif */
+static const struct {
+    const char *src;
+    double value;
+} power_cases[] = {
+    { "2^3^2", 512 },
+    { "(2^3)^2", 64 },
+    { "-2^2", 4 },
+    { "2^-1^2", 2 },
+    { "2^3!", 64 },
+    { "2^[1+1]^{3}", 256 },
+};
+
+static void check_deep(CalcContext *ctx, const char *what, const char *src,
+                       CalcErrorCode want, double value) {
+    double complex res = 0;
+    CalcErrorCode code = calc_eval(ctx, src, &res);
+    if (code != want || (code == CALC_OK && res != value) ||
+        (code != CALC_OK && calc_last_error(ctx)->pos != strlen(src))) {
+        fprintf(stderr, "imbrication : %s donne %.17g (erreur %d) au lieu de %.17g (erreur %d)\n",
+                what, creal(res), code, value, want);
+        failures++;
+    }
+}
+
+/* Expressions de DEEP_N niveaux, sans pile native proportionnelle */
+#define DEEP_N 100000
+
+static void test_deep(void) {
+    CalcContext *ctx = calc_context_new();
+    for (size_t k = 0; k < sizeof(power_cases) / sizeof(*power_cases); k++)
+        check_deep(ctx, power_cases[k].src, power_cases[k].src, CALC_OK, power_cases[k].value);
+
+    static const char open[] = "([{", close[] = ")]}";
+    char *buf = malloc(4 * DEEP_N + 8);
+    if (!buf) {
+        calc_context_free(ctx);
+        failures++;
+        return;
+    }
+    /* ([{([{ ... 1 ... }])}]) */
+    size_t n = 0;
+    for (int k = 0; k < DEEP_N; k++)
+        buf[n++] = open[k % 3];
+    buf[n++] = '1';
+    for (int k = DEEP_N - 1; k >= 0; k--)
+        buf[n++] = close[k % 3];
+    buf[n] = '\0';
+    check_deep(ctx, "groupes imbriqués", buf, CALC_OK, 1);
+    /* groupes jamais fermés : erreur à la fin du texte */
+    buf[DEEP_N + 1] = '\0';
+    check_deep(ctx, "groupes non fermés", buf, CALC_ERR_EXPECTED, 0);
+    /* 1+(1+(1+ ... )) : pile d'exécution de DEEP_N étages */
+    n = 0;
+    for (int k = 0; k < DEEP_N; k++) {
+        memcpy(buf + n, "1+(", 3);
+        n += 3;
+    }
+    buf[n++] = '1';
+    memset(buf + n, ')', DEEP_N);
+    buf[n + DEEP_N] = '\0';
+    check_deep(ctx, "sommes imbriquées", buf, CALC_OK, DEEP_N + 1);
+    /* 2^1^1^ ... ^1^3 : 2 si '^' est associatif à droite, 8 sinon */
+    buf[0] = '2';
+    n = 1;
+    for (int k = 0; k < DEEP_N; k++) {
+        memcpy(buf + n, "^1", 2);
+        n += 2;
+    }
+    memcpy(buf + n, "^3", 3);
+    check_deep(ctx, "tour de puissances", buf, CALC_OK, 2);
+    free(buf);
+    calc_context_free(ctx);
+}
+
+/* ============================= */
+/* Colonnes                      */
+/* ============================= */
+
+/* calc_run_columns() doit donner ligne à ligne le résultat de
+   calc_run_vars(), erreurs et zéros signés compris ; sin, cos et log
+   vectoriels peuvent s'en écarter de 1 ulp (approx non nul) */
+static const struct {
+    const char *src;
+    int approx;
+} column_cases[] = {
+    { "a^2 - 3 x a x b + b/4", 0 },
+    { "sqrt(a) + 1/(a - b)", 0 },
+    { "a // b + a! - abs(b)", 0 },
+    { "(a + b)^3 + a^0.5 + 2^b - a x 0", 0 },
+    { "max(a, b) - min(a, 0) + a% + root(b, 3)", 0 },
+    { "sin(a) x cos(b) + log(a + 5)", 1 },
+};
+
+/* Assez de lignes pour des blocs pleins et un bloc partiel */
+#define COLUMN_ROWS 1003
+
+static void test_columns(void) {
+    CalcContext *ctx = calc_context_new();
+    static double ca[COLUMN_ROWS], cb[COLUMN_ROWS], re[COLUMN_ROWS], im[COLUMN_ROWS];
+    static unsigned char errors[COLUMN_ROWS];
+    for (int r = 0; r < COLUMN_ROWS; r++) {
+        ca[r] = (r % 37) * 0.25 - 4.5;
+        cb[r] = (r % 11) - 5 + 0.5 * (r % 3);
+    }
+    ca[7] = -0.0;
+    const double *cols[2] = { ca, cb };
+    for (size_t k = 0; k < sizeof(column_cases) / sizeof(*column_cases); k++) {
+        const char *src = column_cases[k].src;
+        CalcProgram *prog = calc_compile_vars(ctx, src, var_names, 2);
+        if (!prog) {
+            fprintf(stderr, "colonnes : %s ne compile pas\n", src);
+            failures++;
+            continue;
+        }
+        size_t nerr = calc_run_columns(ctx, prog, cols, COLUMN_ROWS, re, im, errors), want = 0;
+        for (int r = 0; r < COLUMN_ROWS; r++) {
+            double complex vals[2] = { ca[r], cb[r] }, b = 0;
+            CalcErrorCode code = calc_run_vars(ctx, prog, vals, &b);
+            double complex a = CMPLX(re[r], im[r]);
+            int same = column_cases[k].approx
+                       ? same_part(re[r], creal(b)) && same_part(im[r], cimag(b))
+                       : memcmp(&a, &b, sizeof(a)) == 0;
+            if (code != CALC_OK)
+                want++;
+            if (errors[r] != code || (code == CALC_OK && !same))
+                report("colonnes", src, vals, errors[r], a, code, b);
+        }
+        if (nerr != want) {
+            fprintf(stderr, "colonnes : %s : %zu lignes en erreur au lieu de %zu\n", src, nerr, want);
+            failures++;
+        }
+        calc_program_free(prog);
+    }
+    calc_context_free(ctx);
+}
+
+/* ============================= */
+/* Code natif                    */
+/* ============================= */
+
+/* Une fois le programme traduit (après CALC_JIT_THRESHOLD exécutions),
+   le code natif doit donner le résultat de l'interpréteur au bit près,
+   y compris quand il lui rend la main (passage en complexe, erreur) */
+static const char *const jit_cases[] = {
+    "sqrt(a^2+1)/(a+2)+log(a+1)-root(a+8,3)//2+a%",
+    "exp(-a)+max(a,b,2)+atan2(a,2)",
+    "sqrt(a-1)+a!",
+    "a^3 - 2 x a^2 + a/4 - b/8 + (a x b)^5",
+    "-(-a) x (b - 3) // 2 + 1/(a - b)",
+    "sin(a) x cos(b) + tan(a/2) + arctan(b) + ln(abs(a) + 1)",
+    "(a + b)^0.5 + (a x b)^1 + 0^a",
+};
+
+static const double jit_vals[][2] = {
+    { 0.5, 2 }, { -3, 0 }, { 1, 1 }, { 0, -2 }, { -0.0, 0.25 }, { 4.5, -7 }, { 1e300, 3 },
+};
+
+static void test_jit(void) {
+    CalcContext *jit = calc_context_new(), *ref = calc_context_new();
+    calc_set_option(ref, CALC_OPTION_JIT, 0);
+    for (size_t k = 0; k < sizeof(jit_cases) / sizeof(*jit_cases); k++) {
+        CalcProgram *pa = calc_compile_vars(jit, jit_cases[k], var_names, 2);
+        CalcProgram *pb = calc_compile_vars(ref, jit_cases[k], var_names, 2);
+        if (!pa || !pb) {
+            fprintf(stderr, "code natif : %s ne compile pas\n", jit_cases[k]);
+            failures++;
+        }
+        double complex warm[2] = { 0.5, 2 }, res;
+        for (int n = 0; pa && pb && n <= CALC_JIT_THRESHOLD; n++)
+            calc_run_vars(jit, pa, warm, &res);
+        for (size_t v = 0; pa && pb && v < sizeof(jit_vals) / sizeof(*jit_vals); v++) {
+            double complex vals[2] = { jit_vals[v][0], jit_vals[v][1] }, a = 0, b = 0;
+            CalcErrorCode ca = calc_run_vars(jit, pa, vals, &a);
+            CalcErrorCode cb = calc_run_vars(ref, pb, vals, &b);
+            if (ca != cb || memcmp(&a, &b, sizeof(a)) != 0)
+                report("code natif", jit_cases[k], vals, ca, a, cb, b);
+        }
+        calc_program_free(pa);
+        calc_program_free(pb);
+    }
+    calc_context_free(jit);
+    calc_context_free(ref);
+}
+
+/* ============================= */
+/* Cache                         */
+/* ============================= */
+
+static void check_cached(CalcContext *ctx, CalcCache *cache, const char *src) {
+    double complex a = 0, b = 0;
+    CalcErrorCode ca = calc_eval_cached(ctx, cache, src, &a);
+    CalcErrorCode cb = calc_eval(ctx, src, &b);
+    if (ca != cb || memcmp(&a, &b, sizeof(a)) != 0) {
+        fprintf(stderr, "cache : %s donne %.17g%+.17gi (erreur %d) au lieu de %.17g%+.17gi (erreur %d)\n",
+                src, creal(a), cimag(a), ca, creal(b), cimag(b), cb);
+        failures++;
+    }
+}
+
+static void expect_hits(CalcCache *cache, unsigned long long hits, const char *what) {
+    CalcCacheStats st;
+    calc_cache_stats(cache, &st);
+    if (st.hits != hits) {
+        fprintf(stderr, "cache : %s : %llu succès au lieu de %llu\n", what, st.hits, hits);
+        failures++;
+    }
+}
+
+/* Les expressions de même forme normalisée partagent une entrée, les
+   autres non ; un fichier garde ses entrées d'une ouverture à l'autre.
+   Les symboles enregistrés par test_registry() ne sont jamais mis en
+   cache. */
+static void test_cache(void) {
+    CalcContext *ctx = calc_context_new(), *raw = calc_context_new();
+    calc_set_option(raw, CALC_OPTION_OPTIMIZE, 0);
+    CalcCache *cache = calc_cache_open(NULL, 64);
+    if (!cache) {
+        fprintf(stderr, "cache : ouverture impossible\n");
+        failures++;
+        return;
+    }
+    check_cached(ctx, cache, "1 + 2x [ 3 ]");
+    check_cached(ctx, cache, "1+2x(3)");
+    expect_hits(cache, 1, "espaces et crochets");
+    check_cached(ctx, cache, "1e+3");
+    check_cached(ctx, cache, "1e+ 3");
+    check_cached(ctx, cache, "1e- 2");
+    check_cached(ctx, cache, "sin x");
+    check_cached(ctx, cache, "sinx");
+    check_cached(ctx, cache, "4//2");
+    check_cached(ctx, cache, "4/ /2");
+    expect_hits(cache, 1, "espaces significatifs");
+    check_cached(raw, cache, "1+2x(3)");
+    expect_hits(cache, 1, "options du contexte");
+    check_cached(ctx, cache, "1/0");
+    check_cached(ctx, cache, "1/0");
+    expect_hits(cache, 1, "erreurs");
+    check_cached(ctx, cache, "hyp(3, 4)");
+    check_cached(ctx, cache, "hyp(3, 4)");
+    check_cached(ctx, cache, "gravite + 1");
+    check_cached(ctx, cache, "gravite + 1");
+    check_cached(ctx, cache, "sum(k, 1, 3, moyenne(k, 1))");
+    check_cached(ctx, cache, "sum(k, 1, 3, moyenne(k, 1))");
+    expect_hits(cache, 1, "symboles enregistrés");
+    calc_cache_close(cache);
+
+    char path[] = "/tmp/calc_test_cacheXXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        close(fd);
+        unlink(path);
+        cache = calc_cache_open(path, 64);
+        if (cache)
+            check_cached(ctx, cache, "2^10 - 24");
+        calc_cache_close(cache);
+        cache = calc_cache_open(path, 64);
+        if (cache) {
+            check_cached(ctx, cache, "2^10 - 24");
+            expect_hits(cache, 1, "fichier rouvert");
+        } else {
+            fprintf(stderr, "cache : %s ne se rouvre pas\n", path);
+            failures++;
+        }
+        calc_cache_close(cache);
+        unlink(path);
+    }
+    calc_context_free(ctx);
+    calc_context_free(raw);
+}
+
+/* ============================= */
+/* Valeurs exactes               */
+/* ============================= */
+
+static const struct {
+    const char *src, *exact; /* exact NULL : pas de valeur exacte */
+} exact_cases[] = {
+    { "25!", "15511210043330985984000000" },
+    { "0.1+0.2", "0.3" },
+    { "2^-2", "0.25" },
+    { "2^100", "1267650600228229401496703205376" },
+    { "7//2", "3" },
+    { "-1.5x4", "-6" },
+    { "12.5%", "0.125" },
+    { "(1/3)x3", "1" },
+    { "10^-20+1", "1.00000000000000000001" },
+    { "1/3", NULL },
+    { "sqrt(4)", NULL },
+    { "2^0.5", NULL },
+    { "1/0", NULL },
+};
+
+static void test_exact(void) {
+    CalcContext *ctx = calc_context_new();
+    for (size_t k = 0; k < sizeof(exact_cases) / sizeof(*exact_cases); k++) {
+        char buf[128];
+        double complex res;
+        calc_eval(ctx, exact_cases[k].src, &res);
+        int n = calc_eval_exact(ctx, exact_cases[k].src, buf, sizeof(buf));
+        const char *want = exact_cases[k].exact;
+        if (want ? n != (int)strlen(want) || strcmp(buf, want) != 0 : n >= 0) {
+            fprintf(stderr, "exact : %s donne %s au lieu de %s\n", exact_cases[k].src,
+                    n >= 0 ? buf : "(rien)", want ? want : "(rien)");
+            failures++;
+        }
+    }
+    calc_context_free(ctx);
+}
+
+/* ============================= */
+/* Double-double                 */
+/* ============================= */
+
+/* Grands arguments des fonctions trigonométriques : valeurs de référence
+   calculées sur 500 chiffres, arrondies en hi + lo */
+static const struct {
+    const char *src;
+    CalcDD want;
+} dd_cases[] = {
+    { "cos(1e22)", { 0.523214785395139, -4.7143201076575164e-17 } },
+    { "sin(1e22)", { -0.8522008497671888, -6.7806825896773284e-18 } },
+    { "sin(2^1000)", { -0.15920170308624243, -8.410182334689326e-18 } },
+    { "cos(1e15)", { -0.5131937377869703, 5.3179977268261675e-17 } },
+    { "cos(6381956970095103 x 2^797)", { -4.687165924254628e-19, 4.3720557429382733e-36 } },
+};
+
+static void test_dd(void) {
+    CalcContext *ctx = calc_context_new();
+    for (size_t k = 0; k < sizeof(dd_cases) / sizeof(*dd_cases); k++) {
+        CalcDDComplex res;
+        CalcDD want = dd_cases[k].want;
+        CalcErrorCode code = calc_eval_dd(ctx, dd_cases[k].src, &res);
+        double err = (res.re.hi - want.hi) + (res.re.lo - want.lo);
+        if (code != CALC_OK || !(fabs(err) <= 1e-29 * fabs(want.hi))) {
+            fprintf(stderr, "dd : %s donne %.17g%+.17g au lieu de %.17g%+.17g\n", dd_cases[k].src,
+                    res.re.hi, res.re.lo, want.hi, want.lo);
+            failures++;
+        }
+    }
+    /* corps calculés en double : refusés plutôt qu'affichés sur 30 chiffres */
+    CalcDDComplex res;
+    if (calc_eval_dd(ctx, "1+integrate(t^2,t,0,1)", &res) != CALC_ERR_PRECISION ||
+        calc_last_error(ctx)->pos != 2) {
+        fprintf(stderr, "dd : integrate accepté en double-double\n");
+        failures++;
+    }
+    static const struct { double complex z; const char *want; } full_cases[] = {
+        { 1.0 / 3, "0.3333333333333333" },
+        { 0.1, "0.1" },
+        { 1.4142135623730951, "1.4142135623730951" },
+        { CMPLX(0.5, 1.0 / 3), "0.5+0.3333333333333333i" },
+    };
+    for (size_t k = 0; k < sizeof(full_cases) / sizeof(*full_cases); k++) {
+        char buf[64];
+        calc_format_result_full(full_cases[k].z, buf, sizeof(buf));
+        if (strcmp(buf, full_cases[k].want) != 0) {
+            fprintf(stderr, "calc_format_result_full : %s au lieu de %s\n", buf, full_cases[k].want);
+            failures++;
+        }
+    }
+    calc_context_free(ctx);
+}
+
+/* ============================= */
+/* Tampon d'édition              */
+/* ============================= */
+
+/* Suite pseudo-aléatoire d'insertions, d'effacements et de déplacements,
+   comparée au même travail fait sur une chaîne ordinaire */
+static void test_editbuf(void) {
+    EditBuf eb;
+    char ref[4096], copy[4096];
+    size_t len = 0, cursor = 0;
+    unsigned seed = 12345;
+    if (editbuf_init(&eb) < 0) {
+        fprintf(stderr, "tampon : mémoire insuffisante\n");
+        failures++;
+        return;
+    }
+    for (int step = 0; step < 20000; step++) {
+        seed = seed * 1103515245u + 12345u;
+        unsigned r = seed >> 16;
+        switch (r % 8) {
+        case 0: case 1: case 2: { /* insertion de 1 à 3 octets */
+            char text[3] = { (char)('a' + r % 26), (char)('0' + r % 10), '+' };
+            size_t n = 1 + (r >> 4) % 3;
+            if (len + n >= sizeof(ref) / 2)
+                break;
+            editbuf_insert(&eb, text, n);
+            memmove(ref + cursor + n, ref + cursor, len - cursor);
+            memcpy(ref + cursor, text, n);
+            len += n;
+            cursor += n;
+            break;
+        }
+        case 3: case 4:
+            editbuf_delete(&eb);
+            if (cursor > 0) {
+                memmove(ref + cursor - 1, ref + cursor, len - cursor);
+                len--;
+                cursor--;
+            }
+            break;
+        case 5: case 6:
+            cursor = (r >> 3) % (len + 8);
+            editbuf_move(&eb, cursor);
+            if (cursor > len)
+                cursor = len;
+            break;
+        default:
+            if ((r >> 3) % 64 == 0) {
+                editbuf_clear(&eb);
+                len = cursor = 0;
+            } else if ((r >> 3) % 64 == 1) {
+                editbuf_set(&eb, "12+34");
+                memcpy(ref, "12+34", 5);
+                len = cursor = 5;
+            }
+            break;
+        }
+        ref[len] = '\0';
+        size_t from = len ? (r >> 5) % len : 0;
+        size_t n = editbuf_copy(&eb, from, len, copy);
+        if (editbuf_length(&eb) != len || editbuf_cursor(&eb) != cursor ||
+            n != len - from || memcmp(copy, ref + from, n) != 0 ||
+            (step % 16 == 0 && strcmp(editbuf_text(&eb), ref) != 0)) {
+            fprintf(stderr, "tampon : étape %d, \"%s\" (curseur %zu) au lieu de \"%s\" (curseur %zu)\n",
+                    step, editbuf_text(&eb), editbuf_cursor(&eb), ref, cursor);
+            failures++;
+            break;
+        }
+    }
+    editbuf_free(&eb);
+}
+
+/* ============================= */
+/* Intégration et résolution     */
+/* ============================= */
+
+/* Valeurs de référence des opérateurs à variable liée : écart relatif
+   (à max(1, |valeur|)) au plus tol */
+typedef struct {
+    const char *src;
+    CalcErrorCode code;
+    double re, im;
+    double tol;
+} BinderCase;
+
+static void check_binders(const char *part, const BinderCase *cases, size_t n) {
+    CalcContext *ctx = calc_context_new();
+    for (size_t k = 0; k < n; k++) {
+        const BinderCase *c = &cases[k];
+        double complex res = 0, want = CMPLX(c->re, c->im);
+        CalcErrorCode code = calc_eval(ctx, c->src, &res);
+        if (code != c->code ||
+            (code == CALC_OK && !(cabs(res - want) <= c->tol * fmax(1, cabs(want))))) {
+            fprintf(stderr, "%s : %s donne %.17g%+.17gi (erreur %d) au lieu de %.17g%+.17gi (erreur %d)\n",
+                    part, c->src, creal(res), cimag(res), code, c->re, c->im, c->code);
+            failures++;
+        }
+    }
+    calc_context_free(ctx);
+}
+
+/* Singularités intégrables aux bornes : le corps y échoue (1/x pour
+   |x| < 1e-12) ou les nœuds s'y confondent avec la borne */
+static const BinderCase integrate_cases[] = {
+    { "integrate(t^2,t,0,1)", CALC_OK, 1.0 / 3, 0, 1e-15 },
+    { "integrate(sin(t)^2,t,0,pi)", CALC_OK, 1.5707963267948966, 0, 1e-15 },
+    { "integrate(1/(1+t^2),t,0,1)", CALC_OK, 0.78539816339744831, 0, 1e-15 },
+    { "integrate(exp(0-t^2),t,0-10,10)", CALC_OK, 1.7724538509055160, 0, 1e-14 },
+    { "integrate(t x i,t,0,1)", CALC_OK, 0, 0.5, 1e-15 },
+    { "integrate(ln(t),t,0,1)", CALC_OK, -1, 0, 1e-14 },
+    { "integrate(1/sqrt(t),t,0,1)", CALC_OK, 2, 0, 1e-12 },
+    { "integrate(1/sqrt(1-t),t,0,1)", CALC_OK, 2, 0, 1e-12 },
+    { "integrate(1/sqrt(t),t,1,0)", CALC_OK, -2, 0, 1e-12 },
+    { "integrate(1/sqrt(2-t),t,1,2)", CALC_OK, 2, 0, 1e-12 },
+    { "integrate(1/sqrt(t x (1-t)),t,0,1)", CALC_OK, 3.1415926535897932, 0, 1e-11 },
+    { "integrate(cos(t)/sqrt(t),t,0,1)", CALC_OK, 1.8090484758005442, 0, 1e-13 },
+    { "integrate(1/sqrt(sin(t)),t,0,pi)", CALC_OK, 5.2441151085842382, 0, 1e-11 },
+    { "integrate(1/t^0.9,t,0,1)", CALC_OK, 10, 0, 1e-12 },
+    { "integrate(1/(1-t)^0.75,t,0,1)", CALC_OK, 4, 0, 1e-10 },
+    { "integrate(1/t,t,0,1)", CALC_ERR_DIVERGENT, 0, 0, 0 },
+    { "integrate(1/(1-t),t,0,1)", CALC_ERR_DIVERGENT, 0, 0, 0 },
+    { "integrate(1/t^2,t,0,1)", CALC_ERR_DIVERGENT, 0, 0, 0 },
+    { "integrate(1/(t-0.5),t,0,1)", CALC_ERR_DIV_ZERO, 0, 0, 0 },
+};
+
+static const BinderCase solve_cases[] = {
+    { "solve(t^2-2,t,1)", CALC_OK, 1.4142135623730951, 0, 1e-15 },
+    { "solve(cos(t)-t,t,0)", CALC_OK, 0.73908513321516065, 0, 1e-15 },
+    { "solve(ln(t)-1,t,1)", CALC_OK, 2.7182818284590452, 0, 1e-15 },
+    { "solve(t^2+1,t,1)", CALC_OK, 0, 1, 1e-15 },
+    { "solve(exp(t),t,0)", CALC_ERR_NO_ROOT, 0, 0, 0 },
+};
+
+/* Sommes et produits : bornes non entières, intervalles vides, et assez de
+   termes pour passer par les blocs répartis sur les cœurs */
+static const BinderCase sum_cases[] = {
+    { "sum(k,1,100,k)", CALC_OK, 5050, 0, 0 },
+    { "sum(k,1,2000000,k)", CALC_OK, 2000001000000, 0, 0 },
+    { "sum(k,1,100000,0.1)", CALC_OK, 10000, 0, 1e-16 },
+    { "sum(k,1,1000000,1/k^2)", CALC_OK, 1.6449330668487265, 0, 1e-16 },
+    { "sum(k,0.5,3,k)", CALC_OK, 4.5, 0, 0 },
+    { "sum(k,1,3,k x i)", CALC_OK, 0, 6, 0 },
+    { "sum(j,1,10,sum(k,1,j,k))", CALC_OK, 220, 0, 0 },
+    { "sum(k,3,1,k)", CALC_OK, 0, 0, 0 },
+    { "prod(k,1,25,k)", CALC_OK, 1.5511210043330986e25, 0, 1e-15 },
+    { "prod(k,1,1000,1+1/k^2)", CALC_OK, 3.6724055060924186, 0, 1e-13 },
+    { "prod(k,1,2,i)", CALC_OK, -1, 0, 0 },
+    { "prod(k,3,1,k)", CALC_OK, 1, 0, 0 },
+    { "sum(k,1,i,k)", CALC_ERR_BOUNDS, 0, 0, 0 },
+    { "prod(k,1,10^16,k)", CALC_ERR_BOUNDS, 0, 0, 0 },
+    { "sum(k,1,3,1/(k-2))", CALC_ERR_DIV_ZERO, 0, 0, 0 },
+};
+
+static void test_calculus(void) {
+    check_binders("integrate", integrate_cases, sizeof(integrate_cases) / sizeof(*integrate_cases));
+    check_binders("solve", solve_cases, sizeof(solve_cases) / sizeof(*solve_cases));
+    check_binders("sum", sum_cases, sizeof(sum_cases) / sizeof(*sum_cases));
+}
+
+/* ============================= */
+/* Nombres duaux                 */
+/* ============================= */
+
+/* Dérivées exactes, à travers les opérateurs à variable liée compris */
+static const BinderCase diff_cases[] = {
+    { "diff(sin(t),t,1)", CALC_OK, 0.54030230586813977, 0, 1e-16 },
+    { "diff(t!,t,3)", CALC_OK, 7.5367060105908020, 0, 1e-15 },
+    { "diff(root(t,3),t,8)", CALC_OK, 1.0 / 12, 0, 1e-16 },
+    { "diff(sum(k,1,3,k x t^2),t,1)", CALC_OK, 12, 0, 1e-16 },
+    { "diff(prod(k,1,4,t+k),t,0)", CALC_OK, 50, 0, 1e-16 },
+    { "diff(integrate(u x t^2,u,0,1),t,1)", CALC_OK, 1, 0, 1e-15 },
+    { "diff(integrate(u,u,0,t^2),t,3)", CALC_OK, 54, 0, 1e-16 },
+    { "diff(integrate(1/sqrt(u x t),u,0,1),t,1)", CALC_OK, -1, 0, 1e-12 },
+    { "diff(solve(x^2-t,x,1),t,4)", CALC_OK, 0.25, 0, 1e-16 },
+    { "diff(diff(t^3,t,u),u,2)", CALC_OK, 12, 0, 1e-16 },
+    { "diff(diff(exp(t x u),t,1),u,2)", CALC_OK, 22.167168296791949, 0, 1e-15 },
+    { "diff(diff(t!,t,u),u,2)", CALC_OK, 2.4929299919026939, 0, 1e-15 },
+    { "diff(diff(atan2(t,u),t,1),u,2)", CALC_OK, -0.12, 0, 1e-15 },
+    { "diff(diff(t^u,t,2),u,3)", CALC_OK, 12.317766166719343, 0, 1e-15 },
+    { "diff(diff(diff(t^4,t,u),u,v),v,1)", CALC_ERR_DERIVATIVE, 0, 0, 0 },
+    { "diff(diff(sum(k,1,3,k x t),t,u),u,1)", CALC_ERR_DERIVATIVE, 0, 0, 0 },
+};
+
+static void test_dual(void) {
+    check_binders("diff", diff_cases, sizeof(diff_cases) / sizeof(*diff_cases));
+    /* gradient de a^2 b^2 / 2 + b^2 : intégrale à borne variable */
+    CalcContext *ctx = calc_context_new();
+    CalcProgram *prog = calc_compile_vars(ctx, "integrate(u x a^2 + b,u,0,b)", var_names, 2);
+    double complex values[2] = { 1.5, 2 }, res = 0, grad[2] = { 0, 0 };
+    if (!prog || calc_run_gradient(ctx, prog, values, &res, grad) != CALC_OK ||
+        cabs(res - 8.5) > 1e-14 || cabs(grad[0] - 6) > 1e-14 || cabs(grad[1] - 8.5) > 1e-14) {
+        fprintf(stderr, "gradient : %.17g, (%.17g, %.17g) au lieu de 8.5, (6, 8.5)\n",
+                creal(res), creal(grad[0]), creal(grad[1]));
+        failures++;
+    }
+    calc_program_free(prog);
+    calc_context_free(ctx);
+}
+
+/* ============================= */
+/* Sessions                      */
+/* ============================= */
+
+/* Une session qui reprend depuis ses points de reprise doit donner le
+   résultat de calc_eval(), erreurs et positions comprises, pour chaque
+   préfixe du texte tapé puis effacé, et après une modification au
+   milieu */
+static const char *const session_cases[] = {
+    "2+sum(k,1,10,k^2)x3-integrate(t^2,t,0,1)+prod(j,1,4,j+sum(k,1,j,k))",
+    "integrate(sum(k,1,3,t^k),t,0,1)+1+2+3+4+5+6+7+8+9+10+11+12+13+14+15+16+17+18+19+20+diff(t^3,t,2)",
+    "1+2+3+4+5+6+7+8+9+10+11+12+13+14+15+16+17+18+19+20+21+22+23+24+25+26+27+28+29+30+31+32+33"
+    "+sum(k,1+2+3+4+5+6+7+8+9+10+11+12+13+14+15+16+17+18+19+20+21+22+23+24+25+26+27+28+29,1000,k)",
+    "sqrt(-4)x[1+2x{3-4}]/(5+6^2)-log(7)+8!-9%+cos(pi/3)+sin(e)-1/(2-2)+10//3+root(27,3)",
+};
+
+static void check_session(CalcSession *s, CalcContext *ref, const char *src) {
+    double complex a = 0, b = 0;
+    CalcErrorCode ca = calc_session_eval(s, src, &a);
+    CalcErrorCode cb = calc_eval(ref, src, &b);
+    if (ca != cb || (ca == CALC_OK && memcmp(&a, &b, sizeof(a)) != 0) ||
+        (ca != CALC_OK && calc_session_error(s)->pos != calc_last_error(ref)->pos)) {
+        fprintf(stderr, "session : %s donne %.17g%+.17gi (erreur %d) au lieu de %.17g%+.17gi (erreur %d)\n",
+                src, creal(a), cimag(a), ca, creal(b), cimag(b), cb);
+        failures++;
+    }
+}
+
+static void test_session(void) {
+    CalcSession *s = calc_session_new();
+    CalcContext *ref = calc_context_new();
+    char buf[512];
+    for (size_t e = 0; e < sizeof(session_cases) / sizeof(*session_cases); e++) {
+        size_t n = strlen(session_cases[e]);
+        for (size_t k = 1; k <= n; k++) {
+            memcpy(buf, session_cases[e], k);
+            buf[k] = '\0';
+            check_session(s, ref, buf);
+        }
+        for (size_t k = n; k > 0; k--) {
+            buf[k] = '\0';
+            check_session(s, ref, buf);
+        }
+        /* chiffre remplacé au milieu, puis remis */
+        memcpy(buf, session_cases[e], n + 1);
+        for (size_t k = n / 2; k < n; k++)
+            if (buf[k] >= '1' && buf[k] <= '9') {
+                buf[k] = '7';
+                check_session(s, ref, buf);
+                break;
+            }
+        check_session(s, ref, session_cases[e]);
+    }
+    calc_session_free(s);
+    calc_context_free(ref);
+}
+
+/* ============================= */
+/* Démon                         */
+/* ============================= */
+
+/* calcd répond dans l'ordre d'envoi, sur chaque connexion, même quand
+   ses lignes sont évaluées par plusieurs threads et que des lignes
+   lentes (sum), rapides et en erreur alternent. Plusieurs connexions
+   envoient en même temps, par petits morceaux, sans attendre les
+   réponses. Réponses attendues : calc_eval() et le format du mode
+   batch. */
+#define DAEMON_TEST_CONNS 3
+#define DAEMON_TEST_LINES 3000
+#define DAEMON_TEST_SLICE 1000
+
+typedef struct {
+    int fd;
+    char *in, *out, *want;
+    size_t in_len, sent, out_len, want_len;
+    int closed;
+} DaemonConn;
+
+static int daemon_connect(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    /* le démon vient d'être lancé : on lui laisse une seconde */
+    for (int tries = 0; tries < 100; tries++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            return fd;
+        }
+        close(fd);
+        struct timespec ts = { 0, 10 * 1000 * 1000 };
+        nanosleep(&ts, NULL);
+    }
+    return -1;
+}
+
+static void daemon_lines(CalcContext *ctx, DaemonConn *c, int id) {
+    c->in = malloc(64 * DAEMON_TEST_LINES);
+    c->want = malloc(256 * DAEMON_TEST_LINES);
+    c->out = malloc(256 * DAEMON_TEST_LINES);
+    c->in_len = c->want_len = c->out_len = c->sent = 0;
+    c->closed = 0;
+    if (!c->in || !c->want || !c->out)
+        return;
+    for (int k = 0; k < DAEMON_TEST_LINES; k++) {
+        char line[64];
+        if (k % 7 == 3)
+            snprintf(line, sizeof(line), "%d/(%d-%d)", k, id, id);
+        else if (k % 5 == 0)
+            snprintf(line, sizeof(line), "sum(j,1,3000,j)x0+%d.%d", k, id);
+        else
+            snprintf(line, sizeof(line), "%d+0.%d", k, id);
+        double complex res;
+        int n = calc_eval(ctx, line, &res) == CALC_OK
+                ? calc_format_result(res, c->want + c->want_len, 254)
+                : calc_format_error(calc_last_error(ctx), c->want + c->want_len, 254);
+        c->want_len += n;
+        c->want[c->want_len++] = '\n';
+        n = strlen(line);
+        memcpy(c->in + c->in_len, line, n);
+        c->in_len += n;
+        c->in[c->in_len++] = '\n';
+    }
+}
+
+static void test_daemon(void) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/calc_test_%ld.sock", (long)getpid());
+    unlink(path);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl("./calcd", "calcd", "-s", path, "-j", "4", (char *)NULL);
+        _exit(127);
+    }
+    if (pid < 0) {
+        fprintf(stderr, "démon : fork impossible\n");
+        failures++;
+        return;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    CalcContext *ctx = calc_context_new();
+    DaemonConn conns[DAEMON_TEST_CONNS];
+    int open_conns = 0, ok = 1;
+    for (int c = 0; c < DAEMON_TEST_CONNS; c++) {
+        daemon_lines(ctx, &conns[c], c + 1);
+        conns[c].fd = daemon_connect(path);
+        if (conns[c].fd < 0 || !conns[c].in || !conns[c].want || !conns[c].out)
+            ok = 0;
+        else
+            open_conns++;
+    }
+    if (!ok) {
+        fprintf(stderr, "démon : connexion à ./calcd sur %s impossible\n", path);
+        failures++;
+    }
+    /* envoi et réception entremêlés, jusqu'à la fermeture par le démon */
+    while (ok && open_conns > 0) {
+        struct pollfd pfd[DAEMON_TEST_CONNS];
+        for (int c = 0; c < DAEMON_TEST_CONNS; c++) {
+            DaemonConn *d = &conns[c];
+            pfd[c].fd = d->closed ? -1 : d->fd;
+            pfd[c].events = POLLIN | (d->sent < d->in_len ? POLLOUT : 0);
+        }
+        if (poll(pfd, DAEMON_TEST_CONNS, 10000) <= 0) {
+            fprintf(stderr, "démon : plus de réponse\n");
+            failures++;
+            break;
+        }
+        for (int c = 0; c < DAEMON_TEST_CONNS; c++) {
+            DaemonConn *d = &conns[c];
+            if (d->closed)
+                continue;
+            if ((pfd[c].revents & POLLOUT) && d->sent < d->in_len) {
+                size_t len = d->in_len - d->sent;
+                if (len > DAEMON_TEST_SLICE)
+                    len = DAEMON_TEST_SLICE;
+                ssize_t n = write(d->fd, d->in + d->sent, len);
+                if (n > 0 && (d->sent += n) == d->in_len)
+                    shutdown(d->fd, SHUT_WR);
+            }
+            if (pfd[c].revents & (POLLIN | POLLHUP | POLLERR)) {
+                size_t room = 256 * DAEMON_TEST_LINES - d->out_len;
+                ssize_t n = read(d->fd, d->out + d->out_len, room);
+                if (n > 0) {
+                    d->out_len += n;
+                } else if (n == 0 || errno != EAGAIN) {
+                    d->closed = 1;
+                    open_conns--;
+                }
+            }
+        }
+    }
+    for (int c = 0; c < DAEMON_TEST_CONNS; c++) {
+        DaemonConn *d = &conns[c];
+        if (ok && (d->out_len != d->want_len || memcmp(d->out, d->want, d->want_len) != 0)) {
+            size_t k = 0, line = 1;
+            for (; k < d->out_len && k < d->want_len && d->out[k] == d->want[k]; k++)
+                line += d->out[k] == '\n';
+            fprintf(stderr, "démon : connexion %d : réponse %zu différente\n", c + 1, line);
+            failures++;
+        }
+        if (d->fd >= 0)
+            close(d->fd);
+        free(d->in);
+        free(d->out);
+        free(d->want);
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    unlink(path);
+    calc_context_free(ctx);
+}
+
+int main(void) {
+    test_real();
+    test_registry();
+    test_opt();
+    test_deep();
+    test_columns();
+    test_jit();
+    test_cache();
+    test_exact();
+    test_dd();
+    test_editbuf();
+    test_calculus();
+    test_dual();
+    test_session();
+    test_daemon();
+    if (failures)
+        fprintf(stderr, "%d test(s) en échec\n", failures);
+    else
+        printf("tests : OK\n");
+    return failures ? 1 : 0;
+}